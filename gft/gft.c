@@ -363,6 +363,9 @@ typedef struct mst_gen
   /** @brief the external function */
   double (*gchsq)(double *par, void *adar);
 
+  /** @brief the external function for several parameter sets at once, NULL if not supplied */
+  void (*gchsq_vec)(int npoints, double *par, double *chisq, void *adar);
+
   /** @brief the additional arguments to chisquare function */
   void *adar;
 
@@ -791,6 +794,23 @@ static int mst_putf(mst *mstv, double (*input)(double *, void *), int spec);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int mst_putv(mst *mstv, void (*input)(int, double *, double *, void *), int spec)
+  @brief Supply a function for several parameter sets to a minimiser struct, intern
+
+  @param gft_mstv (gft_mst *)  Pointer to main struct
+  @param input    (void (*input)(int, double *, double *, void *)) pointer to function or NULL
+  @param spec     (int)        specifyer of the type of input
+
+  @return (success) int mst_putv:    GFT_ERROR_NONE
+          (error)                   standard
+*/
+/* ------------------------------------------------------------ */
+static int mst_putv(mst *mstv, void (*input)(int, double *, double *, void *), int spec);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
    @fn static int mst_ckme(int method)
@@ -1635,6 +1655,30 @@ static double gchsq_psw(double *nopar, void *npa);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void gchsq_psw_vec(int n, int m, double *nopar, double *fx, void *npa)
+  @brief Function for pswarm minimiser, several points at once
+
+  Passed to the pswarm minimiser if a function for several parameter
+  sets has been supplied. Does for the m points in nopar what gchsq_n
+  does for one point, but calls the external function only once for
+  all of them. The points are registered (best chisquare, number of
+  calls) one after the other in the order of nopar.
+
+  @param n     (int)      Dimension of a point
+  @param m     (int)      Number of points
+  @param nopar (double *) The m points, normalised
+  @param fx    (double *) Output, the m function values
+  @param npa   (void *)   A mst_gen struct
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void gchsq_psw_vec(int n, int m, double *nopar, double *fx, void *npa);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn static double gchsq_n(double *nopar, mst_gen *mst_genv)
@@ -1894,6 +1938,19 @@ int gft_mst_putf (gft_mst *gft_mstv, double (*input)(double *, void *), int spec
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Input of info */
+
+int gft_mst_putv (gft_mst *gft_mstv, void (*input)(int, double *, double *, void *), int spec)
+{
+  return mst_putv((mst *) gft_mstv, input, spec);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Output of info */
@@ -2599,6 +2656,35 @@ static int mst_putf(mst *mstv, double (*input)(double *, void *), int spec)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* specify fitting function for several parameter sets */
+
+static int mst_putv(mst *mstv, void (*input)(int, double *, double *, void *), int spec)
+{
+  if (!(mstv && mstv -> gen))
+    return GFT_ERROR_NULL_PASSED;
+
+  if (mstv -> gen -> error)
+    return GFT_ERROR_ERROR_PRESENT;
+
+  /* This is allowed during fitting and does not change any result */
+  switch (spec) {
+  case GFT_INPUT_GCHSQ_VEC:
+    mstv -> gen -> gchsq_vec = input;
+    break;
+
+  default:
+    return GFT_ERROR_WRONG_IDENT;
+  }
+
+  return GFT_ERROR_NONE;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Generically get information from a minimiser struct, intern */
@@ -3321,6 +3407,7 @@ static mst_gen *mst_gen_const()
   mst_gen_const -> dpar = NULL;
   mst_gen_const -> ndpar = NULL;
   mst_gen_const -> gchsq = NULL;
+  mst_gen_const -> gchsq_vec = NULL;
   mst_gen_const -> adar = NULL;
   mst_gen_const -> ncalls = LARGE_INTEGER;
   mst_gen_const -> calls = 0;
@@ -4412,6 +4499,10 @@ static int mst_psw_init(mst_psw *mst_pswv, mst_gen *mst_genv)
   }
   pswarm_i_printfun(mst_pswv -> optv, &gft_pswarm_standardprint);
 
+  /* Swarms and poll steps go in one call if the user can do that */
+  if ((mst_genv -> gchsq_vec))
+    pswarm_i_vfun(mst_pswv -> optv, &gchsq_psw_vec);
+
   /* Change the input to options */
   mst_pswv -> optv -> inputseed = mst_genv -> seed;
   mst_pswv -> optv -> s = mst_genv -> psnpart;
@@ -4882,6 +4973,63 @@ static double gchsq_psw(double *nopar, void *mst_genv)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Function for pswarm minimiser, several points at once */
+
+static void gchsq_psw_vec(int n, int m, double *nopar, double *fx, void *npa)
+{
+  size_t i;
+  int j;
+  double *par;
+  mst_gen *mst_genv = (mst_gen *) npa;
+
+  /* Without the memory the points are done one by one */
+  if (!(par = (double *) malloc(m*mst_genv -> npar*sizeof(double)))) {
+    for (j = 0; j < m; ++j)
+      fx[j] = gchsq_psw(nopar+j*n, npa);
+    return;
+  }
+
+  /* Check and renormalise all points as in gchsq_n */
+  for (j = 0; j < m; ++j) {
+    if ((mst_genv -> error |= cklimits(mst_genv -> npar, nopar+j*n)))
+      break;
+    for (i = 0; i < mst_genv -> npar; ++i)
+      par[j*mst_genv -> npar+i] = nopar[j*n+i]*mst_genv -> ndpar[i]+mst_genv -> opar[i];
+    if ((mst_genv -> error |= cklimits(mst_genv -> npar, par+j*mst_genv -> npar)))
+      break;
+  }
+
+  if ((mst_genv -> error)) {
+    free(par);
+    for (j = 0; j < m; ++j)
+      fx[j] = HUGE_VAL;
+    errno = EDOM;
+    return;
+  }
+
+  /* Check out the chisquares */
+  (*mst_genv -> gchsq_vec)(m, par, fx, mst_genv -> adar);
+
+  /* Fill the array and the struct as if the points had been passed one by one */
+  for (j = 0; j < m; ++j) {
+    fx[j] = makenormalnumber(fx[j]);
+    for (i = 0; i < mst_genv -> npar; ++i) {
+      mst_genv -> dummypar[i] = par[j*mst_genv -> npar+i];
+      mst_genv -> dummypar2[i] = nopar[j*n+i];
+    }
+    mst_gen_ckch(mst_genv, mst_genv -> dummypar2, fx[j]);
+  }
+
+  free(par);
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Normalised function */
@@ -395,11 +395,12 @@
    @def GFT_INPUTF_
    @brief Input types to supply the minimiser with functions
    
-   See function gft_mst_putf
+   See functions gft_mst_putf and gft_mst_putv
 */
 /* ------------------------------------------------------------ */
 #define GFT_INPUT_GCHSQ            1
 #define GFT_INPUT_GCHSQ_REP        2
+#define GFT_INPUT_GCHSQ_VEC        3
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
@@ -635,6 +636,38 @@ int gft_mst_putf(gft_mst *gft_mstv, double (*input)(double *, void *), int spec)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int gft_mst_putv(gft_mst *gft_mstv, void (*input)(int, double *, double *, void *), int spec)
+  @brief Supply a function evaluating several parameter sets at once
+
+  Same as gft_mst_putf for a function that takes a number of
+  parameter sets m, an array of m parameter sets one after another
+  (each of the size specified with NPARAM), an array receiving the m
+  function values, and the neutral struct with additional
+  arguments. Minimisers that evaluate several points per step (at the
+  moment pswarm) then call this function once per step instead of
+  the function supplied with gft_mst_putf, which is still required
+  for all other calls. The function values must be the same as the
+  ones of the function supplied with gft_mst_putf. Passing NULL
+  removes the function again. Allowed during fitting, it takes effect
+  at the next start of a minimiser.
+
+  constant expression     input type                                  description
+  GFT_INPUT_GCHSQ_VEC     void (*)(int, double *, double *, void *)   Function to be minimised, several parameter sets at once
+
+  @param gft_mstv (gft_mst *)                                 Pointer to main struct
+  @param input    void (*)(int, double *, double *, void *)   input function or NULL
+  @param spec     (int)                                       specifyer of the type of input
+
+  @return (success) int gft_mst_putv: 0
+          (error)                       standard
+*/
+/* ------------------------------------------------------------ */
+int gft_mst_putv(gft_mst *gft_mstv, void (*input)(int, double *, double *, void *), int spec);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn int gft_mst_get(gft_mst *gft_mstv, void *output, int spec)
@@ -76,7 +76,7 @@ typedef struct poll_container {
 static void pollstep(int pi, pswarm_options *opt, pswarm_swarm *pop);
 static void init_D(int n, pswarm_options *opt, poll_container *poll_containerv);
 static void init_pattern(int, pswarm_options *opt, poll_container *poll_containerv);
-static void objfn(double (*)(double *, void *), void *, int, int, double *, double *, double *, double *);
+static void objfn(double (*)(double *, void *), void (*)(int, int, double *, double *, void *), void *, int, int, double *, double *, double *, double *);
 
 /* Allocates a poll_container and sets all pointers to 0 */
 static poll_container *poll_container_const();
@@ -196,6 +196,7 @@ int pswarm_options_init(pswarm_options *opt, int n, double (*fun)(double *, void
   opt -> n             = n;       /* dimension */
 
   opt -> fun           = fun;     /* objective function, the real one */
+  opt -> vfun          = NULL;    /* objective function for several points, only fun if NULL */
   opt -> adar          = adar;    /* additional arguments */
   opt -> lb            = lbv;      /* lower bounds */
   opt -> ub            = ubv;      /* upper bounds */
@@ -384,6 +385,7 @@ int pswarm_swarm_init(pswarm_options *optv, pswarm_swarm *pswarm_swarmv)
 
 /** @brief Print function */                           int pswarm_i_printfun   (pswarm_options *pswarm_optionsv, int    (*printfun)(pswarm_swarm *)){if (!pswarm_optionsv) return PSWARM_STATUS_ERROR | PSWARM_STATUS_INITIAL; pswarm_optionsv -> printfun = printfun; return PSWARM_STATUS_OK;}
 /** @brief objective function */                       int pswarm_i_fun        (pswarm_options *pswarm_optionsv, double (*fun)(double *, void *)){if (!pswarm_optionsv) return PSWARM_STATUS_ERROR | PSWARM_STATUS_INITIAL; pswarm_optionsv -> fun = fun; return PSWARM_STATUS_OK;}
+/** @brief objective function for several points */    int pswarm_i_vfun       (pswarm_options *pswarm_optionsv, void   (*vfun)(int, int, double *, double *, void *)){if (!pswarm_optionsv) return PSWARM_STATUS_ERROR | PSWARM_STATUS_INITIAL; pswarm_optionsv -> vfun = vfun; return PSWARM_STATUS_OK;}
 
 /** @brief tolerance for gradient norm */             /* int pswarm_i_n2grd      (pswarm_options *pswarm_optionsv, double n2grd        ){if (!pswarm_optionsv) return PSWARM_STATUS_ERROR | PSWARM_STATUS_INITIAL; pswarm_optionsv -> n2grd        = n2grd        ; return PSWARM_STATUS_OK; } */
 /** @brief Epsilon for active constraints */          /* int pswarm_i_epsilonact (pswarm_options *pswarm_optionsv, double EpsilonActive){if (!pswarm_optionsv) return PSWARM_STATUS_ERROR | PSWARM_STATUS_INITIAL; pswarm_optionsv -> EpsilonActive= EpsilonActive; return PSWARM_STATUS_OK; } */
@@ -431,10 +433,16 @@ int o_int_gen(pswarm_options *pswarm_optionsv, pswarm_swarm *pswarm_swarmv, int
 
 
 /* The objective function */
-static void objfn(double (*fun)(double *, void *), void *adar, int n, int m, double *x, double *lb, double *ub, double *fx)
+static void objfn(double (*fun)(double *, void *), void (*vfun)(int, int, double *, double *, void *), void *adar, int n, int m, double *x, double *lb, double *ub, double *fx)
 {
   int j;
 
+  /* all points in one call if possible */
+  if(vfun && m>1){
+    vfun(n, m, x, fx, adar);
+    return;
+  }
+
   for(j=0;j<m;j++){
     fx[j]=fun(x+j*n, adar);
   }
@@ -638,7 +646,7 @@ int pswarm_iter(pswarm_options *opt, pswarm_swarm *pop)
 	  j++;
 	}
 
-      objfn(opt -> fun, opt -> adar, opt -> n, j, vectorx, opt -> lb, opt -> ub, vectorfx);
+      objfn(opt -> fun, opt -> vfun, opt -> adar, opt -> n, j, vectorx, opt -> lb, opt -> ub, vectorfx);
       pop -> objfunctions+=j;
 
       for(j=0,i=0;i<opt -> s;i++) /* we could avoid a second cycle if we saved the indices */
@@ -655,7 +663,7 @@ int pswarm_iter(pswarm_options *opt, pswarm_swarm *pop)
 	if(pop -> active[i]){
 
 	  if(feasible_p(opt -> n, &(pop -> x[i*opt -> n]), opt -> lb, opt -> ub)){
-	    objfn(opt -> fun, opt -> adar, opt -> n, 1, &(pop -> x[i*opt -> n]), opt -> lb, opt -> ub, &(pop -> fx[i]));
+	    objfn(opt -> fun, opt -> vfun, opt -> adar, opt -> n, 1, &(pop -> x[i*opt -> n]), opt -> lb, opt -> ub, &(pop -> fx[i]));
 	    pop -> objfunctions++;
 	  } else {
 	    pop -> fx[i]=+DBL_MAX;
@@ -1274,7 +1282,7 @@ static void pollstep(int pi, pswarm_options *opt, pswarm_swarm *pop)
     /* printf("And %d are feasible\n", j); */
     
     if(j>0){
-      objfn(opt -> fun, opt -> adar, opt -> n, j, vectorx, opt -> lb, opt -> ub, vectorfx);
+      objfn(opt -> fun, opt -> vfun, opt -> adar, opt -> n, j, vectorx, opt -> lb, opt -> ub, vectorfx);
       pop -> objfunctions+=j;
     }
     
@@ -1308,7 +1316,7 @@ static void pollstep(int pi, pswarm_options *opt, pswarm_swarm *pop)
 	poll_point[i]=pop -> y[pi*opt -> n+i]+pop -> delta*tmp->vector[i];
       
       if(feasible_p(opt -> n, poll_point, opt -> lb, opt -> ub)){
-	objfn(opt -> fun, opt -> adar, opt -> n, 1, poll_point, opt -> lb, opt -> ub, &fx);
+	objfn(opt -> fun, opt -> vfun, opt -> adar, opt -> n, 1, poll_point, opt -> lb, opt -> ub, &fx);
 	pop -> objfunctions++;
 	if(minfx>fx){
 	  minfx=fx;
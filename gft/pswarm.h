@@ -121,6 +121,8 @@ typedef struct pswarm_options
   int n;                           				    
   /** @brief objective function, the real one */
   double (*fun)(double *, void *); 				    
+  /** @brief objective function for several points (dimension, number, points, values, additional arguments), NULL: fun is called for each point */
+  void (*vfun)(int, int, double *, double *, void *);
   /** @brief additional arguments */
   void *adar;                      				    
   /** @brief lower bounds */
@@ -413,6 +415,7 @@ int pswarm_check_exit(int maxiter, int maxf, pswarm_options *pswarm_optionsv, ps
 /** @brief Epsilon for active constraints */           int pswarm_i_epsilonact (pswarm_options *pswarm_optionsv, double EpsilonActive);
 /** @brief additional arguments */                     int pswarm_i_adar       (pswarm_options *pswarm_optionsv, void   *adar        );
 /** @brief additional arguments */                     int pswarm_i_printfun   (pswarm_options *pswarm_optionsv, int    (*printfun)(pswarm_swarm *));
+/** @brief objective function for several points */    int pswarm_i_vfun       (pswarm_options *pswarm_optionsv, void   (*vfun)(int, int, double *, double *, void *));
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /** 
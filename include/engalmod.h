@@ -142,6 +142,23 @@
 /* TYPEDEFS */
 /* ------------------------------------------------------------ */
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @typedef engalmod_ctx
+   @brief Opaque chisquare evaluation context
+
+   Holds the complete state of one chisquare evaluation, i.e. the
+   cubes, fft plans, and buffers. Create one with
+   engalmod_ctx_create(), initialise it with
+   engalmod_ctx_initchisquare(), and use it with
+   engalmod_ctx_getchisquare(). Different contexts can be used
+   concurrently from different threads. The functions without the
+   engalmod_ctx prefix work on a default context that is private to
+   the module.
+*/
+/* ------------------------------------------------------------ */
+typedef struct engalmod_ctx engalmod_ctx;
+
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
@@ -253,11 +270,12 @@ typedef struct Cube
   weightmap is calculated from the model, that is then used to weight
   the chisquare.
 
-  Bit 1: If set (bit1 = 1), memory will be allocated for one or two
-  arrays within which precalculated factors are stored that otherways
-  at time of chisquare calculation will be repeatedly
-  recalculated. Saves some time. If unset (bit1 = 0) this optimisation
-  will not take place, saving memory.
+  Bit 1: Ignored. Formerly switched the precalculation of the
+  gaussian transfer function in the xy-plane on. This plane of
+  (*x/2+1)**y floats (two with bit 0 set) is now always allocated and
+  filled once at initialisation, as it is small compared to the
+  cubes. The part of the transfer function in v is recalculated when
+  the velocity dispersion changes.
 
   Bit 2: If set (bit2 = 0), memory will be allocated for out-of-place
   ffts instead of the in-place ffts used for the convolution. fftw can
@@ -269,14 +287,10 @@ typedef struct Cube
   return 0 if the memory allocations cannot be made. The additionally
   required memory (not counting the passed arrays) is a bit more than:
 
-  mode = 0: sizeof(float)* [ 0 ]
-  mode = 1: sizeof(float)* [ (*x/2)*2+2)**y**v ]
-  mode = 2: sizeof(float)* [ (*x/2+1)**y ]
-  mode = 3: sizeof(float)* [ (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
-  mode = 4: sizeof(float)* [ (*x/2)*2+2)**y**v ]
-  mode = 5: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v ]
-  mode = 6: sizeof(float)* [ (*x/2)*2+2)**y**v + (*x/2+1)**y ]
-  mode = 7: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
+  mode = 0, 2: sizeof(float)* [ (*x/2+1)**y ]
+  mode = 1, 3: sizeof(float)* [ (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
+  mode = 4, 6: sizeof(float)* [ (*x/2)*2+2)**y**v + (*x/2+1)**y ]
+  mode = 5, 7: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
   
   The chisquare evaluation goes as follows (logically, internal
   calculation goes a slightly different path):
@@ -309,11 +323,6 @@ typedef struct Cube
   and inverse noisemap n by chisquare = sum_x_y_v
   (o(x,y,v)-m(x,y,v))^2/n(x,y,v)
 
-  A value of mode of 2 or 3 means that the module needs a bit more
-  memory, but will be slightly faster, as some factors for the
-  evaluation of the chisquare are precalculated and stored in the
-  memory.
-
   The chisquare parameter passes the pointer to the variable that
   contains the chisquare.
 
@@ -405,7 +414,9 @@ int initchisquare_c(float *arrayorig, float *arraymodel, int x, int y, int v, fl
   Two chisquare evaluations are made, one slightly slower if flags are
   present, one faster, if they are not. If the input array gets
   changed after initialisation with initchisquare, this routine has to
-  be run.
+  be run. In the flagged case a list of runs of unflagged pixels is
+  built here once, such that the chisquare evaluation does not test
+  individual pixels anymore.
 
   @return void
 */
@@ -413,6 +424,564 @@ int initchisquare_c(float *arrayorig, float *arraymodel, int x, int y, int v, fl
 void engalmod_chflgs(void);
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_wisdomfile(const char *wisdomfile)
+
+  @brief Set the stem of the fftw wisdom files
+
+  If set, any initialisation with inimode > 0 imports fftw wisdom
+  before planning and exports it afterwards. The wisdom is stored in
+  the file wisdomfile.XxYxV.pP.tT.fF.mM, keyed by the logical cube
+  dimensions, the physical size in v, the number of threads, the
+  planner flags, and the memory mode. The files are locked while
+  being read or written, such that concurrent runs on one machine can
+  share them. Passing NULL or an empty string switches the wisdom
+  storage off (the default). The string is copied.
+
+  @param wisdomfile (const char *) Stem of the wisdom files or NULL
+
+  @return (success) int engalmod_wisdomfile: 1
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_wisdomfile(const char *wisdomfile);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_autocrop(float sigma_v)
+
+  @brief Switch on automatic cropping of the cubes
+
+  Takes effect at the next initialisation. The cubes are then cropped
+  to the bounding box of the unflagged pixels in the original,
+  enlarged by a halo of five sigmas of the beam in x and y and five
+  times sigma_v in v, and padded to lengths that have no prime
+  factors other than 2, 3, 5, and 7. All ffts and chisquare
+  evaluations are done on the cropped cubes, and model pointsources
+  outside the crop region are ignored. If the original has few
+  unflagged pixels this saves a lot of time and memory.
+
+  The model is still passed in the full array. getchisquare_c writes
+  the convolved model back into the crop region of that array and
+  sets the rest of it to 0. getoriginal_galmod_(),
+  getmodel_galmod_(), and getnoise_galmod_() return the cropped
+  cubes. If engalmod_chflgs() finds that the crop region has changed,
+  the initialisation is repeated. Cropping is not done if it does not
+  reduce the cube size or the memory for the cropped cubes cannot be
+  allocated.
+
+  @param sigma_v (float) Largest dispersion of the convolving gaussian in v in pixels, < 0 switches the cropping off (the default)
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_autocrop(float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_numa(int mode)
+
+  @brief Set the NUMA placement of the internal cubes
+
+  Takes effect at the next initialisation. With mode 1 the weight map
+  and the transformed cubes are written for the first time in
+  parallel, with the same static distribution of the rows over the
+  threads as in the chisquare and in the multiplication with the
+  transfer function. On a machine with several NUMA nodes, every
+  page then lands on the node of the thread that works on it later.
+  With mode 2 the transformed cubes are instead interleaved over all
+  nodes, which suits the ffts whose passes do not follow the rows.
+  Interleaving only works on LINUX. Use engalmod_numacopy() to place
+  the original and the model, which are owned by the caller, and
+  engalmod_numareport() to check the placement. With mode 0 the
+  cubes are left to the first thread touching them (the default). The
+  setting is kept on re-initialisation.
+
+  @param mode (int) 0: no placement, 1: first touch, 2: first touch and interleaved transforms
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_numa(int mode);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_noiseupdate(int ncalls)
+
+  @brief Set how often the weight map is recalculated
+
+  Only relevant if a weight map is used (bit 0 of mode set at
+  initialisation). The weight map changes only slowly with the model,
+  so it can be shared between subsequent evaluations of the
+  chisquare, which saves one backward fft and one pass over the
+  transformed cube per evaluation. With ncalls > 1 a weight map is
+  used for ncalls evaluations. With ncalls = 0 or 1, every
+  evaluation calculates its own weight map (the default). With ncalls
+  < 0, the weight map is only recalculated after a call of
+  engalmod_refreshnoise(). The weight map is always calculated at
+  the first evaluation after an initialisation. The setting is kept
+  on re-initialisation.
+
+  @param ncalls (int) Number of evaluations sharing one weight map
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_noiseupdate(int ncalls);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_refreshnoise(void)
+
+  @brief Recalculate the weight map at the next evaluation
+
+  See engalmod_noiseupdate(). Call this before an evaluation whose
+  chisquare has to be exact.
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_refreshnoise(void);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_multires(int nlevels)
+
+  @brief Build a resolution pyramid for coarse chisquare evaluations
+
+  With nlevels > 1, nlevels-1 coarse copies of the original are
+  kept. Level l (1 <= l < nlevels) bins 2^l x 2^l pixels in the
+  xy-plane and 2^l channels (at most all channels) in v. The beam
+  and the velocity dispersion are scaled to the binned pixels, the
+  rms to the mean of the binned pixels, and the flux of one
+  pointsource to the sum of the binned pixels. Coarse levels are
+  evaluated without weight map (bit 0 of mode). The chisquare at a
+  coarse level approximates the full-resolution chisquare without
+  the contribution of the noise that averages out, so chisquares of
+  different levels must not be compared. The pyramid is built
+  immediately if initchisquare_c has been called, otherwise at
+  initialisation, and is rebuilt at every initialisation. The
+  binned originals follow engalmod_chflgs(). The full resolution is
+  selected after building, see engalmod_level(). nlevels <= 1
+  switches off the pyramid.
+
+  @param nlevels (int) Number of levels including the full resolution
+
+  @return (success) int engalmod_multires: 1\n
+          (error) 0, no pyramid could be built
+*/
+/* ------------------------------------------------------------ */
+int engalmod_multires(int nlevels);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_level(int level)
+
+  @brief Select the resolution level for the following evaluations
+
+  At a coarse level (level > 0, see engalmod_multires()) the model
+  array is binned into the level and the chisquare is calculated
+  there. The model array then does not contain the convolved model
+  after getchisquare_c. Select level 0 if the convolved model is
+  needed. The binning is not a substitute for larger pointsources,
+  the caller may increase the flux of one pointsource (and hence
+  reduce the number of pointsources) by the returned factor to
+  speed up the generation of the model.
+
+  @param level (int) Level, 0 is the full resolution
+
+  @return (success) int engalmod_level: Number of pixels binned into one at that level\n
+          (error) 0, level not available, the level does not change
+*/
+/* ------------------------------------------------------------ */
+int engalmod_level(int level);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_deltaupdate(int ncalls)
+
+  @brief Allow incremental evaluations, see getchisquare_delta_c()
+
+  With ncalls > 0, at most ncalls incremental evaluations follow one
+  full evaluation (getchisquare_c), after that getchisquare_delta_c
+  asks for a full evaluation again. This bounds the accumulation of
+  rounding errors and of the error of the cut kernel. With ncalls <=
+  0 (the default) incremental evaluations are switched off and their
+  buffers are freed. The setting is kept on re-initialisation.
+
+  @param ncalls (int) Number of incremental evaluations between two full evaluations
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_deltaupdate(int ncalls);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_background(int set)
+
+  @brief Freeze the current model array as a background
+
+  With set = 1 the current content of the model array is
+  transformed and kept as a background. Until it is dropped, the
+  background is added to every model before the convolution, such
+  that the model array needs to contain only the remainder of the
+  model. The model array is undefined after the call. The
+  background can only be set at the original resolution
+  (engalmod_level(0)), changing the level drops it, as does a
+  re-initialisation. With set = 0 the background is dropped.
+
+  @param set (int) 1: set the background, 0: drop it
+
+  @return (success) int engalmod_background: 1\n
+          (error) 0: not initialised, coarse level, or memory problems
+*/
+/* ------------------------------------------------------------ */
+int engalmod_background(int set);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_hasbackground(void)
+
+  @brief Check for a background, see engalmod_background()
+
+  @return int engalmod_hasbackground: 1 if a background is set, 0 if not
+*/
+/* ------------------------------------------------------------ */
+int engalmod_hasbackground(void);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn engalmod_ctx *engalmod_ctx_create(void)
+
+  @brief Create an empty chisquare evaluation context
+
+  The context has to be initialised with engalmod_ctx_initchisquare()
+  before use and destroyed with engalmod_ctx_destroy().
+
+  @return (success) engalmod_ctx *engalmod_ctx_create: The context\n
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+engalmod_ctx *engalmod_ctx_create(void);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_destroy(engalmod_ctx *ctx)
+
+  @brief Destroy a chisquare evaluation context
+
+  Frees all memory and fft plans allocated for the context and the
+  context itself. The original and model arrays passed at
+  initialisation are not freed.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_destroy(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_autocrop(engalmod_ctx *ctx, float sigma_v)
+
+  @brief Same as engalmod_autocrop, for a context
+
+  The setting is kept when the context is re-initialised.
+
+  @param ctx     (engalmod_ctx *) The context
+  @param sigma_v (float)          Largest dispersion in v in pixels, < 0 switches the cropping off
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_autocrop(engalmod_ctx *ctx, float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_numa(engalmod_ctx *ctx, int mode)
+
+  @brief Same as engalmod_numa, for a context
+
+  The setting is kept when the context is re-initialised.
+
+  @param ctx  (engalmod_ctx *) The context
+  @param mode (int)            0: no placement, 1: first touch, 2: first touch and interleaved transforms
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_numa(engalmod_ctx *ctx, int mode);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_noiseupdate(engalmod_ctx *ctx, int ncalls)
+
+  @brief Same as engalmod_noiseupdate, for a context
+
+  @param ctx    (engalmod_ctx *) The context
+  @param ncalls (int)            Number of evaluations sharing one weight map
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_noiseupdate(engalmod_ctx *ctx, int ncalls);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_refreshnoise(engalmod_ctx *ctx)
+
+  @brief Same as engalmod_refreshnoise, for a context
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_refreshnoise(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_multires(engalmod_ctx *ctx, int nlevels)
+
+  @brief Same as engalmod_multires, for a context
+
+  @param ctx     (engalmod_ctx *) The context
+  @param nlevels (int)            Number of levels including the full resolution
+
+  @return (success) int engalmod_ctx_multires: 1\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_multires(engalmod_ctx *ctx, int nlevels);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_level(engalmod_ctx *ctx, int level)
+
+  @brief Same as engalmod_level, for a context
+
+  @param ctx   (engalmod_ctx *) The context
+  @param level (int)            Level, 0 is the full resolution
+
+  @return (success) int engalmod_ctx_level: Number of pixels binned into one at that level\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_level(engalmod_ctx *ctx, int level);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_deltaupdate(engalmod_ctx *ctx, int ncalls)
+
+  @brief Same as engalmod_deltaupdate, for a context
+
+  @param ctx    (engalmod_ctx *) The context
+  @param ncalls (int)            Number of incremental evaluations between two full evaluations
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_deltaupdate(engalmod_ctx *ctx, int ncalls);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_background(engalmod_ctx *ctx, int set)
+
+  @brief Same as engalmod_background, for a context
+
+  @param ctx (engalmod_ctx *) The context
+  @param set (int)            1: set the background, 0: drop it
+
+  @return (success) int engalmod_ctx_background: 1\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_background(engalmod_ctx *ctx, int set);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_hasbackground(engalmod_ctx *ctx)
+
+  @brief Same as engalmod_hasbackground, for a context
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return int engalmod_ctx_hasbackground: 1 if a background is set, 0 if not
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_hasbackground(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn int engalmod_ctx_initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
+
+   @brief Same as initchisquare_c, for a context
+
+   Initialises (or re-initialises) ctx. See initchisquare_ for a
+   description of the parameters. The chisquare pointer may be NULL.
+   The creation of fft plans is serialised between contexts, as the
+   fftw planner is not thread safe.
+
+  @param ctx        (engalmod_ctx *) The context
+  @param arrayorig  (*float)    Array corresponding to the original cube
+  @param arraymodel (*float)    Array corresponding to the model (pointsource) cube
+  @param x          (int)     Size of logical array in x (that is regarded in calculation)
+  @param y          (int)     Size fo logical array in y
+  @param v          (int)     Size fo logical array in v
+  @param hpbwmaj    (float)   HPBW of the gaussian beam, major axis
+  @param hpbwmin    (float)   HPBW of the gaussian beam, minor axis
+  @param pa         (float)   Position angle of the gaussian beam
+  @param scale      (float)   Scale factor to scale model by to match original
+  @param flux       (float)   The flux of one pointsource in galmod
+  @param sigma      (float)   Sigma rms in the original
+  @param mode       (int)     See initchisquare_
+  @param arrayvsize (int)     Physical size of the model array in v
+  @param chisquare   (double *) Pointer to the variable containing the chisquare or NULL
+  @param noiseweight (float)  Parameter used for weighting quantisation noise
+  @param inimode     (int)    Mode for the determination of the best fft.
+  @param threads     (int)    Number of threads.
+
+  @return (success) int engalmod_ctx_initchisquare: 1
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void engalmod_ctx_chflgs(engalmod_ctx *ctx)
+
+  @brief Same as engalmod_chflgs, for a context
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void engalmod_ctx_chflgs(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn double engalmod_ctx_getchisquare(engalmod_ctx *ctx, float sigma_v)
+
+  @brief Same as getchisquare_c, for a context
+
+  @param ctx     (engalmod_ctx *) The context
+  @param sigma_v (float)          The velocity dispersion
+
+  @return (success) double engalmod_ctx_getchisquare: The chisquare
+*/
+/* ------------------------------------------------------------ */
+double engalmod_ctx_getchisquare(engalmod_ctx *ctx, float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn double engalmod_ctx_getchisquare_fourier(engalmod_ctx *ctx, float sigma_v)
+
+  @brief Same as getchisquare_fourier_c, for a context
+
+  @param ctx     (engalmod_ctx *) The context
+  @param sigma_v (float)          The velocity dispersion
+
+  @return (success) double engalmod_ctx_getchisquare_fourier: The chisquare
+*/
+/* ------------------------------------------------------------ */
+double engalmod_ctx_getchisquare_fourier(engalmod_ctx *ctx, float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_getchisquare_batch(engalmod_ctx *ctx, int nmodels, float **models, float *sigmas, double *chisquares)
+
+  @brief Same as getchisquare_batch_c, for a context
+
+  @param ctx        (engalmod_ctx *) The context
+  @param nmodels    (int)            Number of models
+  @param models     (float **)       The model arrays
+  @param sigmas     (float *)        The velocity dispersions
+  @param chisquares (double *)       Output, the chisquares
+
+  @return (success) int engalmod_ctx_getchisquare_batch: 1\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_getchisquare_batch(engalmod_ctx *ctx, int nmodels, float **models, float *sigmas, double *chisquares);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_getchisquare_delta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare)
+
+  @brief Same as getchisquare_delta_c, for a context
+
+  @param ctx       (engalmod_ctx *) The context
+  @param delta     (float *)        The change of the unconvolved model
+  @param offsets   (long *)         Offsets of the changed pixels
+  @param noffsets  (long)           Number of offsets
+  @param sigma_v   (float)          The velocity dispersion
+  @param chisquare (double *)       Output, the chisquare
+
+  @return (success) int engalmod_ctx_getchisquare_delta: 1\n
+          (error) 0, a full evaluation is required
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_getchisquare_delta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn double getchisquare_(float *array, float *HPBW_v)
@@ -457,6 +1026,113 @@ double getchisquare_c (float sigma_v);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn double getchisquare_fourier_c(float sigma_v)
+
+  @brief Chisquare calculation from a model, in Fourier space if possible
+
+  Same as getchisquare_c, but if the chisquare is unweighted (bit 0 of
+  mode unset at initialisation) and the original has no flagged
+  pixels, the chisquare is evaluated in Fourier space from the
+  transformed original and the transformed model (Parseval's
+  theorem), saving the backtransformation of the model. The original
+  is transformed at initialisation and in engalmod_chflgs. Otherwise
+  this is identical to getchisquare_c. Hence, after calling this
+  function the model array does not necessarily contain the convolved
+  model. Use getchisquare_c if the convolved model is needed.
+
+  @param sigma_v     (float) The velocity dispersion
+
+  @return (success) double getchisquare_fourier_c: The chisquare
+*/
+/* ------------------------------------------------------------ */
+double getchisquare_fourier_c(float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int getchisquare_batch_c(int nmodels, float **models, float *sigmas, double *chisquares)
+
+  @brief Chisquare calculation for several models at once
+
+  Evaluates the chisquares of nmodels models against the original,
+  like nmodels calls of getchisquare_c. Each models[i] has the layout
+  of the model array passed at initialisation, contains the
+  unconvolved model, and is convolved with the velocity dispersion
+  sigmas[i]. The chisquares are put into chisquares[i].
+
+  Without a weight map (bit 0 of mode unset at initialisation) the
+  models are stacked, transformed and backtransformed with one fft
+  plan each, and the residuals of all models are summed up in one
+  pass through the original. The arrays models[i] are not changed,
+  the model array passed at initialisation is left untouched. The
+  plans and the stack are kept for following calls with the same
+  nmodels and need nmodels times the memory of the model.
+
+  With a weight map, or if the memory for the stack cannot be
+  allocated, the models are copied one by one into the model array
+  passed at initialisation and getchisquare_c is called. The model
+  array then contains the convolved last model.
+
+  @param nmodels    (int)      Number of models
+  @param models     (float **) The model arrays
+  @param sigmas     (float *)  The velocity dispersions
+  @param chisquares (double *) Output, the chisquares
+
+  @return (success) int getchisquare_batch_c: 1\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+int getchisquare_batch_c(int nmodels, float **models, float *sigmas, double *chisquares);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int getchisquare_delta_c(float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare)
+
+  @brief Chisquare after a local change of the model
+
+  Incremental alternative to getchisquare_c if only a small part of
+  the model has changed since the last evaluation. delta has the
+  layout of the model array passed at initialisation and contains
+  the change of the unconvolved model (new minus old pointsources) at
+  the pixels listed in offsets, repetitions are allowed. Because the
+  convolution is linear, the change is convolved directly with the
+  beam and the velocity dispersion cut at DELTACUT of the peak, only
+  in the pixels it reaches, and the chisquare is updated there by
+  subtracting the old and adding the new squared residuals. The
+  model array then contains the convolved new model, as after
+  getchisquare_c.
+
+  This is possible if incremental evaluations are allowed (see
+  engalmod_deltaupdate()), the model array contains the convolved
+  model of the last evaluation at full resolution (i.e. the last
+  evaluation was getchisquare_c or getchisquare_delta_c, and the
+  model array has not been touched since), sigma_v is the velocity
+  dispersion of the last evaluation, a weight map, if used, is not
+  due to be refreshed (see engalmod_noiseupdate()), and the direct
+  convolution is cheaper than a full evaluation. Otherwise nothing
+  is evaluated and 0 is returned. The caller then has to restore the
+  unconvolved new model in the model array and call getchisquare_c.
+  In any case delta is 0 at the listed pixels on return.
+
+  @param delta     (float *)  The change of the unconvolved model
+  @param offsets   (long *)   Offsets of the changed pixels
+  @param noffsets  (long)     Number of offsets
+  @param sigma_v   (float)    The velocity dispersion
+  @param chisquare (double *) Output, the chisquare
+
+  @return (success) int getchisquare_delta_c: 1\n
+          (error) 0, a full evaluation is required
+*/
+/* ------------------------------------------------------------ */
+int getchisquare_delta_c(float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn double getproba_(double *chisquare, int *degrees_of_freedom)
@@ -527,6 +1203,81 @@ Cube *getnoise_galmod_(void);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn float *engalmod_numacopy(float *array, int x, int y, int v, int threads)
+
+  @brief Move a padded cube to memory placed on the NUMA nodes of the threads
+
+  Allocates a new array and copies the cube in parallel, with the same
+  static distribution of the rows over the threads as in the
+  chisquare, such that every page lands on the node of the thread
+  that works on it later. The old array, which must have been
+  allocated with malloc_engalmod(), is freed. The cube has the layout
+  expected by initchisquare_c, rows of length 2*(x/2+1). Call this
+  before the initialisation and with the same number of threads. If
+  the memory for the copy cannot be allocated, the old array is
+  returned unchanged.
+
+  @param array   (float *) The cube
+  @param x       (int)     Logical size in x
+  @param y       (int)     Size in y
+  @param v       (int)     Size in v
+  @param threads (int)     Number of threads
+
+  @return (success) float *engalmod_numacopy: The placed cube or array\n
+          (error) NULL if array is NULL
+*/
+/* ------------------------------------------------------------ */
+float *engalmod_numacopy(float *array, int x, int y, int v, int threads);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_numareport(long *pages, long *local, int *nodes)
+
+  @brief Report the NUMA placement of the cubes
+
+  Queries the nodes of up to 4096 pages of each of the original, the
+  model, the weight map, and the transformed cubes of the initialised
+  default context. A page counts as local if it is on the node that
+  the thread working on it runs on at the time of the call. Threads
+  that are not bound to cores (e.g. OMP_PROC_BIND) may move between
+  nodes, such that the report is only meaningful for bound threads.
+  Only works on LINUX.
+
+  @param pages (long *) Returns the number of pages found
+  @param local (long *) Returns the number of local pages
+  @param nodes (int *)  Returns the number of nodes holding pages
+
+  @return (success) int engalmod_numareport: 1
+          (error) 0 if the placement cannot be queried
+*/
+/* ------------------------------------------------------------ */
+int engalmod_numareport(long *pages, long *local, int *nodes);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int engalmod_ctx_numareport(engalmod_ctx *ctx, long *pages, long *local, int *nodes)
+
+  @brief Same as engalmod_numareport, for a context
+
+  @param ctx   (engalmod_ctx *) The context
+  @param pages (long *)         Returns the number of pages found
+  @param local (long *)         Returns the number of local pages
+  @param nodes (int *)          Returns the number of nodes holding pages
+
+  @return (success) int engalmod_ctx_numareport: 1
+          (error) 0 if the placement cannot be queried
+*/
+/* ------------------------------------------------------------ */
+int engalmod_ctx_numareport(engalmod_ctx *ctx, long *pages, long *local, int *nodes);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn void *malloc_engalmod(size_t size)
@@ -113,6 +113,18 @@
 #define MATHS_I_AKIMA 2
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @def MATHS_QMC_NDIM
+   @brief Number of dimensions of the Halton sequence in maths_rndmf()
+
+   Draws beyond these in one sequence are pseudo-random.
+*/
+/* ------------------------------------------------------------ */
+#define MATHS_QMC_NDIM 8
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* MACROS */
 /* ------------------------------------------------------------ */
@@ -139,6 +151,13 @@
    module. This is the float version. Has to be allocated and then to
    be initialised with maths_rndmf_init(). After that, if passed to
    maths_rndmf() it serves to deliver quasirandom numbers.
+
+   If initialised with maths_rndmf_initc() instead, maths_rndmf()
+   delivers the numbers of a counter-based generator (Philox4x32-10),
+   whose output depends only on the key and the counter. The counter
+   is set with maths_rndmf_seek(). If initialised with
+   maths_rndmf_initq(), the draws of a sequence are the coordinates of
+   a randomly shifted Halton point.
 */
 /* ------------------------------------------------------------ */
 
@@ -150,6 +169,24 @@ typedef struct maths_rstrf
   float cd;
   float cm;
   float u[97];
+
+  /** @brief 0: RANMAR, 1: counter-based generator, 2: shifted Halton sequence */
+  int counter;
+
+  /** @brief Key of the counter-based generator */
+  unsigned int key[2];
+
+  /** @brief Counter of the counter-based generator, index (0, 1) and draw (2, 3) */
+  unsigned int ctr[4];
+
+  /** @brief Random shifts of the Halton sequence */
+  float shift[MATHS_QMC_NDIM];
+
+  /** @brief Last output of the counter-based generator */
+  unsigned int buf[4];
+
+  /** @brief Number of unused numbers in buf */
+  int nbuf;
 } maths_rstrf;
 
 /* ------------------------------------------------------------ */
@@ -182,6 +219,52 @@ typedef struct maths_rstr
 /* ------------------------------------------------------------ */
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @struct maths_interp
+   @brief Workspace and coefficients of an interpolation
+
+   Allocated once for a maximum number of nodes with
+   maths_interp_alloc(), (re-)initialised for a set of nodes with
+   maths_interp_init(), and evaluated with maths_interp_eval() or
+   maths_interp_evalf(). Between the nodes x[i] and x[i+1] the
+   interpolation is y[i]+b[i]*dx+c[i]*dx^2+d[i]*dx^3, with dx =
+   x-x[i]. The linear interpolation, natural cubic spline and
+   non-periodic Akima interpolation are those of the gsl. Evaluation
+   does not change the struct, such that different threads can
+   evaluate one interpolation, and different interpolations can be
+   initialised in parallel.
+*/
+/* ------------------------------------------------------------ */
+
+typedef struct maths_interp
+{
+  /** @brief Interpolation type in use, MATHS_I_XXX */
+  int type;
+
+  /** @brief Maximum number of nodes */
+  long size;
+
+  /** @brief Current number of nodes */
+  long n;
+
+  /** @brief Linear coefficients, size elements */
+  double *b;
+
+  /** @brief Quadratic coefficients, size elements */
+  double *c;
+
+  /** @brief Cubic coefficients, size elements */
+  double *d;
+
+  /** @brief Workspace for maths_interp_init(), 3*size+4 elements */
+  double *work;
+} maths_interp;
+
+/* ------------------------------------------------------------ */
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* FUNCTION DECLARATIONS */
 /* ------------------------------------------------------------ */
@@ -391,6 +474,88 @@ float maths_rndmf(maths_rstrf *rnob);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* 
+   @fn void maths_philox(const unsigned int *ctr, const unsigned int *key, unsigned int *out);
+   @brief The Philox4x32-10 counter-based generator
+
+   Returns four independent 32 bit random numbers for a given counter
+   and key (Salmon et al. 2011, Parallel random numbers: as easy as 1,
+   2, 3). The result depends on nothing else, such that any number in
+   a sequence can be accessed directly.
+
+   @param ctr (const unsigned int *) Counter, 4 components
+   @param key (const unsigned int *) Key, 2 components
+   @param out (unsigned int *)       Output, 4 components
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_philox(const unsigned int *ctr, const unsigned int *key, unsigned int *out);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* 
+   @fn void maths_rndmf_initc(const unsigned int *key, maths_rstrf *out);
+   @brief Initialises a random number object with the counter-based generator
+
+   After this maths_rndmf() delivers the numbers of maths_philox()
+   with the given key, starting at sequence 0.
+
+   @param key (const unsigned int *) Two component key
+   @param out (maths_rstrf *)        An allocated maths_rstrf object
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_rndmf_initc(const unsigned int *key, maths_rstrf *out);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* 
+   @fn void maths_rndmf_initq(const unsigned int *key, maths_rstrf *out);
+   @brief Initialises a random number object with a quasi-random sequence
+
+   After this the draws d = 0, 1, ... of the sequence index set with
+   maths_rndmf_seek() are the coordinates of the point index+1 of the
+   Halton sequence in the bases 2, 3, 5, ..., shifted modulo 1 by a
+   random vector derived from key (Cranley-Patterson rotation). Draws
+   beyond MATHS_QMC_NDIM are taken from maths_philox(). Consecutive
+   sequence indices fill the unit cube more evenly than random
+   numbers.
+
+   @param key (const unsigned int *) Two component key
+   @param out (maths_rstrf *)        An allocated maths_rstrf object
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_rndmf_initq(const unsigned int *key, maths_rstrf *out);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* 
+   @fn void maths_rndmf_seek(maths_rstrf *rnob, unsigned long index);
+   @brief Positions a counter-based random number object at a sequence
+
+   The next numbers returned by maths_rndmf() are the draws 0, 1,
+   ... of sequence index, independent of any previous call. Has no
+   effect on the output if rnob was initialised with
+   maths_rndmf_init().
+
+   @param rnob  (maths_rstrf *)  A maths_rstrf struct
+   @param index (unsigned long)  Index of the sequence
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_rndmf_seek(maths_rstrf *rnob, unsigned long index);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn int maths_checkeq(double a, double b, double accuracy)
@@ -746,6 +911,102 @@ void maths_bubblei(int *array, long length);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn maths_interp *maths_interp_alloc(long size)
+  @brief Allocates an interpolation for up to size nodes
+
+  @param size (long) Maximum number of nodes
+
+  @return (success) maths_interp *maths_interp_alloc: Allocated struct
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+maths_interp *maths_interp_alloc(long size);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void maths_interp_free(maths_interp *interp)
+  @brief Frees an interpolation allocated with maths_interp_alloc()
+
+  @param interp (maths_interp *) Struct to free, may be NULL
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_interp_free(maths_interp *interp);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn int maths_interp_init(maths_interp *interp, int type, const double *x, const double *y, long n)
+  @brief Calculates the coefficients of an interpolation
+
+  The nodes x have to be strictly ascending. With fewer than 3 nodes
+  the interpolation is linear, with fewer than 5 nodes an Akima
+  interpolation is replaced by a natural cubic spline, these being
+  the minimum numbers of nodes in the gsl. No memory is allocated.
+
+  @param interp (maths_interp *) Struct allocated with maths_interp_alloc()
+  @param type   (int)            MATHS_I_LINEAR, MATHS_I_CSPLINE, or MATHS_I_AKIMA
+  @param x      (const double *) Nodes
+  @param y      (const double *) Values at the nodes
+  @param n      (long)           Number of nodes, at least 2
+
+  @return (success) int maths_interp_init: 1
+          (error) 0 wrong type or number of nodes
+*/
+/* ------------------------------------------------------------ */
+int maths_interp_init(maths_interp *interp, int type, const double *x, const double *y, long n);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn double maths_interp_eval(const maths_interp *interp, const double *x, const double *y, double xv)
+  @brief Evaluates an interpolation at one point
+
+  x and y have to be the arrays passed to maths_interp_init(). Outside
+  the nodes the polynomial of the first or last interval is used.
+
+  @param interp (const maths_interp *) Initialised struct
+  @param x      (const double *)       Nodes
+  @param y      (const double *)       Values at the nodes
+  @param xv     (double)               Point
+
+  @return double maths_interp_eval: Interpolated value
+*/
+/* ------------------------------------------------------------ */
+double maths_interp_eval(const maths_interp *interp, const double *x, const double *y, double xv);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn void maths_interp_evalf(const maths_interp *interp, const double *x, const double *y, const float *xv, float *yv, long nv)
+  @brief Evaluates an interpolation at many points
+
+  As maths_interp_eval() for nv points. The interval of a point is
+  searched starting at the interval of the previous one, such that
+  ascending points are found in constant time.
+
+  @param interp (const maths_interp *) Initialised struct
+  @param x      (const double *)       Nodes
+  @param y      (const double *)       Values at the nodes
+  @param xv     (const float *)        Points
+  @param yv     (float *)              Output: interpolated values
+  @param nv     (long)                 Number of points
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+void maths_interp_evalf(const maths_interp *interp, const double *x, const double *y, const float *xv, float *yv, long nv);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn void testmaths(void)
@@ -141,8 +141,16 @@ or use fftw_malloc and fftw_free in this module for the arrays betweeen which th
 /* ------------------------------------------------------------ */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h> 
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <fftw3.h>
+#ifdef LINUX
+#include <sys/syscall.h>
+#endif
 
 #ifndef OPENMPTIR
   #undef OPENMPFFT
@@ -187,63 +195,405 @@ or use fftw_malloc and fftw_free in this module for the arrays betweeen which th
 /* This is -1024 */
 #define HOT_VALUE -1024
 
+/* Distance in doubles between two per-thread partial sums, one cache line */
+#define PARTIALPAD 8
+
+/* Halo around the unflagged pixels in sigmas of the convolving gaussian when cropping */
+#define CROPHALO 5.0
+
+/* The kernel of the incremental evaluation is cut where it drops below this fraction of its peak */
+#define DELTACUT 1.0E-5
+
+/* Cost of a full evaluation per pixel and per log2 of the number of pixels, in multiply-adds of the incremental evaluation */
+#define DELTACOST 4.0
+
+/* Length in unsigned longs of a node mask, enough for 1024 NUMA nodes */
+#define NUMAMASK 16
+
+/* Largest number of pages per array whose placement is queried */
+#define NUMASAMPLE 4096
+
+/* Memory policy interleave and flag to query the allowed nodes, as in linux/mempolicy.h */
+#define NUMA_INTERLEAVE 3
+#define NUMA_MEMS_ALLOWED 4
+
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* STRUCTS */
 /* ------------------------------------------------------------ */
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-/* (PRIVATE) GLOBAL VARIABLES */
+/**
+   @struct initpars
+   @brief Parameters of an initialisation
+
+   Kept to repeat the initialisation with a new crop region if the
+   flags of the original change.
+*/
+/* ------------------------------------------------------------ */
+typedef struct initpars
+{
+  /** @brief HPBW of the gaussian beam, major axis */
+  float hpbwmaj;
+
+  /** @brief HPBW of the gaussian beam, minor axis */
+  float hpbwmin;
+
+  /** @brief Position angle of the gaussian beam */
+  float pa;
+
+  /** @brief Scale factor to scale model by to match original */
+  float scale;
+
+  /** @brief The flux of one pointsource */
+  float flux;
+
+  /** @brief Sigma rms in the original */
+  float sigma;
+
+  /** @brief Memory and weighting mode */
+  int mode;
+
+  /** @brief Physical size of the model array in v */
+  int arrayvsize;
+
+  /** @brief Weight of the quantisation noise */
+  float noiseweight;
+
+  /** @brief Mode of the fft initialisation */
+  int inimode;
+} initpars;
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @struct pyrlevel
+   @brief One coarse level of the resolution pyramid
+
+   A context for binned copies of the original and the model, see
+   engalmod_ctx_multires.
+*/
+/* ------------------------------------------------------------ */
+typedef struct pyrlevel
+{
+  /** @brief Context evaluating the binned cubes */
+  engalmod_ctx *ctx;
+
+  /** @brief The binned original */
+  float *orig;
+
+  /** @brief The binned model */
+  float *model;
+
+  /** @brief Number of pixels binned into one in x, y, v */
+  int bin[3];
+
+  /** @brief Logical size of the binned cubes in x, y, v */
+  int size[3];
+} pyrlevel;
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @struct engalmod_ctx
+   @brief Chisquare evaluation context
+
+   Contains everything that is needed to evaluate the chisquare of
+   one model cube against one original cube: the cubes, the fft plans
+   and buffers, and the precalculated factors of the convolving
+   gaussians. Several contexts can be used concurrently from
+   different threads. The members are private to this module, the
+   type is opaque to the outside.
+*/
 /* ------------------------------------------------------------ */
-static float *expofacsfft_;
-static float *expofacsfft_noise_;
-static float *veloarray_;
-static float *veloarray_noise_;
+struct engalmod_ctx
+{
+  /** @brief Factors of the gaussian for the model */
+  float *expofacsfft;
+
+  /** @brief Factors of the gaussian for the noise */
+  float *expofacsfft_noise;
+
+  /** @brief Gaussian in v-direction for the model */
+  float *veloarray;
+
+  /** @brief Gaussian in v-direction for the noise */
+  float *veloarray_noise;
+
+  /** @brief Sigma of the beam, major axis */
+  float sigma_maj;
+
+  /** @brief Sigma of the beam, minor axis */
+  float sigma_min;
+
+  /** @brief Sigma of the noise beam, major axis */
+  float sigma_maj_noise;
+
+  /** @brief Sigma of the noise beam, minor axis */
+  float sigma_min_noise;
+
+  /** @brief The original */
+  Cube original;
+
+  /** @brief The model */
+  Cube model;
+
+  /** @brief The inverse weight map */
+  Cube noise;
+
+  /** @brief Precalculated gaussian for the model in the xy-plane */
+  Cube expcube_model;
+
+  /** @brief Precalculated gaussian for the noise in the xy-plane */
+  Cube expcube_noise;
+
+  /** @brief Where to put the chisquare */
+  double *chisquare;
+
+  /** @brief Transformed model */
+  fftwf_complex *transformed_cube_model;
+
+  /** @brief Transformed noise */
+  fftwf_complex *transformed_cube_noise;
+
+  /** @brief Transformed original, for the chisquare in Fourier space, NULL if not used */
+  fftwf_complex *transformed_cube_orig;
+
+  /** @brief 1 if transformed_cube_orig is valid and the chisquare can be evaluated in Fourier space */
+  int fourier;
+
+  /** @brief Backward plan noise */
+  fftwf_plan plin_noise;
+
+  /** @brief Forward plan model */
+  fftwf_plan plan_model;
+
+  /** @brief Backward plan model */
+  fftwf_plan plin_model;
+
+  /** @brief Logical size of the cubes in x divided by 2 */
+  int cubesizexhalf;
 
-static float sigma_maj_;
-static float sigma_min_;
-static float sigma_maj_noise_;
-static float sigma_min_noise_;
+  /** @brief Logical size of the cubes in y divided by 2 */
+  int cubesizeyhalf;
 
-static Cube original_;
-static Cube model_;
-static Cube noise_;
-static Cube expcube_model_;
-static Cube expcube_noise_;
+  /** @brief Physical size of the transformed cubes in x */
+  int newsize;
 
-static double *chisquare_;
+  /** @brief Logical size of the cubes in v divided by 2 */
+  int dummy;
 
-static fftwf_complex *transformed_cube_model_;
-static fftwf_complex *transformed_cube_noise_;
+  /** @brief Convolution routine for the model (and the weight map) */
+  Cube *(*conmodel)(struct engalmod_ctx *);
 
-static fftwf_plan plan_noise_, plin_noise_;
-static fftwf_plan plan_model_, plin_model_;
+  /** @brief Chisquare summation routine */
+  double (*fetchchisquare)(struct engalmod_ctx *);
 
-static int cubesizexhalf_;
-static int cubesizeyhalf_;
-static int newsize_;
-static int dummy_;
+  /** @brief Constant for the noise gaussian in v */
+  float noiseconstant_1;
 
-static Cube *(*conmodel_)(void);
-static Cube *(*connoise_)(void);
-static double (*fetchchisquare_)(void);
+  /** @brief Normalisation for the noise gaussian */
+  float noiseconstant_2;
+
+  /** @brief Constant for the model gaussian in v */
+  float modelconstant_1;
+
+  /** @brief Physical size of the original in x */
+  int realorigsizex;
+
+  /** @brief Physical size of the original in y */
+  int realorigsizey;
+
+  /** @brief Physical size of the model in x */
+  int realmodelsizex;
+
+  /** @brief Physical size of the model in y */
+  int realmodelsizey;
+
+  /** @brief Last velocity dispersion */
+  float oldsigma;
+
+  /** @brief Mode the context has been initialised with, 0 if not initialised */
+  int mode;
+
+  /** @brief Number of threads */
+  int threads;
+
+  /** @brief Per-thread partial sums, PARTIALPAD apart */
+  double *vector;
+
+  /** @brief Number of runs of unflagged pixels */
+  long nruns;
+
+  /** @brief Start offsets of runs of unflagged pixels */
+  long *runstart;
+
+  /** @brief Lengths of runs of unflagged pixels */
+  int *runlength;
+
+  /** @brief 1 if the cubes should be cropped at initialisation, survives re-initialisation */
+  int autocrop;
+
+  /** @brief Largest expected velocity dispersion in pixels, determines the halo in v when cropping */
+  float cropsigma_v;
+
+  /** @brief 1 if the cubes are cropped, original and model then point to croporig and cropmodel */
+  int cropped;
+
+  /** @brief The cropped original */
+  float *croporig;
+
+  /** @brief The cropped model */
+  float *cropmodel;
+
+  /** @brief The full original as passed at initialisation */
+  float *fullorig;
+
+  /** @brief The full model as passed at initialisation */
+  float *fullmodel;
+
+  /** @brief Logical size of the full cubes in x, y, v */
+  int fullsize[3];
+
+  /** @brief Position of the crop region in the full cubes in x, y, v */
+  int cropstart[3];
+
+  /** @brief Logical size of the crop region in x, y, v */
+  int cropsize[3];
+
+  /** @brief Parameters of the initialisation, to repeat it if the crop region changes */
+  initpars cropinit;
+
+  /** @brief Number of evaluations sharing one weight map, survives re-initialisation, see engalmod_ctx_noiseupdate */
+  int noiseupdate;
+
+  /** @brief Number of evaluations that have used the current weight map */
+  int noisecalls;
+
+  /** @brief 1 if noise.points contains a valid weight map */
+  int noisevalid;
+
+  /** @brief fftw planner flags of the initialisation */
+  int planflags;
+
+  /** @brief Number of models the batch plans and buffers are made for, 0 if none */
+  int batchn;
+
+  /** @brief Forward plan for batchn stacked models */
+  fftwf_plan batchplan;
+
+  /** @brief Backward plan for batchn stacked models */
+  fftwf_plan batchplin;
+
+  /** @brief Stacked models, each with the physical size of the model, transformed in place */
+  float *batchcube;
+
+  /** @brief Gaussians in v-direction for the stacked models */
+  float *batchvelo;
+
+  /** @brief Per-thread partial sums for the stacked models */
+  double *batchsums;
+
+  /** @brief Number of levels of the resolution pyramid including the full resolution, survives re-initialisation */
+  int pyrlevels;
+
+  /** @brief Number of coarse levels in pyramid */
+  int npyramid;
+
+  /** @brief Coarse levels, level l is pyramid[l-1] */
+  pyrlevel *pyramid;
+
+  /** @brief Current level, 0 is the full resolution */
+  int level;
+
+  /** @brief The original as passed at initialisation, NULL if not initialised */
+  float *pyrorig;
+
+  /** @brief The model as passed at initialisation */
+  float *pyrmodel;
+
+  /** @brief Logical size of the cubes as passed at initialisation */
+  int pyrsize[3];
+
+  /** @brief Number of threads as passed at initialisation */
+  int pyrthreads;
+
+  /** @brief Parameters of the initialisation, to build the pyramid */
+  initpars pyrinit;
+
+  /** @brief Number of incremental evaluations between two full evaluations, 0 if switched off, survives re-initialisation, see engalmod_ctx_deltaupdate */
+  int deltaupdate;
+
+  /** @brief Number of incremental evaluations since the last full evaluation */
+  int deltacalls;
+
+  /** @brief 1 if the model array contains the convolved model of the last full or incremental evaluation */
+  int deltavalid;
+
+  /** @brief Chisquare of the model in the model array */
+  double deltachisquare;
+
+  /** @brief Velocity dispersion the kernel has been made for */
+  float deltasigma;
+
+  /** @brief Half size of the cut kernel in x, y, v */
+  int deltahalo[3];
+
+  /** @brief xy-part of the kernel, (2*deltahalo[0]+1)*(2*deltahalo[1]+1) pixels, NULL if not made */
+  float *deltaplane;
+
+  /** @brief v-part of the kernel, 2*deltahalo[2]+1 pixels, 1 at the centre */
+  float *deltavelo;
+
+  /** @brief The change of the model convolved in v, layout of the model */
+  float *deltatemp;
+
+  /** @brief The change of the model convolved in v, y, x, layout of the model */
+  float *deltaout;
+
+  /** @brief Bit 0 marks pixels listed in deltatlist, bit 1 pixels listed in deltaolist */
+  unsigned char *deltamask;
+
+  /** @brief Offsets of the pixels touched in deltatemp */
+  long *deltatlist;
+
+  /** @brief Offsets of the pixels touched in deltaout */
+  long *deltaolist;
+
+  /** @brief Allocated length of deltatlist */
+  long deltatmax;
+
+  /** @brief Allocated length of deltaolist */
+  long deltaomax;
+
+  /** @brief Number of pixels listed in deltaolist */
+  long deltacount;
+
+  /** @brief Transformed background model added to every model before the convolution, NULL if none */
+  fftwf_complex *background;
+
+  /** @brief NUMA placement of the buffers, 0: none, 1: first touch, 2: first touch and interleaved transforms, survives re-initialisation, see engalmod_ctx_numa */
+  int numa;
+};
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* (PRIVATE) GLOBAL VARIABLES */
+/* ------------------------------------------------------------ */
 
-static float noiseconstant_1_;
-static float noiseconstant_2_;
-static float modelconstant_1_;
+/* The context used by the non-reentrant interface */
+static engalmod_ctx default_ctx_ = {NULL};
 
-static int realorigsizex_;
-static int realorigsizey_;
-static int realmodelsizex_;
-static int realmodelsizey_;
+/* An empty context to initialise new contexts with */
+static const engalmod_ctx default_ctx_null_ = {NULL};
 
-static float oldsigma_;
+/* Stem of the fftw wisdom files, NULL if no wisdom is stored */
+static char *wisdomfile_ = NULL;
 
 #ifdef OPENMPTIR
 #include <omp.h>
 #endif
-static int threads_;
-static double *vector_;
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* PRIVATE FUNCTION DECLARATIONS */
@@ -253,321 +603,417 @@ static double *vector_;
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static double fetchchisquare_unflagged(void)
+  @fn static double fetchchisquare_unflagged(engalmod_ctx *ctx)
   @brief Get the chisquare without taking care of flags
 
   Returns the chisquare without taking care of flags. This function
   will be assigned to the pointer of fetchchisquare if no blanked
   pixels are found in the cube.
 
+  @param ctx (engalmod_ctx *) The context
   @return double fetchchisquare_unflagged the chisquared
 */
 /* ------------------------------------------------------------ */
-static double fetchchisquare_unflagged(void);
+static double fetchchisquare_unflagged(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static double fetchchisquare_flagged(void)
+  @fn static double fetchchisquare_flagged(engalmod_ctx *ctx)
   @brief Get the chisquare taking care of flags
 
   Returns the chisquare taking care of flags. This function
   will be assigned to the pointer of fetchchisquare if any blanked
   pixel is found in the cube.
 
+  @param ctx (engalmod_ctx *) The context
   @return double fetchchisquare_unflagged the chisquared
 */
 /* ------------------------------------------------------------ */
-static double fetchchisquare_flagged(void);
+static double fetchchisquare_flagged(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float fftgaussian (int nx, int ny, int nv, float *expofacs)
-  @brief Calculate a gaussian
+  @fn static double chisquare_run(float *orig, float *mod, int n)
+  @brief Sum of squared differences of two float arrays
 
-  Returns the value of a gaussian in dependence of expofacs. 
-  gaussian  =  exp((expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*
-  ny*ny+expofacs[3]*nv*nv+expofacs[4])).
-  To be used by convolgaussfft. No modulation with respect of the
-  signum of the coordinates will be done. For a number in the exponent
-  lesser than MINEXPONENT the return value is 0.
+  Returns sum_i (orig[i]-mod[i])^2 over n contiguous pixels. The
+  loop works on direct indices without any test, such that the
+  compiler can vectorise it. Summation is done in double.
 
-  @todo Implement the last thing in the description
+  @param orig (float *) Start of the run in the original
+  @param mod  (float *) Start of the run in the model
+  @param n    (int)     Number of pixels in the run
 
-  @param nx       (int)     Relative pixelposition in x
-  @param ny       (int)     Relative pixelposition in x
-  @param nv       (int)     Relative pixelposition in x
-  @param expofacs (float *) Factors in the gaussian, calculated by 
-  expofacsfft and normalised with respect to the sizes of the array
-
-  @return float fftgaussian The gaussian at the desired position
+  @return double chisquare_run: The unnormalised chisquare of the run
 */
 /* ------------------------------------------------------------ */
-static float fftgaussian (int nx, int ny, int nv, float *expofacs, float *veloarray);
+static double chisquare_run(float *orig, float *mod, int n);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float fftgaussian (int nx, int ny, int nv, float *expofacs, float *veloarray)
-  @brief Calculate a gaussian
-
-  Returns the value of a gaussian in dependence of expofacs. 
-  gaussian  =  exp((expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*
-  ny*ny+expofacs[3]*nv*nv+expofacs[4])).
-  To be used by convolgaussfft. No modulation with respect of the
-  signum of the coordinates will be done. For a number in the exponent
-  lesser than MINEXPONENT the return value is 0.
+  @fn static double chisquare_run_noise(float *orig, float *mod, float *noise, int n)
+  @brief Sum of squared differences of two float arrays, weighted
 
-  @todo Implement the last thing in the description
+  Returns sum_i (orig[i]-mod[i])^2/noise[i] over n contiguous
+  pixels. See chisquare_run.
 
-  @param nx       (int)     Relative pixelposition in x
-  @param ny       (int)     Relative pixelposition in x
-  @param nv       (int)     Relative pixelposition in x
-  @param expofacs (float *) Factors in the gaussian, calculated by 
-  expofacsfft and normalised with respect to the sizes of the array
+  @param orig  (float *) Start of the run in the original
+  @param mod   (float *) Start of the run in the model
+  @param noise (float *) Start of the run in the inverse weight map
+  @param n     (int)     Number of pixels in the run
 
-  @return float fftgaussian The gaussian at the desired position
+  @return double chisquare_run_noise: The unnormalised chisquare of the run
 */
 /* ------------------------------------------------------------ */
-static float fftgaussian (int nx, int ny, int nv, float *expofacs, float *veloarray);
+static double chisquare_run_noise(float *orig, float *mod, float *noise, int n);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float fftgaussian (int nx, int ny, int nv, float *expofacs)
-  @brief Calculate a gaussian
+  @fn static double chisquare_run_masked(float *orig, float *mod, float *noise, int n)
+  @brief Sum of squared differences of two float arrays, ignoring NaNs
 
-  Returns the value of a gaussian in dependence of expofacs. 
-  gaussian  =  exp((expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*
-  ny*ny+expofacs[3]*nv*nv+expofacs[4])).
-  To be used by convolgaussfft. No modulation with respect of the
-  signum of the coordinates will be done. For a number in the exponent
-  lesser than MINEXPONENT the return value is 0.
+  As chisquare_run_noise (or chisquare_run if noise is NULL), but
+  pixels that are blanked (NaN) in the original are skipped. The test
+  is a select, not a branch. This is only used if the list of runs
+  could not be allocated.
 
-  @todo Implement the last thing in the description
+  @param orig  (float *) Start of the row in the original
+  @param mod   (float *) Start of the row in the model
+  @param noise (float *) Start of the row in the inverse weight map or NULL
+  @param n     (int)     Number of pixels in the row
 
-  @param nx       (int)     Relative pixelposition in x
-  @param ny       (int)     Relative pixelposition in x
-  @param nv       (int)     Relative pixelposition in x
-  @param expofacs (float *) Factors in the gaussian, calculated by 
-  expofacsfft and normalised with respect to the sizes of the array
-
-  @return float fftgaussian The gaussian at the desired position
+  @return double chisquare_run_masked: The unnormalised chisquare of the row
 */
 /* ------------------------------------------------------------ */
-static float fftgaussian_array (int nx, int ny, int nv, float *expofacs, float *array, float *veloarray);
+static double chisquare_run_masked(float *orig, float *mod, float *noise, int n);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float fftgaussian2d (int nx, int ny, float *expofacs)
-  @brief Calculate a gaussian
+  @fn static void makeruns(engalmod_ctx *ctx)
+  @brief Build the list of runs of unflagged pixels
+
+  Scans the original for blanked pixels (NaN) and fills runstart_,
+  runlength_, and nruns_ with the offsets and lengths of all
+  contiguous stretches of unflagged pixels along x. The offsets are
+  valid for the original, the model, and the noise cube, as their
+  physical layout is identical. If no memory can be allocated,
+  runstart_ and runlength_ are NULL and nruns_ is 0.
+
+  @param ctx (engalmod_ctx *) The context
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void makeruns(engalmod_ctx *ctx);
+
 
-  Returns the value of a gaussian in dependence of expofacs with 
-  nu_v  = 0. gaussian = exp((expofacs[0]*nx*nx+expofacs[1]*nx*ny+
-  expofacs[2]*ny*ny+expofacs[4])).
-  To be used by convolgaussfft. No modulation with respect of the
-  signum of the coordinates will be done. For a number in the exponent
-  lesser than MINEXPONENT the return value is 0 (see fftgaussian).
 
-  @todo The last item in the description to be implemented
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void transformoriginal(engalmod_ctx *ctx)
+  @brief Transform the original to Fourier space if possible
+
+  If the chisquare is unweighted (no noise map) and there are no
+  flagged pixels in the original, the original is transformed into
+  transformed_cube_orig and ctx -> fourier is set to 1, otherwise
+  ctx -> fourier is set to 0. The plan is made with FFTW_ESTIMATE to
+  leave the original untouched and destroyed after use, as this is
+  done only when the original changes.
 
-  @param nx       (int)     Relative pixelposition in x
-  @param ny       (int)     Relative pixelposition in y
-  @param expofacs (float *) Factors in the gaussian, calculated by 
-  expofacsfft and normalised with respect to the sizes of the array
+  @param ctx (engalmod_ctx *) The context
 
-  @return float fftgaussian2d: The gaussian at the desired position,
-  no error handling.
+  @return void
 */
 /* ------------------------------------------------------------ */
-static float fftgaussian2d(int nx, int ny, float *expofacs);
+static void transformoriginal(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float fftgaussian2d (int nx, int ny, float *expofacs)
-  @brief Calculate a gaussian
-
-  Returns the value of a gaussian in dependence of expofacs with 
-  nu_v  = 0. gaussian = exp((expofacs[0]*nx*nx+expofacs[1]*nx*ny+
-  expofacs[2]*ny*ny+expofacs[4])).
-  To be used by convolgaussfft. No modulation with respect of the
-  signum of the coordinates will be done. For a number in the exponent
-  lesser than MINEXPONENT the return value is 0 (see fftgaussian).
+  @fn static void checkflags(engalmod_ctx *ctx)
+  @brief Set up the chisquare evaluation for the current original
 
-  @todo The last item in the description to be implemented
+  Builds the runs of unflagged pixels, chooses the chisquare
+  summation routine, and transforms the original if the chisquare can
+  be evaluated in Fourier space. Works on the (possibly cropped) cubes
+  of the context.
 
-  @param nx       (int)     Relative pixelposition in x
-  @param ny       (int)     Relative pixelposition in y
-  @param expofacs (float *) Factors in the gaussian, calculated by 
-  expofacsfft and normalised with respect to the sizes of the array
+  @param ctx (engalmod_ctx *) The context
 
-  @return float fftgaussian2d: The gaussian at the desired position,
-  no error handling.
+  @return void
 */
 /* ------------------------------------------------------------ */
-static float fftgaussian2d_array(int nx, int ny, float *expofacs, float *array);
+static void checkflags(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_here(void)
-  @brief Convolve a cube with a gaussian via fft
+  @fn static void releasecrop(engalmod_ctx *ctx)
+  @brief Free the cropped cubes of a context
 
-  In-place convolution of a cube Cube with a gaussian via fft. The
-  convolution is not normalised in the xy-plane but in v. No
-  convolution takes place in v-direction in case of only one
-  plane. See function expofacsfft_here for definition of expofacsfft_
-  array.
+  The settings of engalmod_ctx_autocrop are kept.
 
-  @param cube        (Cube *)  The cube
+  @param ctx (engalmod_ctx *) The context
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return void
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_here(void);
+static void releasecrop(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_here_single(void)
-  @brief Convolve a cube with a gaussian via fft
+  @fn static int fftsize(int length, int max)
+  @brief Smallest length >= length that has no prime factors but 2, 3, 5, 7
 
-  In-place convolution of a cube Cube with a gaussian via fft. The
-  convolution is not normalised in the xy-plane but in v. No
-  convolution takes place in v-direction in case of only one
-  plane. See function expofacsfft_here for definition of expofacsfft_
-  array.
+  fftw is fastest for such lengths. The result is limited to max.
 
-  @param cube        (Cube *)  The cube
+  @param length (int) Minimum length
+  @param max    (int) Maximum length
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return int fftsize: The length
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_here_single(void);
+static int fftsize(int length, int max);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_noise(Cube *cube)
-  @brief Calculation of a weights map from the cube
+  @fn static int unflaggedbox(float *array, int x, int y, int v, int *start, int *end)
+  @brief Bounding box of the unflagged pixels in a cube
 
-  cube is convolved with a beam of sqrt(1/2) times the sigma of the
-  convolving beam and normalized with a factor
-  2*sqrt(pi)*sigma_v*fluxpoint, where fluxpoint is the flux of one
-  pointsource in galmod. This is not an in-place convolution, but it
-  is safed to noise_.points. Then the noise of the original cube
-  squared is added to noise_.points (more accurately this is done in
-  Fourier-space before backtransformation.) The resulting map is used
-  as a weights map for calculation of the chisquare. See function
-  expofacsfft_noise for definition of expofacsfft_noise_ array.
+  The cube has the physical size 2*(x/2+1) in x. The box is returned
+  in start and end (inclusive) as x, y, v.
 
-  @param cube (Cube *)  The (pointsource) cube
+  @param array (float *) The cube
+  @param x     (int)     Logical size in x
+  @param y     (int)     Logical size in y
+  @param v     (int)     Logical size in v
+  @param start (int *)   Lower corner of the box (output)
+  @param end   (int *)   Upper corner of the box (output)
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return (success) int unflaggedbox: 1
+          (error) 0: All pixels are flagged
+*/
+/* ------------------------------------------------------------ */
+static int unflaggedbox(float *array, int x, int y, int v, int *start, int *end);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int findcrop(engalmod_ctx *ctx, float *arrayorig, int x, int y, int v, float hpbwmaj, int *start, int *size)
+  @brief Find the crop region for an original
+
+  The crop region is the bounding box of all unflagged pixels,
+  enlarged by a halo of CROPHALO sigmas of the convolving beam in x
+  and y and of CROPHALO times ctx -> cropsigma_v in v, such that
+  model pointsources outside the region do not contribute to the
+  convolved model inside the box. Each axis is then padded to a length
+  that is a product of 2, 3, 5, and 7, keeping the region inside the
+  cube.
+
+  @param ctx       (engalmod_ctx *) The context
+  @param arrayorig (float *)        The full original
+  @param x         (int)            Logical size in x
+  @param y         (int)            Logical size in y
+  @param v         (int)            Logical size in v
+  @param hpbwmaj   (float)          HPBW of the beam, major axis
+  @param start     (int *)          Lower corner of the region x, y, v (output)
+  @param size      (int *)          Size of the region x, y, v (output)
+
+  @return (success) int findcrop: 1 if the region is smaller than the cube
+          (error) 0: Cropping does not help
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_noise(void);
+static int findcrop(engalmod_ctx *ctx, float *arrayorig, int x, int y, int v, float hpbwmaj, int *start, int *size);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_noise_single(Cube *cube)
-  @brief Calculation of a weights map from the cube
+  @fn static void cropcube(engalmod_ctx *ctx, float *full, float *cropped, int uncrop)
+  @brief Copy between a full cube and its cropped version
 
-  cube is convolved with a beam of sqrt(1/2) times the sigma of the
-  convolving beam and normalized with a factor
-  2*sqrt(pi)*sigma_v*fluxpoint, where fluxpoint is the flux of one
-  pointsource in galmod. This is not an in-place convolution, but it
-  is safed to noise_.points. Then the noise of the original cube
-  squared is added to noise_.points (more accurately this is done in
-  Fourier-space before backtransformation.) The resulting map is used
-  as a weights map for calculation of the chisquare. See function
-  expofacsfft_noise for definition of expofacsfft_noise_ array.
+  If uncrop is 0, the crop region of full is copied into
+  cropped. Otherwise cropped is copied into the crop region of full
+  and the rest of full is set to 0.
 
-  @param cube (Cube *)  The (pointsource) cube
+  @param ctx     (engalmod_ctx *) The context
+  @param full    (float *)        The full cube
+  @param cropped (float *)        The cropped cube
+  @param uncrop  (int)            Direction of the copy
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void cropcube(engalmod_ctx *ctx, float *full, float *cropped, int uncrop);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static double fetchchisquare_fourier(engalmod_ctx *ctx)
+  @brief Get the unweighted chisquare in Fourier space
+
+  Requires the model to be forward transformed, but not multiplied
+  with the transfer function. Following Parseval's theorem, with the
+  unnormalised transforms of fftw, the sum of the squared residuals
+  is 1/N sum_k |O_k-N*G_k*M_k|^2, where N is the number of pixels, O
+  the transformed original, M the transformed model, and G the
+  transfer function (which contains a factor 1/N). As only half of
+  the spectrum is stored for a real-to-complex transform, all
+  frequencies in x other than 0 and N_x/2 (for even N_x) are counted
+  twice.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return double fetchchisquare_fourier: The chisquare
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_noise_single(void);
+static double fetchchisquare_fourier(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static void makemodelarray(float *array)
-  @brief Fill the allocated array *array with precalculated summands for exp evaluation of the model_ cube
+  @fn static Cube *convolgaussfft_here(engalmod_ctx *ctx)
+  @brief Convolve a cube with a gaussian via fft
+
+  In-place convolution of the model cube with a gaussian via fft. The
+  convolution is not normalised in the xy-plane but in v. No
+  convolution takes place in v-direction in case of only one
+  plane. The transfer function is the product of the precalculated
+  plane expcube_model and the vector veloarray, see maketransferplane
+  and changeexpofacsfft.
 
-  @param cube (Cube *)  The (pointsource) cube
+  @param ctx (engalmod_ctx *) The context
 
   @return (success) Cube *convolgaussfft_here: The convolved cube\n
           (error) NULL
 */
 /* ------------------------------------------------------------ */
-static void makemodelarray(float *array);
+static Cube *convolgaussfft_here(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static void makenoisearray(float *array)
-  @brief Fill the allocated array *array with precalculated summands for exp evaluation of the model_ cube
+  @fn static Cube *convolgaussfft_both(engalmod_ctx *ctx)
+  @brief Convolve the model and calculate the weights map from it
+
+  Does the same as convolgaussfft_here, and in addition calculates a
+  weights map from the model: the model cube is convolved with a beam
+  of sqrt(1/2) times the sigma of the convolving beam and normalized
+  with a factor 2*sqrt(pi)*sigma_v*fluxpoint, where fluxpoint is the
+  flux of one pointsource in galmod. The result is saved to
+  noise.points. Then the noise of the original cube squared is added
+  to noise.points (more accurately this is done in Fourier-space
+  before backtransformation.) The resulting map is used as a weights
+  map for calculation of the chisquare. The transfer function is the
+  product of the precalculated plane expcube_noise and the vector
+  veloarray_noise, see maketransferplane and
+  changeexpofacsfft_noise. Both convolutions share the forward
+  transform of the model, see splittransfer.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return (success) Cube *convolgaussfft_both: The convolved cube\n
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+static Cube *convolgaussfft_both(engalmod_ctx *ctx);
 
-  @param cube (Cube *)  The (pointsource) cube
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void maketransferplane(engalmod_ctx *ctx, float *plane, float *expofacs)
+  @brief Fill the xy-part of the gaussian transfer function
+
+  The gaussian in Fourier space factorises into a part depending on
+  the frequencies in x and y and a part depending on the frequency in
+  v. This fills plane (of size (x/2+1)*y, ordered like one v-plane of
+  the transformed cube) with exp(expofacs[0]*nx*nx+expofacs[1]*nx*ny+
+  expofacs[2]*ny*ny), where nx and ny run from 0, ..., N/2 and -1,
+  ..., -N/2 or -N/2-1. The normalisation expofacs[4] is contained in
+  the v-part. As the beam does not change, this is done once at
+  initialisation.
+
+  @param ctx      (engalmod_ctx *) The context
+  @param plane    (float *)        Allocated plane to fill
+  @param expofacs (float *)        Factors as calculated by expofacsfft_here
+
+  @return void
 */
 /* ------------------------------------------------------------ */
-static void makenoisearray(float *array);
+static void maketransferplane(engalmod_ctx *ctx, float *plane, float *expofacs);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float findpixelrealrel(Cube cube, int x, int y, int v) 
+  @fn static void multiplytransfer(engalmod_ctx *ctx, fftwf_complex *transformed, float *plane, float *veloarray)
+  @brief Multiply a transformed cube with the gaussian transfer function
 
-  @brief Find relative pixel values in a padded Cube
+  Multiplies the transformed cube with plane[i+newsize*j]*
+  veloarray[|nv|], where nv is the frequency in v belonging to plane
+  k. The cube is processed row by row as a streaming complex-by-real
+  product, no exponentials are evaluated.
 
-  The zero coordinate is array[0]. This function is not safe at all!
+  @param ctx         (engalmod_ctx *)  The context
+  @param transformed (fftwf_complex *) The transformed cube
+  @param plane       (float *)         The xy-part of the transfer function
+  @param veloarray   (float *)         The v-part of the transfer function
 
-  @param array     (float *) The input cube
-  @param x         (int)     relative x coordinate
-  @param y         (int)     relative y coordinate
-  @param v         (int)     relative v coordinate
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void multiplytransfer(engalmod_ctx *ctx, fftwf_complex *transformed, float *plane, float *veloarray);
 
-  @return (success) float findpixelrel: Pixel value
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void splittransfer(engalmod_ctx *ctx)
+  @brief Make the transformed weights map from the transformed model
+
+  In one pass over the transformed model, the transformed model
+  multiplied with the transfer function of the noise is written to
+  transformed_cube_noise, and the transformed model is multiplied with
+  the transfer function of the model in place, see multiplytransfer.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
 */
 /* ------------------------------------------------------------ */
-static float findpixelrealrel(Cube cube, int x, int y, int v);
+static void splittransfer(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float findpixelrealrel(Cube cube, int x, int y, int v) 
+  @fn static float findpixelrealrel(engalmod_ctx *ctx, Cube cube, int x, int y, int v) 
 
   @brief Find relative pixel values in a padded Cube
 
   The zero coordinate is array[0]. This function is not safe at all!
 
+  @param ctx (engalmod_ctx *) The context
   @param array     (float *) The input cube
   @param x         (int)     relative x coordinate
   @param y         (int)     relative y coordinate
@@ -576,13 +1022,13 @@ static float findpixelrealrel(Cube cube, int x, int y, int v);
   @return (success) float findpixelrel: Pixel value
 */
 /* ------------------------------------------------------------ */
-static float findpixelrealrelmod(Cube cube, int x, int y, int v);
+static float findpixelrealrel(engalmod_ctx *ctx, Cube cube, int x, int y, int v);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static float *expofacsfft_here(float sigma_maj, float sigma_min, float *sincosofangle)
+  @fn static float *expofacsfft_here(engalmod_ctx *ctx, float sigma_maj, float sigma_min, float *sincosofangle)
   @brief Calculate static factors needed by convolgaussfft
 
   Returns an allocated array containing factors needed by
@@ -593,6 +1039,7 @@ static float findpixelrealrelmod(Cube cube, int x, int y, int v);
   array that will change and will be added by calling the
   changeexpofacsfft and changeexpofacsfft_noise routines.
 
+  @param ctx (engalmod_ctx *) The context
   @param sigma_maj     (float)   The sigma in direction of the major axis
   @param sigma_min     (float)   The sigma in direction of the minor axis
   @param sincosofangle (float *) An array containing the sin and the cos 
@@ -602,172 +1049,359 @@ static float findpixelrealrelmod(Cube cube, int x, int y, int v);
           (error) NULL
 */
 /* ------------------------------------------------------------ */
-static float *expofacsfft_here(float sigma_maj, float sigma_min, float *sincosofangle);
+static float *expofacsfft_here(engalmod_ctx *ctx, float sigma_maj, float sigma_min, float *sincosofangle);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_here_array(void)
-  @brief Convolve a cube with a gaussian via fft using a predefined array
-
-  In-place convolution of a cube Cube with a gaussian via fft. The
-  convolution is not normalised in the xy-plane but in v. No
-  convolution takes place in v-direction in case of only one
-  plane. See function expofacsfft_here for definition of expofacsfft_
-  array.
+  @fn static void changeexpofacsfft(engalmod_ctx *ctx, float sigma_v)
+  @brief Calculate factors needed by convolgaussfft
+  
+  Changes the expofacsfft_ array containing factors needed by
+  convolgaussfft to convolve an array with a gaussian with sigma at
+  the major axis sigma_major, minor axis sigma_minor, and v-axis
+  sigma_v.
 
-  @param cube        (Cube *)  The cube
+  @param ctx (engalmod_ctx *) The context
+  @param sigma_v (float) The (original) sigma in v-direction
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return (success) void
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_here_array(void);
-/* static void convolgaussfft_here_array_help1(void); */
+static void changeexpofacsfft(engalmod_ctx *ctx, float sigma_v);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_here_single_array(void)
-  @brief Convolve a cube with a gaussian via fft using a predefined array
+  @fn static void fillveloarray(engalmod_ctx *ctx, float sigma_v, float *veloarray)
+  @brief Fill the v-part of the transfer function for the model
 
-  In-place convolution of a cube Cube with a gaussian via fft. The
-  convolution is not normalised in the xy-plane but in v. No
-  convolution takes place in v-direction in case of only one
-  plane. See function expofacsfft_here for definition of expofacsfft_
-  array.
+  Fills the first model.size_v/2+1 elements of veloarray with the
+  gaussian in v with dispersion sigma_v, including the
+  normalisation. Does not change the context.
 
-  @param cube        (Cube *)  The cube
+  @param ctx       (engalmod_ctx *) The context
+  @param sigma_v   (float)          The (original) sigma in v-direction
+  @param veloarray (float *)        The array to fill
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return void
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_here_single_array(void);
+static void fillveloarray(engalmod_ctx *ctx, float sigma_v, float *veloarray);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_noise_array(Cube *cube)
-  @brief Calculation of a weights map from the cube using a predefined array
+  @fn static int makebatch(engalmod_ctx *ctx, int nmodels)
+  @brief Provide plans and buffers for a batch of models
 
-  cube is convolved with a beam of sqrt(1/2) times the sigma of the
-  convolving beam and normalized with a factor
-  2*sqrt(pi)*sigma_v*fluxpoint, where fluxpoint is the flux of one
-  pointsource in galmod. This is not an in-place convolution, but it
-  is safed to noise_.points. Then the noise of the original cube
-  squared is added to noise_.points (more accurately this is done in
-  Fourier-space before backtransformation.) The resulting map is used
-  as a weights map for calculation of the chisquare. See function
-  expofacsfft_noise for definition of expofacsfft_noise_ array.
+  Allocates the stack of nmodels model cubes and creates the fft
+  plans transforming all of them with one call, in place, with the
+  planner flags of the initialisation. Nothing happens if plans for
+  nmodels models exist already.
 
-  @param cube (Cube *)  The (pointsource) cube
+  @param ctx     (engalmod_ctx *) The context
+  @param nmodels (int)            Number of models
 
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return (success) int makebatch: 1\n
+          (error) 0
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_noise_array(void);
-/* static void convolgaussfft_noise_array_help1(void); */
+static int makebatch(engalmod_ctx *ctx, int nmodels);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static Cube *convolgaussfft_noise_single_array(Cube *cube)
-  @brief Calculation of a weights map from the cube using a predefined array
+  @fn static void releasebatch(engalmod_ctx *ctx)
+  @brief Destroy the batch plans and buffers
 
-  cube is convolved with a beam of sqrt(1/2) times the sigma of the
-  convolving beam and normalized with a factor
-  2*sqrt(pi)*sigma_v*fluxpoint, where fluxpoint is the flux of one
-  pointsource in galmod. This is not an in-place convolution, but it
-  is safed to noise_.points. Then the noise of the original cube
-  squared is added to noise_.points (more accurately this is done in
-  Fourier-space before backtransformation.) The resulting map is used
-  as a weights map for calculation of the chisquare. See function
-  expofacsfft_noise for definition of expofacsfft_noise_ array.
+  @param ctx (engalmod_ctx *) The context
 
-  @param cube (Cube *)  The (pointsource) cube
-
-  @return (success) Cube *convolgaussfft_here: The convolved cube\n
-          (error) NULL
+  @return void
 */
 /* ------------------------------------------------------------ */
-static Cube *convolgaussfft_noise_single_array(void);
+static void releasebatch(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static void changeexpofacsfft(float sigma_v)
-  @brief Calculate factors needed by convolgaussfft
-  
-  Changes the expofacsfft_ array containing factors needed by
-  convolgaussfft to convolve an array with a gaussian with sigma at
-  the major axis sigma_major, minor axis sigma_minor, and v-axis
-  sigma_v.
+  @fn static void fetchchisquare_batch(engalmod_ctx *ctx, int nmodels, double *chisquares)
+  @brief Get the unweighted chisquares of the convolved stacked models
 
-  @param sigma_v (float) The (original) sigma in v-direction
+  Goes once through the unflagged pixels of the original and sums up
+  the squared residuals of all nmodels convolved models in the batch
+  stack while the run of the original is in the cache.
 
-  @return (success) void
+  @param ctx        (engalmod_ctx *) The context
+  @param nmodels    (int)            Number of models
+  @param chisquares (double *)       Output, nmodels chisquares
+
+  @return void
 */
 /* ------------------------------------------------------------ */
-static void changeexpofacsfft(float sigma_v);
+static void fetchchisquare_batch(engalmod_ctx *ctx, int nmodels, double *chisquares);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static void changeexpofacsfft_noise(float sigma_v)
-  @brief Calculate factors needed by convolgaussfft_noise
-
-  Changes the expofacsfft_noise_ array containing factors needed by
-  convolgaussfft to convolve an array with a gaussian with sigma at
-  the major axis sigma_major, minor axis sigma_minor, and v-axis
-  sigma_v/sqrt(2). Also, a normalisation is applied, such that the
-  output is scaled by scale*2*sqrt(pi)*sigma_v*fluxpoint.
+  @fn static int initcropped(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
+  @brief Initialisation, on cropped cubes if requested
 
-  @param sigma_maj     (float)   The sigma in direction of the major axis
-  @param sigma_min     (float)   The sigma in direction of the minor axis
-  @param sigma_v       (float)   The sigma in v-direction
-  @param sincosofangle (float *) An array containing the sin and the cos 
-  of the position angle
+  Same as engalmod_ctx_initchisquare, without the resolution pyramid.
 
-  @return (success) float *expofacsfft: The factors wanted\n
-          (error) NULL
+  @return (success) int initcropped: 1\n
+          (error) 0
 */
 /* ------------------------------------------------------------ */
-static void changeexpofacsfft_noise(float sigma_v);
+static int initcropped(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-/** 
-  @fn static float *sincosofangle(float angle)
-  @brief Returns the sin and the cosine of an angle in an 
-  allocated array
+/**
+  @fn static int makepyramid(engalmod_ctx *ctx)
+  @brief Build the coarse levels of the resolution pyramid
 
-  Returns an allocated array containing the cos and the sin of an
-  angle in degrees. The array has to be freed.
+  Level l bins 2^l x 2^l pixels in the xy-plane and 2^l channels (at
+  most all channels) in v. Each level gets its own context,
+  initialised with the binned original and the beam, velocity
+  dispersion halo, and noise scaled to the binned pixels. The
+  pyramid is released on error.
 
-  @param angle (float) Angle in degrees
+  @param ctx (engalmod_ctx *) The context
 
-  @return (success) float *sincosofangle: An array with the sin and 
-  the cos of the angle\n
-          (error) NULL
+  @return (success) int makepyramid: 1\n
+          (error) 0
 */
 /* ------------------------------------------------------------ */
-static float *sincosofangle(float angle);
+static int makepyramid(engalmod_ctx *ctx);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-/** 
-  @fn static float degreetoradian(float degrees)
-  @brief Converts from degrees to radians
+/**
+  @fn static void releasepyramid(engalmod_ctx *ctx)
+  @brief Destroy the coarse levels and return to the full resolution
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void releasepyramid(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void bincube(engalmod_ctx *ctx, pyrlevel *lev, float *full, float *binned, int original)
+  @brief Bin a full-resolution cube into a level of the pyramid
+
+  For the original a binned pixel is the mean of the unflagged
+  pixels, or flagged (nan) if all pixels are flagged. For the model,
+  given in flux per pixel and convolved with a beam with a peak of 1,
+  the pixels are summed up in the xy-plane and averaged in v.
+
+  @param ctx      (engalmod_ctx *) The context
+  @param lev      (pyrlevel *)     The level
+  @param full     (float *)        Full-resolution cube
+  @param binned   (float *)        Output, binned cube
+  @param original (int)            1 for the original, 0 for the model
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void bincube(engalmod_ctx *ctx, pyrlevel *lev, float *full, float *binned, int original);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static double getchisquare_level(engalmod_ctx *ctx, float *model, float sigma_v, int fourier)
+  @brief Chisquare of a model at the current coarse level
+
+  @param ctx     (engalmod_ctx *) The context
+  @param model   (float *)        Full-resolution model
+  @param sigma_v (float)          Velocity dispersion in full-resolution pixels
+  @param fourier (int)            1 to evaluate in Fourier space if possible
+
+  @return double getchisquare_level: The chisquare
+*/
+/* ------------------------------------------------------------ */
+static double getchisquare_level(engalmod_ctx *ctx, float *model, float sigma_v, int fourier);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int makedelta(engalmod_ctx *ctx, float sigma_v)
+  @brief Buffers and kernel for the incremental evaluation
+
+  Allocates the buffers of the incremental evaluation if not yet
+  done and, if the velocity dispersion has changed, makes the
+  kernel. The kernel is the backtransformed transfer function, hence
+  the response of the convolution to a pointsource of flux 1,
+  including the periodicity of the fft. It is separated into the
+  xy-part and the v-part and cut where it drops below DELTACUT of
+  its peak.
+
+  @param ctx     (engalmod_ctx *) The context
+  @param sigma_v (float)          The velocity dispersion
+
+  @return (success) int makedelta: 1\n
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+static int makedelta(engalmod_ctx *ctx, float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void releasedelta(engalmod_ctx *ctx)
+  @brief Free the buffers and the kernel of the incremental evaluation
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void releasedelta(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int growlist(long **list, long *max)
+  @brief Double the length of an offset list
+
+  @param list (long **) The list
+  @param max  (long *)  Allocated length, doubled on success
+
+  @return (success) int growlist: 1\n
+          (error) 0, the list is unchanged
+*/
+/* ------------------------------------------------------------ */
+static int growlist(long **list, long *max);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int convolvedelta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets)
+  @brief Convolve a sparse change of the model with the cut kernel
+
+  Reads the pixels of delta listed in offsets (in the layout of the
+  model array passed at initialisation, repetitions are allowed) and
+  sets them to 0. The change is convolved in v into deltatemp, then
+  in the xy-plane into deltaout, by scattering every touched pixel
+  with the kernel. Pixels outside the crop region are ignored, like
+  in the full evaluation. Stops if the scattering becomes more
+  expensive than a full evaluation.
+
+  @param ctx      (engalmod_ctx *) The context
+  @param delta    (float *)        The change of the model
+  @param offsets  (long *)         Offsets of the changed pixels
+  @param noffsets (long)           Number of offsets
+
+  @return (success) int convolvedelta: 1, deltaout and deltaolist are filled\n
+          (error) 0, deltatemp, deltaout, and deltamask are cleared
+*/
+/* ------------------------------------------------------------ */
+static int convolvedelta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static double applydelta(engalmod_ctx *ctx)
+  @brief Add the convolved change to the model and sum up the change of the chisquare
+
+  Goes through the pixels listed in deltaolist, adds the change to
+  the model (and to the full model if cropped), and returns the
+  change of the sum of the weighted squared residuals, not yet
+  normalised like the chisquare. Clears deltaout and deltamask.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return double applydelta: Change of the sum of squared residuals
+*/
+/* ------------------------------------------------------------ */
+static double applydelta(engalmod_ctx *ctx);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void addbackground(engalmod_ctx *ctx, fftwf_complex *transformed)
+  @brief Add the transformed background to a transformed model
+
+  @param ctx         (engalmod_ctx *)  The context
+  @param transformed (fftwf_complex *) Transformed model
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void addbackground(engalmod_ctx *ctx, fftwf_complex *transformed);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void changeexpofacsfft_noise(engalmod_ctx *ctx, float sigma_v)
+  @brief Calculate factors needed by convolgaussfft_both
+
+  Changes the expofacsfft_noise_ array containing factors needed by
+  convolgaussfft to convolve an array with a gaussian with sigma at
+  the major axis sigma_major, minor axis sigma_minor, and v-axis
+  sigma_v/sqrt(2). Also, a normalisation is applied, such that the
+  output is scaled by scale*2*sqrt(pi)*sigma_v*fluxpoint.
+
+  @param ctx (engalmod_ctx *) The context
+  @param sigma_maj     (float)   The sigma in direction of the major axis
+  @param sigma_min     (float)   The sigma in direction of the minor axis
+  @param sigma_v       (float)   The sigma in v-direction
+  @param sincosofangle (float *) An array containing the sin and the cos 
+  of the position angle
+
+  @return (success) float *expofacsfft: The factors wanted\n
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+static void changeexpofacsfft_noise(engalmod_ctx *ctx, float sigma_v);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/** 
+  @fn static float *sincosofangle(float angle)
+  @brief Returns the sin and the cosine of an angle in an 
+  allocated array
+
+  Returns an allocated array containing the cos and the sin of an
+  angle in degrees. The array has to be freed.
+
+  @param angle (float) Angle in degrees
+
+  @return (success) float *sincosofangle: An array with the sin and 
+  the cos of the angle\n
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+static float *sincosofangle(float angle);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/** 
+  @fn static float degreetoradian(float degrees)
+  @brief Converts from degrees to radians
 
   Changes a number from deg to rad
 
@@ -782,7 +1416,7 @@ static float degreetoradian(float degrees);
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /** 
-   @fn static int initchisquare((float *arrayorig, float *arraymodel, int
+   @fn static int initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int
   *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float
   *scale, float *flux, float *sigma, int *mode, int *arrayvsize,
   double *chisquare, float *noiseweight, int *inimode, int *threads)
@@ -821,11 +1455,12 @@ static float degreetoradian(float degrees);
   weightmap is calculated from the model, that is then used to weight
   the chisquare.
 
-  Bit 1: If set (bit1 = 1), memory will be allocated for one or two
-  arrays within which precalculated factors are stored that otherways
-  at time of chisquare calculation will be repeatedly
-  recalculated. Saves some time. If unset (bit1 = 0) this optimisation
-  will not take place, saving memory.
+  Bit 1: Ignored. Formerly switched the precalculation of the
+  gaussian transfer function in the xy-plane on. This plane of
+  (*x/2+1)**y floats (two with bit 0 set) is now always allocated and
+  filled once at initialisation, as it is small compared to the
+  cubes. The part of the transfer function in v is recalculated when
+  the velocity dispersion changes.
 
   Bit 2: If set (bit2 = 0), memory will be allocated for out-of-place
   ffts instead of the in-place ffts used for the convolution. fftw can
@@ -837,14 +1472,10 @@ static float degreetoradian(float degrees);
   return 0 if the memory allocations cannot be made. The additionally
   required memory (not counting the passed arrays) is a bit more than:
 
-  mode = 0: sizeof(float)* [ 0 ]
-  mode = 1: sizeof(float)* [ (*x/2)*2+2)**y**v ]
-  mode = 2: sizeof(float)* [ (*x/2+1)**y ]
-  mode = 3: sizeof(float)* [ (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
-  mode = 4: sizeof(float)* [ (*x/2)*2+2)**y**v ]
-  mode = 5: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v ]
-  mode = 6: sizeof(float)* [ (*x/2)*2+2)**y**v + (*x/2+1)**y ]
-  mode = 7: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
+  mode = 0, 2: sizeof(float)* [ (*x/2+1)**y ]
+  mode = 1, 3: sizeof(float)* [ (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
+  mode = 4, 6: sizeof(float)* [ (*x/2)*2+2)**y**v + (*x/2+1)**y ]
+  mode = 5, 7: sizeof(float)* [ 3 * (*x/2)*2+2)**y**v + 2 * (*x/2+1)**y ]
   
   The chisquare evaluation goes as follows (logically, internal
   calculation goes a slightly different path):
@@ -877,11 +1508,6 @@ static float degreetoradian(float degrees);
   and inverse noisemap n by chisquare = sum_x_y_v
   (o(x,y,v)-m(x,y,v))^2/n(x,y,v)
 
-  A value of mode of 2 or 3 means that the module needs a bit more
-  memory, but will be slightly faster, as some factors for the
-  evaluation of the chisquare are precalculated and stored in the
-  memory.
-
   The chisquare parameter passes the pointer to the variable that
   contains the chisquare.
 
@@ -900,6 +1526,7 @@ static float degreetoradian(float degrees);
   get the shortest fft, which maybe pays if a long time is spend
   calculating again and again the chisquare.
   
+  @param ctx (engalmod_ctx *) The context
   @param arrayorig  (*float)    Array corresponding to the original cube
   @param arraymodel (*float)    Array corresponding to the model (pointsource) cube
   @param x          (int *)     Size of logical array in x (that is regarded in calculation)
@@ -922,80 +1549,173 @@ static float degreetoradian(float degrees);
           (error) 0
 */
 /* ------------------------------------------------------------ */
-static int initchisquare(float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads);
+static int initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads);
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-/* FUNCTION CODE */
+/**
+  @fn static void releasectx(engalmod_ctx *ctx)
+  @brief Free all memory and plans owned by a context
+
+  Frees everything that has been allocated by initchisquare for the
+  context ctx and resets the pointers, such that the context can be
+  initialised again. The original and the model arrays are owned by
+  the caller and are not freed.
+
+  @param ctx (engalmod_ctx *) The context
+
+  @return void
+*/
 /* ------------------------------------------------------------ */
+static void releasectx(engalmod_ctx *ctx);
+
+
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static char *wisdomname(int x, int y, int v, int arrayvsize, int threads, int flags, int mode)
+  @brief Construct the name of the wisdom file for a cube geometry
+
+  Returns an allocated string wisdomfile_.XxYxV.pP.tT.fF.mM, where X,
+  Y, V are the logical dimensions, P the physical size in v, T the
+  number of threads, F the planner flags, and M the memory mode,
+  which determines in-place or out-of-place transforms. Plans for
+  different keys never end up in the same file. Must be called in
+  the critical section engalmod_fftw.
+
+  @param x          (int) Logical size in x
+  @param y          (int) Logical size in y
+  @param v          (int) Logical size in v
+  @param arrayvsize (int) Physical size in v
+  @param threads    (int) Number of threads
+  @param flags      (int) fftw planner flags
+  @param mode       (int) Memory mode
+
+  @return (success) char *wisdomname: Allocated file name\n
+          (error) NULL
+*/
+/* ------------------------------------------------------------ */
+static char *wisdomname(int x, int y, int v, int arrayvsize, int threads, int flags, int mode);
+
 
-/* Initialisation from external, the sense of this function is to make the module robust to changes from external, i.e., the function expects pointers, because that is what you get when you call c from fortran. Inernally these should be protected, i.e. local static variables are created that are pointed to */
-int initchisquare_(float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads)
-{
-  static int xm, ym, vm; 
-  static float hpbwmajm, hpbwminm, pam, scalem, fluxm, sigmam; 
-  static int modem, arrayvsizem; 
-  static float noiseweightm; 
-  static int inimodem;
-  static int threadsm;
 
-  xm = *x;
-  ym = *y;
-  vm = *v;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int importwisdom(const char *filename)
+  @brief Import fftw wisdom from a file, holding a shared lock
 
-  hpbwmajm = *hpbwmaj;
-  hpbwminm = *hpbwmin;
-  pam = *pa;
-  scalem = *scale;
-  fluxm = *flux;
-  sigmam = *sigma;
+  A missing file is not an error. Must be called in the critical
+  section engalmod_fftw.
 
-  modem =  *mode;
-  arrayvsizem = *arrayvsize;
-  noiseweightm = *noiseweight; 
-  inimodem = *inimode;
-  threadsm = *threads;
+  @param filename (const char *) Name of the wisdom file
 
-  return initchisquare(arrayorig, arraymodel, &xm, &ym, &vm, &hpbwmajm, &hpbwminm, &pam, &scalem, &fluxm, &sigmam, &modem, &arrayvsizem, chisquare, &noiseweightm, &inimodem, &threadsm);
-}
+  @return (success) int importwisdom: 1 if wisdom was read, 0 if not
+*/
+/* ------------------------------------------------------------ */
+static int importwisdom(const char *filename);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int exportwisdom(const char *filename)
+  @brief Export fftw wisdom to a file, holding an exclusive lock
+
+  Wisdom that another process has written to the file since it has
+  been imported is merged before the file is rewritten. Must be called
+  in the critical section engalmod_fftw.
+
+  @param filename (const char *) Name of the wisdom file
+
+  @return (success) int exportwisdom: 1
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+static int exportwisdom(const char *filename);
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void firsttouch(float *array, float *source, long rowlength, long nrows, int threads)
+  @brief Write the rows of an array for the first time, in parallel
+
+  The rows are distributed over the threads with the same static
+  schedule as the chisquare and the multiplication with the transfer
+  function, such that each page lands on the NUMA node of the thread
+  that works on it later. Each row is copied from source if source is
+  not NULL, otherwise it is set to 0. A complex row of a transformed
+  cube has the same length in floats as a padded real row.
+
+  @param array     (float *) Array to touch
+  @param source    (float *) Array to copy from or NULL
+  @param rowlength (long)    Length of a row in floats
+  @param nrows     (long)    Number of rows
+  @param threads   (int)     Number of threads
+
+  @return void
+*/
 /* ------------------------------------------------------------ */
+static void firsttouch(float *array, float *source, long rowlength, long nrows, int threads);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int interleave(void *array, size_t size)
+  @brief Interleave the pages of an array over all allowed NUMA nodes
 
-/* Initialisation from external, the sense of this function is to make the module robust to changes from external, i.e., the function expects pointers, because that is what you get when you call c from fortran. Inernally these should be protected, i.e. local static variables are created that are pointed to */
-int initchisquare_c(float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
-{
-  static int xm, ym, vm; 
-  static float hpbwmajm, hpbwminm, pam, scalem, fluxm, sigmam; 
-  static int modem, arrayvsizem; 
-  static float noiseweightm; 
-  static int inimodem;
-  static int threadsm;
+  Must be called before the array is touched. Only the pages entirely
+  inside the array are affected. Does nothing if the memory policy
+  cannot be set.
+
+  @param array (void *) Array
+  @param size  (size_t) Size of the array in bytes
+
+  @return (success) int interleave: 1
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+static int interleave(void *array, size_t size);
+
+
+
+#if defined(LINUX) && defined(SYS_getcpu)
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int placeme(engalmod_ctx *ctx, void *array, long nrows, int *rownode, long *pages, long *local, unsigned long *nodemask)
+  @brief Query the NUMA nodes of the pages of an array
+
+  Up to NUMASAMPLE pages evenly distributed over the array are
+  queried. A page is local if it is on the node of the thread that
+  works on its first row.
+
+  @param ctx      (engalmod_ctx *)  The context
+  @param array    (void *)          Array with rows of length realmodelsizex
+  @param nrows    (long)            Number of rows
+  @param rownode  (int *)           Node of the thread working on a row, per row
+  @param pages    (long *)          Incremented by the number of pages found
+  @param local    (long *)          Incremented by the number of local pages
+  @param nodemask (unsigned long *) Nodes holding pages are set, NUMAMASK long
+
+  @return (success) int placeme: 1
+          (error) 0
+*/
+/* ------------------------------------------------------------ */
+static int placeme(engalmod_ctx *ctx, void *array, long nrows, int *rownode, long *pages, long *local, unsigned long *nodemask);
+#endif
 
-  xm = x;
-  ym = y;
-  vm = v;
 
-  hpbwmajm = hpbwmaj;
-  hpbwminm = hpbwmin;
-  pam = pa;
-  scalem = scale;
-  fluxm = flux;
-  sigmam = sigma;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* FUNCTION CODE */
+/* ------------------------------------------------------------ */
 
-  modem =  mode;
-  arrayvsizem = arrayvsize;
-  noiseweightm = noiseweight; 
-  inimodem = inimode;
-  threadsm = threads;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  return initchisquare(arrayorig, arraymodel, &xm, &ym, &vm, &hpbwmajm, &hpbwminm, &pam, &scalem, &fluxm, &sigmam, &modem, &arrayvsizem, chisquare, &noiseweightm, &inimodem, &threadsm);
+/* Initialisation from external, the sense of this function is to make the module robust to changes from external, i.e., the function expects pointers, because that is what you get when you call c from fortran. Inernally these should be protected, i.e. local copies are created that are pointed to */
+int initchisquare_(float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads)
+{
+  return engalmod_ctx_initchisquare(&default_ctx_, arrayorig, arraymodel, *x, *y, *v, *hpbwmaj, *hpbwmin, *pa, *scale, *flux, *sigma, *mode, *arrayvsize, chisquare, *noiseweight, *inimode, *threads);
 }
 
 
@@ -1005,493 +1725,2362 @@ int initchisquare_c(float *arrayorig, float *arraymodel, int x, int y, int v, fl
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Initialisation */
+/* Initialisation of the default context */
+int initchisquare_c(float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
+{
+  return engalmod_ctx_initchisquare(&default_ctx_, arrayorig, arraymodel, x, y, v, hpbwmaj, hpbwmin, pa, scale, flux, sigma, mode, arrayvsize, chisquare, noiseweight, inimode, threads);
+}
+
 
-int initchisquare(float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads)
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Initialisation of a context, local copies are made of everything passed */
+int engalmod_ctx_initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
 {
-  float *sincosofangle_;
-  int physical[3];
-  int physical2[3];
-  int logical[3];
-  int physicaln[3];
-  int inimodel;
-  static char usedonce = 0;
+  if (!ctx)
+    return 0;
+
+  releasepyramid(ctx);
+  ctx -> pyrorig = NULL;
+
+  if (!initcropped(ctx, arrayorig, arraymodel, x, y, v, hpbwmaj, hpbwmin, pa, scale, flux, sigma, mode, arrayvsize, chisquare, noiseweight, inimode, threads))
+    return 0;
+
+  ctx -> pyrorig = arrayorig;
+  ctx -> pyrmodel = arraymodel;
+  ctx -> pyrsize[0] = x;
+  ctx -> pyrsize[1] = y;
+  ctx -> pyrsize[2] = v;
+  ctx -> pyrthreads = threads;
+  ctx -> pyrinit.hpbwmaj = hpbwmaj;
+  ctx -> pyrinit.hpbwmin = hpbwmin;
+  ctx -> pyrinit.pa = pa;
+  ctx -> pyrinit.scale = scale;
+  ctx -> pyrinit.flux = flux;
+  ctx -> pyrinit.sigma = sigma;
+  ctx -> pyrinit.mode = mode;
+  ctx -> pyrinit.arrayvsize = arrayvsize;
+  ctx -> pyrinit.noiseweight = noiseweight;
+  ctx -> pyrinit.inimode = inimode;
+
+  /* The pyramid is an option, without it everything is evaluated at full resolution */
+  if (ctx -> pyrlevels > 1)
+    makepyramid(ctx);
 
-  /* hyper */
-#ifdef OPENMPFFT
-  fftwf_init_threads();
-#endif
+  return 1;
+}
 
-  if ((usedonce)) {
-    if ((noise_.points))
-      fftwf_free(noise_.points);
-    if ((transformed_cube_noise_))
-      fftwf_free(transformed_cube_noise_);
-    if ((transformed_cube_model_))
-      fftwf_free(transformed_cube_model_);
-    if ((expcube_model_.points))
-      fftwf_free(expcube_model_.points);
-    if ((expcube_noise_.points))
-      fftwf_free(expcube_noise_.points);
-    if ((expofacsfft_))
-      free(expofacsfft_);
-    if ((expofacsfft_noise_))
-      free(expofacsfft_noise_);
-    if ((veloarray_))
-      fftwf_free(veloarray_);
-     if ((veloarray_noise_))
-      fftwf_free(veloarray_noise_);
- }
-
-  noise_.points = NULL;
-  transformed_cube_noise_ = NULL;
-  transformed_cube_model_ = NULL;
-  expcube_model_.points = NULL;
-  expcube_noise_.points = NULL;
-  expofacsfft_ = NULL;
-  expofacsfft_noise_ = NULL;
-  veloarray_ = NULL;
-  veloarray_noise_ = NULL;
-
-  oldsigma_ = -1;
-
-  threads_ = *threads;
-  vector_ = (double *) malloc(threads_*sizeof(double));
 
-  /* set number of threads */
-#ifdef OPENMPTIR
-  omp_set_num_threads(threads_);
-#endif
+/* ------------------------------------------------------------ */
 
-  /* put the chisquare in its place */
-  chisquare_ = chisquare;
 
-/* Get the array of the original */
-  original_.points = arrayorig;
-/* Get the array of the model */
-  model_.points = arraymodel;
 
-  realorigsizex_ = 2*(*x/2+1);
-/* 2*(*x/2+1); */
-realorigsizey_ = *y;
-realmodelsizex_ = 2*(*x/2+1);
-realmodelsizey_ = *y;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  /* Allocate memory for the noisecube if the noise per pixel is required in future */
-  if ((*mode & 1)) {
-    if (!((noise_.points) = (float *) fftwf_malloc(((*x/2)*2+2)**y**v*sizeof(float))))
-      goto error;
+/* Initialisation, on cropped cubes if requested */
+static int initcropped(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int x, int y, int v, float hpbwmaj, float hpbwmin, float pa, float scale, float flux, float sigma, int mode, int arrayvsize, double *chisquare, float noiseweight, int inimode, int threads)
+{
+  int start[3];
+  int size[3];
+  int cropvsize;
 
-    /* There might be a chance that things work faster with an out-of-place trafo on the expense of double the memory usage */
-    if (*mode & 4) {
-      if (!(transformed_cube_noise_ = (fftwf_complex *) fftwf_malloc((*x/2+1)**y**v*sizeof(fftwf_complex)))) {
-	fftwf_free(noise_.points);
-	goto error;
-      }
-    }
+  releasectx(ctx);
+  releasecrop(ctx);
+
+  /* Cropping is an option, if it does not help or the memory is missing the full cubes are used */
+  if (!(ctx -> autocrop) || !findcrop(ctx, arrayorig, x, y, v, hpbwmaj, start, size))
+    return initchisquare(ctx, arrayorig, arraymodel, &x, &y, &v, &hpbwmaj, &hpbwmin, &pa, &scale, &flux, &sigma, &mode, &arrayvsize, chisquare, &noiseweight, &inimode, &threads);
+
+  if (!(ctx -> croporig = (float *) fftwf_malloc(2*(size[0]/2+1)*size[1]*size[2]*sizeof(float))) || !(ctx -> cropmodel = (float *) fftwf_malloc(2*(size[0]/2+1)*size[1]*size[2]*sizeof(float)))) {
+    releasecrop(ctx);
+    return initchisquare(ctx, arrayorig, arraymodel, &x, &y, &v, &hpbwmaj, &hpbwmin, &pa, &scale, &flux, &sigma, &mode, &arrayvsize, chisquare, &noiseweight, &inimode, &threads);
   }
-  else 
-    noise_.points = NULL;
 
-    /* There might be a chance that things work faster with an out-of-place trafo on the expense of double the memory usage */
-  if (*mode & 4) {
-    if (!(transformed_cube_model_ = (fftwf_complex *) fftwf_malloc((*x/2+1)**y**v*sizeof(fftwf_complex)))) {
-      if (*mode & 1) {
-	fftwf_free(noise_.points);
-	fftwf_free(transformed_cube_noise_);
-	goto error;
-      }
-    }
+  if ((ctx -> numa)) {
+    firsttouch(ctx -> croporig, NULL, 2*(size[0]/2+1), ((long) size[1])*size[2], threads);
+    firsttouch(ctx -> cropmodel, NULL, 2*(size[0]/2+1), ((long) size[1])*size[2], threads);
   }
 
-    /* Allocate memory for the expcubes if they are required in future */
-  if ((*mode & 2)) {
-    if (!((expcube_model_.points) = (float *) fftwf_malloc((*x/2+1)**y*sizeof(float)))) {
-      if ((*mode & 1)) 
-	fftwf_free(noise_.points);
-      if ((*mode & 4)) {
-	if ((*mode & 1))
-	fftwf_free(transformed_cube_noise_);
-	fftwf_free(transformed_cube_model_);
-      }
-      goto error;
-    }
-    expcube_model_.size_x = *x/2+1;
-    expcube_model_.size_y = *y;
-    expcube_model_.size_v = 1;
-    expcube_model_.padding = 0;
-    if ((*mode & 1)) {
-      if (!((expcube_noise_.points) = (float *) fftwf_malloc((*x/2+1)**y*sizeof(float)))) {
-	if ((*mode & 1))
-	  fftwf_free(noise_.points);
-	fftwf_free(expcube_model_.points);
-      if ((*mode & 4)) {
-	if ((*mode & 1))
-	fftwf_free(transformed_cube_noise_);
-	fftwf_free(transformed_cube_model_);
-      }
-	goto error;
-      }
-    }
-    else
-      expcube_noise_.points = NULL;
-    /* This info is warranted */
-      expcube_noise_.size_x = *x/2+1;
-      expcube_noise_.size_y = *y;
-      expcube_noise_.size_v = 1;
-      expcube_noise_.padding = 0;
-    expcube_noise_.refpix_x = expcube_noise_.refpix_y = expcube_noise_.refpix_v = expcube_model_.refpix_x = expcube_model_.refpix_y = expcube_model_.refpix_v = 0;
+  ctx -> fullorig = arrayorig;
+  ctx -> fullmodel = arraymodel;
+  ctx -> fullsize[0] = x;
+  ctx -> fullsize[1] = y;
+  ctx -> fullsize[2] = v;
+  ctx -> cropstart[0] = start[0];
+  ctx -> cropstart[1] = start[1];
+  ctx -> cropstart[2] = start[2];
+  ctx -> cropsize[0] = size[0];
+  ctx -> cropsize[1] = size[1];
+  ctx -> cropsize[2] = size[2];
+
+  ctx -> cropinit.hpbwmaj = hpbwmaj;
+  ctx -> cropinit.hpbwmin = hpbwmin;
+  ctx -> cropinit.pa = pa;
+  ctx -> cropinit.scale = scale;
+  ctx -> cropinit.flux = flux;
+  ctx -> cropinit.sigma = sigma;
+  ctx -> cropinit.mode = mode;
+  ctx -> cropinit.arrayvsize = arrayvsize;
+  ctx -> cropinit.noiseweight = noiseweight;
+  ctx -> cropinit.inimode = inimode;
+
+  cropcube(ctx, arrayorig, ctx -> croporig, 0);
+
+  /* The cropped cubes have no extra planes in v */
+  cropvsize = size[2];
+  if (!initchisquare(ctx, ctx -> croporig, ctx -> cropmodel, size, size+1, size+2, &hpbwmaj, &hpbwmin, &pa, &scale, &flux, &sigma, &mode, &cropvsize, chisquare, &noiseweight, &inimode, &threads)) {
+    releasecrop(ctx);
+    return 0;
   }
-  else 
-    expcube_model_.points = expcube_noise_.points = NULL;
 
-  /* Now get the sizes right */
-  original_.size_x = model_.size_x = noise_.size_x = *x;
-  original_.size_y = model_.size_y = noise_.size_y = *y;
-  original_.size_v = model_.size_v = noise_.size_v = *v;
+  ctx -> cropped = 1;
+  return 1;
+}
 
-  original_.refpix_x = model_.refpix_x  = noise_.refpix_x  = 0;
-  original_.refpix_y = model_.refpix_y  = noise_.refpix_y  = 0;
-  original_.refpix_v = model_.refpix_v  = noise_.refpix_v  = 0;
 
-  /* We don't need the reference pixel, but the padding */
-  original_.padding = model_.padding = noise_.padding = (*x/2)*2+2-*x;
+/* ------------------------------------------------------------ */
 
-  /* The scale */
-  original_.scale = *scale;
-  model_.scale = *flux;
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Create a context */
+engalmod_ctx *engalmod_ctx_create(void)
+{
+  engalmod_ctx *ctx;
+
+  if (!(ctx = (engalmod_ctx *) malloc(sizeof(engalmod_ctx))))
+    return NULL;
+
+  *ctx = default_ctx_null_;
+  return ctx;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Destroy a context */
+void engalmod_ctx_destroy(engalmod_ctx *ctx)
+{
+  if (!ctx)
+    return;
+
+  releasepyramid(ctx);
+  releasectx(ctx);
+  releasecrop(ctx);
+  free(ctx);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Switch on cropping for the default context */
+void engalmod_autocrop(float sigma_v)
+{
+  engalmod_ctx_autocrop(&default_ctx_, sigma_v);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Switch on cropping */
+void engalmod_ctx_autocrop(engalmod_ctx *ctx, float sigma_v)
+{
+  if (!ctx)
+    return;
+
+  ctx -> autocrop = sigma_v >= 0.0;
+  ctx -> cropsigma_v = sigma_v;
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* NUMA placement for the default context */
+void engalmod_numa(int mode)
+{
+  engalmod_ctx_numa(&default_ctx_, mode);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* NUMA placement */
+void engalmod_ctx_numa(engalmod_ctx *ctx, int mode)
+{
+  if (!ctx)
+    return;
+
+  ctx -> numa = (mode < 0) ? 0 : ((mode > 2) ? 2 : mode);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Weight map refresh schedule for the default context */
+void engalmod_noiseupdate(int ncalls)
+{
+  engalmod_ctx_noiseupdate(&default_ctx_, ncalls);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Weight map refresh schedule */
+void engalmod_ctx_noiseupdate(engalmod_ctx *ctx, int ncalls)
+{
+  int l;
+
+  if (!ctx)
+    return;
+
+  ctx -> noiseupdate = ncalls;
+  for (l = 0; l < ctx -> npyramid; ++l)
+    engalmod_ctx_noiseupdate(ctx -> pyramid[l].ctx, ncalls);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Refresh the weight map of the default context at the next evaluation */
+void engalmod_refreshnoise(void)
+{
+  engalmod_ctx_refreshnoise(&default_ctx_);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Refresh the weight map at the next evaluation */
+void engalmod_ctx_refreshnoise(engalmod_ctx *ctx)
+{
+  int l;
+
+  if (!ctx)
+    return;
+
+  ctx -> noisevalid = 0;
+  for (l = 0; l < ctx -> npyramid; ++l)
+    engalmod_ctx_refreshnoise(ctx -> pyramid[l].ctx);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Resolution pyramid for the default context */
+int engalmod_multires(int nlevels)
+{
+  return engalmod_ctx_multires(&default_ctx_, nlevels);
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Resolution pyramid */
+int engalmod_ctx_multires(engalmod_ctx *ctx, int nlevels)
+{
+  if (!ctx)
+    return 0;
+
+  ctx -> pyrlevels = (nlevels > 1) ? nlevels : 1;
+
+  /* Built now if initialised, otherwise at initialisation */
+  releasepyramid(ctx);
+  if ((ctx -> pyrorig) && ctx -> pyrlevels > 1 && !makepyramid(ctx))
+    return 0;
+
+  return 1;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Select the resolution level of the default context */
+int engalmod_level(int level)
+{
+  return engalmod_ctx_level(&default_ctx_, level);
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Select the resolution level */
+int engalmod_ctx_level(engalmod_ctx *ctx, int level)
+{
+  if (!ctx || level < 0 || level > ctx -> npyramid)
+    return 0;
+
+  /* Coarse levels do not convolve the model array and know no background */
+  ctx -> level = level;
+  ctx -> deltavalid = 0;
+
+  if (!level)
+    return 1;
+
+  engalmod_ctx_background(ctx, 0);
+
+  return ctx -> pyramid[level-1].bin[0]*ctx -> pyramid[level-1].bin[1]*ctx -> pyramid[level-1].bin[2];
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Incremental evaluation schedule for the default context */
+void engalmod_deltaupdate(int ncalls)
+{
+  engalmod_ctx_deltaupdate(&default_ctx_, ncalls);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Incremental evaluation schedule */
+void engalmod_ctx_deltaupdate(engalmod_ctx *ctx, int ncalls)
+{
+  if (!ctx)
+    return;
+
+  ctx -> deltaupdate = (ncalls > 0) ? ncalls : 0;
+  if (!(ctx -> deltaupdate))
+    releasedelta(ctx);
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Set or drop the background of the default context */
+int engalmod_background(int set)
+{
+  return engalmod_ctx_background(&default_ctx_, set);
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Set or drop the background */
+int engalmod_ctx_background(engalmod_ctx *ctx, int set)
+{
+  long size;
+
+  if (!ctx)
+    return 0;
+
+  if (!set) {
+    if ((ctx -> background))
+      fftwf_free(ctx -> background);
+    ctx -> background = NULL;
+    return 1;
+  }
+
+  if (!(ctx -> plan_model) || (ctx -> level))
+    return 0;
+
+  size = ((long) ctx -> newsize)*ctx -> model.size_y*ctx -> model.size_v;
+  if (!(ctx -> background) && !(ctx -> background = (fftwf_complex *) fftwf_malloc(size*sizeof(fftwf_complex))))
+    return 0;
+
+  /* The transform of the model array without background */
+  if ((ctx -> cropped))
+    cropcube(ctx, ctx -> fullmodel, ctx -> cropmodel, 0);
+  fftwf_execute(ctx -> plan_model);
+  memcpy(ctx -> background, ctx -> transformed_cube_model, size*sizeof(fftwf_complex));
+  ctx -> deltavalid = 0;
+
+  return 1;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Is there a background in the default context */
+int engalmod_hasbackground(void)
+{
+  return engalmod_ctx_hasbackground(&default_ctx_);
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Is there a background */
+int engalmod_ctx_hasbackground(engalmod_ctx *ctx)
+{
+  return (ctx) && (ctx -> background);
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Build the coarse levels of the resolution pyramid */
+static int makepyramid(engalmod_ctx *ctx)
+{
+  int l, i, npix;
+  pyrlevel *lev;
+
+  releasepyramid(ctx);
+
+  if (ctx -> pyrlevels < 2 || !(ctx -> pyrorig))
+    return 0;
+
+  if (!(ctx -> pyramid = (pyrlevel *) calloc(ctx -> pyrlevels-1, sizeof(pyrlevel))))
+    return 0;
+  ctx -> npyramid = ctx -> pyrlevels-1;
+
+  for (l = 1; l < ctx -> pyrlevels; ++l) {
+    lev = ctx -> pyramid+l-1;
+
+    lev -> bin[0] = lev -> bin[1] = 1 << l;
+    lev -> bin[2] = (lev -> bin[0] < ctx -> pyrsize[2]) ? lev -> bin[0] : ctx -> pyrsize[2];
+    for (i = 0; i < 3; ++i)
+      lev -> size[i] = (ctx -> pyrsize[i]+lev -> bin[i]-1)/lev -> bin[i];
+    npix = lev -> bin[0]*lev -> bin[1]*lev -> bin[2];
+
+    if (!(lev -> ctx = engalmod_ctx_create()))
+      goto error;
+    if (!(lev -> orig = (float *) fftwf_malloc(2*(lev -> size[0]/2+1)*lev -> size[1]*lev -> size[2]*sizeof(float))))
+      goto error;
+    if (!(lev -> model = (float *) fftwf_malloc(2*(lev -> size[0]/2+1)*lev -> size[1]*lev -> size[2]*sizeof(float))))
+      goto error;
+
+    if ((ctx -> autocrop))
+      engalmod_ctx_autocrop(lev -> ctx, ctx -> cropsigma_v/lev -> bin[2]);
+    engalmod_ctx_noiseupdate(lev -> ctx, ctx -> noiseupdate);
+    engalmod_ctx_numa(lev -> ctx, ctx -> numa);
+    if ((ctx -> numa)) {
+      firsttouch(lev -> orig, NULL, 2*(lev -> size[0]/2+1), ((long) lev -> size[1])*lev -> size[2], ctx -> pyrthreads);
+      firsttouch(lev -> model, NULL, 2*(lev -> size[0]/2+1), ((long) lev -> size[1])*lev -> size[2], ctx -> pyrthreads);
+    }
+
+    bincube(ctx, lev, ctx -> pyrorig, lev -> orig, 1);
+
+    /* The noise of a binned pixel is lower, a pointsource carries the flux of npix pointsources. No weight map, with the narrow binned gaussians it would have negative sidelobes */
+    if (!engalmod_ctx_initchisquare(lev -> ctx, lev -> orig, lev -> model, lev -> size[0], lev -> size[1], lev -> size[2], ctx -> pyrinit.hpbwmaj/lev -> bin[0], ctx -> pyrinit.hpbwmin/lev -> bin[0], ctx -> pyrinit.pa, ctx -> pyrinit.scale, ctx -> pyrinit.flux*npix, ctx -> pyrinit.sigma/sqrtf((float) npix), ctx -> pyrinit.mode & ~1, lev -> size[2], NULL, ctx -> pyrinit.noiseweight, ctx -> pyrinit.inimode, ctx -> pyrthreads))
+      goto error;
+  }
+
+  return 1;
+
+ error:
+  releasepyramid(ctx);
+  return 0;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Destroy the coarse levels */
+static void releasepyramid(engalmod_ctx *ctx)
+{
+  int l;
+
+  for (l = 0; l < ctx -> npyramid; ++l) {
+    if ((ctx -> pyramid[l].ctx))
+      engalmod_ctx_destroy(ctx -> pyramid[l].ctx);
+    if ((ctx -> pyramid[l].orig))
+      fftwf_free(ctx -> pyramid[l].orig);
+    if ((ctx -> pyramid[l].model))
+      fftwf_free(ctx -> pyramid[l].model);
+  }
+  if ((ctx -> pyramid))
+    free(ctx -> pyramid);
+
+  ctx -> pyramid = NULL;
+  ctx -> npyramid = 0;
+  ctx -> level = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Bin a cube into a level of the pyramid */
+static void bincube(engalmod_ctx *ctx, pyrlevel *lev, float *full, float *binned, int original)
+{
+  long l, nrows;
+  int i, j, k, ii, jj, kk, n, nv;
+  int fullx, binx;
+  float value;
+  double sum;
+
+  fullx = 2*(ctx -> pyrsize[0]/2+1);
+  binx = 2*(lev -> size[0]/2+1);
+  nrows = ((long) lev -> size[1])*lev -> size[2];
+
+#ifdef OPENMPTIR
+#pragma omp parallel for private(i, j, k, ii, jj, kk, n, nv, value, sum) schedule(static) num_threads(ctx -> pyrthreads)
+#endif
+  for (l = 0; l < nrows; ++l) {
+    j = l % lev -> size[1];
+    k = l / lev -> size[1];
+    for (i = 0; i < lev -> size[0]; ++i) {
+      sum = 0.0;
+      n = nv = 0;
+      for (kk = k*lev -> bin[2]; kk < (k+1)*lev -> bin[2] && kk < ctx -> pyrsize[2]; ++kk) {
+	++nv;
+	for (jj = j*lev -> bin[1]; jj < (j+1)*lev -> bin[1] && jj < ctx -> pyrsize[1]; ++jj) {
+	  for (ii = i*lev -> bin[0]; ii < (i+1)*lev -> bin[0] && ii < ctx -> pyrsize[0]; ++ii) {
+	    value = full[ii+fullx*(jj+(long) ctx -> pyrsize[1]*kk)];
+
+	    /* A nan compared with itself is false */
+	    if (!original || value == value) {
+	      sum += value;
+	      ++n;
+	    }
+	  }
+	}
+      }
+      if ((original))
+	binned[i+binx*l] = (n) ? (float) (sum/n) : NAN;
+      else
+	binned[i+binx*l] = (float) (sum/nv);
+    }
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquare of a model at the current coarse level */
+static double getchisquare_level(engalmod_ctx *ctx, float *model, float sigma_v, int fourier)
+{
+  pyrlevel *lev;
+  double chisquare;
+
+  lev = ctx -> pyramid+ctx -> level-1;
+  bincube(ctx, lev, model, lev -> model, 0);
+
+  if ((fourier))
+    chisquare = engalmod_ctx_getchisquare_fourier(lev -> ctx, sigma_v/lev -> bin[2]);
+  else
+    chisquare = engalmod_ctx_getchisquare(lev -> ctx, sigma_v/lev -> bin[2]);
+
+  if ((ctx -> chisquare))
+    *ctx -> chisquare = chisquare;
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Set the stem of the wisdom files */
+int engalmod_wisdomfile(const char *wisdomfile)
+{
+  int success = 1;
+
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+    free(wisdomfile_);
+    wisdomfile_ = NULL;
+
+    if ((wisdomfile) && (*wisdomfile)) {
+      if ((wisdomfile_ = (char *) malloc((strlen(wisdomfile)+1)*sizeof(char))))
+	strcpy(wisdomfile_, wisdomfile);
+      else
+	success = 0;
+    }
+  }
+
+  return success;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Construct the name of a wisdom file */
+static char *wisdomname(int x, int y, int v, int arrayvsize, int threads, int flags, int mode)
+{
+  char *name;
+  char key[120];
+
+  if (!wisdomfile_)
+    return NULL;
+
+  sprintf(key, ".%ix%ix%i.p%i.t%i.f%i.m%i", x, y, v, arrayvsize, threads, flags, mode);
+
+  if (!(name = (char *) malloc((strlen(wisdomfile_)+strlen(key)+1)*sizeof(char))))
+    return NULL;
+
+  strcpy(name, wisdomfile_);
+  strcat(name, key);
+
+  return name;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Import wisdom */
+static int importwisdom(const char *filename)
+{
+  int fd;
+  FILE *stream;
+  int success = 0;
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return 0;
+
+  if (flock(fd, LOCK_SH)) {
+    close(fd);
+    return 0;
+  }
+
+  if (!(stream = fdopen(fd, "r"))) {
+    flock(fd, LOCK_UN);
+    close(fd);
+    return 0;
+  }
+
+  success = fftwf_import_wisdom_from_file(stream) ? 1 : 0;
+
+  flock(fd, LOCK_UN);
+  fclose(stream);
+
+  return success;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Export wisdom */
+static int exportwisdom(const char *filename)
+{
+  int fd;
+  FILE *stream;
+  int success = 1;
+
+  if ((fd = open(filename, O_RDWR | O_CREAT, 0644)) < 0)
+    return 0;
+
+  if (flock(fd, LOCK_EX)) {
+    close(fd);
+    return 0;
+  }
+
+  if (!(stream = fdopen(fd, "r+"))) {
+    flock(fd, LOCK_UN);
+    close(fd);
+    return 0;
+  }
+
+  /* Merge what others have written meanwhile, an empty file fails silently */
+  fftwf_import_wisdom_from_file(stream);
+
+  rewind(stream);
+  if (ftruncate(fd, 0))
+    success = 0;
+  else {
+    fftwf_export_wisdom_to_file(stream);
+    if (fflush(stream))
+      success = 0;
+  }
+
+  flock(fd, LOCK_UN);
+  fclose(stream);
+
+  return success;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Free everything a context owns */
+static void releasectx(engalmod_ctx *ctx)
+{
+  /* The fftw planner is not thread safe, this includes destroying plans */
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+    if ((ctx -> plin_noise))
+      fftwf_destroy_plan(ctx -> plin_noise);
+    if ((ctx -> plan_model))
+      fftwf_destroy_plan(ctx -> plan_model);
+    if ((ctx -> plin_model))
+      fftwf_destroy_plan(ctx -> plin_model);
+  }
+  ctx -> plin_noise = ctx -> plan_model = ctx -> plin_model = NULL;
+
+  /* The transformed cubes are only allocated for out-of-place transforms */
+  if ((ctx -> mode & 4)) {
+    if ((ctx -> transformed_cube_noise))
+      fftwf_free(ctx -> transformed_cube_noise);
+    if ((ctx -> transformed_cube_model))
+      fftwf_free(ctx -> transformed_cube_model);
+  }
+  if ((ctx -> noise.points))
+    fftwf_free(ctx -> noise.points);
+  if ((ctx -> expcube_model.points))
+    fftwf_free(ctx -> expcube_model.points);
+  if ((ctx -> expcube_noise.points))
+    fftwf_free(ctx -> expcube_noise.points);
+  if ((ctx -> expofacsfft))
+    free(ctx -> expofacsfft);
+  if ((ctx -> expofacsfft_noise))
+    free(ctx -> expofacsfft_noise);
+  if ((ctx -> veloarray))
+    fftwf_free(ctx -> veloarray);
+  if ((ctx -> veloarray_noise))
+    fftwf_free(ctx -> veloarray_noise);
+  if ((ctx -> vector))
+    free(ctx -> vector);
+  if ((ctx -> runstart))
+    free(ctx -> runstart);
+  if ((ctx -> runlength))
+    free(ctx -> runlength);
+  if ((ctx -> transformed_cube_orig))
+    fftwf_free(ctx -> transformed_cube_orig);
+
+  ctx -> noise.points = NULL;
+  ctx -> transformed_cube_noise = NULL;
+  ctx -> transformed_cube_model = NULL;
+  ctx -> expcube_model.points = NULL;
+  ctx -> expcube_noise.points = NULL;
+  ctx -> expofacsfft = NULL;
+  ctx -> expofacsfft_noise = NULL;
+  ctx -> veloarray = NULL;
+  ctx -> veloarray_noise = NULL;
+  ctx -> vector = NULL;
+  ctx -> runstart = NULL;
+  ctx -> runlength = NULL;
+  ctx -> nruns = 0;
+  ctx -> transformed_cube_orig = NULL;
+  ctx -> fourier = 0;
+  ctx -> noisecalls = 0;
+  ctx -> noisevalid = 0;
+  ctx -> mode = 0;
+
+  /* The batch plans, the kernel, and the background depend on the sizes */
+  releasebatch(ctx);
+  releasedelta(ctx);
+  ctx -> deltavalid = 0;
+  if ((ctx -> background))
+    fftwf_free(ctx -> background);
+  ctx -> background = NULL;
+
+  return;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Initialisation */
+
+int initchisquare(engalmod_ctx *ctx, float *arrayorig, float *arraymodel, int *x, int *y, int *v, float *hpbwmaj, float *hpbwmin, float *pa, float *scale, float *flux, float *sigma, int *mode, int *arrayvsize, double *chisquare, float *noiseweight, int *inimode, int *threads)
+{
+  float *sincosofangle_;
+  int physical[3];
+  int physical2[3];
+  int logical[3];
+  int physicaln[3];
+  int inimodel;
+  char *wisname = NULL;
+
+#ifdef OPENMPFFT
+  static char threadsinit = 0;
+#endif
+
+  /* hyper, once per process */
+#ifdef OPENMPFFT
+#pragma omp critical (engalmod_fftw)
+  {
+    if (!threadsinit) {
+      fftwf_init_threads();
+      threadsinit = 1;
+    }
+  }
+#endif
+
+  /* Re-initialisation */
+  releasectx(ctx);
+
+  ctx -> oldsigma = -1;
+
+  ctx -> threads = *threads;
+  if (ctx -> threads < 1)
+    ctx -> threads = 1;
+
+  /* One partial sum per thread, each on its own cache line */
+  if (!(ctx -> vector = (double *) malloc(ctx -> threads*PARTIALPAD*sizeof(double))))
+    goto error;
+
+  /* set number of threads */
+#ifdef OPENMPTIR
+  omp_set_num_threads(ctx -> threads);
+#endif
+
+  /* put the chisquare in its place */
+  ctx -> chisquare = chisquare;
+
+/* Get the array of the original */
+  ctx -> original.points = arrayorig;
+/* Get the array of the model */
+  ctx -> model.points = arraymodel;
+
+  ctx -> realorigsizex = 2*(*x/2+1);
+/* 2*(*x/2+1); */
+ctx -> realorigsizey = *y;
+ctx -> realmodelsizex = 2*(*x/2+1);
+ctx -> realmodelsizey = *y;
+
+  /* Allocate memory for the noisecube if the noise per pixel is required in future */
+  if ((*mode & 1)) {
+    if (!((ctx -> noise.points) = (float *) fftwf_malloc(((*x/2)*2+2)**y**v*sizeof(float))))
+      goto error;
+
+    /* There might be a chance that things work faster with an out-of-place trafo on the expense of double the memory usage */
+    if (*mode & 4) {
+      if (!(ctx -> transformed_cube_noise = (fftwf_complex *) fftwf_malloc((*x/2+1)**y**v*sizeof(fftwf_complex)))) {
+	fftwf_free(ctx -> noise.points);
+	goto error;
+      }
+    }
+  }
+  else 
+    ctx -> noise.points = NULL;
+
+    /* There might be a chance that things work faster with an out-of-place trafo on the expense of double the memory usage */
+  if (*mode & 4) {
+    if (!(ctx -> transformed_cube_model = (fftwf_complex *) fftwf_malloc((*x/2+1)**y**v*sizeof(fftwf_complex)))) {
+      if (*mode & 1) {
+	fftwf_free(ctx -> noise.points);
+	fftwf_free(ctx -> transformed_cube_noise);
+	goto error;
+      }
+    }
+  }
+
+  /* Place the cubes on the NUMA nodes of the threads working on them, optionally spread the transforms over all nodes */
+  if ((ctx -> numa)) {
+    if ((*mode & 4) && ctx -> numa == 2) {
+      interleave(ctx -> transformed_cube_model, ((size_t) (*x/2+1))**y**v*sizeof(fftwf_complex));
+      if ((*mode & 1))
+	interleave(ctx -> transformed_cube_noise, ((size_t) (*x/2+1))**y**v*sizeof(fftwf_complex));
+    }
+    if ((*mode & 1)) {
+      firsttouch(ctx -> noise.points, NULL, 2*(*x/2+1), ((long) *y)**v, ctx -> threads);
+      if ((*mode & 4))
+	firsttouch((float *) ctx -> transformed_cube_noise, NULL, 2*(*x/2+1), ((long) *y)**v, ctx -> threads);
+    }
+    if ((*mode & 4))
+      firsttouch((float *) ctx -> transformed_cube_model, NULL, 2*(*x/2+1), ((long) *y)**v, ctx -> threads);
+  }
+
+  /* Allocate memory for the xy-parts of the transfer functions, small compared to the cubes */
+  if (!((ctx -> expcube_model.points) = (float *) fftwf_malloc((*x/2+1)**y*sizeof(float)))) {
+    if ((*mode & 1)) 
+      fftwf_free(ctx -> noise.points);
+    if ((*mode & 4)) {
+      if ((*mode & 1))
+	fftwf_free(ctx -> transformed_cube_noise);
+      fftwf_free(ctx -> transformed_cube_model);
+    }
+    goto error;
+  }
+  ctx -> expcube_model.size_x = *x/2+1;
+  ctx -> expcube_model.size_y = *y;
+  ctx -> expcube_model.size_v = 1;
+  ctx -> expcube_model.padding = 0;
+  if ((*mode & 1)) {
+    if (!((ctx -> expcube_noise.points) = (float *) fftwf_malloc((*x/2+1)**y*sizeof(float)))) {
+      fftwf_free(ctx -> noise.points);
+      fftwf_free(ctx -> expcube_model.points);
+      if ((*mode & 4)) {
+	fftwf_free(ctx -> transformed_cube_noise);
+	fftwf_free(ctx -> transformed_cube_model);
+      }
+      goto error;
+    }
+  }
+  else
+    ctx -> expcube_noise.points = NULL;
+  /* This info is warranted */
+  ctx -> expcube_noise.size_x = *x/2+1;
+  ctx -> expcube_noise.size_y = *y;
+  ctx -> expcube_noise.size_v = 1;
+  ctx -> expcube_noise.padding = 0;
+  ctx -> expcube_noise.refpix_x = ctx -> expcube_noise.refpix_y = ctx -> expcube_noise.refpix_v = ctx -> expcube_model.refpix_x = ctx -> expcube_model.refpix_y = ctx -> expcube_model.refpix_v = 0;
+
+  /* Now get the sizes right */
+  ctx -> original.size_x = ctx -> model.size_x = ctx -> noise.size_x = *x;
+  ctx -> original.size_y = ctx -> model.size_y = ctx -> noise.size_y = *y;
+  ctx -> original.size_v = ctx -> model.size_v = ctx -> noise.size_v = *v;
+
+  ctx -> original.refpix_x = ctx -> model.refpix_x  = ctx -> noise.refpix_x  = 0;
+  ctx -> original.refpix_y = ctx -> model.refpix_y  = ctx -> noise.refpix_y  = 0;
+  ctx -> original.refpix_v = ctx -> model.refpix_v  = ctx -> noise.refpix_v  = 0;
+
+  /* We don't need the reference pixel, but the padding */
+  ctx -> original.padding = ctx -> model.padding = ctx -> noise.padding = (*x/2)*2+2-*x;
+
+  /* The scale */
+  ctx -> original.scale = *scale;
+  ctx -> model.scale = *flux;
   if (!(*mode & 1))
     *noiseweight = 1;
-  noise_.scale = *sigma**sigma**noiseweight**noiseweight;
-  expcube_model_.scale = *noiseweight**noiseweight;
+  ctx -> noise.scale = *sigma**sigma**noiseweight**noiseweight;
+  ctx -> expcube_model.scale = *noiseweight**noiseweight;
+
+  /* Now initialize the expofacsfft array */
+
+  /* We have only the HPBWs, so calculate the gaussian widths */
+  if (!(sincosofangle_ = sincosofangle(*pa))) {
+    if ((*mode & 1)) {
+      fftwf_free(ctx -> noise.points);
+      fftwf_free(ctx -> expcube_noise.points);
+    }
+    fftwf_free(ctx -> expcube_model.points);
+      if ((*mode & 4)) {
+	if ((*mode & 1))
+	fftwf_free(ctx -> transformed_cube_noise);
+	fftwf_free(ctx -> transformed_cube_model);
+      }
+    goto error;
+  }
+
+  if (!(ctx -> expofacsfft = expofacsfft_here(ctx, ctx -> sigma_maj = 0.42466090014401**hpbwmaj, ctx -> sigma_min = 0.42466090014401**hpbwmin, sincosofangle_))) {
+    if ((*mode & 1)) {
+      fftwf_free(ctx -> noise.points);
+      fftwf_free(ctx -> expcube_noise.points);
+    }
+    fftwf_free(ctx -> expcube_model.points);
+    free(sincosofangle_);
+      if ((*mode & 4)) {
+	if ((*mode & 1))
+	fftwf_free(ctx -> transformed_cube_noise);
+	fftwf_free(ctx -> transformed_cube_model);
+      }
+    goto error;
+  }
+
+  if (!(ctx -> expofacsfft_noise = expofacsfft_here(ctx, ctx -> sigma_maj_noise = ctx -> sigma_maj*SQRTOF2, ctx -> sigma_min_noise = ctx -> sigma_min*SQRTOF2, sincosofangle_))) {
+    if ((*mode & 1)) {
+      fftwf_free(ctx -> noise.points);
+      fftwf_free(ctx -> expcube_noise.points);
+    }
+    fftwf_free(ctx -> expcube_model.points);
+    free(sincosofangle_);
+    free(ctx -> expofacsfft);
+      if ((*mode & 4)) {
+	if ((*mode & 1))
+	fftwf_free(ctx -> transformed_cube_noise);
+	fftwf_free(ctx -> transformed_cube_model);
+      }
+    goto error;
+  }
+
+    /* Now the veloarray */
+  if (!(ctx -> veloarray = (float *) fftwf_malloc((ctx -> model.size_v/2+1)*sizeof(float)))) {
+    if ((*mode & 1)) {
+      fftwf_free(ctx -> noise.points);
+      ctx -> noise.points = NULL;
+      fftwf_free(ctx -> expcube_noise.points);
+      ctx -> expcube_noise.points = NULL;
+    }
+    fftwf_free(ctx -> expcube_model.points);
+    ctx -> expcube_model.points = NULL;
+    free(sincosofangle_);
+    sincosofangle_ = NULL;
+    free(ctx -> expofacsfft);
+    ctx -> expofacsfft = NULL;
+      if ((*mode & 4)) {
+	if ((*mode & 1)) {
+	  fftwf_free(ctx -> transformed_cube_noise);
+	  ctx -> transformed_cube_noise = NULL;
+	}
+	fftwf_free(ctx -> transformed_cube_model);
+	ctx -> transformed_cube_model = NULL;
+      }
+    goto error;
+  }
+
+    /* Now the veloarray */
+  if (!(ctx -> veloarray_noise = (float *) fftwf_malloc((ctx -> model.size_v/2+1)*sizeof(float)))) {
+    if ((*mode & 1)) {
+      fftwf_free(ctx -> noise.points);
+      ctx -> noise.points = NULL;
+      fftwf_free(ctx -> expcube_noise.points);
+      ctx -> expcube_noise.points = NULL;
+    }
+    fftwf_free(ctx -> expcube_model.points);
+    ctx -> expcube_model.points = NULL;
+    free(sincosofangle_);
+    sincosofangle_ = NULL;
+    free(ctx -> expofacsfft);
+    ctx -> expofacsfft = NULL;
+    if ((*mode & 4)) {
+      if ((*mode & 1)) {
+	fftwf_free(ctx -> transformed_cube_noise);
+	ctx -> transformed_cube_noise = NULL;
+      }
+      fftwf_free(ctx -> transformed_cube_model);
+      ctx -> transformed_cube_model = NULL;
+    }
+    fftwf_free(ctx -> veloarray);
+    goto error;
+  }
+
+/* Fill the arrays that describe the transformation */
+
+  if (ctx -> model.size_v != 1) {
+    logical[0] = ctx -> model.size_v;
+    logical[1] = ctx -> model.size_y;
+    logical[2] = ctx -> model.size_x;
+    
+    physical[0] = *arrayvsize;
+    physical[1] = ctx -> model.size_y;
+    physical[2] = 2*(ctx -> model.size_x/2)+2;
+
+    physicaln[0] = ctx -> model.size_v;
+    physicaln[1] = ctx -> model.size_y;
+    physicaln[2] = 2*(ctx -> model.size_x/2)+2;
+
+    physical2[0] = ctx -> model.size_v;
+    physical2[1] = ctx -> model.size_y;
+    physical2[2] = (ctx -> model.size_x/2)+1;
+
+  }
+  else {
+    logical[0] = ctx -> model.size_y;
+    logical[1] = ctx -> model.size_x;
+    
+    physical[0] = ctx -> model.size_y;
+    physical[1] = 2*(ctx -> model.size_x/2)+2;
+
+    physicaln[0] = ctx -> model.size_y;
+    physicaln[1] = 2*(ctx -> model.size_x/2)+2;
+
+    physical2[0] = ctx -> model.size_y;
+    physical2[1] = (ctx -> model.size_x/2)+1;
+  }
+
+  /* The transfer function is always cached, for 2d as well as 3d */
+  if (*mode & 1)
+    ctx -> conmodel = convolgaussfft_both;
+  else
+    ctx -> conmodel = convolgaussfft_here;
+
+  /* Take the input from inimodel to decide upon the way to
+     initialize fftw */
+  switch (*inimode) {
+  case 1:
+    inimodel = FFTW_MEASURE;
+    break;
+  case 2:
+    inimodel = FFTW_PATIENT;
+    break;
+  case 3:
+    inimodel = FFTW_EXHAUSTIVE;
+    break;
+  default:
+    inimodel = FFTW_ESTIMATE;
+    break;
+  }
+  ctx -> planflags = inimodel;
+  
+  /* Now make the plans for the fftw */
+
+  /* The fftw planner is not thread safe */
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+#ifdef OPENMPFFT
+  fftwf_plan_with_nthreads(ctx -> threads);
+#endif
+
+  /* Planning with estimate is fast, no need for wisdom */
+  if (inimodel != FFTW_ESTIMATE) {
+    if ((wisname = wisdomname(ctx -> model.size_x, ctx -> model.size_y, ctx -> model.size_v, *arrayvsize, ctx -> threads, inimodel, *mode & 5)))
+      importwisdom(wisname);
+  }
+
+  if (*mode & 1) {
+
+    /* point the trasnsformed cube to the cube itself for an in-place
+	   transformation */
+    if (*mode & 4)
+      ;
+      else
+    ctx -> transformed_cube_noise = (fftwf_complex *) ctx -> noise.points;
+    
+    /* fill ctx -> plin_noise with the necessary information, the forward transform is the one of the model. Take care with the order of the axes, reversed for fftw */
+
+
+      if (ctx -> model.size_v != 1) {
+	ctx -> plin_noise = fftwf_plan_many_dft_c2r(3, logical, 1, ctx -> transformed_cube_noise, physical2, 1, 0, ctx -> noise.points, physicaln, 1, 0, inimodel);
+/* (*x/2)*2+2)**y**v */
+/* fftwf_plan_dft_c2r_3d(ctx -> model.size_v, ctx -> model.size_y, ctx -> model.size_x, ctx -> transformed_cube_noise, ctx -> noise.points, inimodel); */
+      }
+      else {
+      ctx -> plin_noise = fftwf_plan_dft_c2r_2d(ctx -> model.size_y, ctx -> model.size_x, ctx -> transformed_cube_noise, ctx -> noise.points, inimodel);    
+      
+      }
+  }
+
+  /* Fill the global variables that affect the noise estimation and
+     the convolution */
+  ctx -> cubesizexhalf = ctx -> model.size_x/2;
+  ctx -> cubesizeyhalf = ctx -> model.size_y/2;
+  ctx -> newsize = ctx -> cubesizexhalf+1; /* The physical size of the cube in x */
+  ctx -> dummy = ctx -> model.size_v/2;
+
+  /* point the trasnsformed cube to the cube itself for an in-place transformation */
+  if (*mode & 4)
+    ;
+  else
+    ctx -> transformed_cube_model = (fftwf_complex *) (ctx -> model).points;
+
+  if (ctx -> model.size_v != 1) {
+    logical[0] = ctx -> model.size_v;
+    logical[1] = ctx -> model.size_y;
+    logical[2] = ctx -> model.size_x;
+
+    physical[0] = *arrayvsize;
+    /* formerly: ctx -> model.size_v */
+    physical[1] = ctx -> model.size_y;
+    physical[2] = 2*(ctx -> model.size_x/2)+2;
+
+    physical2[0] = *arrayvsize;
+    /* formerly: ctx -> model.size_v */
+    physical2[1] = ctx -> model.size_y;
+    physical2[2] = (ctx -> model.size_x/2)+1;
+  }
+  else {
+    logical[0] = ctx -> model.size_y;
+    logical[1] = ctx -> model.size_x;
+    
+    physical[0] = ctx -> model.size_y;
+    physical[1] = 2*(ctx -> model.size_x/2)+2;
+
+    physical2[0] = ctx -> model.size_y;
+    physical2[1] = (ctx -> model.size_x/2)+1;
+  }
+
+   /* fill plan and plin with the necessary information. Take care with the order of the axes, reversed for fftw */
+  if (ctx -> model.size_v != 1) {
+    ctx -> plan_model = fftwf_plan_many_dft_r2c(3, logical, 1, ctx -> model.points, physical, 1, 0, ctx -> transformed_cube_model, physical2, 1, 0, inimodel);
+    ctx -> plin_model = fftwf_plan_many_dft_c2r(3, logical, 1, ctx -> transformed_cube_model, physical2, 1, 0, ctx -> model.points, physical, 1, 0, inimodel);
+  }
+  else {
+    ctx -> plan_model = fftwf_plan_dft_r2c_2d((ctx -> model).size_y, (ctx -> model).size_x, (ctx -> model).points, ctx -> transformed_cube_model, inimodel);
+    ctx -> plin_model = fftwf_plan_dft_c2r_2d((ctx -> model).size_y, (ctx -> model).size_x, ctx -> transformed_cube_model, (ctx -> model).points, inimodel);    
+  }
+
+  if ((wisname)) {
+    exportwisdom(wisname);
+    free(wisname);
+  }
+  }
+
+  /* Now do some silly hacking */
+  if (*mode & 1) {
+    ctx -> noiseconstant_1 = (-2*SQRTOF2*PI_HERE*SQRTOF2*PI_HERE)/(ctx -> original.size_v*ctx -> original.size_v);
+    ctx -> noiseconstant_2 = ctx -> original.scale*ctx -> model.scale*2*PI_HERE*ctx -> sigma_min_noise*ctx -> sigma_maj_noise/(ctx -> original.size_v*ctx -> original.size_y*ctx -> original.size_x*2*SQRTPI);
+  }
+
+  ctx -> modelconstant_1 = -2*(PI_HERE*PI_HERE)/(ctx -> original.size_v*ctx -> original.size_v);
+
+  /* Fill the xy-part of the transfer functions, the beam does not change */
+  maketransferplane(ctx, ctx -> expcube_model.points, ctx -> expofacsfft);
+    
+  /* Could be that it is also the noisemap */
+  if (*mode & 1) {
+    maketransferplane(ctx, ctx -> expcube_noise.points, ctx -> expofacsfft_noise);
+  }
+
+  /* Without weight map the chisquare can be evaluated in Fourier space, this is an option, so no error if the memory is missing */
+  if (!(*mode & 1)) {
+    ctx -> transformed_cube_orig = (fftwf_complex *) fftwf_malloc((*x/2+1)**y**v*sizeof(fftwf_complex));
+    if ((ctx -> transformed_cube_orig) && (ctx -> numa)) {
+      if (ctx -> numa == 2)
+	interleave(ctx -> transformed_cube_orig, ((size_t) (*x/2+1))**y**v*sizeof(fftwf_complex));
+      firsttouch((float *) ctx -> transformed_cube_orig, NULL, 2*(*x/2+1), ((long) *y)**v, ctx -> threads);
+    }
+  }
+
+  /* Now check for the function that is needed to calculate the chisquare */
+  checkflags(ctx);
+
+  /* nearly finished */
+  ctx -> mode = *mode;
+  free(sincosofangle_);
+  return 1;
+  
+ error:
+  ctx -> noise.points = NULL;
+  ctx -> transformed_cube_noise = NULL;
+  ctx -> transformed_cube_model = NULL;
+  ctx -> expcube_model.points = NULL;
+  ctx -> expcube_noise.points = NULL;
+  ctx -> expofacsfft = NULL;
+  ctx -> expofacsfft_noise = NULL;
+  ctx -> veloarray = NULL;
+  ctx -> veloarray_noise = NULL;
+  ctx -> mode = 0;
+  return 0;
+}
+
+/* ------------------------------------------------------------ */
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* (Re-)Initialisation of the chisquare finding routine */
+void engalmod_chflgs(void)
+{
+  engalmod_ctx_chflgs(&default_ctx_);
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* (Re-)Initialisation of the chisquare finding routine */
+void engalmod_ctx_chflgs(engalmod_ctx *ctx)
+{
+  int start[3];
+  int size[3];
+  int l;
+
+  if ((ctx -> cropped)) {
+
+    /* If the crop region changes with the flags, everything has to be set up again */
+    if (!findcrop(ctx, ctx -> fullorig, ctx -> fullsize[0], ctx -> fullsize[1], ctx -> fullsize[2], ctx -> cropinit.hpbwmaj, start, size) || start[0] != ctx -> cropstart[0] || start[1] != ctx -> cropstart[1] || start[2] != ctx -> cropstart[2] || size[0] != ctx -> cropsize[0] || size[1] != ctx -> cropsize[1] || size[2] != ctx -> cropsize[2]) {
+      engalmod_ctx_initchisquare(ctx, ctx -> fullorig, ctx -> fullmodel, ctx -> fullsize[0], ctx -> fullsize[1], ctx -> fullsize[2], ctx -> cropinit.hpbwmaj, ctx -> cropinit.hpbwmin, ctx -> cropinit.pa, ctx -> cropinit.scale, ctx -> cropinit.flux, ctx -> cropinit.sigma, ctx -> cropinit.mode, ctx -> cropinit.arrayvsize, ctx -> chisquare, ctx -> cropinit.noiseweight, ctx -> cropinit.inimode, ctx -> threads);
+      return;
+    }
+    cropcube(ctx, ctx -> fullorig, ctx -> croporig, 0);
+  }
+
+  checkflags(ctx);
+  ctx -> deltavalid = 0;
+
+  /* The binned originals change with the flags */
+  for (l = 0; l < ctx -> npyramid; ++l) {
+    bincube(ctx, ctx -> pyramid+l, ctx -> pyrorig, ctx -> pyramid[l].orig, 1);
+    engalmod_ctx_chflgs(ctx -> pyramid[l].ctx);
+  }
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Set up the chisquare evaluation for the current original */
+static void checkflags(engalmod_ctx *ctx)
+{
+  long l;
+
+  makeruns(ctx);
+
+  /* No flags means that every row is exactly one run */
+  ctx -> fetchchisquare = &fetchchisquare_flagged;
+  if ((ctx -> runlength) && ctx -> nruns == (long) ctx -> original.size_y*ctx -> original.size_v) {
+    for (l = 0; l < ctx -> nruns; ++l) {
+      if (ctx -> runlength[l] != ctx -> original.size_x)
+	break;
+    }
+    if (l == ctx -> nruns)
+      ctx -> fetchchisquare = &fetchchisquare_unflagged; 
+  }
+
+  transformoriginal(ctx);
+  
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Transform the original */
+
+static void transformoriginal(engalmod_ctx *ctx)
+{
+  fftwf_plan plan_orig = NULL;
+  int logical[3];
+  int physical[3];
+  int physical2[3];
+
+  ctx -> fourier = 0;
+
+  if (!(ctx -> transformed_cube_orig) || (ctx -> noise.points) || ctx -> fetchchisquare != &fetchchisquare_unflagged)
+    return;
+
+  if (ctx -> original.size_v != 1) {
+    logical[0] = physical[0] = physical2[0] = ctx -> original.size_v;
+    logical[1] = physical[1] = physical2[1] = ctx -> original.size_y;
+    logical[2] = ctx -> original.size_x;
+    physical[2] = ctx -> realorigsizex;
+    physical2[2] = ctx -> original.size_x/2+1;
+  }
+  else {
+    logical[0] = physical[0] = physical2[0] = ctx -> original.size_y;
+    logical[1] = ctx -> original.size_x;
+    physical[1] = ctx -> realorigsizex;
+    physical2[1] = ctx -> original.size_x/2+1;
+  }
+
+  /* The fftw planner is not thread safe */
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+#ifdef OPENMPFFT
+  fftwf_plan_with_nthreads(ctx -> threads);
+#endif
+  plan_orig = fftwf_plan_many_dft_r2c((ctx -> original.size_v != 1) ? 3 : 2, logical, 1, ctx -> original.points, physical, 1, 0, ctx -> transformed_cube_orig, physical2, 1, 0, FFTW_ESTIMATE);
+  }
+
+  if (!plan_orig)
+    return;
+
+  fftwf_execute(plan_orig);
+
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  fftwf_destroy_plan(plan_orig);
+
+  ctx -> fourier = 1;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Free the cropped cubes */
+static void releasecrop(engalmod_ctx *ctx)
+{
+  if ((ctx -> croporig))
+    fftwf_free(ctx -> croporig);
+  if ((ctx -> cropmodel))
+    fftwf_free(ctx -> cropmodel);
+
+  ctx -> croporig = NULL;
+  ctx -> cropmodel = NULL;
+  ctx -> fullorig = NULL;
+  ctx -> fullmodel = NULL;
+  ctx -> cropped = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* fftw-friendly length */
+static int fftsize(int length, int max)
+{
+  int n, rest;
+
+  for (n = length; n < max; ++n) {
+    rest = n;
+    while (!(rest % 2))
+      rest /= 2;
+    while (!(rest % 3))
+      rest /= 3;
+    while (!(rest % 5))
+      rest /= 5;
+    while (!(rest % 7))
+      rest /= 7;
+    if (rest == 1)
+      return n;
+  }
+
+  return max;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Bounding box of the unflagged pixels */
+static int unflaggedbox(float *array, int x, int y, int v, int *start, int *end)
+{
+  int i, j, k, lo, hi;
+  float *row;
+
+  start[0] = x;
+  start[1] = y;
+  start[2] = v;
+  end[0] = end[1] = end[2] = -1;
+
+  for (k = 0; k < v; ++k) {
+    for (j = 0; j < y; ++j) {
+      row = array+2*(x/2+1)*(j+(long) y*k);
+
+      /* A nan compared with itself is false */
+      for (lo = 0; lo < x && row[lo] != row[lo]; ++lo)
+	;
+      if (lo == x)
+	continue;
+      for (hi = x-1; row[hi] != row[hi]; --hi)
+	;
+
+      if (lo < start[0])
+	start[0] = lo;
+      if (hi > end[0])
+	end[0] = hi;
+      if (j < start[1])
+	start[1] = j;
+      if (j > end[1])
+	end[1] = j;
+      if (k < start[2])
+	start[2] = k;
+      end[2] = k;
+    }
+  }
+
+  for (i = 0; i < 3; ++i) {
+    if (end[i] < 0)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Find the crop region */
+static int findcrop(engalmod_ctx *ctx, float *arrayorig, int x, int y, int v, float hpbwmaj, int *start, int *size)
+{
+  int end[3];
+  int full[3];
+  int halo[3];
+  int i, length;
+
+  if (!unflaggedbox(arrayorig, x, y, v, start, end))
+    return 0;
+
+  full[0] = x;
+  full[1] = y;
+  full[2] = v;
+  halo[0] = halo[1] = (int) ceilf(CROPHALO*0.42466090014401*hpbwmaj);
+  halo[2] = (int) ceilf(CROPHALO*ctx -> cropsigma_v);
+
+  for (i = 0; i < 3; ++i) {
+    length = end[i]-start[i]+1+2*halo[i];
+    size[i] = fftsize(length, full[i]);
+
+    /* Distribute the padding on both sides and stay inside the cube */
+    start[i] = start[i]-halo[i]-(size[i]-length)/2;
+    if (start[i] > full[i]-size[i])
+      start[i] = full[i]-size[i];
+    if (start[i] < 0)
+      start[i] = 0;
+  }
+
+  return size[0] < x || size[1] < y || size[2] < v;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Copy between full and cropped cube */
+static void cropcube(engalmod_ctx *ctx, float *full, float *cropped, int uncrop)
+{
+  long l, nrows;
+  int j, k, fullx, cropx;
+  float *row;
+
+  fullx = 2*(ctx -> fullsize[0]/2+1);
+  cropx = 2*(ctx -> cropsize[0]/2+1);
+
+  if (!uncrop) {
+    nrows = (long) ctx -> cropsize[1]*ctx -> cropsize[2];
+#ifdef OPENMPTIR
+#pragma omp parallel for private(j, k) num_threads(ctx -> threads)
+#endif
+    for (l = 0; l < nrows; ++l) {
+      j = ctx -> cropstart[1]+l % ctx -> cropsize[1];
+      k = ctx -> cropstart[2]+l / ctx -> cropsize[1];
+      memcpy(cropped+cropx*l, full+ctx -> cropstart[0]+fullx*(j+(long) ctx -> fullsize[1]*k), ctx -> cropsize[0]*sizeof(float));
+    }
+    return;
+  }
+
+  /* Everything outside the crop region is 0 */
+  nrows = (long) ctx -> fullsize[1]*ctx -> fullsize[2];
+#ifdef OPENMPTIR
+#pragma omp parallel for private(j, k, row) num_threads(ctx -> threads)
+#endif
+  for (l = 0; l < nrows; ++l) {
+    j = l % ctx -> fullsize[1]-ctx -> cropstart[1];
+    k = l / ctx -> fullsize[1]-ctx -> cropstart[2];
+    row = full+fullx*l;
+    if (j < 0 || j >= ctx -> cropsize[1] || k < 0 || k >= ctx -> cropsize[2])
+      memset(row, 0, ctx -> fullsize[0]*sizeof(float));
+    else {
+      memset(row, 0, ctx -> cropstart[0]*sizeof(float));
+      memcpy(row+ctx -> cropstart[0], cropped+cropx*(j+(long) ctx -> cropsize[1]*k), ctx -> cropsize[0]*sizeof(float));
+      memset(row+ctx -> cropstart[0]+ctx -> cropsize[0], 0, (ctx -> fullsize[0]-ctx -> cropstart[0]-ctx -> cropsize[0])*sizeof(float));
+    }
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static void makeruns(engalmod_ctx *ctx)
+{
+  int i,j,k;
+  long n;
+  int pass;
+
+  if ((ctx -> runstart))
+    free(ctx -> runstart);
+  if ((ctx -> runlength))
+    free(ctx -> runlength);
+  ctx -> runstart = NULL;
+  ctx -> runlength = NULL;
+  ctx -> nruns = 0;
+
+  /* First pass counts, second pass fills */
+  for (pass = 0; pass < 2; ++pass) {
+    n = 0;
+    for(k = 0; k < ctx -> original.size_v; ++k){
+      for(j = 0; j < ctx -> original.size_y; ++j) {
+	i = 0;
+	while (i < ctx -> original.size_x) {
+
+	  /* A nan compared with itself is false */
+	  while (i < ctx -> original.size_x && findpixelrealrel(ctx, ctx -> original, i, j, k) != findpixelrealrel(ctx, ctx -> original, i, j, k))
+	    ++i;
+	  if (i == ctx -> original.size_x)
+	    break;
+	  if ((pass)) {
+	    ctx -> runstart[n] = i+(long) ctx -> realorigsizex*(j+(long) ctx -> realorigsizey*k);
+	    ctx -> runlength[n] = i;
+	  }
+	  while (i < ctx -> original.size_x && findpixelrealrel(ctx, ctx -> original, i, j, k) == findpixelrealrel(ctx, ctx -> original, i, j, k))
+	    ++i;
+	  if ((pass))
+	    ctx -> runlength[n] = i-ctx -> runlength[n];
+	  ++n;
+	}
+      }
+    }
+    
+    if (!pass) {
+      if (!(ctx -> runstart = (long *) malloc((n+1)*sizeof(long))))
+	return;
+      if (!(ctx -> runlength = (int *) malloc((n+1)*sizeof(int)))) {
+	free(ctx -> runstart);
+	ctx -> runstart = NULL;
+	return;
+      }
+    }
+  }
+  
+  ctx -> nruns = n;
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static float findpixelrealrel(engalmod_ctx *ctx, Cube cube, int x, int y, int v)
+{
+  return (cube.points)[x+ctx -> realorigsizex*(y+ctx -> realorigsizey*v)];
+}
 
-  /* Now initialize the expofacsfft array */
+/* ------------------------------------------------------------ */
 
-  /* We have only the HPBWs, so calculate the gaussian widths */
-  if (!(sincosofangle_ = sincosofangle(*pa))) {
-    if ((*mode & 1)) {
-      fftwf_free(noise_.points);
-    if ((*mode & 2))
-      fftwf_free(expcube_noise_.points);
-    }
-    if ((*mode & 2))
-      free(expcube_model_.points);
-      if ((*mode & 4)) {
-	if ((*mode & 1))
-	fftwf_free(transformed_cube_noise_);
-	fftwf_free(transformed_cube_model_);
-      }
-    goto error;
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static double chisquare_run(float *orig, float *mod, int n)
+{
+  int i;
+  float diff;
+  double sum = 0.0;
+
+#ifdef OPENMPTIR
+#pragma omp simd reduction(+:sum) private(diff)
+#endif
+  for (i = 0; i < n; ++i) {
+    diff = orig[i]-mod[i];
+    sum += (double) (diff*diff);
   }
+  return sum;
+}
 
-  if (!(expofacsfft_ = expofacsfft_here(sigma_maj_ = 0.42466090014401**hpbwmaj, sigma_min_ = 0.42466090014401**hpbwmin, sincosofangle_))) {
-    if ((*mode & 1)) {
-      fftwf_free(noise_.points);
-    if ((*mode & 2))
-      fftwf_free(expcube_noise_.points);
-    }
-    if ((*mode & 2))
-      fftwf_free(expcube_model_.points);
-    free(sincosofangle_);
-      if ((*mode & 4)) {
-	if ((*mode & 1))
-	fftwf_free(transformed_cube_noise_);
-	fftwf_free(transformed_cube_model_);
-      }
-    goto error;
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static double chisquare_run_noise(float *orig, float *mod, float *noise, int n)
+{
+  int i;
+  float diff;
+  double sum = 0.0;
+
+#ifdef OPENMPTIR
+#pragma omp simd reduction(+:sum) private(diff)
+#endif
+  for (i = 0; i < n; ++i) {
+    diff = orig[i]-mod[i];
+    sum += (double) (diff*diff/noise[i]);
   }
+  return sum;
+}
 
-  if (!(expofacsfft_noise_ = expofacsfft_here(sigma_maj_noise_ = sigma_maj_*SQRTOF2, sigma_min_noise_ = sigma_min_*SQRTOF2, sincosofangle_))) {
-    if ((*mode & 1)) {
-      fftwf_free(noise_.points);
-    if ((*mode & 2))
-      fftwf_free(expcube_noise_.points);
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static double chisquare_run_masked(float *orig, float *mod, float *noise, int n)
+{
+  int i;
+  float diff;
+  double sum = 0.0;
+
+  if ((noise)) {
+#ifdef OPENMPTIR
+#pragma omp simd reduction(+:sum) private(diff)
+#endif
+    for (i = 0; i < n; ++i) {
+      /* A nan compared with itself is false */
+      diff = (orig[i] == orig[i]) ? (orig[i]-mod[i]) : 0.0f;
+      sum += (double) (diff*diff/noise[i]);
+    }
+  }
+  else {
+#ifdef OPENMPTIR
+#pragma omp simd reduction(+:sum) private(diff)
+#endif
+    for (i = 0; i < n; ++i) {
+      diff = (orig[i] == orig[i]) ? (orig[i]-mod[i]) : 0.0f;
+      sum += (double) (diff*diff);
     }
-    if ((*mode & 2))
-      fftwf_free(expcube_model_.points);
-    free(sincosofangle_);
-    free(expofacsfft_);
-      if ((*mode & 4)) {
-	if ((*mode & 1))
-	fftwf_free(transformed_cube_noise_);
-	fftwf_free(transformed_cube_model_);
-      }
-    goto error;
   }
+  return sum;
+}
 
-    /* Now the veloarray */
-  if (!(veloarray_ = (float *) fftwf_malloc((model_.size_v/2+1)*sizeof(float)))) {
-    if ((*mode & 1)) {
-      fftwf_free(noise_.points);
-      noise_.points = NULL;
-      if ((*mode & 2)) {
-      fftwf_free(expcube_noise_.points);
-      expcube_noise_.points = NULL;
-      }
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static double fetchchisquare_flagged(engalmod_ctx *ctx)
+{
+  long l;
+  int i;
+  int nthreadz = 1;
+  double chisquare = 0.0;
+  double partial;
+
+  for (i = 0 ; i < ctx -> threads; ++i)
+    ctx -> vector[i*PARTIALPAD] = 0.0;
+
+  /* Now calculate the chisquare, each thread sums up locally and deposits its partial sum once */
+#ifdef OPENMPTIR
+#pragma omp parallel private(l, partial) num_threads(ctx -> threads)
+#endif
+  {
+    partial = 0.0;
+
+    /* If the run list could not be allocated, go through all rows and mask on the fly */
+    if (!(ctx -> runstart)) {
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+      for (l = 0; l < (long) ctx -> original.size_y*ctx -> original.size_v; ++l)
+	partial += chisquare_run_masked(ctx -> original.points+l*ctx -> realorigsizex, ctx -> model.points+l*ctx -> realmodelsizex, (ctx -> noise.points)?(ctx -> noise.points+l*ctx -> realmodelsizex):NULL, ctx -> original.size_x);
     }
-    if ((*mode & 2)) {
-      fftwf_free(expcube_model_.points);
-      expcube_model_.points = NULL;
+    else if ((ctx -> noise.points)) {
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+      for (l = 0; l < ctx -> nruns; ++l)
+	partial += chisquare_run_noise(ctx -> original.points+ctx -> runstart[l], ctx -> model.points+ctx -> runstart[l], ctx -> noise.points+ctx -> runstart[l], ctx -> runlength[l]);
     }
-    free(sincosofangle_);
-    sincosofangle_ = NULL;
-    free(expofacsfft_);
-    expofacsfft_ = NULL;
-      if ((*mode & 4)) {
-	if ((*mode & 1)) {
-	  fftwf_free(transformed_cube_noise_);
-	  transformed_cube_noise_ = NULL;
-	}
-	fftwf_free(transformed_cube_model_);
-	transformed_cube_model_ = NULL;
-      }
-    goto error;
+    else {
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+      for (l = 0; l < ctx -> nruns; ++l)
+	partial += chisquare_run(ctx -> original.points+ctx -> runstart[l], ctx -> model.points+ctx -> runstart[l], ctx -> runlength[l]);
+    }
+
+#ifdef OPENMPTIR
+    ctx -> vector[omp_get_thread_num()*PARTIALPAD] = partial;
+    if (omp_get_thread_num() == 0)
+      nthreadz = omp_get_num_threads();
+#else
+    ctx -> vector[0] = partial;
+#endif
   }
 
-    /* Now the veloarray */
-  if (!(veloarray_noise_ = (float *) fftwf_malloc((model_.size_v/2+1)*sizeof(float)))) {
-    if ((*mode & 1)) {
-      fftwf_free(noise_.points);
-      noise_.points = NULL;
-      if ((*mode & 2)) {
-	fftwf_free(expcube_noise_.points);
-	expcube_noise_.points = NULL;
-      }
+  for (i = 0; i < nthreadz; ++i) 
+    chisquare += ctx -> vector[i*PARTIALPAD];
+
+  if ((ctx -> noise.points))
+    chisquare = chisquare*(double) ctx -> expcube_model.scale;
+  else
+    chisquare = chisquare/ctx -> noise.scale;
+
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+static double fetchchisquare_unflagged(engalmod_ctx *ctx)
+{
+  long l;
+  int i;
+  int nthreadz = 1;
+  double chisquare = 0.0;
+  double partial;
+
+  for (i = 0 ; i < ctx -> threads; ++i)
+    ctx -> vector[i*PARTIALPAD] = 0.0;
+
+  /* Now calculate the chisquare, row by row, each row is one run */
+#ifdef OPENMPTIR
+#pragma omp parallel private(l, partial) num_threads(ctx -> threads)
+#endif
+  {
+    partial = 0.0;
+
+    if ((ctx -> noise.points)) {
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+      for (l = 0; l < (long) ctx -> original.size_y*ctx -> original.size_v; ++l)
+	partial += chisquare_run_noise(ctx -> original.points+l*ctx -> realorigsizex, ctx -> model.points+l*ctx -> realmodelsizex, ctx -> noise.points+l*ctx -> realmodelsizex, ctx -> original.size_x);
     }
-    if ((*mode & 2)) {
-      fftwf_free(expcube_model_.points);
-      expcube_model_.points = NULL;
+    else {
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+      for (l = 0; l < (long) ctx -> original.size_y*ctx -> original.size_v; ++l)
+	partial += chisquare_run(ctx -> original.points+l*ctx -> realorigsizex, ctx -> model.points+l*ctx -> realmodelsizex, ctx -> original.size_x);
     }
-    free(sincosofangle_);
-    sincosofangle_ = NULL;
-    free(expofacsfft_);
-    expofacsfft_ = NULL;
-    if ((*mode & 4)) {
-      if ((*mode & 1)) {
-	fftwf_free(transformed_cube_noise_);
-	transformed_cube_noise_ = NULL;
+
+#ifdef OPENMPTIR
+    ctx -> vector[omp_get_thread_num()*PARTIALPAD] = partial;
+    if (omp_get_thread_num() == 0)
+      nthreadz = omp_get_num_threads();
+#else
+    ctx -> vector[0] = partial;
+#endif
+  }
+
+  for (i = 0; i < nthreadz; ++i) 
+    chisquare += ctx -> vector[i*PARTIALPAD];
+
+  if ((ctx -> noise.points))
+    chisquare = chisquare*(double) ctx -> expcube_model.scale;
+  else
+    chisquare = chisquare/ctx -> noise.scale;
+
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Unweighted chisquare from the transforms */
+
+static double fetchchisquare_fourier(engalmod_ctx *ctx)
+{
+  long l, nrows, npix;
+  int i, j, k, newsize;
+  int nthreadz = 1;
+  double chisquare = 0.0;
+  double partial, rowsum;
+  float factor, dre, dim;
+  float *orig, *mod, *plane;
+
+  newsize = ctx -> newsize;
+  nrows = ((long) ctx -> model.size_y)*ctx -> model.size_v;
+  npix = nrows*ctx -> model.size_x;
+
+  for (i = 0 ; i < ctx -> threads; ++i)
+    ctx -> vector[i*PARTIALPAD] = 0.0;
+
+  /* Row by row, the v-part of the transfer function is constant along a row, f(v) = f(-v) */
+#ifdef OPENMPTIR
+#pragma omp parallel private(l, i, j, k, partial, rowsum, factor, dre, dim, orig, mod, plane) num_threads(ctx -> threads)
+#endif
+  {
+    partial = 0.0;
+
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+    for (l = 0; l < nrows; ++l) {
+      j = l % ctx -> model.size_y;
+      k = l / ctx -> model.size_y;
+      factor = ((float) npix)*ctx -> veloarray[(k <= ctx -> dummy) ? k : (ctx -> model.size_v-k)];
+      orig = (float *) (ctx -> transformed_cube_orig+newsize*l);
+      mod = (float *) (ctx -> transformed_cube_model+newsize*l);
+      plane = ctx -> expcube_model.points+newsize*j;
+
+      /* Every frequency in x twice ... */
+      rowsum = 0.0;
+#ifdef OPENMPTIR
+#pragma omp simd reduction(+:rowsum) private(dre, dim)
+#endif
+      for (i = 0; i < newsize; ++i) {
+	dre = orig[2*i]-factor*plane[i]*mod[2*i];
+	dim = orig[2*i+1]-factor*plane[i]*mod[2*i+1];
+	rowsum += dre*dre+dim*dim;
       }
-      fftwf_free(transformed_cube_model_);
-      transformed_cube_model_ = NULL;
+      rowsum = 2.0*rowsum;
+
+      /* ... except for 0 and N_x/2 */
+      dre = orig[0]-factor*plane[0]*mod[0];
+      dim = orig[1]-factor*plane[0]*mod[1];
+      rowsum -= dre*dre+dim*dim;
+      if (!(ctx -> model.size_x % 2)) {
+	dre = orig[2*(newsize-1)]-factor*plane[newsize-1]*mod[2*(newsize-1)];
+	dim = orig[2*(newsize-1)+1]-factor*plane[newsize-1]*mod[2*(newsize-1)+1];
+	rowsum -= dre*dre+dim*dim;
+      }
+      partial += rowsum;
     }
-    fftwf_free(veloarray_);
-    goto error;
+
+#ifdef OPENMPTIR
+    ctx -> vector[omp_get_thread_num()*PARTIALPAD] = partial;
+    if (omp_get_thread_num() == 0)
+      nthreadz = omp_get_num_threads();
+#else
+    ctx -> vector[0] = partial;
+#endif
+  }
+
+  for (i = 0; i < nthreadz; ++i) 
+    chisquare += ctx -> vector[i*PARTIALPAD];
+
+  return chisquare/((double) npix)/ctx -> noise.scale;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+double getchisquare_(float *sigma_v)
+{
+  /* formerly times 0.42466090014401, but now it's the real sigma */
+  return getchisquare_c(*sigma_v);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+double getchisquare_c (float sigma_v)
+{
+  return engalmod_ctx_getchisquare(&default_ctx_, sigma_v);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+double engalmod_ctx_getchisquare(engalmod_ctx *ctx, float sigma_v)
+/* If ever the flux of one pointsource changes during one run, activate this */
+/* static double getchisquare (float *array, float HPBW_v, float pointflux) */
+{
+  /* Set the chisquare to 0 */
+  double chisquare = 0;
+
+  if ((ctx -> level))
+    return getchisquare_level(ctx, ctx -> pyrmodel, sigma_v, 0);
+
+  if ((ctx -> cropped))
+    cropcube(ctx, ctx -> fullmodel, ctx -> cropmodel, 0);
+
+  /* If a weight map should be calculated */
+  if ((ctx -> noise.points)) {
+    if (sigma_v != ctx -> oldsigma) {
+      changeexpofacsfft_noise(ctx, sigma_v);
+    }
+    /* If ever the flux of one pointsource changes during one run, activate this */
+    /*     ctx -> model.scale = pointflux; */
+  }
+ 
+  /* In any case we need the convolved cube */
+  if (sigma_v != ctx -> oldsigma) {
+    changeexpofacsfft(ctx, sigma_v);
+  }
+
+  /* Convolved cube and, if required, weight map, which may be kept from a former evaluation */
+  if ((ctx -> noise.points) && (ctx -> noisevalid) && (ctx -> noiseupdate < 0 || ctx -> noisecalls < ctx -> noiseupdate))
+    convolgaussfft_here(ctx);
+  else {
+    (*ctx -> conmodel)(ctx);
+    ctx -> noisecalls = 0;
+    ctx -> noisevalid = 1;
+  }
+  ++ctx -> noisecalls;
+  ctx -> oldsigma = sigma_v;
+  
+  /* Now calculate the chisquare */
+  chisquare = (*ctx -> fetchchisquare)(ctx);
+
+  /* The convolved model in the full cube */
+  if ((ctx -> cropped))
+    cropcube(ctx, ctx -> fullmodel, ctx -> cropmodel, 1);
+
+  /* Incremental evaluations can start from here */
+  ctx -> deltavalid = 1;
+  ctx -> deltacalls = 0;
+  ctx -> deltachisquare = chisquare;
+
+  if ((ctx -> chisquare))
+    *ctx -> chisquare = chisquare;
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquare, in Fourier space if possible */
+
+double getchisquare_fourier_c(float sigma_v)
+{
+  return engalmod_ctx_getchisquare_fourier(&default_ctx_, sigma_v);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquare, in Fourier space if possible */
+
+double engalmod_ctx_getchisquare_fourier(engalmod_ctx *ctx, float sigma_v)
+{
+  double chisquare;
+
+  if ((ctx -> level))
+    return getchisquare_level(ctx, ctx -> pyrmodel, sigma_v, 1);
+
+  /* Flags or weight map, the residuals are needed in real space */
+  if (!ctx -> fourier)
+    return engalmod_ctx_getchisquare(ctx, sigma_v);
+
+  if (sigma_v != ctx -> oldsigma) {
+    changeexpofacsfft(ctx, sigma_v);
+    ctx -> oldsigma = sigma_v;
   }
 
-/* Fill the arrays that describe the transformation */
+  if ((ctx -> cropped))
+    cropcube(ctx, ctx -> fullmodel, ctx -> cropmodel, 0);
+
+  /* Only the forward transform of the model, the model array does not contain the convolved model afterwards */
+  fftwf_execute(ctx -> plan_model);
+  ctx -> deltavalid = 0;
+  if ((ctx -> background))
+    addbackground(ctx, ctx -> transformed_cube_model);
+  chisquare = fetchchisquare_fourier(ctx);
+
+  if ((ctx -> chisquare))
+    *ctx -> chisquare = chisquare;
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquares of several models */
+
+int getchisquare_batch_c(int nmodels, float **models, float *sigmas, double *chisquares)
+{
+  return engalmod_ctx_getchisquare_batch(&default_ctx_, nmodels, models, sigmas, chisquares);
+}
+
+/* ------------------------------------------------------------ */
 
-  if (model_.size_v != 1) {
-    logical[0] = model_.size_v;
-    logical[1] = model_.size_y;
-    logical[2] = model_.size_x;
-    
-    physical[0] = *arrayvsize;
-    physical[1] = model_.size_y;
-    physical[2] = 2*(model_.size_x/2)+2;
 
-    physicaln[0] = model_.size_v;
-    physicaln[1] = model_.size_y;
-    physicaln[2] = 2*(model_.size_x/2)+2;
 
-    physical2[0] = model_.size_v;
-    physical2[1] = model_.size_y;
-    physical2[2] = (model_.size_x/2)+1;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquares of several models */
+
+int engalmod_ctx_getchisquare_batch(engalmod_ctx *ctx, int nmodels, float **models, float *sigmas, double *chisquares)
+{
+  long size;
+  int b, nvelo;
+  float *target;
+
+  if (!ctx || !(ctx -> plan_model) || nmodels < 1 || !models || !sigmas || !chisquares)
+    return 0;
+
+  /* At a coarse level the binned models are small, evaluate one by one */
+  if ((ctx -> level)) {
+    for (b = 0; b < nmodels; ++b)
+      chisquares[b] = getchisquare_level(ctx, models[b], sigmas[b], 1);
+    return 1;
+  }
 
-        if (*mode & 2) {
-    connoise_ = convolgaussfft_noise_array;
-    conmodel_ = convolgaussfft_here_array;
+  /* With a weight map or without the memory for the stack the models are evaluated one by one in the model array */
+  if ((ctx -> noise.points) || !makebatch(ctx, nmodels)) {
+    if ((ctx -> cropped)) {
+      target = ctx -> fullmodel;
+      size = 2*((long) ctx -> fullsize[0]/2+1)*ctx -> fullsize[1]*ctx -> fullsize[2];
     }
     else {
-    connoise_ = convolgaussfft_noise;
-    conmodel_ = convolgaussfft_here;
+      target = ctx -> model.points;
+      size = ((long) ctx -> realmodelsizex)*ctx -> realmodelsizey*ctx -> model.size_v;
+    }
+    for (b = 0; b < nmodels; ++b) {
+      memcpy(target, models[b], size*sizeof(float));
+      chisquares[b] = engalmod_ctx_getchisquare(ctx, sigmas[b]);
     }
 
+    /* The model array has been overwritten */
+    ctx -> deltavalid = 0;
+    return 1;
   }
-  else {
-    logical[0] = model_.size_y;
-    logical[1] = model_.size_x;
-    
-    physical[0] = model_.size_y;
-    physical[1] = 2*(model_.size_x/2)+2;
 
-    physicaln[0] = model_.size_y;
-    physicaln[1] = 2*(model_.size_x/2)+2;
+  size = ((long) ctx -> realmodelsizex)*ctx -> realmodelsizey*ctx -> model.size_v;
+  nvelo = ctx -> model.size_v/2+1;
 
-    physical2[0] = model_.size_y;
-    physical2[1] = (model_.size_x/2)+1;
-
-        if (*mode & 2) {
-    connoise_ = convolgaussfft_noise_single;
-    conmodel_ = convolgaussfft_here_single;
-    }
-    else {
-    connoise_ = convolgaussfft_noise_single_array;
-    conmodel_ = convolgaussfft_here_single_array;
-    }
+  /* Stack the models */
+  for (b = 0; b < nmodels; ++b) {
+    if ((ctx -> cropped))
+      cropcube(ctx, models[b], ctx -> batchcube+b*size, 0);
+    else
+      memcpy(ctx -> batchcube+b*size, models[b], size*sizeof(float));
+    fillveloarray(ctx, sigmas[b], ctx -> batchvelo+b*nvelo);
   }
 
-  /* Take the input from inimodel to decide upon the way to
-     initialize fftw */
-  switch (*inimode) {
-  case 1:
-    inimodel = FFTW_MEASURE;
-    break;
-  case 2:
-    inimodel = FFTW_PATIENT;
-    break;
-  case 3:
-    inimodel = FFTW_EXHAUSTIVE;
-    break;
-  default:
-    inimodel = FFTW_ESTIMATE;
-    break;
+  /* One transform for all, convolve, one backtransform for all */
+  fftwf_execute(ctx -> batchplan);
+  for (b = 0; b < nmodels; ++b) {
+    if ((ctx -> background))
+      addbackground(ctx, (fftwf_complex *) (ctx -> batchcube+b*size));
+    multiplytransfer(ctx, (fftwf_complex *) (ctx -> batchcube+b*size), ctx -> expcube_model.points, ctx -> batchvelo+b*nvelo);
   }
-  
-  /* Now make the plans for the fftw */
+  fftwf_execute(ctx -> batchplin);
 
-#ifdef OPENMPFFT
-  fftwf_plan_with_nthreads(threads_);
-#endif
+  fetchchisquare_batch(ctx, nmodels, chisquares);
 
-  if (*mode & 1) {
+  return 1;
+}
 
-    /* point the trasnsformed cube to the cube itself for an in-place
-	   transformation */
-    if (*mode & 4)
-      ;
-      else
-    transformed_cube_noise_ = (fftwf_complex *) noise_.points;
-    
-    /* fill plan_noise_ and plin_noise_ with the necessary information. Take care with the order of the axes, reversed for fftw */
+/* ------------------------------------------------------------ */
 
 
-      if (model_.size_v != 1) {
-	plan_noise_ = fftwf_plan_many_dft_r2c(3, logical, 1, model_.points, physical, 1, 0, transformed_cube_noise_, physical2, 1, 0, inimodel | FFTW_PRESERVE_INPUT);
-	plin_noise_ = fftwf_plan_many_dft_c2r(3, logical, 1, transformed_cube_noise_, physical2, 1, 0, noise_.points, physicaln, 1, 0, inimodel);
-/* (*x/2)*2+2)**y**v */
-/* fftwf_plan_dft_c2r_3d(model_.size_v, model_.size_y, model_.size_x, transformed_cube_noise_, noise_.points, inimodel); */
-      }
-      else {
-	plan_noise_ = fftwf_plan_many_dft_r2c(2,logical , 1, model_.points, physical, 1, 0, transformed_cube_noise_, physical2, 1, 0, inimodel | FFTW_PRESERVE_INPUT);
-      plin_noise_ = fftwf_plan_dft_c2r_2d(model_.size_y, model_.size_x, transformed_cube_noise_, noise_.points, inimodel);    
-      
-      }
-  }
 
-  /* Fill the global variables that affect the noise estimation and
-     the convolution */
-  cubesizexhalf_ = model_.size_x/2;
-  cubesizeyhalf_ = model_.size_y/2;
-  newsize_ = cubesizexhalf_+1; /* The physical size of the cube in x */
-  dummy_ = model_.size_v/2;
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  /* point the trasnsformed cube to the cube itself for an in-place transformation */
-  if (*mode & 4)
-    ;
-  else
-    transformed_cube_model_ = (fftwf_complex *) (model_).points;
+/* Chisquare after a local change of the model */
 
-  if (model_.size_v != 1) {
-    logical[0] = model_.size_v;
-    logical[1] = model_.size_y;
-    logical[2] = model_.size_x;
+int getchisquare_delta_c(float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare)
+{
+  return engalmod_ctx_getchisquare_delta(&default_ctx_, delta, offsets, noffsets, sigma_v, chisquare);
+}
 
-    physical[0] = *arrayvsize;
-    /* formerly: model_.size_v */
-    physical[1] = model_.size_y;
-    physical[2] = 2*(model_.size_x/2)+2;
+/* ------------------------------------------------------------ */
 
-    physical2[0] = *arrayvsize;
-    /* formerly: model_.size_v */
-    physical2[1] = model_.size_y;
-    physical2[2] = (model_.size_x/2)+1;
-  }
-  else {
-    logical[0] = model_.size_y;
-    logical[1] = model_.size_x;
-    
-    physical[0] = model_.size_y;
-    physical[1] = 2*(model_.size_x/2)+2;
 
-    physical2[0] = model_.size_y;
-    physical2[1] = (model_.size_x/2)+1;
-  }
 
-   /* fill plan and plin with the necessary information. Take care with the order of the axes, reversed for fftw */
-  if (model_.size_v != 1) {
-    plan_model_ = fftwf_plan_many_dft_r2c(3, logical, 1, model_.points, physical, 1, 0, transformed_cube_model_, physical2, 1, 0, inimodel);
-    plin_model_ = fftwf_plan_many_dft_c2r(3, logical, 1, transformed_cube_model_, physical2, 1, 0, model_.points, physical, 1, 0, inimodel);
-  }
-  else {
-    plan_model_ = fftwf_plan_dft_r2c_2d((model_).size_y, (model_).size_x, (model_).points, transformed_cube_model_, inimodel);
-    plin_model_ = fftwf_plan_dft_c2r_2d((model_).size_y, (model_).size_x, transformed_cube_model_, (model_).points, inimodel);    
-  } 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  /* Now do some silly hacking */
-  if (*mode & 1) {
-    noiseconstant_1_ = (-2*SQRTOF2*PI_HERE*SQRTOF2*PI_HERE)/(original_.size_v*original_.size_v);
-    noiseconstant_2_ = original_.scale*model_.scale*2*PI_HERE*sigma_min_noise_*sigma_maj_noise_/(original_.size_v*original_.size_y*original_.size_x*2*SQRTPI);
+/* Chisquare after a local change of the model */
+
+int engalmod_ctx_getchisquare_delta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets, float sigma_v, double *chisquare)
+{
+  long l;
+  int possible;
+  double change;
+
+  if (!ctx || !delta || (noffsets && !offsets) || !chisquare)
+    return 0;
+
+  /* The model array has to contain the convolved model, the convolution must not change, and the weight map must not be due */
+  possible = (ctx -> plan_model) && ctx -> deltaupdate > 0 && (ctx -> deltavalid) && ctx -> deltacalls < ctx -> deltaupdate && !(ctx -> level) && sigma_v == ctx -> oldsigma;
+  if ((possible) && (ctx -> noise.points))
+    possible = (ctx -> noisevalid) && (ctx -> noiseupdate < 0 || ctx -> noisecalls < ctx -> noiseupdate);
+
+  if (!(possible) || !makedelta(ctx, sigma_v) || !convolvedelta(ctx, delta, offsets, noffsets)) {
+
+    /* The caller makes a full evaluation, the change is not needed anymore */
+    for (l = 0; l < noffsets; ++l)
+      delta[offsets[l]] = 0.0f;
+    return 0;
   }
 
-  modelconstant_1_ = -2*(PI_HERE*PI_HERE)/(original_.size_v*original_.size_v);
+  change = applydelta(ctx);
 
-  /* Fill the arrays for the exponential acceleration if required */
-  if (*mode & 2) {
-    /* In any case that is for the model */
-    makemodelarray(expcube_model_.points);
-    
-    /* Could be that it is also the noisemap */
-    if (*mode & 1) {
-      makenoisearray(expcube_noise_.points);
-    }
+  if ((ctx -> noise.points)) {
+    change = change*(double) ctx -> expcube_model.scale;
+    ++ctx -> noisecalls;
   }
+  else
+    change = change/ctx -> noise.scale;
 
-  /* Now check for the function that is needed to calculate the chisquare */
-  engalmod_chflgs();
+  ctx -> deltachisquare = ctx -> deltachisquare+change;
+  ++ctx -> deltacalls;
 
-  /* nearly finished */
-  free(sincosofangle_);
+  *chisquare = ctx -> deltachisquare;
+  if ((ctx -> chisquare))
+    *ctx -> chisquare = ctx -> deltachisquare;
   return 1;
-  
- error:
-  noise_.points = NULL;
-  transformed_cube_noise_ = NULL;
-  transformed_cube_model_ = NULL;
-  expcube_model_.points = NULL;
-  expcube_noise_.points = NULL;
-  expofacsfft_ = NULL;
-  expofacsfft_noise_ = NULL;
-  veloarray_ = NULL;
-  veloarray_noise_ = NULL;
-  return 0;
 }
 
 /* ------------------------------------------------------------ */
 
 
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* (Re-)Initialisation of the chisquare finding routine */
-void engalmod_chflgs(void)
+/* Provide plans and buffers for a batch of models */
+
+static int makebatch(engalmod_ctx *ctx, int nmodels)
 {
-  int i,j,k;
+  int logical[3];
+  int physical[3];
+  int physical2[3];
+  int stride;
+  long size;
 
-  fetchchisquare_ = &fetchchisquare_unflagged; 
+  if (ctx -> batchn == nmodels)
+    return 1;
 
-  for(k = 0; k < original_.size_v; ++k){
-    for(j = 0; j < original_.size_y; ++j) {
-      for(i = 0; i < original_.size_x; ++i) {
-	  /* A nan compared with itself is false */
-	if (findpixelrealrel(original_, i, j, k) != findpixelrealrel(original_, i, j, k)) {
-	/* if ((double) ((findpixelrealrel(original_, i, j, k))) < HOT_VALUE) { */
-	  fetchchisquare_ = &fetchchisquare_flagged;
-	  break;
-	}
-      }
-    }
+  releasebatch(ctx);
+
+  size = ((long) ctx -> realmodelsizex)*ctx -> realmodelsizey*ctx -> model.size_v;
+  stride = ((nmodels+PARTIALPAD-1)/PARTIALPAD)*PARTIALPAD;
+
+  /* fftw takes the distance between the models as int */
+  if (size*nmodels > INT_MAX)
+    return 0;
+
+  if (!(ctx -> batchcube = (float *) fftwf_malloc(nmodels*size*sizeof(float))) || !(ctx -> batchvelo = (float *) malloc(nmodels*(ctx -> model.size_v/2+1)*sizeof(float))) || !(ctx -> batchsums = (double *) malloc(ctx -> threads*stride*sizeof(double)))) {
+    releasebatch(ctx);
+    return 0;
   }
-  
-  return;
+
+  if (ctx -> model.size_v != 1) {
+    logical[0] = physical[0] = physical2[0] = ctx -> model.size_v;
+    logical[1] = physical[1] = physical2[1] = ctx -> model.size_y;
+    logical[2] = ctx -> model.size_x;
+    physical[2] = ctx -> realmodelsizex;
+    physical2[2] = ctx -> newsize;
+  }
+  else {
+    logical[0] = physical[0] = physical2[0] = ctx -> model.size_y;
+    logical[1] = ctx -> model.size_x;
+    physical[1] = ctx -> realmodelsizex;
+    physical2[1] = ctx -> newsize;
+  }
+
+  /* The fftw planner is not thread safe */
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+#ifdef OPENMPFFT
+  fftwf_plan_with_nthreads(ctx -> threads);
+#endif
+  ctx -> batchplan = fftwf_plan_many_dft_r2c((ctx -> model.size_v != 1) ? 3 : 2, logical, nmodels, ctx -> batchcube, physical, 1, (int) size, (fftwf_complex *) ctx -> batchcube, physical2, 1, (int) (size/2), ctx -> planflags);
+  ctx -> batchplin = fftwf_plan_many_dft_c2r((ctx -> model.size_v != 1) ? 3 : 2, logical, nmodels, (fftwf_complex *) ctx -> batchcube, physical2, 1, (int) (size/2), ctx -> batchcube, physical, 1, (int) size, ctx -> planflags);
+  }
+
+  if (!(ctx -> batchplan) || !(ctx -> batchplin)) {
+    releasebatch(ctx);
+    return 0;
+  }
+
+  ctx -> batchn = nmodels;
+  return 1;
 }
 
 /* ------------------------------------------------------------ */
@@ -1500,9 +4089,34 @@ void engalmod_chflgs(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static float findpixelrealrel(Cube cube, int x, int y, int v)
+/* Destroy the batch plans and buffers */
+
+static void releasebatch(engalmod_ctx *ctx)
 {
-  return (cube.points)[x+realorigsizex_*(y+realorigsizey_*v)];
+  /* The fftw planner is not thread safe, this includes destroying plans */
+#ifdef OPENMPTIR
+#pragma omp critical (engalmod_fftw)
+#endif
+  {
+    if ((ctx -> batchplan))
+      fftwf_destroy_plan(ctx -> batchplan);
+    if ((ctx -> batchplin))
+      fftwf_destroy_plan(ctx -> batchplin);
+  }
+  if ((ctx -> batchcube))
+    fftwf_free(ctx -> batchcube);
+  if ((ctx -> batchvelo))
+    free(ctx -> batchvelo);
+  if ((ctx -> batchsums))
+    free(ctx -> batchsums);
+
+  ctx -> batchplan = ctx -> batchplin = NULL;
+  ctx -> batchcube = NULL;
+  ctx -> batchvelo = NULL;
+  ctx -> batchsums = NULL;
+  ctx -> batchn = 0;
+
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1511,86 +4125,62 @@ static float findpixelrealrel(Cube cube, int x, int y, int v)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static double fetchchisquare_flagged(void)
+/* Unweighted chisquares of the stacked models */
+
+static void fetchchisquare_batch(engalmod_ctx *ctx, int nmodels, double *chisquares)
 {
-  int i,j,k;
-  double chisquare = 0;
-  int nthreadz = 0;
+  long l, size;
+  int b, i, stride;
+  int nthreadz = 1;
+  double *partial;
 
-  for (i =0 ; i < threads_; ++i)
-    vector_[i] = 0.0;
+  size = ((long) ctx -> realmodelsizex)*ctx -> realmodelsizey*ctx -> model.size_v;
+  stride = ((nmodels+PARTIALPAD-1)/PARTIALPAD)*PARTIALPAD;
 
-  /* Now calculate the chisquare */
-  if ((noise_.points)) {
+  /* Each thread sums up into its own block, all models per run of the original */
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel private(l, b, partial) num_threads(ctx -> threads)
 #endif
-    for(k = 0; k < original_.size_v; ++k){
+  {
 #ifdef OPENMPTIR
-      if (nthreadz == 0) {
-	nthreadz = omp_get_num_threads();
-      }
+    partial = ctx -> batchsums+omp_get_thread_num()*stride;
+    if (omp_get_thread_num() == 0)
+      nthreadz = omp_get_num_threads();
 #else
-      nthreadz = 1;
+    partial = ctx -> batchsums;
 #endif
-      for(j = 0; j < original_.size_y; ++j) {
-	for(i = 0; i < original_.size_x; ++i) {
+    for (b = 0; b < nmodels; ++b)
+      partial[b] = 0.0;
+
+    /* If the run list could not be allocated, go through all rows and mask on the fly */
+    if (!(ctx -> runstart)) {
 #ifdef OPENMPTIR
-	  /* A nan compared with itself is false */
-	if (findpixelrealrel(original_, i, j, k) == findpixelrealrel(original_, i, j, k)) {
-	  /* if (findpixelrealrel(original_, i, j, k) > HOT_VALUE) { */
-	    vector_[omp_get_thread_num()] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))/findpixelrealrelmod(noise_, i, j, k));
-	  }
-#else
-	  /* A nan compared with itself is false */
-	if (findpixelrealrel(original_, i, j, k) == findpixelrealrel(original_, i, j, k)) {
-	  /* if (findpixelrealrel(original_, i, j, k) > HOT_VALUE) { */
-	    vector_[0] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))/findpixelrealrelmod(noise_, i, j, k));
-	  }
+#pragma omp for schedule(static)
 #endif
-	  
-	}
+      for (l = 0; l < (long) ctx -> original.size_y*ctx -> original.size_v; ++l) {
+	for (b = 0; b < nmodels; ++b)
+	  partial[b] += chisquare_run_masked(ctx -> original.points+l*ctx -> realorigsizex, ctx -> batchcube+b*size+l*ctx -> realmodelsizex, NULL, ctx -> original.size_x);
       }
     }
-  
-    for (i = 0; i < nthreadz; ++i) 
-      chisquare += vector_[i]*(double) expcube_model_.scale;
-  }
-  else {
-#ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-    for(k = 0; k < original_.size_v; ++k){
-#ifdef OPENMPTIR
-      if (nthreadz == 0) {
-	nthreadz = omp_get_num_threads();
-      }
-#else
-      nthreadz = 1;
-#endif
-      for(j = 0; j < original_.size_y; ++j) {
-	for(i = 0; i < original_.size_x; ++i) {
+    else {
 #ifdef OPENMPTIR
-	  /* A nan compared with itself is false */
-	if (findpixelrealrel(original_, i, j, k) == findpixelrealrel(original_, i, j, k)) {
-	  /* if (findpixelrealrel(original_, i, j, k) > HOT_VALUE) { */
-	    vector_[omp_get_thread_num()] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k)));
-	  }
-#else
-	  /* A nan compared with itself is false */
-	if (findpixelrealrel(original_, i, j, k) == findpixelrealrel(original_, i, j, k)) {
-	  /* if (findpixelrealrel(original_, i, j, k) > HOT_VALUE) { */
-	    vector_[0] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k)));
-	  }
+#pragma omp for schedule(static)
 #endif
-	}
+      for (l = 0; l < ctx -> nruns; ++l) {
+	for (b = 0; b < nmodels; ++b)
+	  partial[b] += chisquare_run(ctx -> original.points+ctx -> runstart[l], ctx -> batchcube+b*size+ctx -> runstart[l], ctx -> runlength[l]);
       }
     }
+  }
 
-    for (i = 0; i < nthreadz; ++i) 
-      chisquare += vector_[i]/noise_.scale;
+  for (b = 0; b < nmodels; ++b) {
+    chisquares[b] = 0.0;
+    for (i = 0; i < nthreadz; ++i)
+      chisquares[b] += ctx -> batchsums[i*stride+b];
+    chisquares[b] = chisquares[b]/ctx -> noise.scale;
   }
-    return chisquare;
+
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1599,73 +4189,277 @@ static double fetchchisquare_flagged(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static double fetchchisquare_unflagged(void)
-{
-  int i,j,k;
-  double chisquare = 0;
-  int nthreadz = 0;
+/* Buffers and kernel for the incremental evaluation */
 
-  for (i =0 ; i < threads_; ++i)
-    vector_[i] = 0;
+static int makedelta(engalmod_ctx *ctx, float sigma_v)
+{
+  long size;
+  int i, j, k, n, nx, ny, nv;
+  float peak, cut;
+  float *kernel;
+
+  nx = ctx -> model.size_x;
+  ny = ctx -> model.size_y;
+  nv = ctx -> model.size_v;
+  size = ((long) ctx -> realmodelsizex)*ctx -> realmodelsizey*nv;
+
+  if (!(ctx -> deltamask)) {
+    if (!(ctx -> deltatemp = (float *) calloc(size, sizeof(float))) || !(ctx -> deltaout = (float *) calloc(size, sizeof(float))) || !(ctx -> deltamask = (unsigned char *) calloc(size, sizeof(unsigned char))) || !(ctx -> deltatlist = (long *) malloc(1024*sizeof(long))) || !(ctx -> deltaolist = (long *) malloc(1024*sizeof(long)))) {
+      releasedelta(ctx);
+      return 0;
+    }
+    ctx -> deltatmax = ctx -> deltaomax = 1024;
+  }
 
-  /* Now calculate the chisquare */
-  if ((noise_.points)) {
-#ifdef OPENMPTIR
-# pragma omp parallel for
-#endif
-    for(k = 0; k < original_.size_v; ++k){
-#ifdef OPENMPTIR
-      if (nthreadz == 0) {
-	nthreadz = omp_get_num_threads();
-      }
-#else
-      nthreadz = 1;
-#endif
-      for(j = 0; j < original_.size_y; ++j) {
-	for(i = 0; i < original_.size_x; ++i) {
-#ifdef OPENMPTIR
-	  vector_[omp_get_thread_num()] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))/findpixelrealrelmod(noise_, i, j, k));
-#else
-	  vector_[0] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))/findpixelrealrelmod(noise_, i, j, k));
-#endif
-	}
+  if ((ctx -> deltaplane) && sigma_v == ctx -> deltasigma)
+    return 1;
+
+  if ((ctx -> deltaplane))
+    free(ctx -> deltaplane);
+  if ((ctx -> deltavelo))
+    free(ctx -> deltavelo);
+  ctx -> deltaplane = ctx -> deltavelo = NULL;
+
+  /* The response to a pointsource at the origin, through the batch plan to keep the model array */
+  if (!makebatch(ctx, (ctx -> batchn) ? ctx -> batchn : 1))
+    return 0;
+  kernel = ctx -> batchcube;
+  memset(kernel, 0, ctx -> batchn*size*sizeof(float));
+  kernel[0] = 1.0f;
+  fftwf_execute(ctx -> batchplan);
+  multiplytransfer(ctx, (fftwf_complex *) kernel, ctx -> expcube_model.points, ctx -> veloarray);
+  fftwf_execute(ctx -> batchplin);
+
+  if (!((peak = kernel[0]) > 0.0f))
+    return 0;
+  cut = DELTACUT*peak;
+
+  /* Extent of the kernel, the kernel is periodic */
+  ctx -> deltahalo[0] = ctx -> deltahalo[1] = ctx -> deltahalo[2] = 0;
+  for (j = 0; j < ny; ++j) {
+    for (i = 0; i < nx; ++i) {
+      if (fabsf(kernel[i+ctx -> realmodelsizex*j]) >= cut) {
+	n = (i <= nx/2) ? i : (nx-i);
+	if (n > ctx -> deltahalo[0])
+	  ctx -> deltahalo[0] = n;
+	n = (j <= ny/2) ? j : (ny-j);
+	if (n > ctx -> deltahalo[1])
+	  ctx -> deltahalo[1] = n;
       }
     }
+  }
+  for (k = 0; k < nv; ++k) {
+    if (fabsf(kernel[ctx -> realmodelsizex*ctx -> realmodelsizey*(long) k]) >= cut) {
+      n = (k <= nv/2) ? k : (nv-k);
+      if (n > ctx -> deltahalo[2])
+	ctx -> deltahalo[2] = n;
+    }
+  }
 
+  /* A pixel must not be reached twice */
+  if (2*ctx -> deltahalo[0] >= nx)
+    ctx -> deltahalo[0] = (nx-1)/2;
+  if (2*ctx -> deltahalo[1] >= ny)
+    ctx -> deltahalo[1] = (ny-1)/2;
+  if (2*ctx -> deltahalo[2] >= nv)
+    ctx -> deltahalo[2] = (nv-1)/2;
+
+  if (!(ctx -> deltaplane = (float *) malloc((2*ctx -> deltahalo[0]+1)*(2*ctx -> deltahalo[1]+1)*sizeof(float))) || !(ctx -> deltavelo = (float *) malloc((2*ctx -> deltahalo[2]+1)*sizeof(float)))) {
+    if ((ctx -> deltaplane))
+      free(ctx -> deltaplane);
+    ctx -> deltaplane = NULL;
+    return 0;
+  }
 
-    for (i = 0; i < nthreadz; ++i) 
-	  chisquare += vector_[i]*(double) expcube_model_.scale;
+  /* The kernel is the product of its xy-part at v = 0 and its v-part at the origin, normalised to 1 */
+  for (j = -ctx -> deltahalo[1]; j <= ctx -> deltahalo[1]; ++j) {
+    for (i = -ctx -> deltahalo[0]; i <= ctx -> deltahalo[0]; ++i)
+      ctx -> deltaplane[i+ctx -> deltahalo[0]+(2*ctx -> deltahalo[0]+1)*(j+ctx -> deltahalo[1])] = kernel[((i+nx) % nx)+ctx -> realmodelsizex*((j+ny) % ny)];
   }
-  else {
-#ifdef OPENMPTIR
-# pragma omp parallel for
-#endif
+  for (k = -ctx -> deltahalo[2]; k <= ctx -> deltahalo[2]; ++k)
+    ctx -> deltavelo[k+ctx -> deltahalo[2]] = kernel[ctx -> realmodelsizex*ctx -> realmodelsizey*(long) ((k+nv) % nv)]/peak;
 
-    for(k = 0; k < original_.size_v; ++k){
-#ifdef OPENMPTIR
-      if (nthreadz == 0)
-	nthreadz = omp_get_num_threads();
-#else
-      nthreadz = 1;
-#endif
-     for(j = 0; j < original_.size_y; ++j) {
-	for(i = 0; i < original_.size_x; ++i) {
-#ifdef OPENMPTIR
-	  vector_[omp_get_thread_num()] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k)));
-#else
-	  vector_[0] += (double) ((findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k))*(findpixelrealrel(original_, i, j, k)-findpixelrealrelmod(model_, i, j, k)));
-#endif
+  ctx -> deltasigma = sigma_v;
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Free the buffers and the kernel of the incremental evaluation */
+
+static void releasedelta(engalmod_ctx *ctx)
+{
+  if ((ctx -> deltaplane))
+    free(ctx -> deltaplane);
+  if ((ctx -> deltavelo))
+    free(ctx -> deltavelo);
+  if ((ctx -> deltatemp))
+    free(ctx -> deltatemp);
+  if ((ctx -> deltaout))
+    free(ctx -> deltaout);
+  if ((ctx -> deltamask))
+    free(ctx -> deltamask);
+  if ((ctx -> deltatlist))
+    free(ctx -> deltatlist);
+  if ((ctx -> deltaolist))
+    free(ctx -> deltaolist);
+
+  ctx -> deltaplane = ctx -> deltavelo = ctx -> deltatemp = ctx -> deltaout = NULL;
+  ctx -> deltamask = NULL;
+  ctx -> deltatlist = ctx -> deltaolist = NULL;
+  ctx -> deltatmax = ctx -> deltaomax = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Double the length of an offset list */
+
+static int growlist(long **list, long *max)
+{
+  long *grown;
+
+  if (!(grown = (long *) realloc(*list, 2*(*max)*sizeof(long))))
+    return 0;
+
+  *list = grown;
+  *max = 2*(*max);
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Convolve a sparse change of the model with the cut kernel */
+
+static int convolvedelta(engalmod_ctx *ctx, float *delta, long *offsets, long noffsets)
+{
+  long l, off, ntemp = 0, nout = 0, rowsize, planesize;
+  int i, j, k, x, y, v, xx, yy, vv, fullx, hx, hy, hv, pw;
+  float d;
+  double npix, limit;
+  int success = 1;
+
+  hx = ctx -> deltahalo[0];
+  hy = ctx -> deltahalo[1];
+  hv = ctx -> deltahalo[2];
+  pw = 2*hx+1;
+  rowsize = ctx -> realmodelsizex;
+  planesize = rowsize*ctx -> realmodelsizey;
+  fullx = 2*(ctx -> fullsize[0]/2+1);
+
+  /* Beyond this number of multiply-adds a full evaluation is faster */
+  npix = ((double) ctx -> model.size_x)*ctx -> model.size_y*ctx -> model.size_v;
+  limit = DELTACOST*npix*log(npix+1.0)/log(2.0);
+
+  if (((double) noffsets)*(2*hv+1) > limit)
+    success = 0;
+
+  /* Convolution in v, the offsets are converted to the layout of the model */
+  for (l = 0; l < noffsets; ++l) {
+    d = delta[offsets[l]];
+    delta[offsets[l]] = 0.0f;
+    if (!(success) || d == 0.0f)
+      continue;
+
+    if ((ctx -> cropped)) {
+      x = offsets[l] % fullx-ctx -> cropstart[0];
+      y = (offsets[l]/fullx) % ctx -> fullsize[1]-ctx -> cropstart[1];
+      v = offsets[l]/(fullx*(long) ctx -> fullsize[1])-ctx -> cropstart[2];
+      if (x < 0 || x >= ctx -> cropsize[0] || y < 0 || y >= ctx -> cropsize[1] || v < 0 || v >= ctx -> cropsize[2])
+	continue;
+    }
+    else {
+      x = offsets[l] % rowsize;
+      y = (offsets[l]/rowsize) % ctx -> model.size_y;
+      v = offsets[l]/planesize;
+    }
+
+    for (k = -hv; k <= hv; ++k) {
+      vv = v+k;
+      if (vv < 0)
+	vv += ctx -> model.size_v;
+      else if (vv >= ctx -> model.size_v)
+	vv -= ctx -> model.size_v;
+      off = x+rowsize*y+planesize*vv;
+      if (!(ctx -> deltamask[off] & 1)) {
+	if (ntemp == ctx -> deltatmax && !growlist(&ctx -> deltatlist, &ctx -> deltatmax)) {
+	  success = 0;
+	  break;
 	}
+	ctx -> deltamask[off] |= 1;
+	ctx -> deltatlist[ntemp++] = off;
       }
+      ctx -> deltatemp[off] += d*ctx -> deltavelo[k+hv];
     }
+  }
 
+  if ((success) && ((double) ntemp)*pw*(2*hy+1) > limit)
+    success = 0;
+
+  /* Convolution in the xy-plane */
+  for (l = 0; l < ntemp; ++l) {
+    off = ctx -> deltatlist[l];
+    d = ctx -> deltatemp[off];
+    ctx -> deltatemp[off] = 0.0f;
+    ctx -> deltamask[off] &= ~1;
+    if (!(success))
+      continue;
+
+    x = off % rowsize;
+    y = (off/rowsize) % ctx -> model.size_y;
+    v = off/planesize;
+
+    for (j = -hy; j <= hy; ++j) {
+      yy = y+j;
+      if (yy < 0)
+	yy += ctx -> model.size_y;
+      else if (yy >= ctx -> model.size_y)
+	yy -= ctx -> model.size_y;
+      for (i = -hx; i <= hx; ++i) {
+	xx = x+i;
+	if (xx < 0)
+	  xx += ctx -> model.size_x;
+	else if (xx >= ctx -> model.size_x)
+	  xx -= ctx -> model.size_x;
+	off = xx+rowsize*yy+planesize*v;
+	if (!(ctx -> deltamask[off] & 2)) {
+	  if (nout == ctx -> deltaomax && !growlist(&ctx -> deltaolist, &ctx -> deltaomax)) {
+	    success = 0;
+	    break;
+	  }
+	  ctx -> deltamask[off] |= 2;
+	  ctx -> deltaolist[nout++] = off;
+	}
+	ctx -> deltaout[off] += d*ctx -> deltaplane[i+hx+pw*(j+hy)];
+      }
+      if (!(success))
+	break;
+    }
+  }
 
-
-    for (i = 0; i < nthreadz; ++i) 
-      chisquare += vector_[i]/noise_.scale;
+  if (!(success)) {
+    for (l = 0; l < nout; ++l) {
+      ctx -> deltaout[ctx -> deltaolist[l]] = 0.0f;
+      ctx -> deltamask[ctx -> deltaolist[l]] = 0;
+    }
+    nout = 0;
   }
 
-  return chisquare;
+  ctx -> deltacount = nout;
+  return success;
 }
 
 /* ------------------------------------------------------------ */
@@ -1674,9 +4468,49 @@ static double fetchchisquare_unflagged(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static float findpixelrealrelmod(Cube cube, int x, int y, int v)
+/* Add the convolved change to the model and sum up the change of the chisquare */
+
+static double applydelta(engalmod_ctx *ctx)
 {
-  return (cube.points)[x+realmodelsizex_*(y+realmodelsizey_*v)];
+  long l, off, fulloff;
+  int x, y, v, fullx;
+  float o, m, u, before, after;
+  double change = 0.0;
+
+  fullx = 2*(ctx -> fullsize[0]/2+1);
+
+  for (l = 0; l < ctx -> deltacount; ++l) {
+    off = ctx -> deltaolist[l];
+    u = ctx -> deltaout[off];
+    ctx -> deltaout[off] = 0.0f;
+    ctx -> deltamask[off] = 0;
+
+    m = ctx -> model.points[off];
+    ctx -> model.points[off] = m+u;
+
+    if ((ctx -> cropped)) {
+      x = off % ctx -> realmodelsizex+ctx -> cropstart[0];
+      y = (off/ctx -> realmodelsizex) % ctx -> model.size_y+ctx -> cropstart[1];
+      v = off/(ctx -> realmodelsizex*(long) ctx -> realmodelsizey)+ctx -> cropstart[2];
+      fulloff = x+fullx*(y+(long) ctx -> fullsize[1]*v);
+      ctx -> fullmodel[fulloff] = m+u;
+    }
+
+    /* A nan compared with itself is false */
+    o = ctx -> original.points[off];
+    if (o != o)
+      continue;
+
+    before = o-m;
+    after = o-m-u;
+    if ((ctx -> noise.points))
+      change += ((double) after*after-(double) before*before)/ctx -> noise.points[off];
+    else
+      change += (double) after*after-(double) before*before;
+  }
+  ctx -> deltacount = 0;
+
+  return change;
 }
 
 /* ------------------------------------------------------------ */
@@ -1685,10 +4519,24 @@ static float findpixelrealrelmod(Cube cube, int x, int y, int v)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-double getchisquare_(float *sigma_v)
+/* Add the transformed background to a transformed model */
+
+static void addbackground(engalmod_ctx *ctx, fftwf_complex *transformed)
 {
-  /* formerly times 0.42466090014401, but now it's the real sigma */
-  return getchisquare_c(*sigma_v);
+  long l, size;
+  float *model, *background;
+
+  size = 2*((long) ctx -> newsize)*ctx -> model.size_y*ctx -> model.size_v;
+  model = (float *) transformed;
+  background = (float *) ctx -> background;
+
+#ifdef OPENMPTIR
+#pragma omp parallel for schedule(static) num_threads(ctx -> threads)
+#endif
+  for (l = 0; l < size; ++l)
+    model[l] += background[l];
+
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1697,37 +4545,22 @@ double getchisquare_(float *sigma_v)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-double getchisquare_c (float sigma_v)
-/* If ever the flux of one pointsource changes during one run, activate this */
-/* static double getchisquare (float *array, float HPBW_v, float pointflux) */
+/* Convolve a cube with a gaussian via fft */
+
+static Cube *convolgaussfft_here(engalmod_ctx *ctx)
 {
-  /* Set the chisquare to 0 */
-  double chisquare = 0;
+  /* Now do the transform */
+  fftwf_execute(ctx -> plan_model);
+  if ((ctx -> background))
+    addbackground(ctx, ctx -> transformed_cube_model);
 
-  /* If a weight map should be calculated */
-  if ((noise_.points)) {
-    if (sigma_v != oldsigma_) {
-      changeexpofacsfft_noise(sigma_v);
-    }
-    /* If ever the flux of one pointsource changes during one run, activate this */
-    /*     model_.scale = pointflux; */
-    
-    (*connoise_)();
-  }
- 
-  /* In any case we need the convolved cube */
-  if (sigma_v != oldsigma_) {
-    changeexpofacsfft(sigma_v);
-  }
+  /* multiply with the gaussian */
+  multiplytransfer(ctx, ctx -> transformed_cube_model, ctx -> expcube_model.points, ctx -> veloarray);
 
-  (*conmodel_)();
-  oldsigma_ = sigma_v;
-  
-  /* Now calculate the chisquare */
-  chisquare = (*fetchchisquare_)();
+  /* Now do the backtransformation */
+  fftwf_execute(ctx -> plin_model);
 
-  *chisquare_ = chisquare;
-  return chisquare;
+  return &ctx -> model;
 }
 
 /* ------------------------------------------------------------ */
@@ -1736,73 +4569,26 @@ double getchisquare_c (float sigma_v)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve a cube with a gaussian via fft */
+/* Convolve the input cube with a gaussian via fft and to the weightmap, adding a constant offset */
 
-static Cube *convolgaussfft_here(void)
+static Cube *convolgaussfft_both(engalmod_ctx *ctx)
 {
-  int i, j, k;
-  float expresult;                 /* A dummy */
-  
-  /* Convolution in all dimensions or in xy only */
-  
-  
-  /* Now do the transform */
-  fftwf_execute(plan_model_);
-  
-  /* multiply with the gaussian, first for nu_v = 0 */
-#ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-  for (i = 0; i < newsize_; ++i) {
-    for (j = 0; j < (model_).size_y; ++j) {
-      
-      /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-      expresult = fftgaussian2d((i <= cubesizexhalf_) ? i : (i-(model_).size_x), (j <= cubesizeyhalf_) ? j : (j-(model_).size_y), expofacsfft_);
-      transformed_cube_model_[i+newsize_*j][0] = expresult*transformed_cube_model_[i+newsize_*j][0];
-      transformed_cube_model_[i+newsize_*j][1] = expresult*transformed_cube_model_[i+newsize_*j][1];
-    }
-  }
- 
-  /* Check for an extra-axis in v, i.e. if the dimension in v is even, we have to calculate one v-plane separately */
-  if (!((model_).size_v % 2)) {
-    /* multiply with the gaussian, first for nu_v = N_v/2 */
-#ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-    for (i = 0; i < newsize_; ++i) {
-      for (j = 0; j < (model_).size_y; ++j)
-	{
-	  /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	  expresult = fftgaussian((i <= cubesizexhalf_) ? i : (i-(model_).size_x), (j <= cubesizeyhalf_) ? j : (j-(model_).size_y), dummy_, expofacsfft_, veloarray_);
-	  transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][0];
-	  transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][1];
-	}
-    }
-  }
-  
-  /* Now the rest has to be done, v ranges from 1, ..., N_v-1/2, and using the symmetrics of the gaussian we fill the rest */
-#ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-  for (i = 0; i < newsize_; ++i) {
-    for (j = 0; j < (model_).size_y; ++j) {
-      for (k = 1; k <= ((model_).size_v-1)/2; ++k) {
-	expresult = fftgaussian((i <= cubesizexhalf_) ? i : (i-(model_).size_x), (j <= cubesizeyhalf_) ? j : (j-(model_).size_y), k, expofacsfft_, veloarray_);
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][0];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][1];
-	
-	/* Because of the symmetry, f(v) = f(-v), we can safe quite some calculations */
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][0];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][1];
-      }
-    }
-  }
-  
-      /* Now do the backtransformation */
-      fftwf_execute(plin_model_);    
-    
-  return &model_; 
-  
+  /* One forward transform for both */
+  fftwf_execute(ctx -> plan_model);
+  if ((ctx -> background))
+    addbackground(ctx, ctx -> transformed_cube_model);
+
+  /* multiply with the gaussians */
+  splittransfer(ctx);
+
+  /* Now add the constant square of the noise */
+  ctx -> transformed_cube_noise[0][0] = ctx -> transformed_cube_noise[0][0] + ctx -> noise.scale;
+
+  /* Now do the backtransformations */
+  fftwf_execute(ctx -> plin_noise);
+  fftwf_execute(ctx -> plin_model);
+
+  return &ctx -> model;
 }
 
 /* ------------------------------------------------------------ */
@@ -1811,32 +4597,31 @@ static Cube *convolgaussfft_here(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve a cube with a gaussian via fft */
+/* Fill the xy-part of the transfer function */
 
-static Cube *convolgaussfft_here_single(void)
+static void maketransferplane(engalmod_ctx *ctx, float *plane, float *expofacs)
 {
   int i, j;
-  float expresult;                 /* A dummy */
+  int nx, ny;
 
-      /* Now do the transform */
-      fftwf_execute(plan_model_);
-      
-      /* multiply with the gaussian, first axis y, second x */
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel for private(i, nx, ny) num_threads(ctx -> threads)
 #endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < (model_).size_y; ++j) {
-	  expresult = fftgaussian2d((i <= cubesizexhalf_) ? i : (i-(model_).size_x), (j <= cubesizeyhalf_) ? j : (j-(model_).size_y), expofacsfft_);
-	  transformed_cube_model_[i+newsize_*j][0] = expresult*transformed_cube_model_[i+newsize_*j][0];
-	  transformed_cube_model_[i+newsize_*j][1] = expresult*transformed_cube_model_[i+newsize_*j][1];
-	  
-	}
-      }
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_model_);    
-  return &model_; 
+  for (j = 0; j < ctx -> model.size_y; ++j) {
+    ny = (j <= ctx -> cubesizeyhalf) ? j : (j-ctx -> model.size_y);
+    for (i = 0; i < ctx -> newsize; ++i) {
+      nx = (i <= ctx -> cubesizexhalf) ? i : (i-ctx -> model.size_x);
+      plane[i+ctx -> newsize*j] = expf(expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*ny*ny);
+    }
+
+    /* For even sizes N_x/2 and -N_x/2 are the same frequency, use the mean to keep the transfer function hermitian */
+    if (!(ctx -> model.size_x % 2)) {
+      nx = ctx -> cubesizexhalf;
+      plane[nx+ctx -> newsize*j] = 0.5*(expf(expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*ny*ny)+expf(expofacs[0]*nx*nx-expofacs[1]*nx*ny+expofacs[2]*ny*ny));
+    }
+  }
+
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1845,76 +4630,38 @@ static Cube *convolgaussfft_here_single(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve the input cube with a gaussian via fft to the weightmap, adding a constant offset */
+/* Multiply with the transfer function */
 
-static Cube *convolgaussfft_noise(void)
+static void multiplytransfer(engalmod_ctx *ctx, fftwf_complex *transformed, float *plane, float *veloarray)
 {
-  int i, j, k;
-  float expresult;                 /* A dummy */
-     
-      /* Now do the transform */
-      fftwf_execute(plan_noise_);
-/*       fftwf_execute(plin_noise_); */
-/*       return NULL; */
-      /* multiply with the gaussian, first for nu_v = 0 */
+  long l, nrows;
+  int i, j, k, newsize;
+  float factor;
+  float *row, *planerow;
 
+  newsize = ctx -> newsize;
+  nrows = ((long) ctx -> model.size_y)*ctx -> model.size_v;
+
+  /* One row in x at a time, the v-part is constant along a row, f(v) = f(-v) */
 #ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  
-	  /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	  expresult = fftgaussian2d((i <= cubesizexhalf_) ? i : (i-model_.size_x), (j <= cubesizeyhalf_) ? j : (j-model_.size_y), expofacsfft_noise_);
-	  transformed_cube_noise_[i+newsize_*j][0] = expresult*transformed_cube_noise_[i+newsize_*j][0];
-	  transformed_cube_noise_[i+newsize_*j][1] = expresult*transformed_cube_noise_[i+newsize_*j][1];
-	}
-      }
-      
-      /* Check for an extra-axis in v, i.e. if the dimension in v is even, we have to calculate one v-plane separately */
-      if (!(model_.size_v % 2)) {
-	/* multiply with the gaussian, first for nu_v = N_v/2 */
-#ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel for private(i, j, k, factor, row, planerow) schedule(static) num_threads(ctx -> threads)
 #endif
-	for (i = 0; i < newsize_; ++i) {
-	  for (j = 0; j < model_.size_y; ++j)
-	    {
-	      /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	      expresult = fftgaussian((i <= cubesizexhalf_) ? i : (i-model_.size_x), (j <= cubesizeyhalf_) ? j : (j-model_.size_y), dummy_, expofacsfft_noise_, veloarray_noise_);
-	      transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][0];
-	      transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][1];
-	    }
-	}
-      }
-      
-      /* Now the rest has to be done, v ranges from 1, ..., N_v-1/2, and using the symmetrics of the gaussian we fill the rest */
+  for (l = 0; l < nrows; ++l) {
+    j = l % ctx -> model.size_y;
+    k = l / ctx -> model.size_y;
+    factor = veloarray[(k <= ctx -> dummy) ? k : (ctx -> model.size_v-k)];
+    row = (float *) (transformed+newsize*l);
+    planerow = plane+newsize*j;
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp simd
 #endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  for (k = 1; k <= (model_.size_v-1)/2; ++k) {
-	    expresult = fftgaussian((i <= cubesizexhalf_) ? i : (i-model_.size_x), (j <= cubesizeyhalf_) ? j : (j-model_.size_y), k, expofacsfft_noise_, veloarray_noise_);
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][0];
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][1];
-	    
-	    /* Because of the symmetry, f(v) = f(-v), we can safe quite some calculations */
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][0];
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][1];
-	  }
-	}
-      }
-      /* Now add the constant square of the noise */
-      transformed_cube_noise_[0][0] = transformed_cube_noise_[0][0] + noise_.scale;
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_noise_);    
-    
-    
-    
-    return &noise_; 
+    for (i = 0; i < newsize; ++i) {
+      row[2*i] = row[2*i]*planerow[i]*factor;
+      row[2*i+1] = row[2*i+1]*planerow[i]*factor;
+    }
+  }
 
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1923,39 +4670,44 @@ static Cube *convolgaussfft_noise(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve the input cube with a gaussian via fft to the weightmap, adding a constant offset */
+/* Multiply with both transfer functions */
 
-static Cube *convolgaussfft_noise_single(void)
+static void splittransfer(engalmod_ctx *ctx)
 {
-  int i, j;
-  float expresult;                 /* A dummy */
-    
+  long l, nrows;
+  int i, j, k, kv, newsize;
+  float factor, factor_noise;
+  float *row, *row_noise, *planerow, *planerow_noise;
 
-      /* Now do the transform */
-      fftwf_execute(plan_noise_);
-      
-      /* multiply with the gaussian, first axis y, second x */
+  newsize = ctx -> newsize;
+  nrows = ((long) ctx -> model.size_y)*ctx -> model.size_v;
+
+  /* Like multiplytransfer, reading the transformed model once */
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel for private(i, j, k, kv, factor, factor_noise, row, row_noise, planerow, planerow_noise) schedule(static) num_threads(ctx -> threads)
 #endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  expresult = fftgaussian2d((i <= cubesizexhalf_) ? i : (i-model_.size_x), (j <= cubesizeyhalf_) ? j : (j-model_.size_y), expofacsfft_noise_);
-	  transformed_cube_noise_[i+newsize_*j][0] = expresult*transformed_cube_noise_[i+newsize_*j][0];
-	  transformed_cube_noise_[i+newsize_*j][1] = expresult*transformed_cube_noise_[i+newsize_*j][1];
-	  
-	}
-      }
-      
-      /* Now add the constant square of the noise */
-      transformed_cube_noise_[0][0] = transformed_cube_noise_[0][0] + noise_.scale;
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_noise_);    
-    
-    
-    return &noise_; 
+  for (l = 0; l < nrows; ++l) {
+    j = l % ctx -> model.size_y;
+    k = l / ctx -> model.size_y;
+    kv = (k <= ctx -> dummy) ? k : (ctx -> model.size_v-k);
+    factor = ctx -> veloarray[kv];
+    factor_noise = ctx -> veloarray_noise[kv];
+    row = (float *) (ctx -> transformed_cube_model+newsize*l);
+    row_noise = (float *) (ctx -> transformed_cube_noise+newsize*l);
+    planerow = ctx -> expcube_model.points+newsize*j;
+    planerow_noise = ctx -> expcube_noise.points+newsize*j;
+#ifdef OPENMPTIR
+#pragma omp simd
+#endif
+    for (i = 0; i < newsize; ++i) {
+      row_noise[2*i] = row[2*i]*planerow_noise[i]*factor_noise;
+      row_noise[2*i+1] = row[2*i+1]*planerow_noise[i]*factor_noise;
+      row[2*i] = row[2*i]*planerow[i]*factor;
+      row[2*i+1] = row[2*i+1]*planerow[i]*factor;
+    }
+  }
 
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -1966,20 +4718,20 @@ static Cube *convolgaussfft_noise_single(void)
 
 /* Calculate factors needed by convolgaussfft */
 
-static float *expofacsfft_here(float sigma_maj, float sigma_min, float *sincosofangle)
+static float *expofacsfft_here(engalmod_ctx *ctx, float sigma_maj, float sigma_min, float *sincosofangle)
 {
   float *expofacs;
 
   if ((sincosofangle && (expofacs = (float *) malloc(5*sizeof(float))))) {
 
   /* First content is the factor to put before (n_x/N_x)^2 */
-  expofacs[0] = -2*PI_HERE*PI_HERE*(sigma_min*sigma_min*sincosofangle[1]*sincosofangle[1]+sigma_maj*sigma_maj*sincosofangle[0]*sincosofangle[0])/(original_.size_x*original_.size_x);
+  expofacs[0] = -2*PI_HERE*PI_HERE*(sigma_min*sigma_min*sincosofangle[1]*sincosofangle[1]+sigma_maj*sigma_maj*sincosofangle[0]*sincosofangle[0])/(ctx -> original.size_x*ctx -> original.size_x);
 
   /* Second content is the factor to put before (n_x/N_x)(n_y/N_y) */
-  expofacs[1] = -4*PI_HERE*PI_HERE*sincosofangle[0]*sincosofangle[1]*(sigma_min*sigma_min-sigma_maj*sigma_maj)/(original_.size_x*original_.size_y);
+  expofacs[1] = -4*PI_HERE*PI_HERE*sincosofangle[0]*sincosofangle[1]*(sigma_min*sigma_min-sigma_maj*sigma_maj)/(ctx -> original.size_x*ctx -> original.size_y);
 
   /* Third content is the factor to put before (n_y/N_y)^2 */
-  expofacs[2] = -2*PI_HERE*PI_HERE*(sigma_min*sigma_min*sincosofangle[0]*sincosofangle[0]+sigma_maj*sigma_maj*sincosofangle[1]*sincosofangle[1])/(original_.size_y*original_.size_y);
+  expofacs[2] = -2*PI_HERE*PI_HERE*(sigma_min*sigma_min*sincosofangle[0]*sincosofangle[0]+sigma_maj*sigma_maj*sincosofangle[1]*sincosofangle[1])/(ctx -> original.size_y*ctx -> original.size_y);
 
   /* Fifth component is the normalisation factor due to the width of the gaussians. This is not a factor to put in the exponent though. Here we have to care if only one direction conovolution is desired */
     if (sigma_maj == 0) 
@@ -1988,7 +4740,7 @@ static float *expofacsfft_here(float sigma_maj, float sigma_min, float *sincosof
     if (sigma_min == 0)
       sigma_min = 1.0/sqrtf(2*PI_HERE);
 
-    expofacs[4] = original_.scale*2*PI_HERE*sigma_min*sigma_maj/(original_.size_v*original_.size_y*original_.size_x);
+    expofacs[4] = ctx -> original.scale*2*PI_HERE*sigma_min*sigma_maj/(ctx -> original.size_v*ctx -> original.size_y*ctx -> original.size_x);
   }
   else
     expofacs = NULL;
@@ -2004,29 +4756,29 @@ static float *expofacsfft_here(float sigma_maj, float sigma_min, float *sincosof
 
 /* Calculate factors needed by convolgaussfft */
 
-static void changeexpofacsfft_noise(float sigma_v)
+static void changeexpofacsfft_noise(engalmod_ctx *ctx, float sigma_v)
 {
   int i;
   /* Fourth content is the factor to put before (n_v/N_v)^2 */
-  expofacsfft_noise_[3] = sigma_v*sigma_v*noiseconstant_1_;
+  ctx -> expofacsfft_noise[3] = sigma_v*sigma_v*ctx -> noiseconstant_1;
   if ((sigma_v)) {
-    expofacsfft_noise_[4] = noiseconstant_2_/sigma_v;
+    ctx -> expofacsfft_noise[4] = ctx -> noiseconstant_2/sigma_v;
     /* Now fill the veloarray */
 #ifdef OPENMPTIR
 #pragma omp parallel for
 #endif
-    for (i = 0; i < model_.size_v/2+1; ++i) {
-      veloarray_noise_[i] = expf(expofacsfft_noise_[3]*i*i)*expofacsfft_noise_[4];
+    for (i = 0; i < ctx -> model.size_v/2+1; ++i) {
+      ctx -> veloarray_noise[i] = expf(ctx -> expofacsfft_noise[3]*i*i)*ctx -> expofacsfft_noise[4];
     }
   }
   else {
-    expofacsfft_noise_[4] = 2*SQRTPI*noiseconstant_2_;
+    ctx -> expofacsfft_noise[4] = 2*SQRTPI*ctx -> noiseconstant_2;
    /* Now fill the veloarray */
 #ifdef OPENMPTIR
 #pragma omp parallel for
 #endif
-    for (i = 0; i < model_.size_v/2+1; ++i) {
-      veloarray_noise_[i] = expf(expofacsfft_noise_[3]*i*i)*expofacsfft_noise_[4];
+    for (i = 0; i < ctx -> model.size_v/2+1; ++i) {
+      ctx -> veloarray_noise[i] = expf(ctx -> expofacsfft_noise[3]*i*i)*ctx -> expofacsfft_noise[4];
     }
   }
   return;
@@ -2040,19 +4792,13 @@ static void changeexpofacsfft_noise(float sigma_v)
 
 /* Calculate factors needed by convolgaussfft */
 
-static void changeexpofacsfft(float sigma_v)
+static void changeexpofacsfft(engalmod_ctx *ctx, float sigma_v)
 {
-  int i;
 /* Fourth content is the factor to put before (n_v/N_v)^2 */
-  expofacsfft_[3] = modelconstant_1_*sigma_v*sigma_v;
+  ctx -> expofacsfft[3] = ctx -> modelconstant_1*sigma_v*sigma_v;
 
   /* Now fill the veloarray */
-#ifdef OPENMPTIR
-#pragma omp parallel for
-#endif
-    for (i = 0; i < model_.size_v/2+1; ++i) {
-      veloarray_[i] = expf(expofacsfft_[3]*i*i)*expofacsfft_[4];
-    }
+  fillveloarray(ctx, sigma_v, ctx -> veloarray);
   return;
 }
 
@@ -2062,61 +4808,22 @@ static void changeexpofacsfft(float sigma_v)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Calculate a gaussian */
-
-static float fftgaussian (int nx, int ny, int nv, float *expofacs, float *veloarray)
-{ 
-  /* As the trial to safe some time as seen below failed for some reason, we postpone it */
-
-    return expf(expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*ny*ny)*veloarray[nv];
-}
-
-/* ------------------------------------------------------------ */
-
-
-
-/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-
-/* Calculate a gaussian */
-
-static float fftgaussian_array (int nx, int ny, int nv, float *expofacs, float *array, float *veloarray)
-{ 
-  /* As the trial to safe some time as seen below failed for some reason, we postpone it */
-
-/*     return array[nx+expcube_noise_.size_x*ny]*expf(expofacs[3]*nv*nv) * expofacs[4]; */
-    return array[nx+expcube_noise_.size_x*ny]*veloarray[nv];
-}
-
-/* ------------------------------------------------------------ */
-
-
-
-/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
-
-/* Calculate a gaussian */
+/* Fill the v-part of the transfer function */
 
-static float fftgaussian2d (int nx, int ny, float *expofacs)
+static void fillveloarray(engalmod_ctx *ctx, float sigma_v, float *veloarray)
 {
-/*   double number; */
-
-  /* If the floating point is low enough, we can simply return 0 */
-/*   if ((number = expf(expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*ny*ny+expofacs[4])) <= MINEXPONENT) */
-/*     return (float) exp(number); */
-/*   else */
-    return expf(expofacs[0]*nx*nx+expofacs[1]*nx*ny+expofacs[2]*ny*ny)*expofacs[4];
-}
-
-/* ------------------------------------------------------------ */
-
-
-
-/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+  int i;
+  float expofac;
 
-/* Calculate a gaussian */
+  expofac = ctx -> modelconstant_1*sigma_v*sigma_v;
 
-static float fftgaussian2d_array (int nx, int ny, float *expofacs, float *array)
-{
-  return array[nx+expcube_noise_.size_x*ny]*expofacs[4];
+#ifdef OPENMPTIR
+#pragma omp parallel for
+#endif
+  for (i = 0; i < ctx -> model.size_v/2+1; ++i) {
+    veloarray[i] = expf(expofac*i*i)*ctx -> expofacsfft[4];
+  }
+  return;
 }
 
 /* ------------------------------------------------------------ */
@@ -2160,7 +4867,7 @@ static float degreetoradian(float degrees)
 
 Cube *getoriginal_galmod_(void)
 {
-  return &original_;
+  return &default_ctx_.original;
 }
 
 /* ------------------------------------------------------------ */
@@ -2172,7 +4879,7 @@ Cube *getoriginal_galmod_(void)
 
 Cube *getmodel_galmod_(void)
 {
-  return &model_;
+  return &default_ctx_.model;
 }
 
 /* ------------------------------------------------------------ */
@@ -2184,7 +4891,7 @@ Cube *getmodel_galmod_(void)
 
 Cube *getnoise_galmod_(void)
 {
-  return &noise_;
+  return &default_ctx_.noise;
 }
 
 /* ------------------------------------------------------------ */
@@ -2193,134 +4900,110 @@ Cube *getnoise_galmod_(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static void makemodelarray(float *array)
+/* First write of an array with the static schedule of the chisquare */
+static void firsttouch(float *array, float *source, long rowlength, long nrows, int threads)
 {
-  int i,j;
-  int nx, ny;
+  long l;
+
+  if (threads < 1)
+    threads = 1;
+
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel for schedule(static) num_threads(threads)
 #endif
-  for (i = 0; i < expcube_model_.size_x; ++i) {
-    for (j = 0; j < expcube_model_.size_y; ++j) {
-      nx = (i <= cubesizexhalf_) ? i : (i-(model_).size_x);
-      ny = (j <= cubesizeyhalf_) ? j : (j-(model_).size_y);
-      expcube_model_.points[i+expcube_model_.size_x*j] = expofacsfft_[0]*nx*nx+expofacsfft_[1]*nx*ny+expofacsfft_[2]*ny*ny;
-    }
-  }
-  
-  for (i = 0; i < expcube_model_.size_x; ++i) {
-    for (j = 0; j < expcube_model_.size_y; ++j) {
-      expcube_model_.points[i+expcube_model_.size_x*j] = expf(array[i+expcube_model_.size_x*j]);
-    }
+  for (l = 0; l < nrows; ++l) {
+    if ((source))
+      memcpy(array+l*rowlength, source+l*rowlength, rowlength*sizeof(float));
+    else
+      memset(array+l*rowlength, 0, rowlength*sizeof(float));
   }
 
   return;
 }
 
+
 /* ------------------------------------------------------------ */
 
-/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve a cube with a gaussian via fft */
 
-static Cube *convolgaussfft_here_array(void)
-{
-  int i, j, k;
-  float expresult;                 /* A dummy */
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  /* Convolution in all dimensions or in xy only */
+/* Interleave the pages of an array over the NUMA nodes */
+static int interleave(void *array, size_t size)
+{
+#if defined(LINUX) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+  unsigned long nodemask[NUMAMASK];
+  unsigned long pagesize, start, end;
 
- 
-  /* Now do the transform */
-  fftwf_execute(plan_model_);
-  
-  /* multiply with the gaussian, first for nu_v = 0 */
-/*   #ifdef OPENMPTIR */
-/*   #pragma omp parallel for */
-/*   #endif */
-  for (i = 0; i < newsize_; ++i) {
-    for (j = 0; j < (model_).size_y; ++j) {
-      
-      /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-      expresult = fftgaussian2d_array(i, j, expofacsfft_, expcube_model_.points);
-      transformed_cube_model_[i+newsize_*j][0] = expresult*transformed_cube_model_[i+newsize_*j][0];
-      transformed_cube_model_[i+newsize_*j][1] = expresult*transformed_cube_model_[i+newsize_*j][1];
-    }
-  }
-  
-/*   convolgaussfft_here_array_help1(); */
-   /* Check for an extra-axis in v, i.e. if the dimension in v is even, we have to calculate one v-plane separately */
-  if (!((model_).size_v % 2)) {
-    /* multiply with the gaussian, first for nu_v = N_v/2 */
-    #ifdef OPENMPTIR
-    /* pragma omp parallel for */
-    #endif
-    for (i = 0; i < newsize_; ++i) {
-      for (j = 0; j < (model_).size_y; ++j) {
-	/* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	expresult = fftgaussian_array(i, j, dummy_, expofacsfft_, expcube_model_.points, veloarray_);
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][0];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*dummy_)][1];
-      }
-    }
-  }
+  if (syscall(SYS_get_mempolicy, NULL, nodemask, (unsigned long) NUMAMASK*8*sizeof(unsigned long), NULL, NUMA_MEMS_ALLOWED))
+    return 0;
 
-  /* Now the rest has to be done, v ranges from 1, ..., N_v-1/2, and using the symmetrics of the gaussian we fill the rest */
-/*   #ifdef OPENMPTIR */
-/* !!! pragma omp parallel for */
-/*   #endif */
-  for (i = 0; i < newsize_; ++i) {
-    for (j = 0; j < (model_).size_y; ++j) {
-      for (k = 1; k <= ((model_).size_v-1)/2; ++k) {
-	expresult = fftgaussian_array(i, j, k, expofacsfft_, expcube_model_.points, veloarray_);
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][0];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*k)][1];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][0] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][0];
-	transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][1] = expresult*transformed_cube_model_[i+newsize_*(j+(model_).size_y*((model_).size_v-k))][1];
-      }
-    }
-  }
+  pagesize = (unsigned long) sysconf(_SC_PAGESIZE);
+  start = (((unsigned long) array+pagesize-1)/pagesize)*pagesize;
+  end = (((unsigned long) array+size)/pagesize)*pagesize;
+  if (end <= start)
+    return 0;
 
-  /* Now do the backtransformation */
-  fftwf_execute(plin_model_);    
-    
-  return &model_; 
-  
+  /* The kernel reads one node less than maxnode */
+  return !syscall(SYS_mbind, start, end-start, NUMA_INTERLEAVE, nodemask, (unsigned long) NUMAMASK*8*sizeof(unsigned long)+1, 0);
+#else
+  return 0;
+#endif
 }
 
+
 /* ------------------------------------------------------------ */
 
 
 
+#if defined(LINUX) && defined(SYS_getcpu)
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve a cube with a gaussian via fft */
-
-static Cube *convolgaussfft_here_single_array(void)
+/* Query the nodes of the pages of an array */
+static int placeme(engalmod_ctx *ctx, void *array, long nrows, int *rownode, long *pages, long *local, unsigned long *nodemask)
 {
-  int i, j;
-  float expresult;                 /* A dummy */
-
-      /* Now do the transform */
-      fftwf_execute(plan_model_);
-      
-      /* multiply with the gaussian, first axis y, second x */
-/* #ifdef OPENMPTIR */
-/* !!! pragma omp parallel for */
-/* #endif */
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < (model_).size_y; ++j) {
-	  expresult = fftgaussian2d_array(i, j, expofacsfft_, expcube_model_.points);
-	  transformed_cube_model_[i+newsize_*j][0] = expresult*transformed_cube_model_[i+newsize_*j][0];
-	  transformed_cube_model_[i+newsize_*j][1] = expresult*transformed_cube_model_[i+newsize_*j][1];
-	  
-	}
-      }
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_model_);    
-  return &model_; 
+#if defined(LINUX) && defined(SYS_move_pages)
+  void *addresses[NUMASAMPLE];
+  int status[NUMASAMPLE];
+  unsigned long pagesize, first, last, step;
+  long rowbytes, npages, i, row, offset;
+
+  if (!array || nrows < 1)
+    return 1;
+
+  pagesize = (unsigned long) sysconf(_SC_PAGESIZE);
+  rowbytes = ctx -> realmodelsizex*sizeof(float);
+  first = ((unsigned long) array/pagesize)*pagesize;
+  last = (((unsigned long) array+nrows*rowbytes-1)/pagesize)*pagesize;
+  step = ((last-first)/pagesize)/NUMASAMPLE+1;
+
+  npages = 0;
+  for (i = 0; first+i*step*pagesize <= last; ++i)
+    addresses[npages++] = (void *) (first+i*step*pagesize);
+
+  /* With nodes NULL nothing is moved, the status is the node of a page or a negative error code */
+  if (syscall(SYS_move_pages, 0, (unsigned long) npages, addresses, NULL, status, 0))
+    return 0;
+
+  for (i = 0; i < npages; ++i) {
+    if (status[i] < 0 || status[i] >= NUMAMASK*8*((int) sizeof(unsigned long)))
+      continue;
+    ++*pages;
+    nodemask[status[i]/(8*sizeof(unsigned long))] |= 1UL << (status[i]%(8*sizeof(unsigned long)));
+
+    /* The row at the start of the page decides where the page has been touched */
+    offset = (long) ((char *) addresses[i]-(char *) array);
+    row = (offset > 0) ? offset/rowbytes : 0;
+    if (rownode[row] == status[i])
+      ++*local;
+  }
+  return 1;
+#else
+  return 0;
+#endif
 }
+#endif
+
 
 /* ------------------------------------------------------------ */
 
@@ -2328,151 +5011,98 @@ static Cube *convolgaussfft_here_single_array(void)
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve the input cube with a gaussian via fft to the weightmap, adding a constant offset */
-
-static Cube *convolgaussfft_noise_array(void)
+/* Copy a cube into a new array first touched with the static schedule of the chisquare */
+float *engalmod_numacopy(float *array, int x, int y, int v, int threads)
 {
-  int i, j, k;
-  float expresult;                 /* A dummy */
-     
-      /* Now do the transform */
-      fftwf_execute(plan_noise_);
-/*       fftwf_execute(plin_noise_); */
-/*       return NULL; */
-      /* multiply with the gaussian, first for nu_v = 0 */
+  float *placed;
 
-#ifdef OPENMPTIR
-/* pragma omp parallel for */
-#endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  
-	  /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	  expresult = fftgaussian2d_array(i, j, expofacsfft_noise_, expcube_noise_.points);
-	  transformed_cube_noise_[i+newsize_*j][0] = expresult*transformed_cube_noise_[i+newsize_*j][0];
-	  transformed_cube_noise_[i+newsize_*j][1] = expresult*transformed_cube_noise_[i+newsize_*j][1];
-	}
-      }
-      
-    if (!(model_.size_v % 2)) {
-    /* multiply with the gaussian, first for nu_v = N_v/2 */
-#ifdef OPENMPTIR
-/* pragma omp parallel for */
-#endif
-    for (i = 0; i < newsize_; ++i) {
-      for (j = 0; j < model_.size_y; ++j)
-	{
-	  /* The exponential will be evaluated from 0, ... , N/2 and -1, ..., -N/2 or -N/2 - 1 */
-	  expresult = fftgaussian_array(i,j, dummy_, expofacsfft_noise_, expcube_noise_.points, veloarray_noise_);
-	      transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][0];
-	      transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*dummy_)][1];
-	}
-    }
-  }
+  if (!array)
+    return NULL;
 
-      /* Now the rest has to be done, v ranges from 1, ..., N_v-1/2, and using the symmetrics of the gaussian we fill the rest */
-/* #ifdef OPENMPTIR */
-/* !!! pragma omp parallel for */
-/* #endif */
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  for (k = 1; k <= (model_.size_v-1)/2; ++k) {
-	    expresult = fftgaussian_array(i,j, k, expofacsfft_noise_,expcube_noise_.points, veloarray_noise_);
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][0];
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*k)][1];
-	    
-	    /* Because of the symmetry, f(v) = f(-v), we can safe quite some calculations */
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][0] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][0];
-	    transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][1] = expresult*transformed_cube_noise_[i+newsize_*(j+model_.size_y*(model_.size_v-k))][1];
-	  }
-	}
-      }
-      /* Now add the constant square of the noise */
-      transformed_cube_noise_[0][0] = transformed_cube_noise_[0][0] + noise_.scale;
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_noise_);    
-    
-    
-    
-    return &noise_; 
+  /* Keep the old array if there is no memory for a second one */
+  if (!(placed = (float *) fftwf_malloc(((size_t) (2*(x/2+1)))*y*v*sizeof(float))))
+    return array;
 
+  firsttouch(placed, array, 2*(x/2+1), ((long) y)*v, threads);
+  fftwf_free(array);
+
+  return placed;
 }
 
+
 /* ------------------------------------------------------------ */
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* Convolve the input cube with a gaussian via fft to the weightmap, adding a constant offset */
-
-static Cube *convolgaussfft_noise_single_array(void)
+/* Placement of the cubes of the default context */
+int engalmod_numareport(long *pages, long *local, int *nodes)
 {
-  int i, j;
-  float expresult;                 /* A dummy */
-    
-
-      /* Now do the transform */
-      fftwf_execute(plan_noise_);
-      
-      /* multiply with the gaussian, first axis y, second x */
-#ifdef OPENMPTIR
-/* pragma omp parallel for */
-#endif
-      for (i = 0; i < newsize_; ++i) {
-	for (j = 0; j < model_.size_y; ++j) {
-	  expresult = fftgaussian2d_array(i,j, expofacsfft_noise_, expcube_noise_.points);
-	  transformed_cube_noise_[i+newsize_*j][0] = expresult*transformed_cube_noise_[i+newsize_*j][0];
-	  transformed_cube_noise_[i+newsize_*j][1] = expresult*transformed_cube_noise_[i+newsize_*j][1];
-	  
-	}
-      }
-      
-      /* Now add the constant square of the noise */
-      transformed_cube_noise_[0][0] = transformed_cube_noise_[0][0] + noise_.scale;
-      
-      /* Now do the backtransformation */
-      fftwf_execute(plin_noise_);    
-    
-    
-    return &noise_; 
-
+  return engalmod_ctx_numareport(&default_ctx_, pages, local, nodes);
 }
 
+
 /* ------------------------------------------------------------ */
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-static void makenoisearray(float *array)
+/* Placement of the cubes */
+int engalmod_ctx_numareport(engalmod_ctx *ctx, long *pages, long *local, int *nodes)
 {
-  int i,j;
-  int nx, ny;
+#if defined(LINUX) && defined(SYS_getcpu)
+  unsigned long nodemask[NUMAMASK];
+  int *rownode;
+  long nrows, l;
+  int i, ok;
+#endif
+
+  *pages = *local = 0;
+  *nodes = 0;
+
+  if (!ctx || !(ctx -> model.points))
+    return 0;
+
+#if defined(LINUX) && defined(SYS_getcpu)
+  nrows = ((long) ctx -> original.size_y)*ctx -> original.size_v;
+  if (!(rownode = (int *) malloc(nrows*sizeof(int))))
+    return 0;
+
+  /* The node of the thread working on a row, threads that are not bound to cores may have moved since the first touch */
 #ifdef OPENMPTIR
-#pragma omp parallel for
+#pragma omp parallel num_threads(ctx -> threads)
 #endif
-  for (i = 0; i < expcube_noise_.size_x; ++i) {
-    for (j = 0; j < expcube_noise_.size_y; ++j) {
-      nx = (i <= cubesizexhalf_) ? i : (i-(noise_).size_x);
-      ny = (j <= cubesizeyhalf_) ? j : (j-(noise_).size_y);
-      expcube_noise_.points[i+expcube_noise_.size_x*j] = expofacsfft_noise_[0]*nx*nx+expofacsfft_noise_[1]*nx*ny+expofacsfft_noise_[2]*ny*ny;
-    }
-  }
+  {
+    unsigned int cpu = 0, node = 0;
 
-  /* This is maybe not elegant but may be safe */
-/* #ifdef OPENMPTIR */
-/* !!! pragma omp parallel for */
-/* #endif */
-  for (i = 0; i < expcube_noise_.size_x; ++i) {
-    for (j = 0; j < expcube_noise_.size_y; ++j) {
-      expcube_noise_.points[i+expcube_noise_.size_x*j] = expf(array[i+expcube_noise_.size_x*j]);
-    }
+    syscall(SYS_getcpu, &cpu, &node, NULL);
+#ifdef OPENMPTIR
+#pragma omp for schedule(static)
+#endif
+    for (l = 0; l < nrows; ++l)
+      rownode[l] = (int) node;
   }
-  return;
+
+  for (i = 0; i < NUMAMASK; ++i)
+    nodemask[i] = 0;
+
+  ok = placeme(ctx, ctx -> original.points, nrows, rownode, pages, local, nodemask) && placeme(ctx, ctx -> model.points, nrows, rownode, pages, local, nodemask) && placeme(ctx, ctx -> noise.points, nrows, rownode, pages, local, nodemask) && placeme(ctx, ctx -> transformed_cube_model, nrows, rownode, pages, local, nodemask) && placeme(ctx, ctx -> transformed_cube_noise, nrows, rownode, pages, local, nodemask) && placeme(ctx, ctx -> transformed_cube_orig, nrows, rownode, pages, local, nodemask);
+
+  free(rownode);
+
+  for (i = 0; i < NUMAMASK*8*((int) sizeof(unsigned long)); ++i)
+    if ((nodemask[i/(8*sizeof(unsigned long))] & (1UL << (i%(8*sizeof(unsigned long))))))
+      ++*nodes;
+
+  return ok;
+#else
+  return 0;
+#endif
 }
 
+
 /* ------------------------------------------------------------ */
 
 
@@ -215,6 +215,42 @@ static float absfou4(float x, float a0, float a1, float p1, float a2, float p2,f
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static float maths_rndmf_qmc(maths_rstrf *rnob)
+  @brief Delivers the next coordinate of a shifted Halton point
+
+  See maths_rndmf_initq().
+
+  @param rnob (maths_rstrf *) A maths_rstrf struct initialised with maths_rndmf_initq()
+
+  @return float maths_rndmf_qmc: A number in the range [0,1)
+*/
+/* ------------------------------------------------------------ */
+static float maths_rndmf_qmc(maths_rstrf *rnob);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static long maths_interp_index(const double *x, long n, double xv, long i)
+  @brief Index of the interval of an interpolation containing xv
+
+  Hunts from interval i, then bisects. Points outside the nodes give
+  the first or last interval.
+
+  @param x  (const double *) Nodes
+  @param n  (long)           Number of nodes
+  @param xv (double)         Point
+  @param i  (long)           First guess
+
+  @return long maths_interp_index: Index i with x[i] <= xv < x[i+1]
+*/
+/* ------------------------------------------------------------ */
+static long maths_interp_index(const double *x, long n, double xv, long i);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* FUNCTION CODE */
 /* ------------------------------------------------------------ */
@@ -542,6 +578,7 @@ void maths_rndmf_init(int *seed, maths_rstrf *out)
   out -> cm = out -> cm/16777216;
   out -> i97 = 97;
   out -> j97 = 33;
+  out -> counter = 0;
 
   return;
 }
@@ -590,6 +627,22 @@ double maths_rndm(maths_rstr *rnob)
 float maths_rndmf(maths_rstrf *rnob)
 {
   float random;
+
+  /* Halton sequence */
+  if (rnob -> counter == 2)
+    return maths_rndmf_qmc(rnob);
+
+  /* Counter-based generator, 24 bits per number */
+  if ((rnob -> counter)) {
+    if (!rnob -> nbuf) {
+      maths_philox(rnob -> ctr, rnob -> key, rnob -> buf);
+      ++rnob -> ctr[2];
+      rnob -> nbuf = 4;
+    }
+    --rnob -> nbuf;
+    return (float) (rnob -> buf[rnob -> nbuf] >> 8)*5.9604644775390625e-08f;
+  }
+
   random = rnob -> u[rnob -> i97-1] - rnob -> u[rnob -> j97-1];
   if (random <= 0) 
     random = random + 1.0;
@@ -618,6 +671,154 @@ float maths_rndmf(maths_rstrf *rnob)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* The Philox4x32-10 counter-based generator */
+void maths_philox(const unsigned int *ctr, const unsigned int *key, unsigned int *out)
+{
+  unsigned long long prod0, prod1;
+  unsigned int c[4], k[2];
+  int i;
+
+  c[0] = ctr[0];
+  c[1] = ctr[1];
+  c[2] = ctr[2];
+  c[3] = ctr[3];
+  k[0] = key[0];
+  k[1] = key[1];
+
+  for (i = 0; i < 10; ++i) {
+    prod0 = 0xD2511F53ULL*c[0];
+    prod1 = 0xCD9E8D57ULL*c[2];
+    c[0] = ((unsigned int) (prod1 >> 32))^c[1]^k[0];
+    c[2] = ((unsigned int) (prod0 >> 32))^c[3]^k[1];
+    c[1] = (unsigned int) prod1;
+    c[3] = (unsigned int) prod0;
+    k[0] += 0x9E3779B9U;
+    k[1] += 0xBB67AE85U;
+  }
+
+  out[0] = c[0];
+  out[1] = c[1];
+  out[2] = c[2];
+  out[3] = c[3];
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Delivers the next coordinate of a shifted Halton point */
+static float maths_rndmf_qmc(maths_rstrf *rnob)
+{
+  static const unsigned int prime[MATHS_QMC_NDIM] = {2, 3, 5, 7, 11, 13, 17, 19};
+  unsigned long long n;
+  unsigned int d, b;
+  double f, x;
+  float random;
+
+  d = rnob -> ctr[3];
+  ++rnob -> ctr[3];
+
+  /* Beyond the tabulated dimensions, one pseudo-random number per draw */
+  if (d >= MATHS_QMC_NDIM) {
+    maths_philox(rnob -> ctr, rnob -> key, rnob -> buf);
+    return (float) (rnob -> buf[0] >> 8)*5.9604644775390625e-08f;
+  }
+
+  /* Radical inverse of the index in base prime[d], index 0 is not used */
+  n = ((unsigned long long) rnob -> ctr[1] << 32)+rnob -> ctr[0]+1ULL;
+  b = prime[d];
+  f = 1.0/b;
+  x = 0.0;
+  while (n) {
+    x = x+f*(double) (n%b);
+    n = n/b;
+    f = f/b;
+  }
+
+  x = x+rnob -> shift[d];
+  if (x >= 1.0)
+    x = x-1.0;
+
+  random = (float) x;
+  if (random >= 1.0f)
+    random = 0.99999994f;
+
+  return random;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Initialises a random number object with the counter-based generator */
+void maths_rndmf_initc(const unsigned int *key, maths_rstrf *out)
+{
+  out -> counter = 1;
+  out -> key[0] = key[0];
+  out -> key[1] = key[1];
+  maths_rndmf_seek(out, 0);
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Initialises a random number object with a quasi-random sequence */
+void maths_rndmf_initq(const unsigned int *key, maths_rstrf *out)
+{
+  unsigned int ctr[4] = {0, 0, 0xFFFFFFFFU, 0xFFFFFFFFU};
+  int i;
+
+  maths_rndmf_initc(key, out);
+  out -> counter = 2;
+
+  /* The shifts come from a counter that maths_rndmf_seek never reaches */
+  for (i = 0; i < MATHS_QMC_NDIM; ++i) {
+    if (!(i%4)) {
+      maths_philox(ctr, out -> key, out -> buf);
+      --ctr[3];
+    }
+    out -> shift[i] = (float) ((out -> buf[i%4] >> 8)*5.9604644775390625e-08);
+  }
+  out -> nbuf = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Positions a counter-based random number object at a sequence */
+void maths_rndmf_seek(maths_rstrf *rnob, unsigned long index)
+{
+  rnob -> ctr[0] = (unsigned int) (index & 0xFFFFFFFFUL);
+  rnob -> ctr[1] = (unsigned int) ((index >> 16) >> 16);
+  rnob -> ctr[2] = 0;
+  rnob -> ctr[3] = 0;
+  rnob -> nbuf = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* 3d active rotation about x-axis */
@@ -1280,6 +1481,249 @@ void maths_bubblei(int *array, long length)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Allocates an interpolation */
+maths_interp *maths_interp_alloc(long size)
+{
+  maths_interp *interp;
+
+  if (size < 2 || !(interp = (maths_interp *) malloc(sizeof(maths_interp))))
+    return NULL;
+
+  interp -> type = MATHS_I_LINEAR;
+  interp -> size = size;
+  interp -> n = 0;
+  interp -> b = (double *) malloc(size*sizeof(double));
+  interp -> c = (double *) malloc(size*sizeof(double));
+  interp -> d = (double *) malloc(size*sizeof(double));
+  interp -> work = (double *) malloc((3*size+4)*sizeof(double));
+
+  if (!(interp -> b) || !(interp -> c) || !(interp -> d) || !(interp -> work)) {
+    maths_interp_free(interp);
+    return NULL;
+  }
+
+  return interp;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Frees an interpolation */
+void maths_interp_free(maths_interp *interp)
+{
+  if (!(interp))
+    return;
+
+  if ((interp -> b))
+    free(interp -> b);
+  if ((interp -> c))
+    free(interp -> c);
+  if ((interp -> d))
+    free(interp -> d);
+  if ((interp -> work))
+    free(interp -> work);
+  free(interp);
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Calculates the coefficients of an interpolation */
+int maths_interp_init(maths_interp *interp, int type, const double *x, const double *y, long n)
+{
+  long i;
+  double h, hp1, g, gp1, ne, nenext, alpha, alphap1, tl;
+  double *diag, *offdiag, *rhs, *m;
+
+  if (n < 2 || n > interp -> size)
+    return 0;
+
+  if (type == MATHS_I_AKIMA && n < 5)
+    type = MATHS_I_CSPLINE;
+  if (type == MATHS_I_CSPLINE && n < 3)
+    type = MATHS_I_LINEAR;
+
+  interp -> type = type;
+  interp -> n = n;
+
+  switch (type) {
+  case MATHS_I_LINEAR:
+    for (i = 0; i < n-1; ++i) {
+      h = x[i+1]-x[i];
+      interp -> b[i] = h > 0.0 ? (y[i+1]-y[i])/h : 0.0;
+      interp -> c[i] = interp -> d[i] = 0.0;
+    }
+    break;
+
+  case MATHS_I_CSPLINE:
+
+    /* Natural spline, the second derivatives c[1] to c[n-2] from a symmetric tridiagonal system */
+    diag = interp -> work;
+    offdiag = interp -> work+n;
+    rhs = interp -> work+2*n;
+    interp -> c[0] = interp -> c[n-1] = 0.0;
+    for (i = 0; i < n-2; ++i) {
+      h = x[i+1]-x[i];
+      hp1 = x[i+2]-x[i+1];
+      g = h != 0.0 ? 1.0/h : 0.0;
+      gp1 = hp1 != 0.0 ? 1.0/hp1 : 0.0;
+      offdiag[i] = hp1;
+      diag[i] = 2.0*(hp1+h);
+      rhs[i] = 3.0*((y[i+2]-y[i+1])*gp1-(y[i+1]-y[i])*g);
+    }
+
+    /* Forward elimination, then back substitution */
+    for (i = 1; i < n-2; ++i) {
+      g = offdiag[i-1]/diag[i-1];
+      diag[i] -= g*offdiag[i-1];
+      rhs[i] -= g*rhs[i-1];
+    }
+    interp -> c[n-2] = rhs[n-3]/diag[n-3];
+    for (i = n-4; i >= 0; --i)
+      interp -> c[i+1] = (rhs[i]-offdiag[i]*interp -> c[i+2])/diag[i];
+
+    for (i = 0; i < n-1; ++i) {
+      h = x[i+1]-x[i];
+      if (h > 0.0) {
+	interp -> b[i] = (y[i+1]-y[i])/h-h*(interp -> c[i+1]+2.0*interp -> c[i])/3.0;
+	interp -> d[i] = (interp -> c[i+1]-interp -> c[i])/(3.0*h);
+      }
+      else
+	interp -> b[i] = interp -> d[i] = 0.0;
+    }
+    break;
+
+  case MATHS_I_AKIMA:
+
+    /* The slopes, two extrapolated ones on each side */
+    m = interp -> work+2;
+    for (i = 0; i < n-1; ++i)
+      m[i] = (y[i+1]-y[i])/(x[i+1]-x[i]);
+    m[-2] = 3.0*m[0]-2.0*m[1];
+    m[-1] = 2.0*m[0]-m[1];
+    m[n-1] = 2.0*m[n-2]-m[n-3];
+    m[n] = 3.0*m[n-2]-2.0*m[n-3];
+
+    for (i = 0; i < n-1; ++i) {
+      ne = fabs(m[i+1]-m[i])+fabs(m[i-1]-m[i-2]);
+      if (ne == 0.0) {
+	interp -> b[i] = m[i];
+	interp -> c[i] = interp -> d[i] = 0.0;
+      }
+      else {
+	h = x[i+1]-x[i];
+	nenext = fabs(m[i+2]-m[i+1])+fabs(m[i]-m[i-1]);
+	alpha = fabs(m[i-1]-m[i-2])/ne;
+	if (nenext == 0.0)
+	  tl = m[i];
+	else {
+	  alphap1 = fabs(m[i]-m[i-1])/nenext;
+	  tl = (1.0-alphap1)*m[i]+alphap1*m[i+1];
+	}
+	interp -> b[i] = (1.0-alpha)*m[i-1]+alpha*m[i];
+	interp -> c[i] = (3.0*m[i]-2.0*interp -> b[i]-tl)/h;
+	interp -> d[i] = (interp -> b[i]+tl-2.0*m[i])/(h*h);
+      }
+    }
+    break;
+
+  default:
+    return 0;
+  }
+
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Index of the interval of an interpolation containing xv */
+static long maths_interp_index(const double *x, long n, double xv, long i)
+{
+  long lo, hi, mid;
+
+  /* The same or the next interval */
+  if (i < 0 || i > n-2)
+    i = 0;
+  if (xv >= x[i] && (i == n-2 || xv < x[i+1]))
+    return i;
+  if (i < n-2 && xv >= x[i+1] && (i+1 == n-2 || xv < x[i+2]))
+    return i+1;
+
+  if (xv < x[1])
+    return 0;
+  if (xv >= x[n-2])
+    return n-2;
+
+  lo = 1;
+  hi = n-2;
+  while (hi-lo > 1) {
+    mid = (lo+hi)/2;
+    if (xv < x[mid])
+      hi = mid;
+    else
+      lo = mid;
+  }
+
+  return lo;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Evaluates an interpolation at one point */
+double maths_interp_eval(const maths_interp *interp, const double *x, const double *y, double xv)
+{
+  long i;
+  double dx;
+
+  i = maths_interp_index(x, interp -> n, xv, 0);
+  dx = xv-x[i];
+
+  return y[i]+dx*(interp -> b[i]+dx*(interp -> c[i]+dx*interp -> d[i]));
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Evaluates an interpolation at many points */
+void maths_interp_evalf(const maths_interp *interp, const double *x, const double *y, const float *xv, float *yv, long nv)
+{
+  long i = 0, k;
+  double dx;
+
+  for (k = 0; k < nv; ++k) {
+    i = maths_interp_index(x, interp -> n, xv[k], i);
+    dx = xv[k]-x[i];
+    yv[k] = y[i]+dx*(interp -> b[i]+dx*(interp -> c[i]+dx*interp -> d[i]));
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ 
 
    $Log: maths.c,v $
@@ -477,8 +477,6 @@ jozsa@astron.nl
 #include <limits.h>
 #include <sys/stat.h>
 #include <gft.h>
-#include <gsl/gsl_interp.h>
-#include <gsl/gsl_spline.h>
 #ifdef OPENMPTIR
 #include <omp.h>
 #endif
@@ -529,6 +527,33 @@ jozsa@astron.nl
 #define MAXNSUBS 2048
 #define MAXVARY MAXNUR*9+1
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define WISDOMFILE_DEFAULT
+   @brief Default stem of the fftw wisdom files, placed in the directory of the logfile
+*/
+/* ------------------------------------------------------------ */
+#define WISDOMFILE_DEFAULT "tirific_fftw.wisdom"
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define NOISEUPD_ITER
+   @brief NOISEUPD= value: refresh the weight map once per iteration
+
+   NOISEUPD=N with N > 0 refreshes the weight map every N models,
+   NOISEUPD_LOOP once per loop.
+*/
+/* ------------------------------------------------------------ */
+#define NOISEUPD_ITER -1
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define NOISEUPD_LOOP
+   @brief NOISEUPD= value: refresh the weight map once per loop
+*/
+/* ------------------------------------------------------------ */
+#define NOISEUPD_LOOP -2
+
 
 /* Primary beam correction, since I am not sure at all if this should end up in the final code ... */
 /* #define PBCORR 1 */
@@ -891,6 +916,7 @@ jozsa@astron.nl
 #define PSW_PSFI_DEF 0.4   /* PSWARM final weight */								   
 #define PSW_PSID_DEF 2.	   /* PSWARM increase delta */								   
 #define PSW_PSDD_DEF 0.5   /* PSWARM decrease delta */                                                            
+#define PSW_PSBA_DEF 1     /* PSWARM models evaluated at once */                                                            
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
@@ -950,6 +976,115 @@ jozsa@astron.nl
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define GRID_ALL GRID_DELTA GRID_FORE GRID_BACK
+   @brief Modes of galmod_grid()
+
+   GRID_ALL:   All pointsources onto the model array
+   GRID_DELTA: Only new pointsource lists into rpm -> deltac
+   GRID_FORE:  Only the subrings changed by the current VARY group (srd bgactive)
+   GRID_BACK:  Only the subrings not changed by the current VARY group
+*/
+/* ------------------------------------------------------------ */
+#define GRID_ALL   0
+#define GRID_DELTA 1
+#define GRID_FORE  2
+#define GRID_BACK  3
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define SRCONST_BLOCK
+   @brief Number of clouds generated at once by srconst_block()
+*/
+/* ------------------------------------------------------------ */
+#define SRCONST_BLOCK 512
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define SRCONST_XXX
+   @brief Modes of srconst()
+
+   SRCONST_ALL:   the subring is made by the calling thread
+   SRCONST_SPLIT: large subrings are split into chunks of
+                  SRCONST_CHUNK clouds, made by OpenMP tasks, see
+                  srconst_split()
+*/
+/* ------------------------------------------------------------ */
+#define SRCONST_ALL   0
+#define SRCONST_SPLIT 1
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define SRCONST_CHUNK
+   @brief Number of clouds in a chunk made by srconst_split()
+*/
+/* ------------------------------------------------------------ */
+#define SRCONST_CHUNK (16*SRCONST_BLOCK)
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define STREAMBIN
+   @brief Number of pointsources a thread collects per velocity slab before it puts them onto the cube in the streaming deposition
+*/
+/* ------------------------------------------------------------ */
+#define STREAMBIN 256
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define DEPOSIT_XXX
+   @brief Deposition of a pointsource onto the cube, DEPOSIT=
+
+   DEPOSIT_NGP: nearest grid point, one pixel
+   DEPOSIT_CIC: cloud in cell, trilinear weights on 2x2x2 pixels
+   DEPOSIT_TSC: triangular shaped cloud, quadratic weights on 3x3x3 pixels
+*/
+/* ------------------------------------------------------------ */
+#define DEPOSIT_NGP 0
+#define DEPOSIT_CIC 1
+#define DEPOSIT_TSC 2
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define SRPREP_XXX
+   @brief Kind of change passed to srprep()
+
+   SRPREP_ALL:   any parameter, the pointsource list is made anew
+   SRPREP_COUNT: only the number and flux of the clouds change (SBR)
+*/
+/* ------------------------------------------------------------ */
+#define SRPREP_ALL   0
+#define SRPREP_COUNT 1
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @define ZSAMPLER_NTAB
+   @brief Number of nodes in the inverse-CDF table of a zsampler
+
+   @define ZSAMPLER_QMAX
+   @brief Upper end of the tabulated range in |2u-1|, the tails
+   beyond are calculated
+*/
+/* ------------------------------------------------------------ */
+#define ZSAMPLER_NTAB 4096
+#define ZSAMPLER_QMAX 0.99
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /* PRIVATE MACROS */
 /* ------------------------------------------------------------ */
@@ -1017,6 +1152,9 @@ typedef struct loginf
   /** @brief Number of cores */
   int ncores;
 
+  /** @brief NUMA placement of the cubes, 0: none, 1: first touch, 2: first touch and interleaved transforms, NUMA= */
+  int numa;
+
 } loginf;
 
 
@@ -1247,6 +1385,42 @@ typedef struct varlel
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @struct streambin
+   @brief Pointsources of one thread in the streaming deposition
+
+   The pointsources made by one thread are collected per velocity
+   slab. A full bin is put onto the cube while the thread holds the
+   lock of the slab, such that no thread needs a copy of the cube, see
+   srstream().
+ */
+/* ------------------------------------------------------------ */
+typedef struct streambin
+{
+  /** @brief Offsets into the cube, STREAMBIN per velocity slab */
+  unsigned int *off;
+
+  /** @brief Flux of the pointsources in off */
+  float *flux;
+
+  /** @brief Number of pointsources per velocity slab */
+  int *fill;
+
+  /** @brief Number of velocity slabs, ringparms nslabs */
+  int nslabs;
+
+  /** @brief Number of pixels in one velocity slab, ringparms slabsize */
+  long slabsize;
+
+#ifdef OPENMPTIR
+  /** @brief One lock per velocity slab, shared by all threads */
+  omp_lock_t *lock;
+#endif
+} streambin;
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
    @struct srd
@@ -1418,20 +1592,47 @@ typedef struct srd
   void (*gridpoint)(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
 
   /** @brief method to put the point sources onto the cube */
-  int (*srput)(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+  int (*srput)(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #else
   /** @brief method to grid the point sources */
   void (*gridpoint)(hdrinf *hdr, float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
 
   /** @brief method to put the point sources onto the cube */
-  int (*srput)(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+  int (*srput)(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #endif
 
   /** @brief Flux of one pointsource */
   float pf;
 
-  /** @brief Pointsource list, an array of pointers to points in the cube */
-  float **pl;
+  /** @brief Pointsource list, offsets into plbase, positive clouds at the start, negative clouds at the end */
+  unsigned int *pl;
+
+  /** @brief The cube the offsets in pl refer to */
+  float *plbase;
+
+  /** @brief Boundaries of the velocity slabs in pl, positive run then negative run, each ringparms nslabs+1 long, NULL if not binned */
+  long *plslab;
+
+  /** @brief Index of the cloud each entry in pl comes from, NULL if the list cannot be resized, see srprep() */
+  unsigned int *plcloud;
+
+  /** @brief 1 if pl is kept and srconst() only adds or removes clouds */
+  int resize;
+
+  /** @brief Number of entries in pl when resize was set */
+  long plstored;
+
+  /** @brief 1 if the pointsources are put onto the cube in the parallel deposition */
+  int deferred;
+
+  /** @brief Flux of a negative (0) and a positive (1) pointsource in the streaming deposition */
+  float sflux[2];
+
+  /** @brief Deposition of a pointsource in the streaming deposition, DEPOSIT_NGP, DEPOSIT_CIC, or DEPOSIT_TSC */
+  int deposit;
+
+  /** @brief Bins of the thread making the subring in the streaming deposition, NULL if the pointsources go straight onto plbase */
+  struct streambin *streambin;
 
 #ifdef PBCORR
   /** @brief primary beam factor list, an array of floats, used for primary beam correction */
@@ -1474,16 +1675,47 @@ typedef struct srd
   /** @brief The allocated permanent random generator (from ringparms) */
   maths_rstrf *permrandstr;
 
+  /** @brief Index of the next cloud in permrandstr if the counter-based generator is used */
+  unsigned long cloud;
+
   /** @brief The allocated permanent random generator (from inf_gau) */
   maths_rstrf *grandstr[4];
 
   /** @brief Number saved for zprof */
   float y2;
 
+  /** @brief 1 if the pointsource list is made anew in the current evaluation */
+  int fresh;
+
+  /** @brief 1 if the subring is changed by the current VARY group and hence not in the background */
+  int bgactive;
+
 } srd;
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @struct zsampler
+   @brief Sampler of the vertical profile of one disk
+
+   Read-only during the model calculation, such that all threads
+   share it. With a table, every deviate costs exactly one random
+   number and an interpolation, see zsampler_draw().
+ */
+/* ------------------------------------------------------------ */
+typedef struct zsampler {
+
+  /** @brief The layer type, LTYPE= */
+  int ltype;
+
+  /** @brief Inverse of the CDF of |z| at ZSAMPLER_NTAB nodes in [0,ZSAMPLER_QMAX], NULL: use zprof() */
+  float *tab;
+
+} zsampler;
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
    @struct inlistel
@@ -1665,6 +1897,12 @@ typedef struct inf_azi {
   /** @brief The function to shape the point source */
   int (*srshape)(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int outofrange, int disk);
 
+  /** @brief The srshape pipeline called by srshape, selected by chkb_srshape */
+  void (*kernel)(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+
+  /** @brief 1 if srconst_block() can make the conventional clouds, set by chkb_srshape */
+  int block;
+
   /** @brief Function correcting for the point source number */
   void (*corrp)(void *rpm, int srnr, int *outofrange, int signum);
 } inf_azi;
@@ -2052,6 +2290,12 @@ typedef struct ringparms
   /* Layer type */
   int *ltype; 
 
+  /** @brief Vertical profile samplers, one per disk */
+  zsampler *zsam;
+
+  /** @brief 1 if the vertical profiles are sampled from tables, ZSAMPLER= */
+  int ztable;
+
   /** @brief Array of same size containing the previous parameters */
   double *oldpar;
 
@@ -2068,19 +2312,13 @@ typedef struct ringparms
   float *modpar;
 
   /** @brief array of interpolation objects, for each parameter class one */
-  gsl_interp **gsl_interparray;
-
-  /** @brief array of interpolation lookup objects */
-  gsl_interp_accel **gsl_interp_accelarray;
+  maths_interp **interparray;
 
   /** @brief array of smoothing schemes for each parameter: 0: linear 1: spline 2: Akima */ 
   int *smothcar;
 
-  /** @brief array of interpolation objects, for each parameter class one */
-  gsl_interp **gsl_indinterparray;
-
-  /** @brief array of interpolation lookup objects */
-  gsl_interp_accel **gsl_indinterp_accelarray;
+  /** @brief array of interpolation objects for the indexed parameters, for each parameter class one */
+  maths_interp **indinterparray;
 
   /** @brief array of smoothing schemes for each parameter for indexing: 0: linear 1: spline 2: Akima */ 
   int *smothindcar;
@@ -2115,6 +2353,27 @@ typedef struct ringparms
   /** @brief One seed argument for the permanent random number generator */
   /* parallel changed this */ int iseed2;
 
+  /** @brief 1 if the clouds are generated in blocks where possible, see srconst_block(), CLOUDBLOCK= */
+  int cloudblock;
+
+  /** @brief Random number generator for the clouds, 0: RANMAR, 1: counter-based, RNG= */
+  int rng;
+
+  /** @brief Sampling of the clouds, 0: pseudo-random, 1: quasi-random (Halton), SAMPLER= */
+  int sampler;
+
+  /** @brief 1 if pointsource lists are resized instead of made anew when only the cloud number changes, PREFIX= */
+  int prefix;
+
+  /** @brief Scheduling of the subrings, 0: disk by disk, 1: all disks at once, largest first, with large subrings split, SCHEDULE= */
+  int schedule;
+
+  /** @brief Order of the (disk, subring) pairs, disk*nr+subring, see srschedule(), NULL if not allocated */
+  int *srorder;
+
+  /** @brief Estimated cost of each (disk, subring) pair, see srschedule(), NULL if not allocated */
+  long *srcost;
+
   /** @brief A list of subring descriptors */
   srd **sd;
 
@@ -2127,6 +2386,57 @@ typedef struct ringparms
   /** @brief A dummy for use in writemodel */
   long *fluxpoints;
 
+  /** @brief Change of the unconvolved model in an incremental evaluation, NULL if not used, DELTAMOD= */
+  float *deltac;
+
+  /** @brief Offsets of the changed pixels in deltac */
+  long *deltalist;
+
+  /** @brief Number of offsets in deltalist */
+  long ndelta;
+
+  /** @brief Allocated length of deltalist */
+  long deltamax;
+
+  /** @brief The model array, while deltac takes its place */
+  float *deltabase;
+
+  /** @brief 1 while the pointsources of changed subrings are removed into deltac */
+  int deltaactive;
+
+  /** @brief 1 if the model array contains the convolved model of the current pointsource lists */
+  int deltaready;
+
+  /** @brief 1 if deltalist could not be extended */
+  int deltafail;
+
+  /** @brief 1 if the subrings not changed by the current VARY group are frozen in a background, BGCACHE= */
+  int bgcache;
+
+  /** @brief 1 if the background contains the current pointsource lists of all subrings with bgactive == 0 */
+  int bgready;
+
+  /** @brief The VARY group the background has been made for */
+  varlel *bgvarele;
+
+  /** @brief Number of velocity slabs for the parallel deposition of pointsources, 0 for serial deposition */
+  int nslabs;
+
+  /** @brief Number of pixels in one velocity slab */
+  long slabsize;
+
+  /** @brief 1 if the pointsources are put onto the cube while they are generated, without pointsource lists, STREAM= */
+  int stream;
+
+  /** @brief Bins of the threads for the streaming deposition, nstreambins long, NULL if the subrings are generated serially */
+  streambin *streambins;
+
+  /** @brief Deposition of the pointsources in the streaming deposition, DEPOSIT= */
+  int deposit;
+
+  /** @brief Number of threads in the streaming deposition, length of streambins */
+  int nstreambins;
+
   /** @brief The penalty for outlyers */
   double penalty;
 
@@ -2335,6 +2645,18 @@ typedef struct fitparms
   /** @brief PSWARM decrease delta */
   double psdd;
   
+  /** @brief PSWARM number of models evaluated at once */
+  int psba;
+  
+  /** @brief Model cubes of a PSWARM batch, psba of them */
+  float **psbamodels;
+  
+  /** @brief Velocity dispersions of a PSWARM batch */
+  float *psbasigmas;
+  
+  /** @brief Outside, flux, and total pointsources of the models in a PSWARM batch, 1+2*ndisks per model */
+  long *psbapoints;
+  
   /** @brief The input of vary, saved for output */
   char *varyhstr;
   
@@ -2413,6 +2735,39 @@ typedef struct fitparms
   /** @brief degrees of freedom */
   double dof;
 
+  /** @brief Refresh policy of the weight map, NOISEUPD= */
+  int noiseupd;
+
+  /** @brief Iteration of the last refresh of the weight map in genfit */
+  size_t noise_alliter;
+
+  /** @brief Loop of the last refresh of the weight map in genfit */
+  size_t noise_alloops;
+
+  /** @brief Number of resolution levels in the golden section search, MULTIRES= */
+  int multires;
+
+  /** @brief Current resolution level, 0 is the full resolution */
+  int multireslevel;
+
+  /** @brief Point source flux at full resolution, CFLUX= */
+  double *multires_cflux;
+
+  /** @brief Penalty at full resolution */
+  double multires_penalty;
+
+  /** @brief Number of incremental evaluations between two full evaluations in the golden section search, DELTAMOD= */
+  int deltamod;
+
+  /** @brief Background model of the subrings not changed by the current VARY group in the golden section search, BGCACHE= */
+  int bgcache;
+
+  /** @brief Streaming deposition without pointsource lists, STREAM= */
+  int stream;
+
+  /** @brief Deposition of the pointsources, DEPOSIT_NGP, DEPOSIT_CIC, or DEPOSIT_TSC, DEPOSIT= */
+  int deposit;
+
 } fitparms;
 
 
@@ -2806,6 +3161,88 @@ static double gchsq_gen2(double *vector, void *rest);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static void gchsq_gen_vec(int m, double *vectors, double *chisquares, void *rest)
+   @brief function passed to gft, several parameter sets at once
+
+   Same as m calls of gchsq_gen for the m parameter sets in vectors,
+   one after the other. After recalling from the logfile, the models
+   are made in batches of up to PSBA= models, and the chisquares of a
+   batch are calculated together by getchisquare_batch_c before the
+   models are logged one by one as in gchsq_gen2. The chisquares are
+   calculated in the image plane instead of the Fourier plane and can
+   hence differ from the ones of gchsq_gen2 by rounding.
+
+   @param m          (int)       Number of parameter sets
+   @param vectors    (double *)  m arrays of fit parameters
+   @param chisquares (double *)  Output, the m chisquares
+   @param rest       (void *)    concealed adar struct
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+static void gchsq_gen_vec(int m, double *vectors, double *chisquares, void *rest);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static double gchsq_gen_eval(double *vector, adar *adarv, double chisquare, long *points)
+   @brief The work of gchsq_gen2
+
+   Does what gchsq_gen2 does. If points is not NULL, the model is not
+   made, but chisquare is taken as the chisquare of the model (before
+   regularisation and penalties) and points as the pointsource numbers
+   of the model, 1+2*ndisks of them as in fit -> psbapoints.
+
+   @param vector    (double *)  An array of fit parameters
+   @param adarv     (adar *)    adar struct
+   @param chisquare (double)    chisquare if points is not NULL
+   @param points    (long *)    pointsource numbers or NULL
+
+   @return double gchsq_gen_eval  The chisquared
+*/
+/* ------------------------------------------------------------ */
+static double gchsq_gen_eval(double *vector, adar *adarv, double chisquare, long *points);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static double gchsq_gen_par(adar *adarv, double *vector)
+   @brief Put the fit parameters into rpm -> par
+
+   Changes the fit parameters in rpm -> par to the ones in vector and
+   aligns the dependent parameters. Returns the factor to multiply the
+   chisquare with, which is larger than 1 if parameters are out of
+   range.
+
+   @param adarv  (adar *)    adar struct
+   @param vector (double *)  An array of fit parameters
+
+   @return (success) double gchsq_gen_par: factor for the chisquare
+           (error) -1.0
+*/
+/* ------------------------------------------------------------ */
+static double gchsq_gen_par(adar *adarv, double *vector);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static void gchsq_gen_noise(adar *adarv)
+   @brief Refresh the weight map with a new iteration or loop if required
+
+   @param adarv  (adar *)    adar struct
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+static void gchsq_gen_noise(adar *adarv);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
    @fn static loginf *create_loginf(void)
@@ -3611,6 +4048,73 @@ static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, deco
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static int galmod_grid(hdrinf *hdr, ringparms *rpm, long *fluxpoints, int *allnpoints, int mode)
+   @brief Put the pointsources of all subrings onto the cube
+
+   The part of galmod() after the interpolation. The pointsource lists
+   that have been terminated are made again. With mode GRID_ALL the
+   model array is set to 0 and all pointsources are put onto it, a
+   background in engalmod is dropped. With GRID_DELTA only the new
+   pointsource lists (srd fresh) are put into rpm -> deltac instead
+   of the model array, and their offsets are appended to rpm ->
+   deltalist, see srdelta(). With GRID_FORE (GRID_BACK) the model
+   array is set to 0 and only the subrings with bgactive == 1 (0) are
+   put onto it. The returned numbers always count all subrings. With
+   rpm -> stream set (only together with GRID_ALL) no pointsource
+   lists are kept, the subrings are generated in parallel and every
+   thread puts its pointsources onto the model array through its bins
+   in rpm -> streambins, see srconst() and srstream(). The order of the
+   summation then depends on the threads, the model is only
+   reproducible to rounding.
+
+   @param hdr        (hdrinf *)    header information struct
+   @param rpm        (ringparms *) Ring parameter information struct
+   @param fluxpoints (long *)      Output, number of pointsources contributing to flux per disk
+   @param allnpoints (int *)       Output, number of pointsources per disk
+   @param mode       (int)         GRID_ALL, GRID_DELTA, GRID_FORE, or GRID_BACK
+
+   @return int galmod_grid: Number of pointsources
+*/
+/* ------------------------------------------------------------ */
+static int galmod_grid(hdrinf *hdr, ringparms *rpm, long *fluxpoints, int *allnpoints, int mode);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static double galmod_chisquare(hdrinf *hdr, ringparms *rpm, varlel *varele, decomp_inlist *index, long *fluxpoints, int *allnpoints)
+   @brief Model and chisquare after a change of the parameters, incremental if possible
+
+   Same as galmod() followed by getchisquare_c(). If incremental
+   evaluations are switched on (rpm -> deltac allocated, DELTAMOD=)
+   and the model array contains the convolved model of the current
+   pointsource lists, only the pointsources of the changed subrings
+   are removed and added in rpm -> deltac, and getchisquare_delta_c()
+   updates the convolved model and the chisquare locally. If that is
+   not possible, the full model is made from the pointsource lists
+   and the chisquare is calculated with getchisquare_c(). With a
+   background (rpm -> bgcache, BGCACHE=) the subrings that have not
+   been changed since the current VARY group varele started are
+   frozen in a transformed background in engalmod, and only the
+   changed subrings are put onto the model array. The background is
+   made again when a frozen subring changes or when varele changes.
+
+   @param hdr        (hdrinf *)        header information struct
+   @param rpm        (ringparms *)     Ring parameter information struct
+   @param varele     (varlel *)        Actual element that is processed in the varlel list
+   @param index      (decomp_inlist *) Index- and dependency list
+   @param fluxpoints (long *)          Output, number of pointsources contributing to flux per disk
+   @param allnpoints (int *)           Output, number of pointsources per disk
+
+   @return double galmod_chisquare: The chisquare
+*/
+/* ------------------------------------------------------------ */
+static double galmod_chisquare(hdrinf *hdr, ringparms *rpm, varlel *varele, decomp_inlist *index, long *fluxpoints, int *allnpoints);
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
    @fn static int changedependent(ringparms *rpm, double *par, decomp_inlist *index, varlel *varele, int fitmode, int *chapar)
@@ -3707,10 +4211,16 @@ static int chkchangep(varlel *varele, int fitmode, int parnr, int nur);
   @brief Preparation of a srd struct
   
   Precalculations for the calculation of a ring.
+
+  With mode SRPREP_COUNT and a list that srresizable() accepts before
+  and after the change, the pointsource list is kept and resize is
+  set: the clouds of a subring are then a fixed sequence, such that
+  srconst() only has to cut the list or to make the additional clouds.
+  Otherwise the list is freed.
   
   @param rpm  (ringparms *) Properly configured ringparms struct
   @param srnr (int *)       Number of the subring (start with 0)
-  @param mode (long)        Dummy at the moment  
+  @param mode (long)        SRPREP_ALL or SRPREP_COUNT
   @param disk (int)         Disk number
 
   @return void
@@ -3722,44 +4232,489 @@ static void srprep(ringparms *rpm, int srnr, long mode, int disk);
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
-  @brief Generation of a pointsource list
-  
-  Generates a pointsource list that is attached to the appropriate srd struct
+  @fn static int srresizable(ringparms *rpm, int srnr, int disk)
+  @brief Checks if the pointsource list of a subring can be resized
+
+  True if every cloud of the subring is a function of its index
+  only, and the list holds one run of conventional clouds tagged with
+  that index: PREFIX=1 (which implies RNG=1 or SAMPLER=1), no
+  streaming, no harmonic surface brightness, no azimuthal ranges, no
+  Gaussian components, and no primary beam factors per cloud.
 
-  @param hdr  (hdrinf *)    Properly configured hdrinf struct
   @param rpm  (ringparms *) Properly configured ringparms struct
-  @param srnr (int *)       Number of the subring (start with 0)
-  @param mode (long)        Dummy at the moment  
+  @param srnr (int)         Number of the subring (start with 0)
   @param disk (int)         Disk number
 
-  @return long srconst: Number of pointsources outside the cube
+  @return int srresizable: 1 if resizable, 0 if not
 */
 /* ------------------------------------------------------------ */
-static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk);
+static int srresizable(ringparms *rpm, int srnr, int disk);
 
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static int srshape(hdrinf *hdr, ringparms *rpm, float sinaz, float cosaz, int srnr, long mode, int disk)
-  @brief Determines the coordinates of a point source
-  
-  Subroutine to srconst. After the calculation of the azimuth of a
-  point source, the coordinates are transformed according to the
-  parameters in this function.
+  @fn static long srresize(ringparms *rpm, int srnr, int disk, long *j, long *npoints)
+  @brief Cuts or extends a pointsource list for a new cloud number
+
+  With fewer clouds than before, the entries of the clouds beyond the
+  new number are removed and the counters are set as srconst() would
+  have. With more clouds, the list is enlarged and j and npoints are
+  set such that the loop in srconst() only makes the new clouds.
+
+  @param rpm     (ringparms *) Properly configured ringparms struct
+  @param srnr    (int)         Number of the subring (start with 0)
+  @param disk    (int)         Disk number
+  @param j       (long *)      Output: number of the next pointsource
+  @param npoints (long *)      Output: number of pointsources to reach
+
+  @return (success) long srresize: Index of the first cloud to make, 0 if nothing is to be made
+          (error) -1 memory problems
+*/
+/* ------------------------------------------------------------ */
+static long srresize(ringparms *rpm, int srnr, int disk, long *j, long *npoints);
 
-  @param rpm   (ringparms *) Properly configured ringparms struct
-  @param pp    (float *)     Point source coordinates
-  @param sinaz (float)       sine of azimuth
-  @param cosaz (float)       cosine of azimuth
-  @param srnr  (int *)       Number of the subring (start with 0)
-  @param disk (int)         Disk number
 
-  @return long srconst: Number of pointsources outside the cube
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srdelta(ringparms *rpm, int srnr, int disk, int remove)
+  @brief Record the pointsources of a subring for an incremental evaluation
+
+  With remove == 1 the pointsources are subtracted from rpm ->
+  deltac. With remove == 0 the pointsources have just been put into
+  rpm -> deltac by srput and their list is made to refer to the
+  model array rpm -> deltabase again. In both cases the offsets are
+  appended to rpm -> deltalist. If the list cannot be extended, rpm
+  -> deltafail is set.
+
+  @param rpm    (ringparms *) Properly configured ringparms struct
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param disk   (int)         Disk number
+  @param remove (int)         1 to remove, 0 to add
+
+  @return void
 */
 /* ------------------------------------------------------------ */
-static void srshape(ringparms *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+static void srdelta(ringparms *rpm, int srnr, int disk, int remove);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srruns(srd *sd, long *start, long *stop, float *flux)
+  @brief The ranges of a pointsource list filled by srput
+
+  A pointsource list consists of two runs, [start[0], stop[0]) and
+  [start[1], stop[1]), the second of which is empty for lists with
+  only one sign. After srput, flux[0] and flux[1] is the flux put
+  onto the cube by every pointsource in the run.
+
+  @param sd    (srd *)   The subring descriptor
+  @param start (long *)  Output, start of the two runs
+  @param stop  (long *)  Output, end of the two runs
+  @param flux  (float *) Output, flux per pointsource in the two runs
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srruns(srd *sd, long *start, long *stop, float *flux);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srbin(ringparms *rpm, int srnr, int disk)
+  @brief Sort a pointsource list into velocity slabs
+
+  If parallel deposition is switched on (rpm -> nslabs > 1), each run
+  of the pointsource list is sorted by the velocity slab the
+  pointsources fall in, keeping their order within a slab, and the
+  boundaries are stored in srd plslab. The primary beam factors are
+  sorted alike. If memory is short, plslab stays NULL and the list is
+  put serially. Called by srconst.
+
+  @param rpm    (ringparms *) Properly configured ringparms struct
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param disk   (int)         Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srbin(ringparms *rpm, int srnr, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srdeposit(ringparms *rpm, int srnr, int disk, int slab)
+  @brief Put the pointsources of a subring in one velocity slab onto the cube
+
+  The part of srput_norm or srput_mixed that adds the flux, restricted
+  to one slab of a list sorted by srbin(). srput must have been called
+  with deposit == 0 before. Threads working on different slabs write
+  to disjoint parts of the cube.
+
+  @param rpm    (ringparms *) Properly configured ringparms struct
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param disk   (int)         Disk number
+  @param slab   (int)         Velocity slab
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srdeposit(ringparms *rpm, int srnr, int disk, int slab);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int create_streambins(ringparms *rpm, int n)
+  @brief Allocates the bins of n threads for the streaming deposition
+
+  Any previous bins are destroyed. One bin of STREAMBIN pointsources
+  per thread and velocity slab (rpm -> nslabs) is allocated, the memory
+  does not depend on the size of the cube. With less than two slabs
+  or threads nothing is allocated and the subrings are made serially.
+
+  @param rpm (ringparms *) Properly configured ringparms struct
+  @param n   (int)         Number of threads
+
+  @return (success) int create_streambins: 1
+          (error) 0, rpm -> streambins is NULL
+*/
+/* ------------------------------------------------------------ */
+static int create_streambins(ringparms *rpm, int n);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void destroy_streambins(ringparms *rpm)
+  @brief Deallocates the bins of the streaming deposition
+
+  @param rpm (ringparms *) Properly configured ringparms struct
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void destroy_streambins(ringparms *rpm);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srstream(srd *sd, long off, float flux)
+  @brief Puts a pointsource onto the cube in the streaming deposition
+
+  Without bins (sd -> streambin NULL) the flux is added to sd ->
+  plbase at off. Otherwise it is appended to the bin of the velocity
+  slab of off, and a full bin is put onto the cube by
+  srstreamflush().
+
+  @param sd   (srd *) Subring descriptor
+  @param off  (long)  Offset into sd -> plbase
+  @param flux (float) Flux of the pointsource
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srstream(srd *sd, long off, float flux);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srstreamflush(srd *sd, int slab)
+  @brief Puts the bin of one velocity slab onto the cube
+
+  The pointsources in the bin of slab in sd -> streambin are added to
+  sd -> plbase while the lock of the slab is held, and the bin is
+  emptied.
+
+  @param sd   (srd *) Subring descriptor with sd -> streambin set
+  @param slab (int)   Velocity slab
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srstreamflush(srd *sd, int slab);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
+  @brief Generation of a pointsource list
+  
+  Generates a pointsource list that is attached to the appropriate srd struct
+
+  With rpm -> stream set no list is made. The subring is generated
+  again at every call and gridpoint (linked to gridpoint_normstream()
+  or gridpoint_mixedstream() by galmod_grid()) puts the clouds onto
+  the model array, through the bins of the calling thread in rpm ->
+  streambins if the subrings are made in parallel, see srstream().
+
+  @param hdr  (hdrinf *)    Properly configured hdrinf struct
+  @param rpm  (ringparms *) Properly configured ringparms struct
+  @param srnr (int *)       Number of the subring (start with 0)
+  @param mode (long)        SRCONST_ALL or SRCONST_SPLIT
+  @param disk (int)         Disk number
+
+  @return long srconst: Number of pointsources outside the cube
+*/
+/* ------------------------------------------------------------ */
+static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srconst_block(hdrinf *hdr, ringparms *rpm, srd *sd, int srnr, int disk, long *j, long *npoints, int signum)
+  @brief Generates the conventional clouds of a subring in blocks
+
+  Replaces the loop over the conventional (non-Gaussian) clouds in
+  srconst() if inf_aziv[disk] -> block is set (no azimuthal ranges,
+  constant surface brightness in azimuth, no subclouds, and one of
+  the pipelines srshape_flat_00 or srshape_flat_10). Up to
+  SRCONST_BLOCK clouds are made at once in three passes: the random
+  numbers are drawn in the same order as in the scalar path, then the
+  positions, velocities, and grid indices are calculated in a loop
+  without calls and branches that the compiler can vectorise, then
+  the clouds are put into the pointsource list, or onto the cube in
+  streaming mode, with the same bookkeeping as the gridpoint
+  functions. On return *j == *npoints.
+
+  All state of the subring is taken from sd, which is rpm -> sd[disk]
+  + srnr or a copy of it with its own generators, see srconst_split().
+
+  @param hdr     (hdrinf *)    Properly configured hdrinf struct
+  @param rpm     (ringparms *) Properly configured ringparms struct
+  @param sd      (srd *)       The subring
+  @param srnr    (int)         Number of the subring (start with 0)
+  @param disk    (int)         Disk number
+  @param j       (long *)      Number of the next pointsource, changed
+  @param npoints (long *)      Number of pointsources to make, changed
+  @param signum  (int)         Indicates negative point sources
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srconst_block(hdrinf *hdr, ringparms *rpm, srd *sd, int srnr, int disk, long *j, long *npoints, int signum);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int srconst_split(hdrinf *hdr, ringparms *rpm, int srnr, int disk, long *j, long *npoints, int signum)
+  @brief Generates the conventional clouds of a large subring in chunks
+
+  Instead of srconst_block(), the clouds *j to *npoints are split into
+  chunks of SRCONST_CHUNK clouds that are made by OpenMP tasks, which
+  the threads of the team that are done with their own subrings take
+  up. Every chunk works on a copy of the srd struct with its own
+  generators, positioned at the first cloud of the chunk (skip-ahead
+  of the counter-based generator or the Halton sequence), and writes
+  into its own section of the pointsource list. The sections are then
+  joined, such that the list is the same as the one srconst_block()
+  makes. Only for lists of one sign without subclouds, with RNG=1 or
+  SAMPLER=1 and without streaming.
+
+  @param hdr     (hdrinf *)    Properly configured hdrinf struct
+  @param rpm     (ringparms *) Properly configured ringparms struct
+  @param srnr    (int)         Number of the subring (start with 0)
+  @param disk    (int)         Disk number
+  @param j       (long *)      Number of the next pointsource, changed
+  @param npoints (long *)      Number of pointsources to make, changed
+  @param signum  (int)         Indicates negative point sources
+
+  @return (success) int srconst_split: 1
+          (error) 0 subring not eligible or memory problems, nothing done
+*/
+/* ------------------------------------------------------------ */
+static int srconst_split(hdrinf *hdr, ringparms *rpm, int srnr, int disk, long *j, long *npoints, int signum);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int srschedule(ringparms *rpm)
+  @brief Orders the (disk, subring) pairs by their estimated cost
+
+  The cost of a subring is the number of pointsources srconst() will
+  make, nharmnorm plus the Gaussian components, both including the
+  nsubcl subclouds, and 0 if the pointsource list is kept. The pairs
+  of all disks are sorted by decreasing cost into rpm -> srorder, such
+  that a dynamic schedule starts the largest subrings first and fills
+  up with small ones at the end.
+
+  @param rpm (ringparms *) Properly configured ringparms struct
+
+  @return (success) int srschedule: 1
+          (error) 0 memory problems
+*/
+/* ------------------------------------------------------------ */
+static int srschedule(ringparms *rpm);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srrandom_init(ringparms *rpm, int srnr, int disk)
+  @brief Initialises the permanent random generator of a subring
+
+  With RNG=0 the RANMAR generator is seeded with iseed2 as
+  before. With RNG=1 the counter-based generator is keyed by ISEED
+  and the (disk, subring) pair, and the cloud counter is set to 0.
+  With SAMPLER=1 the same key selects the random shift of a Halton
+  sequence, one point per cloud.
+
+  @param rpm  (ringparms *) Properly configured ringparms struct
+  @param srnr (int)         Number of the subring (start with 0)
+  @param disk (int)         Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srrandom_init(ringparms *rpm, int srnr, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srrandom_next(ringparms *rpm, int srnr, int disk)
+  @brief Starts the random numbers of the next cloud of a subring
+
+  With the counter-based generator the random numbers of each cloud
+  only depend on (ISEED, disk, subring, cloud index, draw), such that
+  clouds can be made in any order. With SAMPLER=1 the draws of a cloud
+  are the coordinates of one Halton point. The dispersion generator
+  is positioned alike, see rndmf_init_sdis_act(). Has no effect with
+  RANMAR.
+
+  @param rpm  (ringparms *) Properly configured ringparms struct
+  @param srnr (int)         Number of the subring (start with 0)
+  @param disk (int)         Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srrandom_next(ringparms *rpm, int srnr, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srrandom_step(ringparms *rpm, srd *sd)
+  @brief srrandom_next() for a given srd struct
+
+  @param rpm (ringparms *) Properly configured ringparms struct
+  @param sd  (srd *)       The subring or a copy of it
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srrandom_step(ringparms *rpm, srd *sd);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int srshape(hdrinf *hdr, ringparms *rpm, float sinaz, float cosaz, int srnr, long mode, int disk)
+  @brief Determines the coordinates of a point source
+  
+  Subroutine to srconst. After the calculation of the azimuth of a
+  point source, the coordinates are transformed according to the
+  parameters in this function.
+
+  @param rpm   (ringparms *) Properly configured ringparms struct
+  @param pp    (float *)     Point source coordinates
+  @param sinaz (float)       sine of azimuth
+  @param cosaz (float)       cosine of azimuth
+  @param srnr  (int *)       Number of the subring (start with 0)
+  @param disk (int)         Disk number
+
+  @return long srconst: Number of pointsources outside the cube
+*/
+/* ------------------------------------------------------------ */
+static void srshape(ringparms *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srshape_gen(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+  @brief The generic srshape pipeline
+
+  Calls srshape(), which walks through all model terms. Used if
+  harmonics, warps, or the shifts LC0/LS0 are active for a disk.
+
+  @param rpm   (void *)      Properly configured ringparms struct
+  @param pp    (float *)     Point source coordinates
+  @param sinaz (float)       sine of azimuth
+  @param cosaz (float)       cosine of azimuth
+  @param srnr  (int)         Number of the subring (start with 0)
+  @param disk  (int)         Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srshape_gen(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srshape_flat(ringparms *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk, int vrad, int zterms)
+  @brief srshape() without harmonics, warps, and shifts
+
+  Does the same as srshape() for a disk without harmonic terms in
+  rotation, radial, and line-of-sight velocity, without warp terms,
+  and without LC0/LS0, in the same order of operations, such that the
+  result is identical. The radial velocity term is inlined if vrad is
+  set. The terms depending on the height (DVRO, DVRA, VVER, DVVE) are
+  called if zterms is set. Called with constant vrad and zterms by
+  srshape_flat_00 and siblings, such that the compiler can specialise
+  it.
+
+  @param rpm    (ringparms *) Properly configured ringparms struct
+  @param pp     (float *)     Point source coordinates
+  @param sinaz  (float)       sine of azimuth
+  @param cosaz  (float)       cosine of azimuth
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param disk   (int)         Disk number
+  @param vrad   (int)         1: radial velocity active
+  @param zterms (int)         1: terms depending on the height active
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srshape_flat(ringparms *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk, int vrad, int zterms);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srshape_flat_00(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+  @brief The specialised srshape pipelines
+
+  srshape_flat() with vrad and zterms set to the digits in the name,
+  selected by chkb_srshape().
+
+  @param rpm   (void *)      Properly configured ringparms struct
+  @param pp    (float *)     Point source coordinates
+  @param sinaz (float)       sine of azimuth
+  @param cosaz (float)       cosine of azimuth
+  @param srnr  (int)         Number of the subring (start with 0)
+  @param disk  (int)         Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srshape_flat_00(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+static void srshape_flat_10(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+static void srshape_flat_01(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
+static void srshape_flat_11(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk);
 
 
 
@@ -3768,7 +4723,7 @@ static void srshape(ringparms *rpm, float *pp, float sinaz, float cosaz, int srn
   @fn static void gridpoint_norm(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, float *primbeam, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
   @brief Grids a point to a pointsource list
   
-  Grids the point point (6 phase-space coords) in a list of pointers to the cube hdr ->
+  Grids the point point (6 phase-space coords) in a list of offsets into the cube hdr ->
   model. If the point doesn't fit the cube, the pointsource number of
   the subring will be redced by 1, if it fits, pnr will be increased
   by one. Called by srconst.
@@ -3800,7 +4755,7 @@ static void gridpoint_norm(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
   @fn static void gridpoint_mixed(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, float *primbeam, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
   @brief Grids a point to a pointsource list
   
-  Grids the point point (6 phase-space coords) in a list of pointers
+  Grids the point point (6 phase-space coords) in a list of offsets
   to the cube hdr -> model. If the point doesn't fit the cube, the
   pointsource number of the subring will be redced by 1, if it fits,
   pnr will be increased by one. Called by srconst.  This function
@@ -3829,13 +4784,107 @@ static void gridpoint_mixed(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
 #endif
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void gridpoint_normstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+  @brief Grids a point directly onto the cube
+
+  Streaming counterpart of gridpoint_norm(). Instead of storing the
+  offset in the pointsource list, the flux sd[disk][srnr].sflux[signum]
+  is put onto the cube at that offset with srstream(), multiplied with
+  the primary beam if fill_pbcfac is fill_pbcfac_act. The counting is
+  the same as in gridpoint_norm(). Linked in by galmod_grid() when
+  rpm -> stream is set.
+
+  @param hdr    (hdrinf *)    Properly configured hdrinf struct
+  @param fill_pbcfac (void *) fill_pbcfac_act or fill_pbcfac_pas
+  @param modpar (float *)     Properly configured array of subring descriptors
+  @param nr     (int *)       Properly number of subrings
+  @param sd     (srd **)      Properly configured subring descriptor
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param pnr    (long *)      Number of the pointsource (start with 0)
+  @param pp     (float *)     Phase-space coordinates of the point
+  @param signum (int)         Indicates negative point source
+  @param npoints (long *)     Number of maximal points in specific structure
+  @param disk (int)           Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+#ifdef PBCORR
+static void gridpoint_normstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
+#else
+static void gridpoint_normstream(hdrinf *hdr, float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
+#endif
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void gridpoint_mixedstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+  @brief Grids a point with either sign directly onto the cube
+
+  Streaming counterpart of gridpoint_mixed(), see
+  gridpoint_normstream(). Counts the positive and negative clouds in
+  npos and nneg like gridpoint_mixed().
+
+  @param hdr    (hdrinf *)    Properly configured hdrinf struct
+  @param fill_pbcfac (void *) fill_pbcfac_act or fill_pbcfac_pas
+  @param modpar (float *)     Properly configured array of subring descriptors
+  @param nr     (int *)       Properly number of subrings
+  @param sd     (srd **)      Properly configured subring descriptor
+  @param srnr   (int)         Number of the subring (start with 0)
+  @param pnr    (long *)      Number of the pointsource (start with 0)
+  @param pp     (float *)     Phase-space coordinates of the point
+  @param signum (int)         Indicates negative source, needed for this function
+  @param npoints (long *)     Number of maximal points in specific structure
+  @param disk (int)           Disk number
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+#ifdef PBCORR
+static void gridpoint_mixedstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
+#else
+static void gridpoint_mixedstream(hdrinf *hdr, float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk);
+#endif
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void srspread(hdrinf *hdr, srd *sd, float *primbeam, float *pos, float flux, int deposit)
+  @brief Spreads the flux of a pointsource over the neighbouring pixels
+
+  The pointsource at the pixel coordinates pos is put onto the cube
+  with srstream(), with cloud-in-cell (DEPOSIT_CIC, 2 pixels per axis) or
+  triangular-shaped-cloud (DEPOSIT_TSC, 3 pixels per axis)
+  weights. The weights sum up to one, the flux falling onto pixels
+  outside the cube is lost. If primbeam is not NULL, the flux on each
+  pixel is multiplied with the primary beam there.
+
+  @param hdr      (hdrinf *) Properly configured hdrinf struct
+  @param sd       (srd *)    Subring descriptor
+  @param primbeam (float *)  Primary beam or NULL
+  @param pos      (float *)  Pixel coordinates of the pointsource, 3 components
+  @param flux     (float)    Flux of the pointsource
+  @param deposit  (int)      DEPOSIT_CIC or DEPOSIT_TSC
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void srspread(hdrinf *hdr, srd *sd, float *primbeam, float *pos, float flux, int deposit);
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long *pnr, long grid), struct sdr **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+  @fn static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long *pnr, long grid), struct sdr **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
   @brief Puts a pointsource list on a cube
   
   Puts the srnrth pointsource list in rpm on the cube by adding the
   flux in the list pointwise. In case of exclusively positive or exclusively negative clouds.
+  With deposit == 0 only the pointsource flux and the numbers are
+  determined, the pointsources are put by srdeposit().
 
   @param hdr    (hdrinf *) Properly configured hdrinf struct
   @param sd     (srd **)    Properly configured subring descriptor
@@ -3845,24 +4894,27 @@ static void gridpoint_mixed(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
   @param radsep (double)   Separation of subrings in pixel
   @param srnr   (int)      Subring number
   @param disk (int)        Disk number
+  @param deposit (int)     1: put the pointsources onto the cube
 
   @return void
 */
 /* ------------------------------------------------------------ */
 #ifdef PBCORR 
-static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #else
-static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #endif
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
-  @fn static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long *pnr, long grid), struct sdr **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+  @fn static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long *pnr, long grid), struct sdr **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
   @brief Puts a pointsource list on a cube
   
   Puts the srnrth pointsource list in rpm on the cube by adding the
   flux in the list pointwise. In case of mixed positive and negative clouds.
+  With deposit == 0 only the pointsource flux and the numbers are
+  determined, the pointsources are put by srdeposit().
 
   @param hdr    (hdrinf *) Properly configured hdrinf struct
   @param sd     (srd *)    Properly configured subring descriptor
@@ -3872,14 +4924,15 @@ static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, dou
   @param radsep (double)   Separation of subrings in pixel
   @param srnr   (int)      Subring number
   @param disk (int)        Disk number
+  @param deposit (int)     1: put the pointsources onto the cube
 
   @return void
 */
 /* ------------------------------------------------------------ */
 #ifdef PBCORR
-static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #else
-static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk);
+static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit);
 #endif
 
 
@@ -4170,6 +5223,88 @@ static float zprof(int option, maths_rstrf *permrandstr, float *y2);
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static int zsampler_init(zsampler *zs, int ltype, int table)
+   @brief (Re-)initialises a vertical profile sampler
+
+   With table set, the inverse of the cumulative distribution of |z|
+   for the layer type ltype is tabulated, otherwise the sampler
+   defers to zprof().
+
+   @param zs    (zsampler *) An allocated zsampler
+   @param ltype (int)        The layer type, see zprof()
+   @param table (int)        1: tabulate, 0: use zprof()
+
+   @return (success) int zsampler_init: 1
+           (error) 0
+*/
+/* ------------------------------------------------------------ */
+static int zsampler_init(zsampler *zs, int ltype, int table);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static float zsampler_draw(zsampler *zs, maths_rstrf *permrandstr, float *y2)
+   @brief Delivers a random variable according to the vertical profile
+
+   Replaces zprof(ltype, permrandstr, y2) for the layers. With a
+   table exactly one random number is drawn per call, for every layer
+   type, and the result does not depend on any state but permrandstr,
+   such that calls made only to forward the random generator stay
+   aligned with the calls that make clouds.
+
+   @param zs          (zsampler *)    The sampler
+   @param permrandstr (maths_rstrf *) An initialised random number control object
+   @param y2          (float *)       Number saved for zprof(), only used without table
+
+   @return float zsampler_draw: A random number distributed according to the layer type
+*/
+/* ------------------------------------------------------------ */
+static float zsampler_draw(zsampler *zs, maths_rstrf *permrandstr, float *y2);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static void zsampler_eval(zsampler *zs, float *u, long n)
+   @brief Transforms uniform random numbers into vertical deviates
+
+   The batch version of zsampler_draw() for a sampler with a table:
+   the n random numbers u in [0,1) are replaced by the deviates. The
+   loop contains only the table lookup apart from the rare tails,
+   such that it can be vectorised.
+
+   @param zs (zsampler *) The sampler, with a table
+   @param u  (float *)    Uniform random numbers in [0,1), replaced
+   @param n  (long)       Number of elements in u
+
+   @return void
+*/
+/* ------------------------------------------------------------ */
+static void zsampler_eval(zsampler *zs, float *u, long n);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+   @fn static float zsampler_invcdf(int ltype, float q)
+   @brief Inverse of the cumulative distribution of |z|
+
+   Returns the g for which the probability of |z| < g is q, for
+   the layer types of zprof().
+
+   @param ltype (int)   The layer type
+   @param q     (float) Probability, 0 <= q < 1
+
+   @return float zsampler_invcdf: g
+*/
+/* ------------------------------------------------------------ */
+static float zsampler_invcdf(int ltype, float q);
+
+
+
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
@@ -4456,6 +5591,67 @@ static int putgenresults(startinf *startinfv, loginf *log, hdrinf *hdr, ringparm
 */
 /* ------------------------------------------------------------ */
 static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringparms *rpm, fitparms *fit);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static int multireslevel(fitparms *fit, long loop)
+  @brief Resolution level by loop number
+
+  The first half of the loops is spread evenly over the coarse
+  levels, from the coarsest to the finest, the second half is done at
+  full resolution.
+
+  @param fit  (fitparms *) Properly configured fitparms struct
+  @param loop (long)       Loop, starting with 0
+
+  @return int multireslevel: The level, 0 is the full resolution
+*/
+/* ------------------------------------------------------------ */
+static int multireslevel(fitparms *fit, long loop);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void setmultires(ringparms *rpm, fitparms *fit, int level)
+  @brief Change the resolution level of the chisquare evaluation
+
+  Selects the level in engalmod and scales the point source flux and
+  the penalty with the number of pixels binned at that level, such
+  that fewer point sources are generated at coarse levels. All
+  subrings are calculated freshly.
+
+  @param rpm   (ringparms *) Properly configured ringparms struct
+  @param fit   (fitparms *)  Properly configured fitparms struct
+  @param level (int)         The level, 0 is the full resolution
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void setmultires(ringparms *rpm, fitparms *fit, int level);
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static double multires_chisquare(hdrinf *hdr, ringparms *rpm, fitparms *fit, long loop)
+  @brief Chisquare of the current parameters at the current level
+
+  Chisquares of different levels cannot be compared, the golden
+  section search needs a fresh reference after a change of the
+  level.
+
+  @param hdr  (hdrinf *)    Properly configured hdrinf struct
+  @param rpm  (ringparms *) Properly configured ringparms struct
+  @param fit  (fitparms *)  Properly configured fitparms struct
+  @param loop (long)        Loop, for the regularisation
+
+  @return double multires_chisquare: The chisquare, also put into hdr -> chi2
+*/
+/* ------------------------------------------------------------ */
+static double multires_chisquare(hdrinf *hdr, ringparms *rpm, fitparms *fit, long loop);
   
 
 
@@ -5145,6 +6341,26 @@ static int chkb_gau (ringparms *rpm, fitparms *fit);
 static int chkb_azi (ringparms *rpm, fitparms *fit);
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/**
+  @fn static void chkb_srshape(ringparms *rpm)
+  @brief Selects the srshape pipeline for each disk
+
+  To be called after the other chkb functions. Checks which of the
+  function pointers called in srshape() are the passive dummies and
+  links the fitting pipeline to inf_aziv[disk] -> kernel: one of the
+  srshape_flat_xx if no harmonic, warp, or shift term is active,
+  srshape_gen otherwise.
+
+  @param rpm  (ringparms *) Properly configured ringparms struct
+
+  @return void
+*/
+/* ------------------------------------------------------------ */
+static void chkb_srshape(ringparms *rpm);
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 /**
   @fn static void rndmf_init_sdis_pas(ringparms *rpm, int srnr, int disk)
@@ -5422,6 +6638,8 @@ static void srpr_ro4c_act(void *rpm, int srnr, int disk);
   @fn static void pr_vmi_pas(void *rpm, float v, int srnr, float sinaz, float cosaz, int disk)
   @brief dummy instead of pr_vm1-4s/c_act
 
+  pr_rai_pas and pr_roi_pas are the same for the ra and ro terms.
+
   @param rpm     (void *)  Properly structured ringparms struct
   @param v       (float *) Original velocity on input, will be changed
   @param srnr    (int)     sub-ring number
@@ -5433,6 +6651,8 @@ static void srpr_ro4c_act(void *rpm, int srnr, int disk);
 */
 /* ------------------------------------------------------------ */
 static void pr_vmi_pas(void *rpm, float *v, int srnr, float sinaz, float cosaz, int disk);
+static void pr_rai_pas(void *rpm, float *v, int srnr, float sinaz, float cosaz, int disk);
+static void pr_roi_pas(void *rpm, float *v, int srnr, float sinaz, float cosaz, int disk);
 
 
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
@@ -7423,8 +8643,25 @@ static loginf *get_loginf(startinf *startinfv, loginf *loginfv)
     userint_tir(startinfv -> arel, &log -> ncores, &nel, &def, "NCORES=", mes);
   }
   omp_set_num_threads(log -> ncores);
+
+  /* Placement of the cubes on the NUMA nodes of the cores */
+  log -> numa = 0;
+  def = 2;
+  sprintf(mes, "NUMA placement, 0: none, 1: first touch, 2: also interleave ffts [0]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &log -> numa, &nel, &def, "NUMA=", mes);
+  while (log -> numa < 0 || log -> numa > 2) {
+    sprintf(mes, "Out of range %i, give 0, 1, or 2", log -> numa);
+    cancel_tir(startinfv -> arel, "NUMA=", 2);
+    log -> numa = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &log -> numa, &nel, &def, "NUMA=", mes);
+  }
+  if (log -> ncores < 2)
+    log -> numa = 0;
 #else
   log -> ncores = 1;
+  log -> numa = 0;
 #endif
 
   /* First thing to do is the logfile and the text logfile */
@@ -7657,6 +8894,19 @@ static hdrinf *get_hdrinf(startinf *startinfv, loginf *log, hdrinf *hdrinfv)
   padcubex(hdr -> oric);
   padcubex(hdr -> modelc);
 
+  /* Padding has touched the cubes with a single thread, copy them with the threads evaluating the chisquare */
+  if ((log -> numa)) {
+    hdr -> oric -> points = engalmod_numacopy(hdr -> oric -> points, hdr -> oric -> size_x, hdr -> oric -> size_y, hdr -> oric -> size_v, log -> ncores);
+    hdr -> modelc -> points = engalmod_numacopy(hdr -> modelc -> points, hdr -> modelc -> size_x, hdr -> modelc -> size_y, hdr -> modelc -> size_v, log -> ncores);
+  }
+
+  /* Pointsource lists store 32 bit offsets into the model */
+  if (((unsigned long) (hdr -> modelc -> size_x+hdr -> modelc -> padding))*hdr -> modelc -> size_y*hdr -> modelc -> size_v > UINT_MAX) {
+    outerr = 1;
+    anyout_tir(&outerr, "Cube too large for the pointsource lists");
+    goto error;
+  }
+
   /* Linking, too (is absolutely dangerous and should be removed) */
   /* hdr -> ori = hdr -> oric -> points; */
   /* hdr -> model = hdr -> modelc ->points; */
@@ -8155,20 +9405,40 @@ static ringparms *create_ringparms(int ndisks)
   create_ringparms -> oldpar = NULL;
   create_ringparms -> chapar = NULL;
   create_ringparms -> modpar = NULL;
-  create_ringparms -> gsl_interparray = NULL;
-  create_ringparms -> gsl_interp_accelarray = NULL;
+  create_ringparms -> interparray = NULL;
   create_ringparms -> smothcar = NULL;
-  create_ringparms -> gsl_indinterparray = NULL;
-  create_ringparms -> gsl_indinterp_accelarray = NULL;
+  create_ringparms -> indinterparray = NULL;
   create_ringparms -> smothindcar = NULL;
   create_ringparms -> actarray = NULL;
   create_ringparms -> actindar = NULL;
   create_ringparms -> interar = NULL;
   create_ringparms -> radar = NULL;
   create_ringparms -> ltype = NULL;
+  create_ringparms -> zsam = NULL;
+  create_ringparms -> ztable = 0;
   create_ringparms -> cflux = NULL;
   create_ringparms -> allnpoints = NULL;
   create_ringparms -> fluxpoints = NULL;
+  create_ringparms -> deltac = NULL;
+  create_ringparms -> deltalist = NULL;
+  create_ringparms -> ndelta = create_ringparms -> deltamax = 0;
+  create_ringparms -> deltabase = NULL;
+  create_ringparms -> deltaactive = create_ringparms -> deltaready = create_ringparms -> deltafail = 0;
+  create_ringparms -> bgcache = create_ringparms -> bgready = 0;
+  create_ringparms -> bgvarele = NULL;
+  create_ringparms -> nslabs = 0;
+  create_ringparms -> slabsize = 0;
+  create_ringparms -> stream = 0;
+  create_ringparms -> deposit = DEPOSIT_NGP;
+  create_ringparms -> cloudblock = 0;
+  create_ringparms -> rng = 0;
+  create_ringparms -> sampler = 0;
+  create_ringparms -> prefix = 0;
+  create_ringparms -> schedule = 0;
+  create_ringparms -> srorder = NULL;
+  create_ringparms -> srcost = NULL;
+  create_ringparms -> streambins = NULL;
+  create_ringparms -> nstreambins = 0;
 
     create_ringparms -> sd        = NULL;
     create_ringparms -> inf_sdisv = NULL;
@@ -8237,6 +9507,12 @@ static ringparms *create_ringparms(int ndisks)
   /* Now allocate more memory */
   if (!(create_ringparms -> ltype = (int *) malloc(create_ringparms -> ndisks*sizeof(int))))
     goto error;
+  if (!(create_ringparms -> zsam = (zsampler *) malloc(create_ringparms -> ndisks*sizeof(zsampler))))
+    goto error;
+  for (i = 0; i < create_ringparms -> ndisks; ++i) {
+    create_ringparms -> zsam[i].ltype = 0;
+    create_ringparms -> zsam[i].tab = NULL;
+  }
 
   if (!(create_ringparms -> cflux = (double *) malloc(create_ringparms -> ndisks*sizeof(double))))
     goto error;
@@ -8276,36 +9552,18 @@ void destroy_ringparms(ringparms *prm)
   if ((prm -> chapar))
     free(prm -> chapar);
 
-  if ((prm -> gsl_interparray)) {
-    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i) {
-	if ((prm -> gsl_interparray[i]))
-	  gsl_interp_free(prm -> gsl_interparray[i]);
-    }
-    free(prm -> gsl_interparray);
-  }
-  if ((prm -> gsl_interp_accelarray)) {
-    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i) {
-      if ((prm -> gsl_interp_accelarray[i]))
-	gsl_interp_accel_free(prm -> gsl_interp_accelarray[i]);
-    }
-    free(prm -> gsl_interp_accelarray);
+  if ((prm -> interparray)) {
+    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i)
+      maths_interp_free(prm -> interparray[i]);
+    free(prm -> interparray);
   }
     
   if ((prm -> smothcar))
-    free(prm -> smothcar);
-  if ((prm -> gsl_indinterparray)) {
-    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i) {
-	if ((prm -> gsl_indinterparray[i]))
-	  gsl_interp_free(prm -> gsl_indinterparray[i]);
-    }
-    free(prm -> gsl_indinterparray);
-  }
-  if ((prm -> gsl_indinterp_accelarray)) {
-    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i) {
-      if ((prm -> gsl_indinterp_accelarray[i]))
-	gsl_interp_accel_free(prm -> gsl_indinterp_accelarray[i]);
-    }
-    free(prm -> gsl_indinterp_accelarray);
+    free(prm -> smothcar);
+  if ((prm -> indinterparray)) {
+    for (i = 0; i < prm -> ndisks*NDPARAMS; ++i)
+      maths_interp_free(prm -> indinterparray[i]);
+    free(prm -> indinterparray);
   }
   if ((prm -> smothindcar))
     free(prm -> smothindcar);
@@ -8320,6 +9578,13 @@ void destroy_ringparms(ringparms *prm)
 
   if (prm -> ltype)
     free(prm -> ltype);
+  if (prm -> zsam) {
+    for (i = 0; i < prm -> ndisks; ++i) {
+      if (prm -> zsam[i].tab)
+	free(prm -> zsam[i].tab);
+    }
+    free(prm -> zsam);
+  }
   if (prm -> cflux)
     free(prm -> cflux);
   
@@ -8328,6 +9593,15 @@ void destroy_ringparms(ringparms *prm)
     free(prm -> allnpoints);
   if (prm -> fluxpoints)
     free(prm -> fluxpoints);
+  if (prm -> deltac)
+    free(prm -> deltac);
+  if (prm -> deltalist)
+    free(prm -> deltalist);
+  destroy_streambins(prm);
+  if (prm -> srorder)
+    free(prm -> srorder);
+  if (prm -> srcost)
+    free(prm -> srcost);
 
   if (prm -> sd        != NULL) {for (i = 0; i < prm -> ndisks; ++i) {if (prm -> sd[i]        != NULL) destroy_srd(prm ->  sd[i], prm -> nr);}  free(prm -> sd);}
   if (prm -> inf_sdisv != NULL) {for (i = 0; i < prm -> ndisks; ++i) {if (prm -> inf_sdisv[i] != NULL) destroy_inf_sdis(prm -> inf_sdisv[i]);}  free(prm -> inf_sdisv);}
@@ -8433,10 +9707,20 @@ static srd *create_srd(int n)
 
   for (i = 0; i < n; ++i) {
     (sd+i) -> pl = NULL;
+    (sd+i) -> plbase = NULL;
+    (sd+i) -> plslab = NULL;
+    (sd+i) -> plcloud = NULL;
+    (sd+i) -> resize = 0;
+    (sd+i) -> plstored = 0;
+    (sd+i) -> deferred = 0;
+    (sd+i) -> fresh = (sd+i) -> bgactive = 0;
 #ifdef PBCORR
     (sd+i) -> pbfac = NULL;
 #endif
     (sd+i) -> permrandstr = NULL;
+    (sd+i) -> cloud = 0;
+    (sd+i) -> deposit = DEPOSIT_NGP;
+    (sd+i) -> streambin = NULL;
     (sd+i) -> randstr = NULL;
     (sd+i) -> grandstr[0] = NULL;
     (sd+i) -> grandstr[1] = NULL;
@@ -8468,6 +9752,10 @@ static void destroy_srd(srd *sd, int n)
 
   for (i = 0; i < n; ++i) {
     free(sd[i].pl);
+    if ((sd[i].plslab))
+      free(sd[i].plslab);
+    if ((sd[i].plcloud))
+      free(sd[i].plcloud);
 
 #ifdef PBCORR
     if (sd[i].pbfac)
@@ -8515,8 +9803,6 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
   char mes[81];  /* Any message */
   char placer[10];
   int inty, indinty; /* interpolation type */
-  const gsl_interp_type * intytype; /* same, only internal to gsl */
-  const gsl_interp_type * indintytype; /* same, only internal to gsl */
 
   int i,j = 0; /* Simple control variables */
   int disk; /* number of the disk */
@@ -8524,6 +9810,11 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
   int mode; /* For memory handling */
   int ndisks;
   int pcondisp, condisp;
+  char *wisdomfile = NULL, *wisdompos; /* fftw wisdom */
+  int keypres, nread, nreturned;
+  double autocrop; /* Cropping of the cubes in the chisquare evaluation */
+  long numapages, numalocal; /* Placement of the cubes */
+  int numanodes;
 
 /* primary beam stuff */
 #ifdef PBCORR
@@ -8592,24 +9883,16 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
 	  rpm -> chapar[j] = 0;
 
 	/* Allocate the interpolation structures */
-	if (!(rpm -> gsl_interparray = (gsl_interp **) malloc(rpm -> ndisks*NDPARAMS*sizeof(gsl_interp *))))
+	if (!(rpm -> interparray = (maths_interp **) malloc(rpm -> ndisks*NDPARAMS*sizeof(maths_interp *))))
 	  goto error;
 	for (j = 0; j < rpm -> ndisks*NDPARAMS; ++j)
-	  rpm -> gsl_interparray[j] = NULL;
-	if (!(rpm -> gsl_interp_accelarray = (gsl_interp_accel **) malloc(rpm -> ndisks*NDPARAMS*sizeof(gsl_interp_accel *))))
-	      goto error;	
-	for (j = 0; j < rpm -> ndisks*NDPARAMS; ++j)
-	  rpm -> gsl_interp_accelarray[j] = NULL;
+	  rpm -> interparray[j] = NULL;
 	if (!(rpm -> smothcar = (int *) malloc(rpm -> ndisks*NDPARAMS*sizeof(int))))
 	      goto error;
-	if (!(rpm -> gsl_indinterparray = (gsl_interp **) malloc(rpm -> ndisks*NDPARAMS*sizeof(gsl_interp *))))
+	if (!(rpm -> indinterparray = (maths_interp **) malloc(rpm -> ndisks*NDPARAMS*sizeof(maths_interp *))))
 	  goto error;
 	for (j = 0; j < rpm -> ndisks*NDPARAMS; ++j)
-	  rpm -> gsl_indinterparray[j] = NULL;
-	if (!(rpm -> gsl_indinterp_accelarray = (gsl_interp_accel **) malloc(rpm -> ndisks*NDPARAMS*sizeof(gsl_interp_accel *))))
-	      goto error;	
-	for (j = 0; j < rpm -> ndisks*NDPARAMS; ++j)
-	  rpm -> gsl_indinterp_accelarray[j] = NULL;
+	  rpm -> indinterparray[j] = NULL;
 	if (!(rpm -> smothindcar = (int *) malloc(rpm -> ndisks*NDPARAMS*sizeof(int))))
 	      goto error;
 	if (!(rpm -> actarray = (int *) malloc(rpm -> nur * sizeof(int))))
@@ -8673,39 +9956,26 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
 	err = 1;
     }
 
-    /* Now allocate all the interpolation structs and "accelerators" */
+    /* Check the interpolation type, maths_interp_init falls back to the same */
     switch (inty) {
-    case INTERP_LINEAR:
-      intytype = gsl_interp_linear;
-      break;
-
     case INTERP_CSPLINE:
-      if (rpm -> nur > 2){
-	intytype = gsl_interp_cspline;
-      }
-      else {
+      if (rpm -> nur <= 2) {
 	sprintf(mes, "Must have at least 3 radii for spline, using linear");
 	anyout_tir(&err, mes);
-	intytype = gsl_interp_linear;
       }
       break;
     
     case INTERP_AKIMA:
-      if (rpm -> nur > 4) {
-	intytype = gsl_interp_akima;
-      }
-      else {
+      if (rpm -> nur <= 4) {
 	sprintf(mes, "Must have at least 5 radii for Akima");
 	anyout_tir(&err, mes);
 	if (rpm -> nur > 2) {
 	  sprintf(mes, "Using natural cubic spline");
 	  anyout_tir(&err, mes);
-	  intytype = gsl_interp_cspline;
 	}
 	else {
 	  sprintf(mes, "Using linear");
 	  anyout_tir(&err, mes);
-	  intytype = gsl_interp_linear;
 	}
       }
       break;
@@ -8715,13 +9985,9 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
       break;
     }
 
-    /* Real allocation here */
+    /* Real allocation here, the workspaces are reused in each call */
     for (i = 0; i < rpm -> ndisks*NDPARAMS; ++i) {
-      if (!(rpm -> gsl_interparray[i] = gsl_interp_alloc(intytype, rpm -> nur)))
-	goto error;
-      /* printf("%s"); */
-
-      if (!(rpm -> gsl_interp_accelarray[i] = gsl_interp_accel_alloc()))
+      if (!(rpm -> interparray[i] = maths_interp_alloc(rpm -> nur > 2 ? rpm -> nur : 2)))
 	goto error;
       rpm -> smothcar[i] = inty;
     }
@@ -8745,38 +10011,26 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
 	err = 1;
     }
 
-    /* Now allocate all the interpolation structs and "accelerators" */
+    /* Check the interpolation type, maths_interp_init falls back to the same */
     switch (indinty) {
-    case INTERP_LINEAR:
-      indintytype = gsl_interp_linear;
-      break;
-
     case INTERP_CSPLINE:
-      if (rpm -> nur > 2)
-	indintytype = gsl_interp_cspline;
-      else {
+      if (rpm -> nur <= 2) {
 	sprintf(mes, "Must have at least 3 radii for spline, using linear");
 	anyout_tir(&err, mes);
-	indintytype = gsl_interp_linear;
       }
       break;
     
     case INTERP_AKIMA:
-      if (rpm -> nur > 4) {
-	indintytype = gsl_interp_akima;
-      }
-      else {
+      if (rpm -> nur <= 4) {
 	sprintf(mes, "Must have at least 5 radii for Akima");
 	anyout_tir(&err, mes);
 	if (rpm -> nur > 2) {
 	  sprintf(mes, "Using natural cubic spline");
 	  anyout_tir(&err, mes);
-	  indintytype = gsl_interp_cspline;
 	}
 	else {
 	  sprintf(mes, "Using linear");
 	  anyout_tir(&err, mes);
-	  indintytype = gsl_interp_linear;
 	}
       }
       break;
@@ -8786,13 +10040,9 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
       break;
     }
 
-    /* Real allocation here */
+    /* Real allocation here, changedependent uses these instead of allocating its own */
     for (i = 0; i < rpm -> ndisks*NDPARAMS; ++i) {
-      if (!(rpm -> gsl_indinterparray[i] = gsl_interp_alloc(indintytype, rpm -> nur)))
-	goto error;
-      /* printf("%s"); */
-
-      if (!(rpm -> gsl_indinterp_accelarray[i] = gsl_interp_accel_alloc()))
+      if (!(rpm -> indinterparray[i] = maths_interp_alloc(rpm -> nur > 2 ? rpm -> nur : 2)))
 	goto error;
       rpm -> smothindcar[i] = indinty;
     }
@@ -9288,6 +10538,40 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
       err = 1;
   }
 
+  /* fftw wisdom files, by default in the directory of the logfile, an empty entry switches them off */
+  if (simparse_scn_arel_readval_string(startinfv -> arel, "WISDOMFILE", "Provide stem of fftw wisdom files (default: next to logfile).", 0, "", 0, -1, 0, 0, &keypres, &nread, &nreturned, &wisdomfile))
+    goto error;
+
+  if (!keypres && (log -> logname)) {
+    free(wisdomfile);
+    if (!(wisdomfile = (char *) malloc((strlen(log -> logname)+strlen(WISDOMFILE_DEFAULT)+1)*sizeof(char))))
+      goto error;
+    strcpy(wisdomfile, log -> logname);
+    if ((wisdompos = strrchr(wisdomfile, '/')))
+      *(wisdompos+1) = '\0';
+    else
+      *wisdomfile = '\0';
+    strcat(wisdomfile, WISDOMFILE_DEFAULT);
+  }
+
+  err = engalmod_wisdomfile(wisdomfile);
+  free(wisdomfile);
+  if (!err)
+    goto error;
+
+  engalmod_numa(log -> numa);
+
+  /* Cropping to the unflagged part of the cube, the halo in v is determined by the largest expected CONDISP */
+  autocrop = -1.0;
+  sprintf(mes, "Max CONDISP (km/s) for cropping to unflagged region, -1: no cropping [-1]");
+  def = 2;
+  nel = 1;
+  userdble_tir(startinfv -> arel, &autocrop, &nel, &def, "AUTOCROP=", mes);
+  if (autocrop >= 0.0)
+    engalmod_autocrop(dparamtointern(autocrop, condisp, hdr, rpm -> ndisks));
+  else
+    engalmod_autocrop(-1.0);
+
   /* Input mode */
     rpm -> mode = 3;
     def = 5;
@@ -9349,6 +10633,16 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
   j = 4;
   if (mode < 8)
     error_tir(&j,"Error initializing chi^2 derivation control.");
+
+  /* Report where the cubes have ended up */
+  if ((log -> numa)) {
+    j = 1;
+    if (engalmod_numareport(&numapages, &numalocal, &numanodes) && numapages > 0)
+      sprintf(mes, "NUMA: %ld of %ld pages local, on %i node(s)", numalocal, numapages, numanodes);
+    else
+      sprintf(mes, "NUMA: placement cannot be queried");
+    anyout_tir(&j, mes);
+  }
   
   /* Write inset data into ori array  (has been done since long)*/
   /* nel = 0; */
@@ -9379,6 +10673,17 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
 
   /* Also, we change the nprof */
   hdr -> nprof = hdr -> bcsize1*hdr -> bsize2;
+
+  /* Velocity slabs for the parallel deposition, a few per core for the load balance */
+  rpm -> nslabs = 0;
+#ifdef OPENMPTIR
+  if (log -> ncores > 1) {
+    rpm -> nslabs = 4*log -> ncores < hdr -> nsubs ? 4*log -> ncores : hdr -> nsubs;
+    rpm -> slabsize = (hdr -> nsubs+rpm -> nslabs-1)/rpm -> nslabs;
+    rpm -> nslabs = (hdr -> nsubs+rpm -> slabsize-1)/rpm -> slabsize;
+    rpm -> slabsize = rpm -> slabsize*hdr -> nprof;
+  }
+#endif
   
 
   /* We initialise the sd array */
@@ -9423,6 +10728,109 @@ static ringparms *get_ringparms(startinf *startinfv, loginf *log, hdrinf *hdr, r
     }
   }
 
+  /* Block generation of the clouds, the scalar path is kept for comparison */
+  rpm -> cloudblock = 1;
+  def = 2;
+  sprintf(mes, "Generate clouds in blocks, 0: one by one, 1: in blocks [1]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "CLOUDBLOCK=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> cloudblock, &nel, &def, "CLOUDBLOCK=", mes);
+  while (rpm -> cloudblock < 0 || rpm -> cloudblock > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> cloudblock);
+    cancel_tir(startinfv -> arel, "CLOUDBLOCK=", 2);
+    rpm -> cloudblock = 1;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> cloudblock, &nel, &def, "CLOUDBLOCK=", mes);
+  }
+
+  /* Random number generator for the clouds */
+  rpm -> rng = 0;
+  def = 2;
+  sprintf(mes, "Cloud random numbers, 0: RANMAR, 1: counter-based [0]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "RNG=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> rng, &nel, &def, "RNG=", mes);
+  while (rpm -> rng < 0 || rpm -> rng > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> rng);
+    cancel_tir(startinfv -> arel, "RNG=", 2);
+    rpm -> rng = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> rng, &nel, &def, "RNG=", mes);
+  }
+
+  /* Sampler of the vertical profiles */
+  rpm -> ztable = 0;
+  def = 2;
+  sprintf(mes, "Vertical profiles, 0: exact, 1: from tables [0]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "ZSAMPLER=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> ztable, &nel, &def, "ZSAMPLER=", mes);
+  while (rpm -> ztable < 0 || rpm -> ztable > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> ztable);
+    cancel_tir(startinfv -> arel, "ZSAMPLER=", 2);
+    rpm -> ztable = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> ztable, &nel, &def, "ZSAMPLER=", mes);
+  }
+
+  for (i = 0; i < rpm -> ndisks; ++i) {
+    if (!zsampler_init(rpm -> zsam+i, rpm -> ltype[i], rpm -> ztable))
+      goto error;
+  }
+
+  /* Quasi-random sampling of the clouds */
+  rpm -> sampler = 0;
+  def = 2;
+  sprintf(mes, "Cloud sampling, 0: pseudo-random, 1: quasi-random [0]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "SAMPLER=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> sampler, &nel, &def, "SAMPLER=", mes);
+  while (rpm -> sampler < 0 || rpm -> sampler > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> sampler);
+    cancel_tir(startinfv -> arel, "SAMPLER=", 2);
+    rpm -> sampler = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> sampler, &nel, &def, "SAMPLER=", mes);
+  }
+
+  /* Resizing of the pointsource lists, requires the addressable cloud streams of RNG=1 or SAMPLER=1 */
+  rpm -> prefix = 1;
+  def = 2;
+  sprintf(mes, "Resize pointsource lists if only SBR changes, 0: no, 1: yes [1]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "PREFIX=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> prefix, &nel, &def, "PREFIX=", mes);
+  while (rpm -> prefix < 0 || rpm -> prefix > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> prefix);
+    cancel_tir(startinfv -> arel, "PREFIX=", 2);
+    rpm -> prefix = 1;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> prefix, &nel, &def, "PREFIX=", mes);
+  }
+  if (!(rpm -> rng) && !(rpm -> sampler))
+    rpm -> prefix = 0;
+
+  /* Scheduling of the subrings over the threads */
+  rpm -> schedule = 1;
+  def = 2;
+  sprintf(mes, "Schedule subrings, 0: disk by disk, 1: by cost [1]");
+  if (!startinfv -> firstrun)
+    cancel_tir(startinfv -> arel, "SCHEDULE=", 0);
+  nel = 1;
+  userint_tir(startinfv -> arel, &rpm -> schedule, &nel, &def, "SCHEDULE=", mes);
+  while (rpm -> schedule < 0 || rpm -> schedule > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", rpm -> schedule);
+    cancel_tir(startinfv -> arel, "SCHEDULE=", 2);
+    rpm -> schedule = 1;
+    def = 1;
+    userint_tir(startinfv -> arel, &rpm -> schedule, &nel, &def, "SCHEDULE=", mes);
+  }
+
   return rpm;
   
   error:
@@ -9458,6 +10866,11 @@ static fitparms *create_fitparms(ringparms *rpm)
   fit -> mon_dpar = NULL;
   fit -> reg_contv = NULL;
   fit -> npoints = NULL;
+  fit -> multires_cflux = NULL;
+  fit -> psba = PSW_PSBA_DEF;
+  fit -> psbamodels = NULL;
+  fit -> psbasigmas = NULL;
+  fit -> psbapoints = NULL;
 
   /* Allocate the memory */
   if (!(fit -> normrandstr = (maths_rstr *) malloc(sizeof(maths_rstr))))
@@ -9471,6 +10884,8 @@ static fitparms *create_fitparms(ringparms *rpm)
      goto error;
   if (!(fit -> mon_totalflux = (double *) malloc(rpm -> ndisks*sizeof(double))))
      goto error;
+  if (!(fit -> multires_cflux = (double *) malloc(rpm -> ndisks*sizeof(double))))
+     goto error;
 
   return fit;
 
@@ -9488,6 +10903,8 @@ static fitparms *create_fitparms(ringparms *rpm)
 /* Destroys a fitparms structure */
 void destroy_fitparms(fitparms *fit)
 {
+  int i;
+
   /* Check if it is there */
   if (!(fit))
     return;
@@ -9504,6 +10921,8 @@ void destroy_fitparms(fitparms *fit)
     free(fit -> mon_repnpoints);
   if((fit -> mon_totalflux))
     free(fit -> mon_totalflux);
+  if((fit -> multires_cflux))
+    free(fit -> multires_cflux);
   if((fit -> gft_mstv))
     gft_mst_destr(fit -> gft_mstv);
   if((fit -> varyhstr))
@@ -9516,6 +10935,17 @@ void destroy_fitparms(fitparms *fit)
     reg_cont_destr(fit -> reg_contv);
   if ((fit -> adar))
     free(fit -> adar);
+  if ((fit -> psbamodels)) {
+    for (i = 0; i < fit -> psba; ++i) {
+      if ((fit -> psbamodels[i]))
+	free(fit -> psbamodels[i]);
+    }
+    free(fit -> psbamodels);
+  }
+  if ((fit -> psbasigmas))
+    free(fit -> psbasigmas);
+  if ((fit -> psbapoints))
+    free(fit -> psbapoints);
 
   free(fit);
     return;
@@ -9599,6 +11029,7 @@ static fitparms *get_fitparms(startinf *startinfv, loginf *log, hdrinf *hdr, rin
     cancel_tir(startinfv -> arel, "PSFW=", 0); /* only fitmode = PSWARM */
     cancel_tir(startinfv -> arel, "PSID=", 0); /* only fitmode = PSWARM */
     cancel_tir(startinfv -> arel, "PSDD=", 0); /* only fitmode = PSWARM */
+    cancel_tir(startinfv -> arel, "PSBA=", 0); /* only fitmode = PSWARM */
     cancel_tir(startinfv -> arel, "VARINDX=", 0);
     cancel_tir(startinfv -> arel, "VARY=", 0);
     cancel_tir(startinfv -> arel, "VARYSING=", 0);
@@ -9674,6 +11105,149 @@ static fitparms *get_fitparms(startinf *startinfv, loginf *log, hdrinf *hdr, rin
   sprintf(mes, "Give number of loops to process. [500000]");
   nel = 1;
   userint_tir(startinfv -> arel, &fit -> loops, &nel, &def, "LOOPS=", mes);
+
+  /* Refresh policy of the weight map, only relevant with WEIGHT != 0 */
+  fit -> noiseupd = 1;
+  def = 2;
+  sprintf(mes, "Refresh weight map every N models, -1: per iteration, -2: per loop [1]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> noiseupd, &nel, &def, "NOISEUPD=", mes);
+  while (fit -> noiseupd < NOISEUPD_LOOP || fit -> noiseupd == 0) {
+    sprintf(mes, "Out of range %i, give N > 0, -1 or -2", fit -> noiseupd);
+    cancel_tir(startinfv -> arel, "NOISEUPD=", 2);
+    fit -> noiseupd = 1;
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> noiseupd, &nel, &def, "NOISEUPD=", mes);
+  }
+
+  /* Per iteration and per loop are driven from the fitting routines */
+  engalmod_noiseupdate((fit -> noiseupd > 0) ? fit -> noiseupd : -1);
+  fit -> noise_alliter = fit -> noise_alloops = 0;
+
+  /* Resolution pyramid for the first half of the loops of the golden section search */
+  fit -> multires = 1;
+  def = 2;
+  sprintf(mes, "Number of resolution levels, 1: full resolution only [1]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> multires, &nel, &def, "MULTIRES=", mes);
+  while (fit -> multires < 1) {
+    sprintf(mes, "Out of range %i, give a number >= 1", fit -> multires);
+    cancel_tir(startinfv -> arel, "MULTIRES=", 2);
+    fit -> multires = 1;
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> multires, &nel, &def, "MULTIRES=", mes);
+  }
+
+  /* Only the golden section search restarts from a fresh chisquare when the level changes */
+  if (fit -> fitmode != GOLDEN_SECTION)
+    fit -> multires = 1;
+  if (!engalmod_multires(fit -> multires))
+    fit -> multires = 1;
+  fit -> multireslevel = 0;
+  for (i = 0; i < rpm -> ndisks; ++i)
+    fit -> multires_cflux[i] = rpm -> cflux[i];
+  fit -> multires_penalty = rpm -> penalty;
+
+  /* Sub-pixel deposition of the pointsources */
+  fit -> deposit = DEPOSIT_NGP;
+  def = 2;
+  sprintf(mes, "Pointsource deposition, 0: NGP, 1: CIC, 2: TSC [0]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> deposit, &nel, &def, "DEPOSIT=", mes);
+  while (fit -> deposit < DEPOSIT_NGP || fit -> deposit > DEPOSIT_TSC) {
+    sprintf(mes, "Out of range %i, give 0, 1, or 2", fit -> deposit);
+    cancel_tir(startinfv -> arel, "DEPOSIT=", 2);
+    fit -> deposit = DEPOSIT_NGP;
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> deposit, &nel, &def, "DEPOSIT=", mes);
+  }
+  rpm -> deposit = fit -> deposit;
+
+  /* Streaming deposition, the default for the fitters that change all subrings in every step, and required by CIC and TSC */
+  fit -> stream = (fit -> fitmode == SIMPLEX || fit -> fitmode == PSWARM || fit -> deposit != DEPOSIT_NGP);
+  def = 2;
+  sprintf(mes, "Deposit pointsources without pointsource lists, 0: off, 1: on [%i]", fit -> stream);
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> stream, &nel, &def, "STREAM=", mes);
+  while (fit -> stream < 0 || fit -> stream > 1 || (!fit -> stream && fit -> deposit != DEPOSIT_NGP)) {
+    if (fit -> stream < 0 || fit -> stream > 1)
+      sprintf(mes, "Out of range %i, give 0 or 1", fit -> stream);
+    else
+      sprintf(mes, "DEPOSIT=%i requires STREAM=1", fit -> deposit);
+    cancel_tir(startinfv -> arel, "STREAM=", 2);
+    fit -> stream = (fit -> fitmode == SIMPLEX || fit -> fitmode == PSWARM || fit -> deposit != DEPOSIT_NGP);
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> stream, &nel, &def, "STREAM=", mes);
+  }
+  rpm -> stream = fit -> stream;
+
+  /* The bins of the threads, without them the subrings are generated serially */
+  destroy_streambins(rpm);
+  if ((rpm -> stream))
+    create_streambins(rpm, log -> ncores);
+
+  /* Incremental evaluation in the golden section search */
+  fit -> deltamod = 0;
+  def = 2;
+  sprintf(mes, "Incremental evaluations between two full evaluations, 0: off [0]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> deltamod, &nel, &def, "DELTAMOD=", mes);
+  while (fit -> deltamod < 0) {
+    sprintf(mes, "Out of range %i, give a number >= 0", fit -> deltamod);
+    cancel_tir(startinfv -> arel, "DELTAMOD=", 2);
+    fit -> deltamod = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> deltamod, &nel, &def, "DELTAMOD=", mes);
+  }
+
+  /* The other fitters do not vary one parameter at a time */
+  if (fit -> fitmode != GOLDEN_SECTION || (fit -> stream))
+    fit -> deltamod = 0;
+
+#ifdef PBCORR
+  /* An active primary beam correction weights every pointsource, as in srresizable */
+  if ((fit -> deltamod) && rpm -> fill_pbcfac == fill_pbcfac_act) {
+    fit -> deltamod = 0;
+    def = 1;
+    anyout_tir(&def, "DELTAMOD ignored with primary beam correction");
+  }
+#endif
+
+  if ((fit -> deltamod)) {
+    if (!(rpm -> deltac = (float *) calloc(hdr -> nprof*hdr -> nsubs, sizeof(float))) || !(rpm -> deltalist = (long *) malloc(1024*sizeof(long)))) {
+      if ((rpm -> deltac))
+	free(rpm -> deltac);
+      rpm -> deltac = NULL;
+      fit -> deltamod = 0;
+    }
+    else
+      rpm -> deltamax = 1024;
+  }
+  engalmod_deltaupdate(fit -> deltamod);
+
+  /* Background model while one VARY group is being optimised */
+  fit -> bgcache = 0;
+  def = 2;
+  sprintf(mes, "Freeze subrings not changed by the current VARY group, 0: off, 1: on [0]");
+  nel = 1;
+  userint_tir(startinfv -> arel, &fit -> bgcache, &nel, &def, "BGCACHE=", mes);
+  while (fit -> bgcache < 0 || fit -> bgcache > 1) {
+    sprintf(mes, "Out of range %i, give 0 or 1", fit -> bgcache);
+    cancel_tir(startinfv -> arel, "BGCACHE=", 2);
+    fit -> bgcache = 0;
+    def = 1;
+    userint_tir(startinfv -> arel, &fit -> bgcache, &nel, &def, "BGCACHE=", mes);
+  }
+  if (fit -> fitmode != GOLDEN_SECTION || (fit -> stream))
+    fit -> bgcache = 0;
+#ifdef PBCORR
+  if ((fit -> bgcache) && rpm -> fill_pbcfac == fill_pbcfac_act) {
+    fit -> bgcache = 0;
+    def = 1;
+    anyout_tir(&def, "BGCACHE ignored with primary beam correction");
+  }
+#endif
+  rpm -> bgcache = fit -> bgcache;
     
   /* Get the total maximum number of iterations */
   if (fit -> fitmode > GOLDEN_SECTION) {
@@ -9760,6 +11334,37 @@ static fitparms *get_fitparms(startinf *startinfv, loginf *log, hdrinf *hdr, rin
     sprintf(mes, "Give decrease factor for delta for grid search. [2.0]");
     nel = 1;
     userdble_tir(startinfv -> arel, &fit -> psdd, &nel, &def, "PSDD=", mes);
+
+    fit -> psba = PSW_PSBA_DEF;
+    def = 2;
+    sprintf(mes, "Give number of models PSWARM evaluates at once. [1]");
+    nel = 1;
+    userint_tir(startinfv -> arel, &fit -> psba, &nel, &def, "PSBA=", mes);
+    while (fit -> psba < 1) {
+      sprintf(mes, "Out of range %i, give a number >= 1", fit -> psba);
+      cancel_tir(startinfv -> arel, "PSBA=", 2);
+      fit -> psba = PSW_PSBA_DEF;
+      def = 1;
+      userint_tir(startinfv -> arel, &fit -> psba, &nel, &def, "PSBA=", mes);
+    }
+
+    /* The models of a batch are kept until their chisquares are known */
+    if (fit -> psba > 1) {
+      if (!(fit -> psbamodels = (float **) calloc(fit -> psba, sizeof(float *))) || !(fit -> psbasigmas = (float *) malloc(fit -> psba*sizeof(float))) || !(fit -> psbapoints = (long *) malloc(fit -> psba*(1+2*rpm -> ndisks)*sizeof(long))))
+	goto error;
+      for (i = 0; i < fit -> psba; ++i) {
+	if (!(fit -> psbamodels[i] = (float *) malloc(hdr -> nprof*hdr -> nsubs*sizeof(float))))
+	  break;
+      }
+
+      /* Without the memory as many as possible */
+      if (i < fit -> psba) {
+	def = 1;
+	sprintf(mes, "Not enough memory for PSBA=%i, using %i", fit -> psba, (i > 1) ? i : 1);
+	anyout_tir(&def, mes);
+	fit -> psba = (i > 1) ? i : 1;
+      }
+    }
   }
   /* We are through with the first hdu, so it will be created if not already existent */
   /******************/
@@ -10221,6 +11826,7 @@ static fitparms *get_fitparms(startinf *startinfv, loginf *log, hdrinf *hdr, rin
   chkb_smi(rpm,fit);
   chkb_gau(rpm,fit);
   chkb_azi(rpm,fit);
+  chkb_srshape(rpm);
 
   /* These are now not necessary anymore, they exist in any case */
   free(parmax);
@@ -11736,6 +13342,7 @@ static int writemodel(hdrinf *origin, ringparms *rpm, fitparms *fit, double *par
   int i=0;
   /* char mes[200]; */
   int pcondisp;
+  int level;
   /* int checki = 0, checkia = 0; */
 
 /*   int allnpoints[ndisks]; */
@@ -11772,9 +13379,15 @@ static int writemodel(hdrinf *origin, ringparms *rpm, fitparms *fit, double *par
   /*   printf("Is empty\n"); */
   /* } */
 
+  /* The output is at full resolution */
+  level = fit -> multireslevel;
+  setmultires(rpm, fit, 0);
+
   /* Then we generate the cube and convolve it */
   galmod(origin, rpm, 1, NULL, index, rpm -> fluxpoints, rpm -> allnpoints);
 
+  /* The output needs the exact weight map */
+  engalmod_refreshnoise();
   origin -> chi2 = getchisquare_c(rpm -> par[(pcondisp)*rpm -> nur]);
 
   /* Regularise */
@@ -11812,6 +13425,8 @@ static int writemodel(hdrinf *origin, ringparms *rpm, fitparms *fit, double *par
   /* This should do */
   cubarithm_writecube(origin -> modelc, origin -> outset, NULL);
 
+  setmultires(rpm, fit, level);
+
  /* Now change this back */
  /* origin -> nprof = origin -> bcsize1*origin -> bsize2; */
 
@@ -12221,6 +13836,10 @@ static int genfit(startinf *startinfv, loginf *log, hdrinf *hdr, ringparms *rpm,
       *dblarray = fit -> psfi; gft_mst_put(fit -> gft_mstv, dblarray, GFT_INPUT_PSFININ);
       *dblarray = fit -> psid; gft_mst_put(fit -> gft_mstv, dblarray, GFT_INPUT_PSINCDE);
       *dblarray = fit -> psdd; gft_mst_put(fit -> gft_mstv, dblarray, GFT_INPUT_PSDECDE);
+
+      /* Swarms and poll steps in batches */
+      if (fit -> psba > 1)
+	gft_mst_putv(fit -> gft_mstv, &gchsq_gen_vec, GFT_INPUT_GCHSQ_VEC);
     }  
     /* As long as there is moderation, we do this */
     while (fit -> loopnr <= fit -> loops && fit -> loopnr <= maxmod) {
@@ -12540,8 +14159,11 @@ static double gchsq_gen_start(double *vector, void *rest)
   /* Do make the model */
   galmod(adarv -> hdr, adarv -> rpm, GENFIT, adarv -> fit -> varylist, adarv -> fit -> index, adarv -> fit -> fluxpoints, adarv -> fit -> npoints);
   
-  /* Get the chisquare, formerly using PCONDISP (NPARAMS + (ndisks - 1)*NDPARAMS) */
-  gchsq_genv = getchisquare_c(adarv -> rpm -> par[((NPARAMS + (adarv -> rpm -> ndisks - 1)*NDPARAMS))*adarv -> rpm -> nur]);
+  /* A fresh weight map for the start */
+  engalmod_refreshnoise();
+
+  /* Get the chisquare in Fourier space, the convolved model is not needed here, formerly using PCONDISP (NPARAMS + (ndisks - 1)*NDPARAMS) */
+  gchsq_genv = getchisquare_fourier_c(adarv -> rpm -> par[((NPARAMS + (adarv -> rpm -> ndisks - 1)*NDPARAMS))*adarv -> rpm -> nur]);
 
   /* Regularise and get alloops first */
   gft_mst_get(adarv -> fit -> gft_mstv, &adarv -> fit -> mon_alloops   , GFT_OUTPUT_ALLOOPS);
@@ -12734,53 +14356,185 @@ static double gchsq_gen(double *vector, void *rest)
   adarv -> fit -> mon_maxiter = adarv -> fit -> maxiter;
   adarv -> fit -> mon_loops = adarv -> fit -> loops;
 
-  varele = adarv -> fit -> varylist;
-  i = 0;
-  if (adarv -> fit -> mon_npar_cur > -1) {
-    while (i < adarv -> fit -> mon_npar_cur) {
-      varele = varele -> next;
-      ++i;
-    }
-    ftstab_putcoltitl(adarv -> fit -> mon_key, (*varele -> elements)/adarv -> rpm -> nur+1);
-  }
-  else {
-    sprintf(adarv -> fit -> mon_key,"GEN");
-  }
+  varele = adarv -> fit -> varylist;
+  i = 0;
+  if (adarv -> fit -> mon_npar_cur > -1) {
+    while (i < adarv -> fit -> mon_npar_cur) {
+      varele = varele -> next;
+      ++i;
+    }
+    ftstab_putcoltitl(adarv -> fit -> mon_key, (*varele -> elements)/adarv -> rpm -> nur+1);
+  }
+  else {
+    sprintf(adarv -> fit -> mon_key,"GEN");
+  }
+
+  adarv -> fit -> mon_dsize = ddinterntoparam(adarv -> fit -> mon_dsize, (*varele -> elements)/adarv -> rpm -> nur+1, adarv -> hdr, adarv -> rpm -> ndisks);
+  for (k = 0; k < adarv -> fit -> mon_npar; ++k) {
+    adarv -> fit -> mon_dpar[k] = ddinterntoparam(adarv -> fit -> mon_dpar[k], (*varele -> elements)/adarv -> rpm -> nur+1, adarv -> hdr, adarv -> rpm -> ndisks);
+  }
+  adarv -> fit -> mon_ring = (*varele -> elements)%adarv -> rpm -> nur+1;
+  for (disk = 0; disk < adarv -> rpm -> ndisks; ++disk){
+    adarv -> fit -> mon_repnpoints[disk] = adarv -> fit -> npoints[disk];
+    adarv -> fit -> mon_totalflux[disk] = adarv -> fit -> fluxpoints[disk]*adarv -> rpm -> cflux[disk]*adarv -> hdr -> deltgridtouser[2];
+  }
+
+  }
+  else {
+    /* ERROR SOURCE: Some initialisation here ? */
+    gchsq_genv = gchsq_gen2(vector, rest);
+
+    /* Change the fitting function */
+    gft_mst_putf(adarv -> fit -> gft_mstv, &gchsq_gen2, GFT_INPUT_GCHSQ_REP);
+
+  }
+
+  return gchsq_genv;
+
+ error:
+  return -1.0;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* function passed to gft */
+static double gchsq_gen2(double *vector, void *rest)
+{
+  return gchsq_gen_eval(vector, (adar *) rest, 0.0, NULL);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* function passed to gft, several parameter sets at once */
+static void gchsq_gen_vec(int m, double *vectors, double *chisquares, void *rest)
+{
+  double dummy;
+  int i, j, nb, disk, nval, batched;
+  long *points;
+  adar *adarv;
+
+  /* We get all the info from the additional arguments */
+  adarv = (adar *) rest;
+  nval = 1+2*adarv -> rpm -> ndisks;
+
+  /* We read from the logfile as long as possible */
+  j = 0;
+  while (j < m && ftstab_get_value(adarv -> fit -> recnr+1L, 1L, &dummy)) {
+    chisquares[j] = gchsq_gen(vectors+j*adarv -> fit -> mon_npar, rest);
+
+    /* gft counts the models of this call only after it */
+    adarv -> fit -> mon_allcalls += j+1;
+    adarv -> fit -> mon_calls_st += j+1;
+    ++j;
+  }
+
+  while (j < m) {
+    nb = (m-j < adarv -> fit -> psba) ? m-j : adarv -> fit -> psba;
+
+    /* Make the models of the batch */
+    gchsq_gen_noise(adarv);
+    for (i = 0; i < nb; ++i) {
+      if (gchsq_gen_par(adarv, vectors+(j+i)*adarv -> fit -> mon_npar) < 0.0)
+	goto error;
+      galmod(adarv -> hdr, adarv -> rpm, GENFIT, adarv -> fit -> varylist, adarv -> fit -> index, adarv -> rpm -> fluxpoints, adarv -> fit -> npoints);
+      memcpy(adarv -> fit -> psbamodels[i], adarv -> hdr -> modelc -> points, adarv -> hdr -> nprof*adarv -> hdr -> nsubs*sizeof(float));
+      adarv -> fit -> psbasigmas[i] = adarv -> rpm -> par[((NPARAMS + (adarv -> rpm -> ndisks - 1)*NDPARAMS))*adarv -> rpm -> nur];
+      points = adarv -> fit -> psbapoints+i*nval;
+      points[0] = adarv -> rpm -> outpoints;
+      for (disk = 0; disk < adarv -> rpm -> ndisks; ++disk) {
+	points[1+disk] = adarv -> rpm -> fluxpoints[disk];
+	points[1+adarv -> rpm -> ndisks+disk] = adarv -> fit -> npoints[disk];
+      }
+    }
+
+    /* Get the chisquares of all models in one go, if that fails, one by one */
+    batched = getchisquare_batch_c(nb, adarv -> fit -> psbamodels, adarv -> fit -> psbasigmas, chisquares+j);
+
+    /* Log the models as if they had been made one by one */
+    for (i = 0; i < nb; ++i) {
+      if ((batched))
+	chisquares[j] = gchsq_gen_eval(vectors+j*adarv -> fit -> mon_npar, adarv, chisquares[j], adarv -> fit -> psbapoints+i*nval);
+      else
+	chisquares[j] = gchsq_gen_eval(vectors+j*adarv -> fit -> mon_npar, adarv, 0.0, NULL);
+      adarv -> fit -> mon_allcalls += j+1;
+      adarv -> fit -> mon_calls_st += j+1;
+      ++j;
+    }
+  }
+
+  return;
+
+ error:
+  while (j < m)
+    chisquares[j++] = -1.0;
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Set the parameters of a model */
+static double gchsq_gen_par(adar *adarv, double *vector)
+{
+  int i;
+  double chimult;
+
+  /* Change them, if they get out of range, the chisquare is multiplied by OUTRANGEFAC */
+  chimult = pow(OUTRANGEFAC,chprm_gen(vector, adarv -> fit -> varylist, adarv -> rpm -> par));
+
+  /* Now ensure that the indexed parameters are aligned */
+  for (i = adarv -> rpm -> nur*NSSDPARAMS; i < adarv -> rpm->nur *(NSSDPARAMS+NDPARAMS*adarv -> rpm->ndisks); ++i)
+    adarv -> rpm -> chapar[i] = chkchangep(adarv -> fit -> varylist, adarv -> fit -> fitmode, i, adarv -> rpm -> nur);
+
+  if (changedependent(adarv -> rpm, adarv -> rpm -> par, adarv -> fit -> index, adarv -> rpm -> chapar) < 0)
+    return -1.0;
+
+  return chimult;
+}
+
+/* ------------------------------------------------------------ */
 
-  adarv -> fit -> mon_dsize = ddinterntoparam(adarv -> fit -> mon_dsize, (*varele -> elements)/adarv -> rpm -> nur+1, adarv -> hdr, adarv -> rpm -> ndisks);
-  for (k = 0; k < adarv -> fit -> mon_npar; ++k) {
-    adarv -> fit -> mon_dpar[k] = ddinterntoparam(adarv -> fit -> mon_dpar[k], (*varele -> elements)/adarv -> rpm -> nur+1, adarv -> hdr, adarv -> rpm -> ndisks);
-  }
-  adarv -> fit -> mon_ring = (*varele -> elements)%adarv -> rpm -> nur+1;
-  for (disk = 0; disk < adarv -> rpm -> ndisks; ++disk){
-    adarv -> fit -> mon_repnpoints[disk] = adarv -> fit -> npoints[disk];
-    adarv -> fit -> mon_totalflux[disk] = adarv -> fit -> fluxpoints[disk]*adarv -> rpm -> cflux[disk]*adarv -> hdr -> deltgridtouser[2];
-  }
 
-  }
-  else {
-    /* ERROR SOURCE: Some initialisation here ? */
-    gchsq_genv = gchsq_gen2(vector, rest);
 
-    /* Change the fitting function */
-    gft_mst_putf(adarv -> fit -> gft_mstv, &gchsq_gen2, GFT_INPUT_GCHSQ_REP);
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-  }
+/* Refresh the weight map if required */
+static void gchsq_gen_noise(adar *adarv)
+{
+  size_t alliter, alloops;
 
-  return gchsq_genv;
+  /* Refresh the weight map with a new iteration or loop */
+  if (adarv -> fit -> noiseupd == NOISEUPD_ITER || adarv -> fit -> noiseupd == NOISEUPD_LOOP) {
+    gft_mst_get(adarv -> fit -> gft_mstv, &alliter, GFT_OUTPUT_ALLITER);
+    gft_mst_get(adarv -> fit -> gft_mstv, &alloops, GFT_OUTPUT_ALLOOPS);
+    if (alloops != adarv -> fit -> noise_alloops || (adarv -> fit -> noiseupd == NOISEUPD_ITER && alliter != adarv -> fit -> noise_alliter))
+      engalmod_refreshnoise();
+    adarv -> fit -> noise_alliter = alliter;
+    adarv -> fit -> noise_alloops = alloops;
+  }
 
- error:
-  return -1.0;
+  return;
 }
 
-
 /* ------------------------------------------------------------ */
 
 
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
-/* function passed to gft */
-static double gchsq_gen2(double *vector, void *rest)
+/* The work of gchsq_gen2 */
+static double gchsq_gen_eval(double *vector, adar *adarv, double chisquare, long *points)
 {
   char mes[260]; /* Any message */
   int dev = 1;
@@ -12792,16 +14546,6 @@ static double gchsq_gen2(double *vector, void *rest)
   size_t length;
   varlel *varele;
 
-  /************************/
-  /************************/
-  adar *adarv;
-  /************************/
-
-
-
-  /* We get all the info from the additional arguments */
-  adarv = (adar *) rest;
-
   /* Find the chisquare of the latest iteration */
   gft_mst_get(adarv -> fit -> gft_mstv, &adarv -> fit -> mon_bestchisq , GFT_OUTPUT_BESTCHISQ);
   gft_mst_get(adarv -> fit -> gft_mstv, &adarv -> fit -> mon_actchisq  , GFT_OUTPUT_ACTCHISQ);
@@ -12871,26 +14615,28 @@ static double gchsq_gen2(double *vector, void *rest)
   progressout(adarv -> startinfv, mes);
 
    /* Change them */
-  chimult = pow(OUTRANGEFAC,chprm_gen(vector, adarv -> fit -> varylist, adarv -> rpm -> par));
-/*   if (chprm_gen(vector, adarv -> fit -> varylist, adarv -> rpm -> par)) */
-    
-/*     If they get out of range, we multiply the chisquare by OUTRANGEFAC  */
-/*     chimult = OUTRANGEFAC; */
-/*   else */
-/*     chimult = 1.0; */
- 
-  /* Now ensure that the indexed parameters are aligned */
-  for (i = adarv -> rpm -> nur*NSSDPARAMS; i < adarv -> rpm->nur *(NSSDPARAMS+NDPARAMS*adarv -> rpm->ndisks); ++i)
-    adarv -> rpm -> chapar[i] = chkchangep(adarv -> fit -> varylist, adarv -> fit -> fitmode, i, adarv -> rpm -> nur);
-
-  if (changedependent(adarv -> rpm, adarv -> rpm -> par, adarv -> fit -> index, adarv -> rpm -> chapar) < 0)
+  if ((chimult = gchsq_gen_par(adarv, vector)) < 0.0)
     goto error;
 
-  /* Do make the model */
-  galmod(adarv -> hdr, adarv -> rpm, GENFIT, adarv -> fit -> varylist, adarv -> fit -> index, adarv -> rpm -> fluxpoints, adarv -> fit -> npoints);
+  if (!(points)) {
+    gchsq_gen_noise(adarv);
+
+    /* Do make the model */
+    galmod(adarv -> hdr, adarv -> rpm, GENFIT, adarv -> fit -> varylist, adarv -> fit -> index, adarv -> rpm -> fluxpoints, adarv -> fit -> npoints);
+
+    /* Get the chisquare in Fourier space, formerly using pcondisp */
+    gchsq_genv = getchisquare_fourier_c(adarv -> rpm -> par[((NPARAMS + (adarv -> rpm -> ndisks - 1)*NDPARAMS))*adarv -> rpm -> nur]);
+  }
+  else {
 
-  /* Get the chisquare, formerly using pcondisp */
-  gchsq_genv = getchisquare_c(adarv -> rpm -> par[((NPARAMS + (adarv -> rpm -> ndisks - 1)*NDPARAMS))*adarv -> rpm -> nur]);
+    /* The model has been made in a batch */
+    gchsq_genv = chisquare;
+    adarv -> rpm -> outpoints = points[0];
+    for (disk = 0; disk < adarv -> rpm -> ndisks; ++disk) {
+      adarv -> rpm -> fluxpoints[disk] = points[1+disk];
+      adarv -> fit -> npoints[disk] = (int) points[1+adarv -> rpm -> ndisks+disk];
+    }
+  }
 
   /* Regularise */
 /* First recall the loop number, keep everything in mind for the next iteration */
@@ -12988,80 +14734,42 @@ static double gchsq_gen2(double *vector, void *rest)
 
 static void interpinit(ringparms *rpm, double radsep, int disk)
 {
-  int i,j,jp,k;
-  /* float width; */
-  /* float dpardr[NPARAMS]; */
-  /* float dr; */
+  int i,l,k;
   int n2, n1;
   
 
-  /* In the modpar array interpolate over all rings */
+  /* The radii of all subrings */
   for (i = 1; i < rpm -> nur; ++i) {
     
-    /* This is the actual width between two radii */
-    /* Obsolete when using GSL */
-    /* width = rpm -> par[PRADI*rpm -> nur+i] - rpm -> par[PRADI*rpm -> nur+i-1]; */
-    
     /* These are the rings to be calculated */
     n2 = (int) (rpm -> par[PRADI*rpm -> nur+i]/radsep-0.5); 
     n1 = ((int) (rpm -> par[PRADI*rpm -> nur+i-1]/radsep+0.5)); 
-    
-    /* in-between two rings, the slope is determined */
-/* 	for (j = NPARAMS+(disk-1)*NDPARAMS; j < NPARAMS+disk*NDPARAMS; ++j) { */
-
-
-    for (jp = NPARAMS-NDPARAMS; jp < NPARAMS; ++jp) {
-      
-      j = jp + disk*NDPARAMS;
-
-      /* If the parameter is in the list */
-      /* Obsolete when using GSL */
-      /* dpardr[jp]= (rpm -> par[j*rpm -> nur+i]-rpm -> par[j*rpm -> nur+i-1])/width; */
-
-      /* Not sure if this is required, but do it anyway */
-      gsl_interp_accel_reset(rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
+    for (k = n1; k <= n2; ++k)
+      rpm -> modpar[PRADI*rpm -> nr+k] = ((float) k)*radsep+radsep/2.0;
+  }
 
-      /* Very sure that this is a requirement; a test has shown that this should be ouside an omp pragma, not sure why */
-      gsl_interp_init(rpm -> gsl_interparray[j-NSSDPARAMS],rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, rpm -> nur);
-    }
+  /* Each parameter has its own interpolation, such that the parameters can be done in parallel */
+#ifdef OPENMPTIR
+#pragma omp parallel for private(i, n1, n2) schedule(dynamic)
+#endif
+  for (l = disk*NDPARAMS; l < (disk+1)*NDPARAMS; ++l) {
+    maths_interp_init(rpm -> interparray[l], rpm -> smothcar[l], rpm -> par+PRADI*rpm -> nur, rpm -> par+rpm -> nur*(NSSDPARAMS+l), rpm -> nur);
 
-    /* D*mn GSL! GSL interpolation is not compatible with OMP anyway */
-/* #ifdef OPENMPTIR */
-/* #pragma  omp parallel for schedule(dynamic) */
-/* #endif */
-    for (jp = NPARAMS-NDPARAMS; jp < NPARAMS; ++jp) {
-      
-      j = jp + disk*NDPARAMS;
-
-      /* If the parameter is in the list */
-      /* Obsolete when using GSL */
-      /* dpardr[jp]= (rpm -> par[j*rpm -> nur+i]-rpm -> par[j*rpm -> nur+i-1])/width; */
-
-      /* Not sure if this is required, but do it anyway */
-      gsl_interp_accel_reset(rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
-
-      /* Very sure that this is a requirement; a test has shown */
-      gsl_interp_init(rpm -> gsl_interparray[j-NSSDPARAMS],rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, rpm -> nur);
-
-      for (k = n1; k <= n2; ++k) {
-	/* for each parameter the intepolation is done */
-	rpm -> modpar[PRADI*rpm -> nr+k] = ((float) k)*radsep+radsep/2.0;
-	/* Obsolete when using GSL */
-	/* dr = rpm -> modpar[PRADI*rpm -> nr+k]-rpm -> par[PRADI*rpm -> nur+i-1];  */
-	/* rpm -> modpar[j*rpm -> nr+k] = rpm -> par[j*rpm -> nur+i-1]+dpardr[jp]*dr;  */
-	/* if (k == n1) { */
-	/*   fprintf(stderr,"Alpha j: %i n1: %i n2: %i %i %f %f\n",j,n1,n2,k,rpm -> modpar[PRADI*rpm -> nr+k],rpm -> par[PRADI*rpm -> nur+i-1]); */
-	/* } */
-	/* if (k == n2) { */
-	/*   fprintf(stderr,"Omega %i %f %f\n",k,rpm -> modpar[PRADI*rpm -> nr+k],rpm -> par[PRADI*rpm -> nur+i]); */
-	/* } */
-	rpm -> modpar[j*rpm -> nr+k] = gsl_interp_eval(rpm -> gsl_interparray[j-NSSDPARAMS], rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, rpm -> modpar[PRADI*rpm -> nr+k], rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
-      }
+    /* In the modpar array interpolate over all rings */
+    for (i = 1; i < rpm -> nur; ++i) {
+      n2 = (int) (rpm -> par[PRADI*rpm -> nur+i]/radsep-0.5); 
+      n1 = ((int) (rpm -> par[PRADI*rpm -> nur+i-1]/radsep+0.5)); 
+      if (n2 >= n1)
+	maths_interp_evalf(rpm -> interparray[l], rpm -> par+PRADI*rpm -> nur, rpm -> par+rpm -> nur*(NSSDPARAMS+l), rpm -> modpar+PRADI*rpm -> nr+n1, rpm -> modpar+(NSSDPARAMS+l)*rpm -> nr+n1, n2-n1+1);
     }
+  }
 
-    /* Now change the pre-processed parameters and terminate the pointsource lists */
+  /* Now change the pre-processed parameters and terminate the pointsource lists */
+  for (i = 1; i < rpm -> nur; ++i) {
+    n2 = (int) (rpm -> par[PRADI*rpm -> nur+i]/radsep-0.5); 
+    n1 = ((int) (rpm -> par[PRADI*rpm -> nur+i-1]/radsep+0.5)); 
     for (k = n1; k <= n2; ++k)
-      srprep(rpm, k, 0, disk);
+      srprep(rpm, k, SRPREP_ALL, disk);
   } 
 }
 
@@ -13076,7 +14784,7 @@ static void interpinit(ringparms *rpm, double radsep, int disk)
 
 static void interpover(ringparms *rpm, double radsep, int fitmode, varlel *varele, decomp_inlist *index)
 {
-  int i,j,jp,k,disk;
+  int i,j,jp,k,l,disk;
   /* float width; */
   /* float dpardr[NPARAMS]; */
   /* float dr; */
@@ -13135,44 +14843,46 @@ static void interpover(ringparms *rpm, double radsep, int fitmode, varlel *varel
   /*     printf(" %i", i); */
   /* printf(" "); */
 
-  for (disk = 0; disk < rpm -> ndisks; ++disk) {
-    
-    /* In the modpar array interpolate over all rings */
+  /* Interpolate the changed parameters of all disks, each has its own interpolation such that they can be done in parallel */
+#ifdef OPENMPTIR
+#pragma omp parallel for private(i, j, n1, n2) schedule(dynamic)
+#endif
+  for (l = 0; l < rpm -> ndisks*NDPARAMS; ++l) {
+
+    j = NSSDPARAMS+l;
+
     for (i = 1; i < rpm -> nur; ++i) {
-      
+      if (rpm -> chapar[j*rpm -> nur+i])
+	break;
+    }
+    if (i == rpm -> nur)
+      continue;
+
+    maths_interp_init(rpm -> interparray[l], rpm -> smothcar[l], rpm -> par+PRADI*rpm -> nur, rpm -> par+rpm -> nur*j, rpm -> nur);
+
+    /* In the modpar array interpolate over all rings with a change */
+    for (i = 1; i < rpm -> nur; ++i) {
+      if (rpm -> chapar[j*rpm -> nur+i]) {
+
 	/* These are the subrings to be calculated */
+	n2 = (int) (rpm -> par[PRADI*rpm -> nur+i]/radsep-0.5); 
+	n1 = ((int) (rpm -> par[PRADI*rpm -> nur+i-1]/radsep+0.5)); 
+	if (n2 >= n1)
+	  maths_interp_evalf(rpm -> interparray[l], rpm -> par+PRADI*rpm -> nur, rpm -> par+rpm -> nur*j, rpm -> modpar+PRADI*rpm -> nr+n1, rpm -> modpar+j*rpm -> nr+n1, n2-n1+1);
+      }
+    }
+  }
+
+  /* Now change the pre-processed parameters and terminate the pointsource lists, serially and in the same order as before, a change in SBR only changes the number of clouds */
+  for (disk = 0; disk < rpm -> ndisks; ++disk) {
+    for (i = 1; i < rpm -> nur; ++i) {
       n2 = (int) (rpm -> par[PRADI*rpm -> nur+i]/radsep-0.5); 
       n1 = ((int) (rpm -> par[PRADI*rpm -> nur+i-1]/radsep+0.5)); 
-      
-      /* D*mn GSL! GSL interpolation is not compatible with OMP anyway */
-      /* #ifdef OPENMPTIR */
-      /* #pragma omp parallel for schedule(dynamic) */
-      /* #endif */
       for (jp = 0; jp < NDPARAMS; ++jp) {
-
 	j = NSSDPARAMS+jp+disk*NDPARAMS;
-	
-	/* If the parameter is in the list */
 	if (rpm -> chapar[j*rpm -> nur+i]) {
-	  
-	  /* Obsolete when using GSL */
-	  /* dpardr[jp]= (rpm -> par[j*rpm -> nur+i]-rpm -> par[j*rpm -> nur+i-1])/width; */
-	  
-	  /* GSL Re-initialise interpolation, don't know if required, but well ... */
-	  gsl_interp_accel_reset(rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
-	  
-	  for (k = n1; k <= n2; ++k) {
-	    /* Obsolete when using GSL */	    
-	    /* dr = rpm -> modpar[PRADI*rpm -> nr+k]-rpm -> par[PRADI*rpm -> nur+i-1]; */
-	    
-	    /* for each parameter the intepolation is done */
-	    /* Obsolete when using GSL */	    
-	    /* rpm -> modpar[j*rpm -> nr+k] = rpm -> par[j*rpm -> nur+i-1]+dpardr[jp]*dr; */
-	    rpm -> modpar[j*rpm -> nr+k] = gsl_interp_eval (rpm -> gsl_interparray[j-NSSDPARAMS], rpm -> par, rpm -> par + rpm -> nur*j, rpm -> modpar[PRADI*rpm -> nr+k], rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
-	  }
-	  /* Now change the pre-processed parameters and terminate the pointsource lists */
 	  for (k = n1; k <= n2; ++k)
-	    srprep(rpm, k, 0, disk);
+	    srprep(rpm, k, (j == PRPARAMS+disk*NDPARAMS+PSBR) ? SRPREP_COUNT : SRPREP_ALL, disk);
 	}
       }
     }
@@ -13189,6 +14899,27 @@ static void interpover(ringparms *rpm, double radsep, int fitmode, varlel *varel
 /* Generation of a pointsource list */
 static void srprep(ringparms *rpm, int srnr, long mode, int disk)
 {
+  int keep;
+
+  /* Only the cloud number changes and the list can follow that */
+  keep = mode == SRPREP_COUNT && srresizable(rpm, srnr, disk);
+
+  /* The old pointsources leave the model, unless that was done by a previous call */
+  if ((rpm -> sd[disk][srnr].pl) && !(rpm -> sd[disk][srnr].resize)) {
+    if ((rpm -> deltaactive))
+      srdelta(rpm, srnr, disk, 1);
+    else
+      rpm -> deltaready = 0;
+
+    /* A frozen subring changes */
+    if (!(rpm -> sd[disk][srnr].bgactive))
+      rpm -> bgready = 0;
+
+    /* srconst changes n, this is the length of the list */
+    if ((keep))
+      rpm -> sd[disk][srnr].plstored = rpm -> sd[disk][srnr].n;
+  }
+
   (*(rpm -> inf_smiv[disk] -> srprsbrmax))((void *) rpm, srnr, disk);
   (*(rpm -> inf_smiv[disk] -> srprb0))((void *) rpm, srnr, disk);
   (*(rpm -> inf_smiv[disk] -> srprs1))((void *) rpm, srnr, disk);
@@ -13281,19 +15012,472 @@ static void srprep(ringparms *rpm, int srnr, long mode, int disk)
     (*(rpm -> inf_aziv[disk] -> srpr1))((void *) rpm, srnr, 1, disk); 
   }
   
+  /* Keep the pointsource list if the new clouds are of the same kind */
+  if ((keep) && srresizable(rpm, srnr, disk)) {
+    rpm -> sd[disk][srnr].resize = 1;
+    return;
+  }
+
   /* free the pointsource list */
+  rpm -> sd[disk][srnr].resize = 0;
   if ((rpm -> sd[disk][srnr].pl)) {
     free(rpm -> sd[disk][srnr].pl);
     rpm -> sd[disk][srnr].pl = NULL;
   }
+  if ((rpm -> sd[disk][srnr].plslab)) {
+    free(rpm -> sd[disk][srnr].plslab);
+    rpm -> sd[disk][srnr].plslab = NULL;
+  }
+  if ((rpm -> sd[disk][srnr].plcloud)) {
+    free(rpm -> sd[disk][srnr].plcloud);
+    rpm -> sd[disk][srnr].plcloud = NULL;
+  }
+#ifdef PBCORR
+  rpm -> dealloc_pbcfac(rpm, srnr, disk);
+#endif
+  
+  
+  
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Checks if the pointsource list of a subring can be resized */
+static int srresizable(ringparms *rpm, int srnr, int disk)
+{
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+
+  if (!(rpm -> prefix) || (rpm -> stream) || !(sd -> pl) || !(sd -> plcloud))
+    return 0;
+
+  if (sd -> srput != srput_norm || sd -> ngaussian[0] || sd -> ngaussian[1] || sd -> ngaussian[2] || sd -> ngaussian[3])
+    return 0;
+
+  if (rpm -> inf_smiv[disk] -> getaz != &smi_getaz_cons || rpm -> inf_aziv[disk] -> srshape != &srshape_azi_pas)
+    return 0;
+
+#ifdef PBCORR
+  if (rpm -> fill_pbcfac == fill_pbcfac_act)
+    return 0;
+#endif
+
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Cuts or extends a pointsource list for a new cloud number */
+static long srresize(ringparms *rpm, int srnr, int disk, long *j, long *npoints)
+{
+  long i, kept, clouds, newclouds;
+  unsigned int *pl, *plcloud;
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+  sd -> resize = 0;
+
+  clouds = sd -> cloud;
+  newclouds = sd -> nharmnorm/sd -> nsubcl;
+
+  /* Fewer clouds, the list is cut */
+  if (newclouds <= clouds) {
+    kept = 0;
+    for (i = 0; i < sd -> plstored; ++i) {
+      if (sd -> plcloud[i] < newclouds) {
+	sd -> pl[kept] = sd -> pl[i];
+	sd -> plcloud[kept] = sd -> plcloud[i];
+	++kept;
+      }
+    }
+    sd -> n = kept;
+    sd -> outn = newclouds*sd -> nsubcl-kept;
+    sd -> cloud = newclouds;
+    return 0;
+  }
+
+  /* More clouds, the list grows */
+  *j = sd -> plstored;
+  *npoints = sd -> plstored+(newclouds-clouds)*sd -> nsubcl;
+
+  if (!(pl = (unsigned int *) realloc(sd -> pl, *npoints*sizeof(unsigned int))))
+    return -1;
+  sd -> pl = pl;
+  if (!(plcloud = (unsigned int *) realloc(sd -> plcloud, *npoints*sizeof(unsigned int))))
+    return -1;
+  sd -> plcloud = plcloud;
+
+  sd -> n = *npoints;
+  sd -> outn = clouds*sd -> nsubcl-sd -> plstored;
+
+  return clouds;
+}
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Record the pointsources of a subring for an incremental evaluation */
+static void srdelta(ringparms *rpm, int srnr, int disk, int remove)
+{
+  long i, off, *grown;
+  long start[2], stop[2];
+  float flux[2];
+  int range;
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+  srruns(sd, start, stop, flux);
+
+  for (range = 0; range < 2; ++range) {
+    for (i = start[range]; i < stop[range]; ++i) {
+      off = sd -> pl[i];
+      if ((remove))
+	rpm -> deltac[off] -= flux[range];
+
+      if (rpm -> ndelta == rpm -> deltamax) {
+	if (!(grown = (long *) realloc(rpm -> deltalist, 2*rpm -> deltamax*sizeof(long)))) {
+	  rpm -> deltafail = 1;
+	  continue;
+	}
+	rpm -> deltalist = grown;
+	rpm -> deltamax = 2*rpm -> deltamax;
+      }
+      rpm -> deltalist[rpm -> ndelta++] = off;
+    }
+  }
+
+  /* The new pointsources have been put into deltac, they belong to the model */
+  if (!(remove))
+    sd -> plbase = rpm -> deltabase;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* The ranges of a pointsource list filled by srput and their flux */
+static void srruns(srd *sd, long *start, long *stop, float *flux)
+{
+  if (sd -> srput == srput_mixed) {
+    start[0] = 0;
+    stop[0] = sd -> npos;
+    flux[0] = -sd -> pf;
+    start[1] = sd -> pllength-sd -> nneg;
+    stop[1] = sd -> pllength;
+    flux[1] = sd -> pf;
+  }
+  else {
+    start[0] = 0;
+    stop[0] = sd -> n;
+    flux[0] = sd -> pf;
+    start[1] = stop[1] = 0;
+    flux[1] = 0.0;
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Sort a pointsource list into velocity slabs */
+static void srbin(ringparms *rpm, int srnr, int disk)
+{
+  long i, length, *bound, start[2], stop[2];
+  float flux[2];
+  unsigned int *temp, *cltemp = NULL;
+#ifdef PBCORR
+  float *pbtemp = NULL;
+#endif
+  int range, slab;
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+
+  if ((sd -> plslab)) {
+    free(sd -> plslab);
+    sd -> plslab = NULL;
+  }
+
+  /* Without a buffer the list is put serially */
+  if (rpm -> nslabs < 2 || !(length = sd -> pllength))
+    return;
+  if (!(bound = (long *) malloc(2*(rpm -> nslabs+1)*sizeof(long))))
+    return;
+  if (!(temp = (unsigned int *) malloc(length*sizeof(unsigned int)))) {
+    free(bound);
+    return;
+  }
+#ifdef PBCORR
+  if ((sd -> pbfac) && !(pbtemp = (float *) malloc(length*sizeof(float)))) {
+    free(temp);
+    free(bound);
+    return;
+  }
+#endif
+
+  /* Without its cloud indices the list is no longer resized */
+  if ((sd -> plcloud) && !(cltemp = (unsigned int *) malloc(length*sizeof(unsigned int)))) {
+    free(sd -> plcloud);
+    sd -> plcloud = NULL;
+  }
+
+  srruns(sd, start, stop, flux);
+
+  /* A stable counting sort of each run */
+  for (range = 0; range < 2; ++range) {
+    for (slab = 0; slab <= rpm -> nslabs; ++slab)
+      bound[range*(rpm -> nslabs+1)+slab] = 0;
+    for (i = start[range]; i < stop[range]; ++i) {
+      temp[i] = sd -> pl[i];
+      ++bound[range*(rpm -> nslabs+1)+sd -> pl[i]/rpm -> slabsize+1];
+#ifdef PBCORR
+      if ((pbtemp))
+	pbtemp[i] = sd -> pbfac[i];
+#endif
+      if ((cltemp))
+	cltemp[i] = sd -> plcloud[i];
+    }
+
+    bound[range*(rpm -> nslabs+1)] = start[range];
+    for (slab = 1; slab <= rpm -> nslabs; ++slab)
+      bound[range*(rpm -> nslabs+1)+slab] += bound[range*(rpm -> nslabs+1)+slab-1];
+
+    for (i = start[range]; i < stop[range]; ++i) {
+      slab = temp[i]/rpm -> slabsize;
+#ifdef PBCORR
+      if ((pbtemp))
+	sd -> pbfac[bound[range*(rpm -> nslabs+1)+slab]] = pbtemp[i];
+#endif
+      if ((cltemp))
+	sd -> plcloud[bound[range*(rpm -> nslabs+1)+slab]] = cltemp[i];
+      sd -> pl[bound[range*(rpm -> nslabs+1)+slab]++] = temp[i];
+    }
+
+    /* The ends have been moved to the start of the next slab */
+    for (slab = rpm -> nslabs; slab > 0; --slab)
+      bound[range*(rpm -> nslabs+1)+slab] = bound[range*(rpm -> nslabs+1)+slab-1];
+    bound[range*(rpm -> nslabs+1)] = start[range];
+  }
+
+  free(temp);
+  if ((cltemp))
+    free(cltemp);
 #ifdef PBCORR
-  rpm -> dealloc_pbcfac(rpm, srnr, disk);
+  if ((pbtemp))
+    free(pbtemp);
 #endif
-  
-  
-  
+  sd -> plslab = bound;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Put the pointsources of a subring in one velocity slab onto the cube */
+static void srdeposit(ringparms *rpm, int srnr, int disk, int slab)
+{
+  long i, start[2], stop[2], *bound;
+  float flux[2], *plbase;
+  unsigned int *pl;
+  int range;
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+  srruns(sd, start, stop, flux);
+  plbase = sd -> plbase;
+  pl = sd -> pl;
+
+  for (range = 0; range < 2; ++range) {
+    bound = sd -> plslab+range*(rpm -> nslabs+1);
+#ifdef PBCORR
+    if ((sd -> pbfac)) {
+      for (i = bound[slab]; i < bound[slab+1]; ++i)
+	plbase[pl[i]] += flux[range]*sd -> pbfac[i];
+      continue;
+    }
+#endif
+    for (i = bound[slab]; i < bound[slab+1]; ++i)
+      plbase[pl[i]] += flux[range];
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Allocates the bins of n threads for the streaming deposition */
+static int create_streambins(ringparms *rpm, int n)
+{
+#ifdef OPENMPTIR
+  int i, slab;
+  size_t size;
+  unsigned int *off = NULL;
+  float *flux = NULL;
+  int *fill = NULL;
+  omp_lock_t *lock = NULL;
+#endif
+
+  destroy_streambins(rpm);
+
+  /* Without threads or slabs the subrings are made serially */
+  if (n < 2 || rpm -> nslabs < 2)
+    return 1;
+
+#ifdef OPENMPTIR
+  /* STREAMBIN pointsources per thread and slab, independent of the size of the cube */
+  size = (size_t) n*rpm -> nslabs;
+  if (!(rpm -> streambins = (streambin *) malloc(n*sizeof(streambin))) || !(off = (unsigned int *) malloc(size*STREAMBIN*sizeof(unsigned int))) || !(flux = (float *) malloc(size*STREAMBIN*sizeof(float))) || !(fill = (int *) calloc(size, sizeof(int))) || !(lock = (omp_lock_t *) malloc(rpm -> nslabs*sizeof(omp_lock_t)))) {
+    if ((rpm -> streambins))
+      free(rpm -> streambins);
+    if ((off))
+      free(off);
+    if ((flux))
+      free(flux);
+    if ((fill))
+      free(fill);
+    rpm -> streambins = NULL;
+    return 0;
+  }
+
+  for (slab = 0; slab < rpm -> nslabs; ++slab)
+    omp_init_lock(lock+slab);
+
+  for (i = 0; i < n; ++i) {
+    rpm -> streambins[i].off = off+(size_t) i*rpm -> nslabs*STREAMBIN;
+    rpm -> streambins[i].flux = flux+(size_t) i*rpm -> nslabs*STREAMBIN;
+    rpm -> streambins[i].fill = fill+(size_t) i*rpm -> nslabs;
+    rpm -> streambins[i].nslabs = rpm -> nslabs;
+    rpm -> streambins[i].slabsize = rpm -> slabsize;
+    rpm -> streambins[i].lock = lock;
+  }
+  rpm -> nstreambins = n;
+#endif
+
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Deallocates the bins of the streaming deposition */
+static void destroy_streambins(ringparms *rpm)
+{
+#ifdef OPENMPTIR
+  int slab;
+
+  if ((rpm -> streambins)) {
+    for (slab = 0; slab < rpm -> streambins[0].nslabs; ++slab)
+      omp_destroy_lock(rpm -> streambins[0].lock+slab);
+    free(rpm -> streambins[0].lock);
+    free(rpm -> streambins[0].off);
+    free(rpm -> streambins[0].flux);
+    free(rpm -> streambins[0].fill);
+    free(rpm -> streambins);
+  }
+#endif
+  rpm -> streambins = NULL;
+  rpm -> nstreambins = 0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Puts a pointsource onto the cube in the streaming deposition */
+static void srstream(srd *sd, long off, float flux)
+{
+  streambin *bin;
+  long i;
+  int slab;
+
+  if (!(bin = sd -> streambin)) {
+    sd -> plbase[off] += flux;
+    return;
+  }
+
+  slab = off/bin -> slabsize;
+  if (bin -> fill[slab] == STREAMBIN)
+    srstreamflush(sd, slab);
+
+  i = (long) slab*STREAMBIN+bin -> fill[slab];
+  bin -> off[i] = off;
+  bin -> flux[i] = flux;
+  ++bin -> fill[slab];
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Puts the bin of one velocity slab onto the cube */
+static void srstreamflush(srd *sd, int slab)
+{
+  streambin *bin;
+  unsigned int *off;
+  float *flux;
+  int i;
+
+  bin = sd -> streambin;
+  if (!(bin -> fill[slab]))
+    return;
+
+  off = bin -> off+(long) slab*STREAMBIN;
+  flux = bin -> flux+(long) slab*STREAMBIN;
+
+  /* Only one thread at a time writes into a slab */
+#ifdef OPENMPTIR
+  omp_set_lock(bin -> lock+slab);
+#endif
+  for (i = 0; i < bin -> fill[slab]; ++i)
+    sd -> plbase[off[i]] += flux[i];
+#ifdef OPENMPTIR
+  omp_unset_lock(bin -> lock+slab);
+#endif
+
+  bin -> fill[slab] = 0;
+
   return;
 }
+
 /* ------------------------------------------------------------ */
 
 
@@ -13322,7 +15506,11 @@ static void gridpoint_norm(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
       if (grid[2] >= 0 && grid[2] < hdr -> nsubs) {
 	
 	/* This is the position in the linear cube array */
-	sd[disk][srnr].pl[*pnr] = hdr -> modelc -> points +(grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]));
+	sd[disk][srnr].pl[*pnr] = grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]);
+
+	/* The cloud it belongs to, see srprep */
+	if ((sd[disk][srnr].plcloud))
+	  sd[disk][srnr].plcloud[*pnr] = sd[disk][srnr].cloud-1;
 
 	/* And this is for the primary beam correction */
 
@@ -13380,12 +15568,12 @@ static void gridpoint_mixed(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
 	
 	/* This is the position in the linear cube array */
 	if (signum) {
-	  sd[disk][srnr].pl[sd[disk][srnr].npos] = hdr -> modelc -> points +(grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]));
+	  sd[disk][srnr].pl[sd[disk][srnr].npos] = grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]);
 	  ++sd[disk][srnr].npos;
 	}
 	else {
 	  ++sd[disk][srnr].nneg;
-	  sd[disk][srnr].pl[sd[disk][srnr].pllength-sd[disk][srnr].nneg] = hdr -> modelc -> points+(grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]));
+	  sd[disk][srnr].pl[sd[disk][srnr].pllength-sd[disk][srnr].nneg] = grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]);
 	}
 
 #ifdef PBCORR
@@ -13435,6 +15623,188 @@ static void gridpoint_mixed(hdrinf *hdr, float *modpar, int nr, struct srd **sd,
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Grids a point directly onto the cube */
+#ifdef PBCORR
+static void gridpoint_normstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+#else
+static void gridpoint_normstream(hdrinf *hdr, float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+#endif
+{
+  int grid[3];
+  float flux, pos[3];
+
+  /* Same as in gridpoint_norm */
+  grid[0] = roundnormal(modpar[(PRPARAMS+disk*NDPARAMS+PXPOS)*nr+srnr]-pp[1]);
+  
+  if (grid[0] >= 0 && grid[0] < hdr -> bsize1) {
+    
+    grid[1] = roundnormal(modpar[(PRPARAMS+disk*NDPARAMS+PYPOS)*nr+srnr]+pp[0]);
+    if (grid[1] >= 0 && grid[1] < hdr -> bsize2) {
+      grid[2] = roundnormal((modpar[(PRPARAMS+disk*NDPARAMS+PVSYS)*nr+srnr]+hdr -> signv*pp[5]));
+      if (grid[2] >= 0 && grid[2] < hdr -> nsubs) {
+	
+	/* The flux goes straight onto the cube */
+	flux = sd[disk][srnr].sflux[signum];
+	if (sd[disk][srnr].deposit != DEPOSIT_NGP) {
+	  pos[0] = modpar[(PRPARAMS+disk*NDPARAMS+PXPOS)*nr+srnr]-pp[1];
+	  pos[1] = modpar[(PRPARAMS+disk*NDPARAMS+PYPOS)*nr+srnr]+pp[0];
+	  pos[2] = modpar[(PRPARAMS+disk*NDPARAMS+PVSYS)*nr+srnr]+hdr -> signv*pp[5];
+#ifdef PBCORR
+	  srspread(hdr, sd[disk]+srnr, fill_pbcfac == fill_pbcfac_act ? hdr -> primbeam : NULL, pos, flux, sd[disk][srnr].deposit);
+#else
+	  srspread(hdr, sd[disk]+srnr, NULL, pos, flux, sd[disk][srnr].deposit);
+#endif
+	}
+	else {
+#ifdef PBCORR
+	  if (fill_pbcfac == fill_pbcfac_act)
+	    flux = flux*hdr -> primbeam[grid[0]+ hdr -> bsize1*(grid[1])];
+#endif
+	  srstream(sd[disk]+srnr, grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]), flux);
+	}
+	++(*pnr);
+	return;
+      }
+    }
+  }
+
+  --sd[disk][srnr].n;
+  *npoints -= 1;
+  ++sd[disk][srnr].outn;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Grids a point with either sign directly onto the cube */
+#ifdef PBCORR
+static void gridpoint_mixedstream(hdrinf *hdr, void (*fill_pbcfac)(hdrinf *hdr, struct srd **sd, int disk, int srnr, long *pnr, int *grid), float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+#else
+static void gridpoint_mixedstream(hdrinf *hdr, float *modpar, int nr, struct srd **sd, int srnr, long *pnr, float *pp, int signum, long *npoints, int disk)
+#endif
+{
+  int grid[3];
+  float flux, pos[3];
+
+  /* Same as in gridpoint_mixed */
+  grid[0] = roundnormal(modpar[(PRPARAMS+disk*NDPARAMS+PXPOS)*nr+srnr]-pp[1]);
+  
+  if (grid[0] >= 0 && grid[0] < hdr -> bsize1) {
+    
+    grid[1] = roundnormal(modpar[(PRPARAMS+disk*NDPARAMS+PYPOS)*nr+srnr]+pp[0]);
+    if (grid[1] >= 0 && grid[1] < hdr -> bsize2) {
+      grid[2] = roundnormal((modpar[(PRPARAMS+disk*NDPARAMS+PVSYS)*nr+srnr]+hdr -> signv*pp[5]));
+      if (grid[2] >= 0 && grid[2] < hdr -> nsubs) {
+	
+	/* The flux goes straight onto the cube */
+	flux = sd[disk][srnr].sflux[signum];
+	if (sd[disk][srnr].deposit != DEPOSIT_NGP) {
+	  pos[0] = modpar[(PRPARAMS+disk*NDPARAMS+PXPOS)*nr+srnr]-pp[1];
+	  pos[1] = modpar[(PRPARAMS+disk*NDPARAMS+PYPOS)*nr+srnr]+pp[0];
+	  pos[2] = modpar[(PRPARAMS+disk*NDPARAMS+PVSYS)*nr+srnr]+hdr -> signv*pp[5];
+#ifdef PBCORR
+	  srspread(hdr, sd[disk]+srnr, fill_pbcfac == fill_pbcfac_act ? hdr -> primbeam : NULL, pos, flux, sd[disk][srnr].deposit);
+#else
+	  srspread(hdr, sd[disk]+srnr, NULL, pos, flux, sd[disk][srnr].deposit);
+#endif
+	}
+	else {
+#ifdef PBCORR
+	  if (fill_pbcfac == fill_pbcfac_act)
+	    flux = flux*hdr -> primbeam[grid[0]+ hdr -> bsize1*(grid[1])];
+#endif
+	  srstream(sd[disk]+srnr, grid[0]+ hdr -> bcsize1*(grid[1])+hdr -> nprof*(grid[2]), flux);
+	}
+
+	if (signum)
+	  ++sd[disk][srnr].npos;
+	else
+	  ++sd[disk][srnr].nneg;
+
+	++(*pnr);
+	return;
+      }
+    }
+  }
+
+  --sd[disk][srnr].n;
+  *npoints -= 1;
+  ++sd[disk][srnr].outn;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Spreads the flux of a pointsource over the neighbouring pixels */
+static void srspread(hdrinf *hdr, srd *sd, float *primbeam, float *pos, float flux, int deposit)
+{
+  int first[3], nw, d, i, j, k, size[3];
+  float w[3][3], d0, wij;
+  long offk, offj;
+
+  size[0] = hdr -> bsize1;
+  size[1] = hdr -> bsize2;
+  size[2] = hdr -> nsubs;
+
+  /* The first pixel and the weights along each axis */
+  if (deposit == DEPOSIT_CIC) {
+    nw = 2;
+    for (d = 0; d < 3; ++d) {
+      first[d] = (int) floorf(pos[d]);
+      d0 = pos[d]-first[d];
+      w[d][0] = 1.0f-d0;
+      w[d][1] = d0;
+    }
+  }
+  else {
+    nw = 3;
+    for (d = 0; d < 3; ++d) {
+      first[d] = roundnormal(pos[d]);
+      d0 = pos[d]-first[d];
+      --first[d];
+      w[d][0] = 0.5f*(0.5f-d0)*(0.5f-d0);
+      w[d][1] = 0.75f-d0*d0;
+      w[d][2] = 0.5f*(0.5f+d0)*(0.5f+d0);
+    }
+  }
+
+  for (k = 0; k < nw; ++k) {
+    if (first[2]+k < 0 || first[2]+k >= size[2] || !w[2][k])
+      continue;
+    offk = hdr -> nprof*(long) (first[2]+k);
+
+    for (j = 0; j < nw; ++j) {
+      if (first[1]+j < 0 || first[1]+j >= size[1] || !w[1][j])
+	continue;
+      offj = offk+hdr -> bcsize1*(long) (first[1]+j);
+      wij = flux*w[2][k]*w[1][j];
+
+      for (i = 0; i < nw; ++i) {
+	if (first[0]+i < 0 || first[0]+i >= size[0])
+	  continue;
+	if ((primbeam))
+	  srstream(sd, offj+first[0]+i, wij*w[0][i]*primbeam[first[0]+i+hdr -> bsize1*(first[1]+j)]);
+	else
+	  srstream(sd, offj+first[0]+i, wij*w[0][i]);
+      }
+    }
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Grids a point to a pointsource list */
@@ -13459,7 +15829,7 @@ static void gridpoint_normcool(hdrinf *hdr, float *modpar, int nr, struct srd **
       if (grid[2] >= 0 && grid[2] < hdr -> coolcube -> size_v) {
 	
 	/* This is the position in the linear cube array */
-	sd[disk][srnr].pl[*pnr] = hdr -> coolcube -> points +(grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]));
+	sd[disk][srnr].pl[*pnr] = grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]);
 
 	/* And this is for the primary beam correction */
 
@@ -13517,12 +15887,12 @@ static void gridpoint_mixedcool(hdrinf *hdr, float *modpar, int nr, struct srd *
 	
 	/* This is the position in the linear cube array */
 	if (signum) {
-	  sd[disk][srnr].pl[sd[disk][srnr].npos] = hdr -> coolcube -> points +(grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]));
+	  sd[disk][srnr].pl[sd[disk][srnr].npos] = grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]);
 	  ++sd[disk][srnr].npos;
 	}
 	else {
 	  ++sd[disk][srnr].nneg;
-	  sd[disk][srnr].pl[sd[disk][srnr].pllength-sd[disk][srnr].nneg] = hdr -> coolcube -> points+(grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]));
+	  sd[disk][srnr].pl[sd[disk][srnr].pllength-sd[disk][srnr].nneg] = grid[0]+ hdr -> coolcube -> size_x*(grid[1])+hdr -> nprofcool*(grid[2]);
 	}
 
 #ifdef PBCORR
@@ -13576,13 +15946,17 @@ static void gridpoint_mixedcool(hdrinf *hdr, float *modpar, int nr, struct srd *
 
 /* Grids a point to a pointsource list */
 #ifdef PBCORR
-static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+static int srput_mixed(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
 #else
-static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
 #endif
 {
   long i;
   int negstop;
+#ifndef PBCORR
+  float *plbase;
+  unsigned int *pl;
+#endif
 
 /*   ringflux = TWOPI*modpar[PRADI*nr+srnr]*radsep*modpar[PSBR*nr+srnr]/cflux; */
 
@@ -13601,16 +15975,21 @@ static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, do
 /*   if (!(sd[disk][srnr].pf)) */
 /*     sd[disk][srnr].pf = cflux[0]; */
 
+  if ((deposit)) {
 #ifdef PBCORR
   for (i = 0; i < sd[disk][srnr].npos; ++i)
     corr_pbcfac(sd, disk, srnr, i);
 #else
+  plbase = sd[disk][srnr].plbase;
+  pl = sd[disk][srnr].pl;
   for (i = 0; i < sd[disk][srnr].npos; ++i)
-    *(sd[disk][srnr].pl[i]) += sd[disk][srnr].pf;
+    plbase[pl[i]] += sd[disk][srnr].pf;
 #endif
+  }
 
   sd[disk][srnr].pf = -sd[disk][srnr].pf;
 
+  if ((deposit)) {
   /* Here I don't trust the compiler a bit */
   negstop = sd[disk][srnr].pllength-sd[disk][srnr].nneg-1;
 
@@ -13619,8 +15998,9 @@ static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, do
     corr_pbcfac(sd, disk, srnr, i);
 #else
   for (i = sd[disk][srnr].pllength-1; i > negstop; --i)
-    *(sd[disk][srnr].pl[i]) += sd[disk][srnr].pf;
+    plbase[pl[i]] += sd[disk][srnr].pf;
 #endif
+  }
 
   /* Don't need that anymore, but it would be good to have) */
 /*   forget((void **) &sd[disk][srnr].pl); */
@@ -13640,12 +16020,16 @@ static int srput_mixed(struct srd **sd, float *modpar, int nr, double *cflux, do
 
 /* Grids a point to a pointsource list */
 #ifdef PBCORR
-static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+static int srput_norm(void (*corr_pbcfac)(struct srd **sd, int disk, int srnr, long grid), struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
 #else
-static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk)
+static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, double radsep, int srnr, long *fluxpoints, int disk, int deposit)
 #endif
 {
   long i;
+#ifndef PBCORR
+  float *plbase;
+  unsigned int *pl;
+#endif
   /****************/
   /****************/
 /*       int obsint = 1;  */
@@ -13660,13 +16044,17 @@ static int srput_norm(struct srd **sd, float *modpar, int nr, double *cflux, dou
   /******/
 
   /* What was the pointsource flux, note that this is done now in parallel (danger?) */
+  if ((deposit)) {
 #ifdef PBCORR
   for (i = 0; i < sd[disk][srnr].n; ++i)
     corr_pbcfac(sd, disk, srnr, i);
 #else
+  plbase = sd[disk][srnr].plbase;
+  pl = sd[disk][srnr].pl;
   for (i = 0; i < sd[disk][srnr].n; ++i)
-    *(sd[disk][srnr].pl[i]) += sd[disk][srnr].pf;
+    plbase[pl[i]] += sd[disk][srnr].pf;
 #endif
+  }
 
   /* Don't need that anymore, but it would be good to have) */
 /*   forget((void **) &sd[disk][srnr].pl); */
@@ -13698,49 +16086,117 @@ static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
   int err = 4;
   int signum;
   long npoints, j;
+  long cloud0 = 0;
   int dummyint;
   
 
-
-  /* First check if we do anything but remembering */
-  if (rpm -> sd[disk][srnr].pl) {
-/*     remember((void **) &rpm -> sd[disk][srnr].pl); */
-    return rpm -> sd[disk][srnr].outpoints = rpm -> sd[disk][srnr].outn/rpm -> sd[disk][srnr].nsubcl;
-  }
-
-  /* Now we try to allocate */
-  if ((rpm -> sd[disk][srnr].n)){
-    if (!(rpm -> sd[disk][srnr].pl = (float **) malloc(rpm -> sd[disk][srnr].n*sizeof(float *)))) {
-      /* Catastrophy, simply stop */
-      sprintf(mes, "Too many pointsources, increase PFLUX");
-      error_tir(&err, mes);
+  /* Streaming: nothing is remembered, the clouds go onto the model array, through the bins of this thread */
+  if ((rpm -> stream)) {
+    if ((rpm -> sd[disk][srnr].pl)) {
+      free(rpm -> sd[disk][srnr].pl);
+      rpm -> sd[disk][srnr].pl = NULL;
+    }
+    if ((rpm -> sd[disk][srnr].plslab)) {
+      free(rpm -> sd[disk][srnr].plslab);
+      rpm -> sd[disk][srnr].plslab = NULL;
     }
+    if ((rpm -> sd[disk][srnr].plcloud)) {
+      free(rpm -> sd[disk][srnr].plcloud);
+      rpm -> sd[disk][srnr].plcloud = NULL;
+    }
+    rpm -> sd[disk][srnr].resize = 0;
 #ifdef PBCORR
-    rpm -> alloc_pbcfac(rpm, srnr, disk);
+    rpm -> dealloc_pbcfac(rpm, srnr, disk);
 #endif
-  }
 
-  /* If there's no pointsource we allocate nevertheless for the smallest thing possible */
+    /* gridpoint counts down from the number made by srprep */
+    rpm -> sd[disk][srnr].n = rpm -> sd[disk][srnr].pllength;
+    rpm -> sd[disk][srnr].nneg = rpm -> sd[disk][srnr].npos = 0;
+    if (!(rpm -> sd[disk][srnr].n)) {
+      rpm -> sd[disk][srnr].outn = 0;
+      return rpm -> sd[disk][srnr].outpoints = 0;
+    }
+
+    rpm -> sd[disk][srnr].plbase = hdr -> modelc -> points;
+    rpm -> sd[disk][srnr].streambin = NULL;
+#ifdef OPENMPTIR
+    if ((rpm -> streambins))
+      rpm -> sd[disk][srnr].streambin = rpm -> streambins+omp_get_thread_num();
+#endif
+
+    /* What srput would do with the flux, see srput_norm and srput_mixed */
+    if (rpm -> sd[disk][srnr].srput == srput_mixed) {
+      rpm -> sd[disk][srnr].sflux[1] = rpm -> cflux[disk]*rpm -> sd[disk][srnr].nsubclinv;
+      rpm -> sd[disk][srnr].sflux[0] = -rpm -> sd[disk][srnr].sflux[1];
+    }
+    else
+      rpm -> sd[disk][srnr].sflux[0] = rpm -> sd[disk][srnr].sflux[1] = rpm -> sd[disk][srnr].pf;
+    rpm -> sd[disk][srnr].deposit = rpm -> deposit;
+  }
   else {
-    if (!(rpm -> sd[disk][srnr].pl = (float **) malloc(sizeof(float *)))) {
+    /* First check if we do anything but remembering */
+    if (rpm -> sd[disk][srnr].pl) {
+/*     remember((void **) &rpm -> sd[disk][srnr].pl); */
+      if (!(rpm -> sd[disk][srnr].resize))
+	return rpm -> sd[disk][srnr].outpoints = rpm -> sd[disk][srnr].outn/rpm -> sd[disk][srnr].nsubcl;
+
+      /* Only the cloud number has changed, see srprep */
+      rpm -> sd[disk][srnr].plbase = hdr -> modelc -> points;
+      if ((cloud0 = srresize(rpm, srnr, disk, &j, &npoints)) < 0) {
+	sprintf(mes, "Too many pointsources, increase PFLUX");
+	error_tir(&err, mes);
+      }
+      if (!(cloud0)) {
+	srbin(rpm, srnr, disk);
+	return rpm -> sd[disk][srnr].outpoints = rpm -> sd[disk][srnr].outn/rpm -> sd[disk][srnr].nsubcl;
+      }
+    }
 
-      /* Catastrophy, simply stop */
-      sprintf(mes, "Too many pointsources, increase PFLUX");
-      error_tir(&err, mes);
+    /* The offsets refer to the current model array */
+    rpm -> sd[disk][srnr].plbase = hdr -> modelc -> points;
+
+    /* Now we try to allocate, unless the list is extended */
+    if ((cloud0))
+      ;
+    else if ((rpm -> sd[disk][srnr].n)){
+      if (!(rpm -> sd[disk][srnr].pl = (unsigned int *) malloc(rpm -> sd[disk][srnr].n*sizeof(unsigned int)))) {
+	/* Catastrophy, simply stop */
+	sprintf(mes, "Too many pointsources, increase PFLUX");
+	error_tir(&err, mes);
+      }
+#ifdef PBCORR
+      rpm -> alloc_pbcfac(rpm, srnr, disk);
+#endif
+
+      /* The cloud of each entry, such that the list can be resized, see srprep */
+      if ((rpm -> sd[disk][srnr].plcloud))
+	free(rpm -> sd[disk][srnr].plcloud);
+      rpm -> sd[disk][srnr].plcloud = NULL;
+      if ((rpm -> prefix))
+	rpm -> sd[disk][srnr].plcloud = (unsigned int *) malloc(rpm -> sd[disk][srnr].n*sizeof(unsigned int));
     }
+
+    /* If there's no pointsource we allocate nevertheless for the smallest thing possible */
+    else {
+      if (!(rpm -> sd[disk][srnr].pl = (unsigned int *) malloc(sizeof(unsigned int)))) {
+
+	/* Catastrophy, simply stop */
+	sprintf(mes, "Too many pointsources, increase PFLUX");
+	error_tir(&err, mes);
+      }
     
 #ifdef PBCORR
-    rpm -> alloc_pbcfac(rpm, srnr, disk);
+      rpm -> alloc_pbcfac(rpm, srnr, disk);
 #endif
 
-    /* Changed this, but not sure */
-    rpm -> sd[disk][srnr].outn = rpm -> sd[disk][srnr].nneg = rpm -> sd[disk][srnr].npos = 0;
-    return rpm -> sd[disk][srnr].outpoints = 0;
+      /* Changed this, but not sure */
+      rpm -> sd[disk][srnr].outn = rpm -> sd[disk][srnr].nneg = rpm -> sd[disk][srnr].npos = 0;
+      return rpm -> sd[disk][srnr].outpoints = 0;
+    }
   }
 
   /* Initialise random generators */
-  rpm -> sd[disk][srnr].iseed2[1] = srnr+disk;
-  maths_rndmf_init(rpm -> sd[disk][srnr].iseed2, rpm -> sd[disk][srnr].permrandstr);
+  srrandom_init(rpm, srnr, disk);
   
   /* reset the  zprof */ 
   zprof(6, rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2));
@@ -13753,18 +16209,30 @@ static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
   (*(rpm -> inf_gauv[disk] -> rndmf_init2))((void *) rpm, srnr, 2,disk);
   (*(rpm -> inf_gauv[disk] -> rndmf_init3))((void *) rpm, srnr, 3,disk);
 
-  /* Reset the counters */
-  j = 0;
-  rpm -> sd[disk][srnr].outn = 0;
+  /* Reset the counters, an extended list continues with the first new cloud, see srresize */
+  if ((cloud0))
+    rpm -> sd[disk][srnr].cloud = cloud0;
+  else {
+    j = 0;
+    rpm -> sd[disk][srnr].outn = 0;
 /*   rpm -> sd[disk][srnr].outnpos = */
 /*   rpm -> sd[disk][srnr].outnneg = 0; */
 
-  npoints = rpm -> sd[disk][srnr].nharmnorm;
+    npoints = rpm -> sd[disk][srnr].nharmnorm;
+  }
 
   signum = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PSBR)*rpm -> nr+srnr] > 0?1:0;
 
+  /* In the common case the clouds are made in blocks and the loop below has nothing left to do, large subrings are shared with other threads */
+  if ((rpm -> cloudblock) && (rpm -> inf_aziv[disk] -> block)) {
+    if (mode != SRCONST_SPLIT || !srconst_split(hdr, rpm, srnr, disk, &j, &npoints, signum))
+      srconst_block(hdr, rpm, rpm -> sd[disk]+srnr, srnr, disk, &j, &npoints, signum);
+  }
+
   while (j < npoints) {
 
+    srrandom_next(rpm, srnr, disk);
+
     /* Calculate azimuth sine and cosine, conventional */
     (*(rpm -> inf_smiv[disk] -> getaz))((void *) rpm, &az, &sinaz, &cosaz, &signum, srnr, disk);
 
@@ -13815,6 +16283,8 @@ static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
 
       while (j < npoints) {
 	
+	srrandom_next(rpm, srnr, disk);
+
 	/* Calculate azimuth sine and cosine, Gaussian */
 	gau_getaz(rpm, (PRPARAMS+disk*NDPARAMS+PGA1P)+3*i, rpm -> sd[disk][srnr].grandstr[i], i, &az, &sinaz, &cosaz, srnr, disk);
 
@@ -13851,6 +16321,14 @@ static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
     }
   }
 
+  /* Sort the list into velocity slabs for the parallel deposition, or empty the bins */
+  if (!(rpm -> stream))
+    srbin(rpm, srnr, disk);
+  else if ((rpm -> sd[disk][srnr].streambin)) {
+    for (i = 0; i < rpm -> sd[disk][srnr].streambin -> nslabs; ++i)
+      srstreamflush(rpm -> sd[disk]+srnr, i);
+  }
+
   return rpm -> sd[disk][srnr].outpoints = rpm -> sd[disk][srnr].outn/rpm -> sd[disk][srnr].nsubcl;
 }
 
@@ -13859,6 +16337,360 @@ static long srconst(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int disk)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Initialises the permanent random generator of a subring */
+static void srrandom_init(ringparms *rpm, int srnr, int disk)
+{
+  unsigned int key[2];
+
+  if ((rpm -> rng) || (rpm -> sampler)) {
+    key[0] = (unsigned int) rpm -> iseed2;
+    key[1] = (unsigned int) (disk*rpm -> nr+srnr);
+    if ((rpm -> sampler))
+      maths_rndmf_initq(key, rpm -> sd[disk][srnr].permrandstr);
+    else
+      maths_rndmf_initc(key, rpm -> sd[disk][srnr].permrandstr);
+    rpm -> sd[disk][srnr].cloud = 0;
+  }
+  else {
+    rpm -> sd[disk][srnr].iseed2[1] = srnr+disk;
+    maths_rndmf_init(rpm -> sd[disk][srnr].iseed2, rpm -> sd[disk][srnr].permrandstr);
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Starts the random numbers of the next cloud of a subring */
+static void srrandom_next(ringparms *rpm, int srnr, int disk)
+{
+  srrandom_step(rpm, rpm -> sd[disk]+srnr);
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* srrandom_next() for a given srd struct */
+static void srrandom_step(ringparms *rpm, srd *sd)
+{
+  if (!(rpm -> rng) && !(rpm -> sampler))
+    return;
+
+  maths_rndmf_seek(sd -> permrandstr, sd -> cloud);
+  if ((sd -> srandstr))
+    maths_rndmf_seek(sd -> srandstr, sd -> cloud);
+  ++sd -> cloud;
+
+  /* No Gaussian deviate is carried over from the previous cloud */
+  sd -> y2 = -1024.0;
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Generates the conventional clouds of a subring in blocks */
+static void srconst_block(hdrinf *hdr, ringparms *rpm, srd *sd, int srnr, int disk, long *j, long *npoints, int signum)
+{
+  float az[SRCONST_BLOCK], rnd[SRCONST_BLOCK], zp[SRCONST_BLOCK], dv[SRCONST_BLOCK];
+  float pos0[SRCONST_BLOCK], pos1[SRCONST_BLOCK], pos2[SRCONST_BLOCK];
+  float pos[3];
+  int grid0[SRCONST_BLOCK], grid1[SRCONST_BLOCK], grid2[SRCONST_BLOCK];
+#ifdef PBCORR
+  int grid[3];
+#endif
+  long k, nblock, off;
+  int stream, mixed, vrad, sdis;
+  double rad2, rad1;
+  float radi, z0, vrot, vradv, cosi, sini, cosp, sinp, xpos, ypos, vsys, signv, flux, sdisv;
+  float cosaz, sinaz, r, pp4, pp21, pp25, px, py;
+
+  stream = sd -> gridpoint == gridpoint_normstream || sd -> gridpoint == gridpoint_mixedstream;
+  mixed = sd -> gridpoint == gridpoint_mixed || sd -> gridpoint == gridpoint_mixedstream;
+  vrad = rpm -> inf_aziv[disk] -> kernel == &srshape_flat_10;
+  sdis = rpm -> inf_sdisv[disk] -> pr == &pr_sdis_act;
+
+  /* The constants of srshape_flat and gridpoint_norm for this subring */
+  radi = rpm -> modpar[PRADI*rpm -> nr+srnr];
+  rad2 = (radi-0.5*rpm -> radsep)*(radi-0.5*rpm -> radsep);
+  rad1 = 2*rpm -> radsep*radi;
+  z0 = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
+  vrot = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVROT)*rpm -> nr+srnr];
+  vradv = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVRAD)*rpm -> nr+srnr];
+  xpos = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PXPOS)*rpm -> nr+srnr];
+  ypos = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PYPOS)*rpm -> nr+srnr];
+  vsys = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVSYS)*rpm -> nr+srnr];
+  cosi = sd -> cosi;
+  sini = sd -> sini;
+  cosp = sd -> cosp;
+  sinp = sd -> sinp;
+  signv = hdr -> signv;
+  sdisv = rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PSDIS)*rpm -> nr+srnr];
+
+  while (*j < *npoints) {
+    nblock = *npoints-*j;
+    if (nblock > SRCONST_BLOCK)
+      nblock = SRCONST_BLOCK;
+
+    /* The random numbers, in the order of smi_getaz_cons, srshape_flat, and the dispersion */
+    for (k = 0; k < nblock; ++k) {
+      srrandom_step(rpm, sd);
+      az[k] = TWOPI*maths_rndmf(sd -> permrandstr);
+      rnd[k] = maths_rndmf(sd -> permrandstr);
+      if ((rpm -> zsam[disk].tab))
+	zp[k] = maths_rndmf(sd -> permrandstr);
+      else
+	zp[k] = zprof(rpm -> ltype[disk], sd -> permrandstr, &(sd -> y2));
+
+      /* As pr_sdis_act, which would also overwrite the azimuth with the old velocity */
+      dv[k] = (sdis) ? zprof(1, sd -> srandstr, &(sd -> y2))*sdisv : 0.0;
+    }
+
+    /* The vertical deviates from the table */
+    if ((rpm -> zsam[disk].tab))
+      zsampler_eval(rpm -> zsam+disk, zp, nblock);
+
+    /* The geometry, no calls apart from the maths library */
+    for (k = 0; k < nblock; ++k) {
+      cosaz = cosf(az[k]);
+      sinaz = sinf(az[k]);
+      r = sqrtf(rad2+rad1*rnd[k]);
+      pp4 = cosaz*vrot;
+      if ((vrad))
+	pp4 = pp4+sinaz*vradv;
+      pp21 = (sinaz*r)*cosi-(zp[k]*z0)*sini;
+      pp25 = pp4*sini;
+      px = (cosaz*r)*cosp-pp21*sinp;
+      py = (cosaz*r)*sinp+pp21*cosp;
+
+      /* roundnormal rounds half away from zero like roundf */
+      pos0[k] = xpos-py;
+      pos1[k] = ypos+px;
+      pos2[k] = vsys+signv*(pp25+dv[k]);
+      grid0[k] = (int) roundf(pos0[k]);
+      grid1[k] = (int) roundf(pos1[k]);
+      grid2[k] = (int) roundf(pos2[k]);
+    }
+
+    /* Into the list or onto the cube, as in the gridpoint functions */
+    for (k = 0; k < nblock; ++k) {
+      if (grid0[k] < 0 || grid0[k] >= hdr -> bsize1 || grid1[k] < 0 || grid1[k] >= hdr -> bsize2 || grid2[k] < 0 || grid2[k] >= hdr -> nsubs) {
+	--sd -> n;
+	*npoints -= 1;
+	++sd -> outn;
+	continue;
+      }
+
+      off = grid0[k]+ hdr -> bcsize1*(grid1[k])+hdr -> nprof*(grid2[k]);
+#ifdef PBCORR
+      grid[0] = grid0[k];
+      grid[1] = grid1[k];
+      grid[2] = grid2[k];
+#endif
+
+      if ((stream)) {
+	flux = sd -> sflux[signum];
+	if (sd -> deposit != DEPOSIT_NGP) {
+	  pos[0] = pos0[k];
+	  pos[1] = pos1[k];
+	  pos[2] = pos2[k];
+#ifdef PBCORR
+	  srspread(hdr, sd, rpm -> fill_pbcfac == fill_pbcfac_act ? hdr -> primbeam : NULL, pos, flux, sd -> deposit);
+#else
+	  srspread(hdr, sd, NULL, pos, flux, sd -> deposit);
+#endif
+	}
+	else {
+#ifdef PBCORR
+	  if (rpm -> fill_pbcfac == fill_pbcfac_act)
+	    flux = flux*hdr -> primbeam[grid[0]+ hdr -> bsize1*(grid[1])];
+#endif
+	  srstream(sd, off, flux);
+	}
+	if ((mixed)) {
+	  if (signum)
+	    ++sd -> npos;
+	  else
+	    ++sd -> nneg;
+	}
+      }
+      else {
+	if (!(mixed)) {
+	  sd -> pl[*j] = off;
+	  if ((sd -> plcloud))
+	    sd -> plcloud[*j] = sd -> cloud-nblock+k;
+	}
+	else if (signum) {
+	  sd -> pl[sd -> npos] = off;
+	  ++sd -> npos;
+	}
+	else {
+	  ++sd -> nneg;
+	  sd -> pl[sd -> pllength-sd -> nneg] = off;
+	}
+#ifdef PBCORR
+	rpm -> fill_pbcfac(hdr, rpm -> sd, disk, srnr, j, grid);
+#endif
+      }
+      ++(*j);
+    }
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Generates the conventional clouds of a large subring in chunks */
+static int srconst_split(hdrinf *hdr, ringparms *rpm, int srnr, int disk, long *j, long *npoints, int signum)
+{
+#ifdef OPENMPTIR
+  long c, nchunks, j0, cloud0, dst, outn, *kept, *outc;
+  srd *sd;
+
+  sd = rpm -> sd[disk]+srnr;
+
+  if (omp_get_num_threads() < 2 || *npoints-*j <= SRCONST_CHUNK)
+    return 0;
+  if ((!(rpm -> rng) && !(rpm -> sampler)) || (rpm -> stream) || sd -> gridpoint != gridpoint_norm || sd -> nsubcl != 1)
+    return 0;
+
+  nchunks = (*npoints-*j+SRCONST_CHUNK-1)/SRCONST_CHUNK;
+  if (!(kept = (long *) malloc(2*nchunks*sizeof(long))))
+    return 0;
+  outc = kept+nchunks;
+
+  j0 = *j;
+  cloud0 = sd -> cloud;
+
+  for (c = 0; c < nchunks; ++c) {
+#pragma omp task firstprivate(c) shared(kept, outc, sd, j0, cloud0, npoints, hdr, rpm, srnr, disk, signum)
+    {
+      srd sdc;
+      maths_rstrf permrandstr, srandstr;
+      long jc, npc;
+
+      /* The chunk has its own generators, positioned at its first cloud by srrandom_step */
+      sdc = *sd;
+      permrandstr = *(sd -> permrandstr);
+      sdc.permrandstr = &permrandstr;
+      if ((sd -> srandstr)) {
+	srandstr = *(sd -> srandstr);
+	sdc.srandstr = &srandstr;
+      }
+      sdc.cloud = cloud0+c*SRCONST_CHUNK;
+      sdc.outn = 0;
+
+      jc = j0+c*SRCONST_CHUNK;
+      npc = jc+SRCONST_CHUNK < *npoints ? jc+SRCONST_CHUNK : *npoints;
+      srconst_block(hdr, rpm, &sdc, srnr, disk, &jc, &npc, signum);
+
+      kept[c] = jc-(j0+c*SRCONST_CHUNK);
+      outc[c] = sdc.outn;
+    }
+  }
+#pragma omp taskwait
+
+  /* Join the sections of the chunks, the first one is in place */
+  dst = j0+kept[0];
+  outn = outc[0];
+  for (c = 1; c < nchunks; ++c) {
+    memmove(sd -> pl+dst, sd -> pl+j0+c*SRCONST_CHUNK, kept[c]*sizeof(unsigned int));
+    if ((sd -> plcloud))
+      memmove(sd -> plcloud+dst, sd -> plcloud+j0+c*SRCONST_CHUNK, kept[c]*sizeof(unsigned int));
+#ifdef PBCORR
+    if ((sd -> pbfac))
+      memmove(sd -> pbfac+dst, sd -> pbfac+j0+c*SRCONST_CHUNK, kept[c]*sizeof(float));
+#endif
+    dst += kept[c];
+    outn += outc[c];
+  }
+
+  /* The same bookkeeping as srconst_block */
+  sd -> cloud = cloud0+*npoints-j0;
+  sd -> n -= outn;
+  sd -> outn += outn;
+  *npoints -= outn;
+  *j = dst;
+
+  free(kept);
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Orders the (disk, subring) pairs by their estimated cost */
+static int srschedule(ringparms *rpm)
+{
+  int i, k, disk, n, gap, order;
+  long cost;
+  srd *sd;
+
+  n = rpm -> ndisks*rpm -> nr;
+
+  if (!(rpm -> srorder) && !(rpm -> srorder = (int *) malloc(n*sizeof(int))))
+    return 0;
+  if (!(rpm -> srcost) && !(rpm -> srcost = (long *) malloc(n*sizeof(long))))
+    return 0;
+
+  for (disk = 0; disk < rpm -> ndisks; ++disk) {
+    for (i = 0; i < rpm -> nr; ++i) {
+      sd = rpm -> sd[disk]+i;
+      if ((sd -> pl) && !(sd -> resize))
+	cost = 0;
+      else
+	cost = labs(sd -> nharmnorm)+sd -> ngaussian[0]+sd -> ngaussian[1]+sd -> ngaussian[2]+sd -> ngaussian[3];
+      rpm -> srorder[disk*rpm -> nr+i] = disk*rpm -> nr+i;
+      rpm -> srcost[disk*rpm -> nr+i] = cost;
+    }
+  }
+
+  /* Shell sort by decreasing cost, ties keep the disk and subring order */
+  for (gap = n/2; gap > 0; gap /= 2) {
+    for (i = gap; i < n; ++i) {
+      order = rpm -> srorder[i];
+      cost = rpm -> srcost[order];
+      for (k = i; k >= gap && (rpm -> srcost[rpm -> srorder[k-gap]] < cost || (rpm -> srcost[rpm -> srorder[k-gap]] == cost && rpm -> srorder[k-gap] > order)); k -= gap)
+	rpm -> srorder[k] = rpm -> srorder[k-gap];
+      rpm -> srorder[k] = order;
+    }
+  }
+
+  return 1;
+}
+
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Generation of a pointsource list */
@@ -13884,10 +16716,22 @@ static long srconstcool(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int di
 /*     remember((void **) &rpm -> sd[disk][srnr].pl); */
   /*   return rpm -> sd[disk][srnr].outpoints = rpm -> sd[disk][srnr].outn/rpm -> sd[disk][srnr].nsubcl; */
   /* } */
+
+  /* The offsets refer to the cool cube, the lists are not binned and not resized */
+  rpm -> sd[disk][srnr].plbase = hdr -> coolcube -> points;
+  if ((rpm -> sd[disk][srnr].plslab)) {
+    free(rpm -> sd[disk][srnr].plslab);
+    rpm -> sd[disk][srnr].plslab = NULL;
+  }
+  if ((rpm -> sd[disk][srnr].plcloud)) {
+    free(rpm -> sd[disk][srnr].plcloud);
+    rpm -> sd[disk][srnr].plcloud = NULL;
+  }
+  rpm -> sd[disk][srnr].resize = 0;
   
   /* Now we try to allocate */
   if ((rpm -> sd[disk][srnr].n)){
-    if (!(rpm -> sd[disk][srnr].pl = (float **) malloc(rpm -> sd[disk][srnr].n*sizeof(float *)))) {
+    if (!(rpm -> sd[disk][srnr].pl = (unsigned int *) malloc(rpm -> sd[disk][srnr].n*sizeof(unsigned int)))) {
       /* Catastrophy, simply stop */
       sprintf(mes, "Too many pointsources, increase PFLUX");
       error_tir(&err, mes);
@@ -13899,7 +16743,7 @@ static long srconstcool(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int di
 
   /* If there's no pointsource we allocate nevertheless for the smallest thing possible */
   else {
-    if (!(rpm -> sd[disk][srnr].pl = (float **) malloc(sizeof(float *)))) {
+    if (!(rpm -> sd[disk][srnr].pl = (unsigned int *) malloc(sizeof(unsigned int)))) {
 
       /* Catastrophy, simply stop */
       sprintf(mes, "Too many pointsources, increase PFLUX");
@@ -13916,8 +16760,7 @@ static long srconstcool(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int di
   }
 
   /* Initialise random generators */
-  rpm -> sd[disk][srnr].iseed2[1] = srnr+disk;
-  maths_rndmf_init(rpm -> sd[disk][srnr].iseed2, rpm -> sd[disk][srnr].permrandstr);
+  srrandom_init(rpm, srnr, disk);
   
   /* reset the  zprof */ 
   zprof(6, rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2));
@@ -13942,6 +16785,8 @@ static long srconstcool(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int di
 
   while (j < npoints) {
 
+    srrandom_next(rpm, srnr, disk);
+
     /* Calculate azimuth sine and cosine, conventional */
     (*(rpm -> inf_smiv[disk] -> getaz))((void *) rpm, &az, &sinaz, &cosaz, &signum, srnr, disk);
 
@@ -13992,6 +16837,8 @@ static long srconstcool(hdrinf *hdr, ringparms *rpm, int srnr, long mode, int di
 
       while (j < npoints) {
 	
+	srrandom_next(rpm, srnr, disk);
+
 	/* Calculate azimuth sine and cosine, Gaussian */
 	gau_getaz(rpm, (PRPARAMS+disk*NDPARAMS+PGA1P)+3*i, rpm -> sd[disk][srnr].grandstr[i], i, &az, &sinaz, &cosaz, srnr, disk);
 
@@ -14051,7 +16898,7 @@ static void srshape(ringparms *rpm, float *pp, float sinaz, float cosaz, int srn
   /* Calculate the coordinates of the point source before rotation */
     pp[0] = cosaz*r;
     pp[1] = sinaz*r;
-    pp[2] = zprof(rpm -> ltype[disk],  rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
+    pp[2] = zsampler_draw(rpm -> zsam+disk, rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
 
     pp[4] = cosaz*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVROT)*rpm -> nr+srnr];
 
@@ -14154,6 +17001,104 @@ return;
 /* ------------------------------------------------------------ */
 
 
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* The generic srshape pipeline */
+static void srshape_gen(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+{
+  srshape((ringparms *) rpm, pp, sinaz, cosaz, srnr, disk);
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* srshape without harmonics, warps, and shifts */
+static void srshape_flat(ringparms *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk, int vrad, int zterms)
+{
+  float r;
+  float pp2[6];
+  
+  /* Same as in srshape */
+  r = sqrtf((rpm -> modpar[PRADI*rpm -> nr+srnr]-0.5*rpm -> radsep)*(rpm -> modpar[PRADI*rpm -> nr+srnr]-0.5*rpm -> radsep)+2*rpm -> radsep*rpm -> modpar[PRADI*rpm -> nr+srnr]*maths_rndmf(rpm -> sd[disk][srnr].permrandstr));
+  
+  pp[0] = cosaz*r;
+  pp[1] = sinaz*r;
+  pp[2] = zsampler_draw(rpm -> zsam+disk, rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
+  
+  pp[4] = cosaz*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVROT)*rpm -> nr+srnr];
+  
+  if ((zterms))
+    (*(rpm -> inf_dvrov[disk] -> pr)) ((void *) rpm, pp, srnr, sinaz, cosaz, disk);
+  
+  /* This is pr_vrad_act */
+  if ((vrad))
+    pp[4] = pp[4]+sinaz*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVRAD)*rpm -> nr+srnr];
+  
+  if ((zterms))
+    (*(rpm -> inf_dvrav[disk] -> pr)) ((void *) rpm, pp, srnr, sinaz, cosaz, disk);
+  
+  pp[5] = 0.0;
+  
+  if ((zterms)) {
+    (*(rpm -> inf_vverv[disk] -> pr)) ((void *) rpm, pp, srnr, disk);
+    (*(rpm -> inf_dvvev[disk] -> pr)) ((void *) rpm, pp, srnr, disk);
+  }
+  
+  /* Rotate about the x-axis by i */
+  pp2[0] = pp[0];
+  pp2[1] = pp[1]*rpm -> sd[disk][srnr].cosi-pp[2]*rpm -> sd[disk][srnr].sini;
+  pp2[5] = pp[4]*rpm -> sd[disk][srnr].sini;
+  
+  if ((zterms))
+    (*(rpm -> inf_vverv[disk] -> pr_rota)) ((void *) rpm, pp+5, pp2+5, srnr, disk);
+  
+  /* Rotate about the z-axis by pa */
+  pp[0] = pp2[0]*rpm -> sd[disk][srnr].cosp-pp2[1]*rpm -> sd[disk][srnr].sinp;
+  pp[1] = pp2[0]*rpm -> sd[disk][srnr].sinp+pp2[1]*rpm -> sd[disk][srnr].cosp;
+  pp[5] = pp2[5];
+  
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* The specialised srshape pipelines */
+static void srshape_flat_00(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+{
+  srshape_flat((ringparms *) rpm, pp, sinaz, cosaz, srnr, disk, 0, 0);
+  return;
+}
+
+static void srshape_flat_10(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+{
+  srshape_flat((ringparms *) rpm, pp, sinaz, cosaz, srnr, disk, 1, 0);
+  return;
+}
+
+static void srshape_flat_01(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+{
+  srshape_flat((ringparms *) rpm, pp, sinaz, cosaz, srnr, disk, 0, 1);
+  return;
+}
+
+static void srshape_flat_11(void *rpm, float *pp, float sinaz, float cosaz, int srnr, int disk)
+{
+  srshape_flat((ringparms *) rpm, pp, sinaz, cosaz, srnr, disk, 1, 1);
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Generation of a pointsource list */
@@ -14169,7 +17114,7 @@ static void srshapecool(ringparms *rpm, float *pp, float sinaz, float cosaz, int
   /* Calculate the coordinates of the point source before rotation */
     pp[0] = cosaz*r;
     pp[1] = sinaz*r;
-    pp[2] = zprof(rpm -> ltype[disk],  rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
+    pp[2] = zsampler_draw(rpm -> zsam+disk, rpm -> sd[disk][srnr].permrandstr, &(rpm -> sd[disk][srnr].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+srnr];
 
     /* pp[4] = cosaz*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PVROT)*rpm -> nr+srnr]; */
 
@@ -14369,8 +17314,6 @@ static int changedependent(ringparms *rpm, double *par, decomp_inlist *index, in
 {
   int i,j,k,counts;
   int nactive; /* number of active points (not indexed) */
-  gsl_interp *gsl_interpv = NULL; /* interpolation function */
-  gsl_interp_accel *gsl_interp_accelv = NULL; /* interpolation function accelerator */
   double dummy;
 
   /* fprintf(stderr,"got here\n"); */
@@ -14452,43 +17395,17 @@ static int changedependent(ringparms *rpm, double *par, decomp_inlist *index, in
 	    }
 	  }
 	  
-	  /* Interpolate: use the appropriate mode, same as defined in rpm -> smothcar (user input indy) unless number of available points is 2, which entails linear */
-	  
-	  /* This we need in any case */
-	  if (!(gsl_interp_accelv = gsl_interp_accel_alloc()))
-	    goto error;
-	  
-	  /* Linear */
-	  if ((k < 3) || rpm -> smothindcar[j-NPARAMS+NDPARAMS] == INTERP_LINEAR  ) {
-	    if (!(gsl_interpv = gsl_interp_alloc (gsl_interp_linear, k)))
-	      goto error;
-	  }
-	  
-	  /* Spline */
-	  else if (k < 5 || rpm -> smothindcar[j-NPARAMS+NDPARAMS] == INTERP_CSPLINE) {
-	    if (!(gsl_interpv = gsl_interp_alloc (gsl_interp_cspline, k)))
-	      goto error;
-	  }
-	  
-	  /* Akima */
-	  else if (rpm -> smothindcar[j-NPARAMS+NDPARAMS] == INTERP_AKIMA) {
-	    if (!(gsl_interpv = gsl_interp_alloc (gsl_interp_akima, k)))
-	      goto error;
-	  }
-	  
-	  /* Something's wrong */
-	  else
+	  /* Interpolate: use the appropriate mode, same as defined in rpm -> smothcar (user input indy) unless number of available points is 2, which entails linear, or 3 to 4, which entails spline for Akima */
+	  if (!maths_interp_init(rpm -> indinterparray[j-NPARAMS+NDPARAMS], rpm -> smothindcar[j-NPARAMS+NDPARAMS], rpm -> radar, rpm -> interar, k))
 	    goto error;
 	  
-	  gsl_interp_init (gsl_interpv, rpm -> radar, rpm -> interar, k);
-	  
 	  /* Now interpolate where required */
 	  
 	  for (i = 0; i < rpm -> nur; ++i) {
 	    /* fprintf(stderr,"got here number: %i %i\n", i, rpm -> actarray[i]); */
 	    if (!(rpm -> actarray[i])) {
 	      dummy = par[rpm -> actindar[i]];
-	      par[rpm -> actindar[i]] = gsl_interp_eval(gsl_interpv, rpm -> radar, rpm -> interar, par[PRADI*rpm -> nur+i], gsl_interp_accelv);
+	      par[rpm -> actindar[i]] = maths_interp_eval(rpm -> indinterparray[j-NPARAMS+NDPARAMS], rpm -> radar, rpm -> interar, par[PRADI*rpm -> nur+i]);
 	      /* If there was a change, we note it down */
 	      if (par[rpm -> actindar[i]] != dummy) {
 		/* fprintf(stderr,"Found this to have changed: %i\n", i); */
@@ -14497,9 +17414,6 @@ static int changedependent(ringparms *rpm, double *par, decomp_inlist *index, in
 	    }
 	  }
 	}
-	
-	gsl_interp_free(gsl_interpv);
-	gsl_interp_accel_free(gsl_interp_accelv);
       }
       if (counts == index -> nuel)
 	break;
@@ -14529,25 +17443,49 @@ static int changedependent(ringparms *rpm, double *par, decomp_inlist *index, in
   return index -> nuel;
   
  error:
-  if (gsl_interpv)
-    gsl_interp_free(gsl_interpv);
-  if (gsl_interp_accelv)
-    gsl_interp_accel_free(gsl_interp_accelv);
   return -1;
 }
 /* ------------------------------------------------------------ */
 
 
 
-/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Core to construct a pointsource cube from a parameter list */
+static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, decomp_inlist *index, long *fluxpoints, int *allnpoints)
+{
+  interpover(rpm, rpm -> radsep, fitmode, varele, index);
+
+  return galmod_grid(hdr, rpm, fluxpoints, allnpoints, GRID_ALL);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Put the pointsources of all subrings onto the cube */
+static int galmod_grid(hdrinf *hdr, ringparms *rpm, long *fluxpoints, int *allnpoints, int mode)
+{ int i, slab;
+  int disk, allnpoint = 0, scheduled;
+  long l;
+#ifdef OPENMPTIR
+  int threads;
+#endif
+
+  /* The full model must not be added to a background */
+  if (mode == GRID_ALL && engalmod_hasbackground()) {
+    engalmod_background(0);
+    rpm -> bgready = 0;
+  }
 
-/* Core to construct a pointsource cube from a parameter list */
-static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, decomp_inlist *index, long *fluxpoints, int *allnpoints)
-{ int i;
-  int disk, allnpoint = 0;
-  
-  interpover(rpm, rpm -> radsep, fitmode, varele, index);
-  
+  /* Incremental: the new pointsources go into deltac */
+  if (mode == GRID_DELTA) {
+    rpm -> deltabase = hdr -> modelc -> points;
+    hdr -> modelc -> points = rpm -> deltac;
+  }
+  else {
 
   /* Initialise the model array */
   /*   for (i = 0; i < hdr -> bcsize1*hdr -> bsize2*hdr -> nsubs; ++i) */
@@ -14557,24 +17495,69 @@ static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, deco
 #endif
   for (i = 0; i < hdr -> nprof*hdr -> nsubs; ++i)
 	hdr -> modelc -> points[i] = 0;
+
+    rpm -> deltaready = 0;
+  }
+
+#ifdef OPENMPTIR
+  /* Streaming, one thread per set of bins */
+  threads = (rpm -> streambins) ? rpm -> nstreambins : 1;
+#endif
   
   /* Initialise the chisquare */
   /*    hdr -> chi2 = 0; */
   
   rpm -> outpoints = 0;
 
+  /* The subrings of all disks at once, the largest first */
+  scheduled = !(rpm -> stream) && (rpm -> schedule) && srschedule(rpm);
+  if ((scheduled)) {
+#ifdef OPENMPTIR
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (l = 0; l < rpm -> ndisks*rpm -> nr; ++l)
+      srconst(hdr, rpm, rpm -> srorder[l]%rpm -> nr, SRCONST_SPLIT, rpm -> srorder[l]/rpm -> nr);
+  }
+
   for (disk = 0; disk < rpm -> ndisks; ++disk) {
     
     allnpoints[disk] = 0; 
     fluxpoints[disk] = 0; 
-    
-    /* Do all the loops */
+
+    /* Scheduled subrings have been made above */
+    if (!(scheduled)) {
+
+      /* Streaming, the clouds go onto the cube while they are made */
+      if ((rpm -> stream)) {
+	for (i = 0; i < rpm -> nr; ++i) {
+	  if (rpm -> sd[disk][i].gridpoint == gridpoint_norm)
+	    rpm -> sd[disk][i].gridpoint = gridpoint_normstream;
+	  else
+	    rpm -> sd[disk][i].gridpoint = gridpoint_mixedstream;
+	}
+#ifdef OPENMPTIR
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+#endif
+	for (i = 0; i < rpm -> nr; ++i)
+	  srconst(hdr, rpm, i, SRCONST_ALL, disk);
+	for (i = 0; i < rpm -> nr; ++i) {
+	  if (rpm -> sd[disk][i].gridpoint == gridpoint_normstream)
+	    rpm -> sd[disk][i].gridpoint = gridpoint_norm;
+	  else
+	    rpm -> sd[disk][i].gridpoint = gridpoint_mixed;
+	}
+      }
+      else {
+
+	/* Do all the loops */
 #ifdef OPENMPTIR
 #pragma omp parallel for schedule(dynamic)
 #endif
-    for (i = 0; i < rpm -> nr; ++i) {
-      /*       rpm -> outpoints +=  */
-      srconst(hdr, rpm, i, 0, disk);
+	for (i = 0; i < rpm -> nr; ++i) {
+	  /*       rpm -> outpoints +=  */
+	  srconst(hdr, rpm, i, SRCONST_ALL, disk);
+	}
+      }
     }
 
     /* non-parallel bookkeeping */
@@ -14582,11 +17565,16 @@ static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, deco
 
       /* now create the clouds and grid them, seems to go well, although there is an additional component there */
       /*       allnpoints[disk] +=  */
+      if (mode == GRID_ALL || (mode == GRID_DELTA && (rpm -> sd[disk][i].fresh)) || (mode == GRID_FORE && (rpm -> sd[disk][i].bgactive)) || (mode == GRID_BACK && !(rpm -> sd[disk][i].bgactive))) {
+
+	/* Binned lists are put in parallel below */
+	rpm -> sd[disk][i].deferred = (rpm -> sd[disk][i].plslab != NULL);
 #ifdef PBCORR
-      (*(rpm -> sd[disk][i].srput))(rpm -> corr_pbcfac, rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk);
+      (*(rpm -> sd[disk][i].srput))(rpm -> corr_pbcfac, rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk, !(rpm -> sd[disk][i].deferred) && !(rpm -> stream));
 #else
-      (*(rpm -> sd[disk][i].srput))(rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk);
+      (*(rpm -> sd[disk][i].srput))(rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk, !(rpm -> sd[disk][i].deferred) && !(rpm -> stream));
 #endif
+      }
 
       /* this should be correct */
       rpm -> outpoints += rpm -> sd[disk][i].outpoints;
@@ -14598,6 +17586,34 @@ static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, deco
     }
   }
 
+  /* Parallel deposition, every thread owns a velocity slab of the cube */
+  if (rpm -> nslabs > 1) {
+#ifdef OPENMPTIR
+#pragma omp parallel for private(disk, i) schedule(dynamic)
+#endif
+    for (slab = 0; slab < rpm -> nslabs; ++slab) {
+      for (disk = 0; disk < rpm -> ndisks; ++disk) {
+	for (i = 0; i < rpm -> nr; ++i) {
+	  if ((rpm -> sd[disk][i].deferred))
+	    srdeposit(rpm, i, disk, slab);
+	}
+      }
+    }
+    for (disk = 0; disk < rpm -> ndisks; ++disk) {
+      for (i = 0; i < rpm -> nr; ++i)
+	rpm -> sd[disk][i].deferred = 0;
+    }
+  }
+
+  if (mode == GRID_DELTA) {
+    for (disk = 0; disk < rpm -> ndisks; ++disk) {
+      for (i = 0; i < rpm -> nr; ++i) {
+	if ((rpm -> sd[disk][i].fresh))
+	  srdelta(rpm, i, disk, 0);
+      }
+    }
+    hdr -> modelc -> points = rpm -> deltabase;
+  }
 
   /* We return the number of clouds */
   for (disk = 0; disk < rpm -> ndisks; ++disk)
@@ -14610,6 +17626,80 @@ static int galmod(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele, deco
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Model and chisquare, incremental if possible */
+static double galmod_chisquare(hdrinf *hdr, ringparms *rpm, varlel *varele, decomp_inlist *index, long *fluxpoints, int *allnpoints)
+{
+  int i, disk, nback, delta;
+  double chisquare;
+  float sigma_v;
+
+  sigma_v = rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur];
+
+  /* The old pointsources of the changed subrings go into deltac with a negative sign, the new ones with a positive sign */
+  delta = (rpm -> deltac) && (rpm -> deltaready);
+  if ((delta)) {
+    rpm -> ndelta = 0;
+    rpm -> deltafail = 0;
+    rpm -> deltaactive = 1;
+  }
+  interpover(rpm, rpm -> radsep, 1, varele, index);
+  rpm -> deltaactive = 0;
+
+  for (disk = 0; disk < rpm -> ndisks; ++disk) {
+    for (i = 0; i < rpm -> nr; ++i)
+      rpm -> sd[disk][i].fresh = !(rpm -> sd[disk][i].pl) || (rpm -> sd[disk][i].resize);
+  }
+
+  if ((delta)) {
+    galmod_grid(hdr, rpm, fluxpoints, allnpoints, GRID_DELTA);
+
+    if (!(rpm -> deltafail) && getchisquare_delta_c(rpm -> deltac, rpm -> deltalist, rpm -> ndelta, sigma_v, &chisquare))
+      return chisquare;
+
+    /* Not all changes are listed */
+    if ((rpm -> deltafail))
+      memset(rpm -> deltac, 0, hdr -> nprof*hdr -> nsubs*sizeof(float));
+  }
+
+  /* The subrings changed by this VARY group stay in the foreground, all others are frozen */
+  if ((rpm -> bgcache) && (!(rpm -> bgready) || rpm -> bgvarele != varele || !engalmod_hasbackground())) {
+    nback = 0;
+    for (disk = 0; disk < rpm -> ndisks; ++disk) {
+      for (i = 0; i < rpm -> nr; ++i) {
+	rpm -> sd[disk][i].bgactive = rpm -> sd[disk][i].fresh;
+	nback += !(rpm -> sd[disk][i].fresh);
+      }
+    }
+    rpm -> bgready = 0;
+    if ((nback)) {
+      galmod_grid(hdr, rpm, fluxpoints, allnpoints, GRID_BACK);
+      if (engalmod_background(1)) {
+	rpm -> bgready = 1;
+	rpm -> bgvarele = varele;
+      }
+    }
+  }
+
+  /* Full evaluation, the pointsource lists are complete */
+  if ((rpm -> bgcache) && (rpm -> bgready))
+    galmod_grid(hdr, rpm, fluxpoints, allnpoints, GRID_FORE);
+  else
+    galmod_grid(hdr, rpm, fluxpoints, allnpoints, GRID_ALL);
+  chisquare = getchisquare_c(sigma_v);
+
+  /* The pointsource lists now point into the model, srdelta needs that before the next grid */
+  rpm -> deltabase = hdr -> modelc -> points;
+  rpm -> deltaready = (rpm -> deltac != NULL);
+
+  return chisquare;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Core to construct a pointsource cube from a parameter list */
@@ -14678,9 +17768,9 @@ static int galmodcool(hdrinf *hdr, ringparms *rpm, int fitmode, varlel *varele,
       /* now create the clouds and grid them, seems to go well, although there is an additional component there */
       /*       allnpoints[disk] +=  */
 #ifdef PBCORR
-      (*(rpm -> sd[disk][i].srput))(rpm -> corr_pbcfac, rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk);
+      (*(rpm -> sd[disk][i].srput))(rpm -> corr_pbcfac, rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk, 1);
 #else
-      (*(rpm -> sd[disk][i].srput))(rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk);
+      (*(rpm -> sd[disk][i].srput))(rpm -> sd, rpm -> modpar, rpm -> nr, rpm -> cflux, rpm -> radsep, i, fluxpoints, disk, 1);
 #endif
 
       /* this should be correct */
@@ -15108,7 +18198,7 @@ static float zprof(int option, maths_rstrf *permrandstr, float *y2)
   /* Note: y1 is basically uninitialised for case 1 UNLESS it is initialised by calling zprof(6,randstr) before. This is (hopefully done throughout the program) */
 
   float  x1, x2, w;
-  static float y1 = 0.0;
+  float y1 = 0.0;
 
 /*   static float y2; */
 
@@ -15179,6 +18269,155 @@ static float zprof(int option, maths_rstrf *permrandstr, float *y2)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* (Re-)initialises a vertical profile sampler */
+static int zsampler_init(zsampler *zs, int ltype, int table)
+{
+  int i;
+
+  zs -> ltype = ltype;
+
+  if (!(table)) {
+    if ((zs -> tab))
+      free(zs -> tab);
+    zs -> tab = NULL;
+    return 1;
+  }
+
+  if (!(zs -> tab) && !(zs -> tab = (float *) malloc(ZSAMPLER_NTAB*sizeof(float))))
+    return 0;
+
+  for (i = 0; i < ZSAMPLER_NTAB; ++i)
+    zs -> tab[i] = zsampler_invcdf(ltype, (float) (ZSAMPLER_QMAX*i/(ZSAMPLER_NTAB-1)));
+
+  return 1;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Delivers a random variable according to the vertical profile */
+static float zsampler_draw(zsampler *zs, maths_rstrf *permrandstr, float *y2)
+{
+  float z;
+
+  if (!(zs -> tab))
+    return zprof(zs -> ltype, permrandstr, y2);
+
+  z = maths_rndmf(permrandstr);
+  zsampler_eval(zs, &z, 1);
+
+  return z;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Transforms uniform random numbers into vertical deviates */
+static void zsampler_eval(zsampler *zs, float *u, long n)
+{
+  long i;
+  int k;
+  float x, q, t, g;
+  const float scale = (ZSAMPLER_NTAB-1)/ZSAMPLER_QMAX;
+
+  for (i = 0; i < n; ++i) {
+
+    /* As in zprof, the sign comes from the same random number */
+    x = 2.0f*u[i]-1.0f;
+    q = fabsf(x);
+
+    if (q < ZSAMPLER_QMAX) {
+      t = q*scale;
+      k = (int) t;
+      if (k > ZSAMPLER_NTAB-2)
+	k = ZSAMPLER_NTAB-2;
+      g = zs -> tab[k]+(t-k)*(zs -> tab[k+1]-zs -> tab[k]);
+    }
+    else
+      g = zsampler_invcdf(zs -> ltype, q);
+
+    u[i] = x < 0.0f ? -g : g;
+  }
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Inverse of the cumulative distribution of |z| */
+static float zsampler_invcdf(int ltype, float q)
+{
+  float w, p;
+
+  /* u = 0 gives q = 1, which zprof would reject */
+  if (q > 0.99999994f)
+    q = 0.99999994f;
+
+  switch (ltype) {
+
+    /* Gaussian, sqrt(2)*erfinv(q), after Giles (2010) */
+  case 1:
+    w = -logf((1.0f-q)*(1.0f+q));
+    if (w < 5.0f) {
+      w = w-2.5f;
+      p = 2.81022636e-08f;
+      p = 3.43273939e-07f+p*w;
+      p = -3.5233877e-06f+p*w;
+      p = -4.39150654e-06f+p*w;
+      p = 0.00021858087f+p*w;
+      p = -0.00125372503f+p*w;
+      p = -0.00417768164f+p*w;
+      p = 0.246640727f+p*w;
+      p = 1.50140941f+p*w;
+    }
+    else {
+      w = sqrtf(w)-3.0f;
+      p = -0.000200214257f;
+      p = 0.000100950558f+p*w;
+      p = 0.00134934322f+p*w;
+      p = -0.00367342844f+p*w;
+      p = 0.00573950773f+p*w;
+      p = -0.0076224613f+p*w;
+      p = 0.00943887047f+p*w;
+      p = 1.00167406f+p*w;
+      p = 2.83297682f+p*w;
+    }
+    return 1.41421356f*p*q;
+
+    /* Sech2 */
+  case 2:
+    return atanhf(q);
+
+    /* Exponential */
+  case 3:
+    return -logf(1.0f-q);
+
+    /* Lorentzian */
+  case 4:
+    return tanf(PIHALF*q);
+
+    /* Box */
+  default:
+    return q;
+  }
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Initializes the standard header context table */
@@ -15535,7 +18774,8 @@ static int putgenresults(startinf *startinfv, loginf *log, hdrinf *hdr, ringparm
   /* Do make the model */
   galmod(hdr, rpm, GENFIT, fit -> varylist, fit -> index, fit -> fluxpoints, fit -> npoints);
 
-  /* Get the chisquare */  
+  /* Get the chisquare, with the exact weight map */  
+  engalmod_refreshnoise();
 
   /* use here the usual replacement of PCONDISP */
   doublev = chimult*(reg_do(fit -> reg_contv, (fit -> mon_alloops == fit -> loops)?fit -> loops - 1:fit -> mon_alloops, getchisquare_c(rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur]))+((double) rpm -> outpoints)*rpm -> penalty);
@@ -15731,10 +18971,17 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
   /* When starting make one run of interpover */
   interpover(rpm, rpm -> radsep, 1, NULL, fit -> index);
 
+  /* Start at the coarse level of the first loop */
+  setmultires(rpm, fit, multireslevel(fit, (bigloops) ? (bigloops-1) : 0));
+
 /* Get the old chisqare or initialise */
   if ((fit -> loopnr)) {
     hdr -> oldchi2 = log -> outarray[(NPARAMS+(rpm -> ndisks-1)*NDPARAMS)*rpm -> nur+NSPARAMS+CHISQ_TABNR-1];
     satisfied = log -> outarray[(NPARAMS+(rpm -> ndisks-1)*NDPARAMS)*rpm -> nur+NSPARAMS+ACCEPT_TABNR-1];
+
+    /* The table contains the chisquare at full resolution */
+    if ((fit -> multireslevel))
+      hdr -> oldchi2 = multires_chisquare(hdr, rpm, fit, bigloops-1);
   }  
   else {
 
@@ -15753,11 +19000,8 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
        varele2 = varele2 -> next;
      }
 
-    /* Do it */
-    galmod(hdr, rpm, 1, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
-
-    /* Get the chisquare */
-    hdr -> chi2 = getchisquare_c(rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur]);
+    /* Do it and get the chisquare */
+    hdr -> chi2 = galmod_chisquare(hdr, rpm, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
  
     /* Regularise */
     hdr -> chi2 = reg_do(fit -> reg_contv, fit -> loopnr, hdr -> chi2);
@@ -15785,10 +19029,24 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
 
   /* This will run until the bigloops is reached */
   while (bigloops <= fit -> loops) {
+
+    /* Finer resolution by loop number, the reference chisquare changes */
+    if (fit -> multireslevel > multireslevel(fit, bigloops-1)) {
+      setmultires(rpm, fit, multireslevel(fit, bigloops-1));
+      hdr -> oldchi2 = multires_chisquare(hdr, rpm, fit, bigloops-1);
+    }
+
+    /* A new loop */
+    if (fit -> noiseupd == NOISEUPD_LOOP)
+      engalmod_refreshnoise();
     
     /* We go through the varylist */
     while(varele) {
        
+      /* A new iteration */
+      if (fit -> noiseupd == NOISEUPD_ITER)
+	engalmod_refreshnoise();
+
       /* Record where we started */
       for (i = 0; i < varele -> nelem; ++i)
 	prevresult[i] = rpm -> oldpar[varele -> elements[i]];
@@ -15858,13 +19116,11 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
      /* Do it */
      for (i = 0; i < rpm -> ndisks; ++i)
        rpm -> fluxpoints[i] = 0;
-     galmod(hdr, rpm, 1, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
+	/* Get the chisquare */
+     hdr -> chi2 = galmod_chisquare(hdr, rpm, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
 
 	++globiter;
  
-	/* Get the chisquare */
-	hdr -> chi2 = getchisquare_c(rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur]);
- 
 	/* Regularise */
 	hdr -> chi2 = reg_do(fit -> reg_contv, bigloops-1, hdr -> chi2);
 	fit -> mon_alloops = bigloops-1;
@@ -16005,12 +19261,9 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
 
      /* We don't have to check whether we broke out of range */
      
-     /* Do it */
-     galmod(hdr, rpm, 1, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
+     /* Do it and get the chisquare */
+     hdr -> chi2 = galmod_chisquare(hdr, rpm, varele, fit -> index, rpm -> fluxpoints, fit -> npoints);
      ++globiter;
-     
-     /* Get the chisquare */
-	  hdr -> chi2 = getchisquare_c(rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur]);
    
 	  /* Regularise */
 	  hdr -> chi2 = reg_do(fit -> reg_contv, bigloops-1, hdr -> chi2);
@@ -16225,7 +19478,14 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
     
     /* If we are still satisfied, we break, because we have results, which is documented also in outarray[(NPARAMS+(rpm -> ndisks-1)*NDPARAMS)*rpm -> nur+NSPARAMS-1+ACCEPT_TABNR] */
     if ((satisfied)) {
-      break;
+
+      /* Converged at a coarse level, go on at the next finer one */
+      if ((fit -> multireslevel)) {
+	setmultires(rpm, fit, fit -> multireslevel-1);
+	hdr -> oldchi2 = multires_chisquare(hdr, rpm, fit, bigloops-1);
+      }
+      else
+	break;
     }
 
     /* We start at the start of the varylist again */
@@ -16235,10 +19495,12 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
     satisfied = 1;
   }
 
+  setmultires(rpm, fit, 0);
   free(prevresult);
   return 1;
 
  error:
+  setmultires(rpm, fit, 0);
   return 0;
 }
 
@@ -16246,6 +19508,86 @@ static int golden_section(startinf *startinfv, loginf *log, hdrinf *hdr, ringpar
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Resolution level by loop number */
+static int multireslevel(fitparms *fit, long loop)
+{
+  long ncoarse;
+
+  ncoarse = fit -> loops/2;
+
+  if (fit -> multires < 2 || loop >= ncoarse)
+    return 0;
+
+  return fit -> multires-1-(int) ((loop*(fit -> multires-1))/ncoarse);
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Change the resolution level of the chisquare evaluation */
+static void setmultires(ringparms *rpm, fitparms *fit, int level)
+{
+  int disk, factor;
+
+  if (level == fit -> multireslevel)
+    return;
+
+  if (!(factor = engalmod_level(level)))
+    return;
+
+  for (disk = 0; disk < rpm -> ndisks; ++disk)
+    rpm -> cflux[disk] = fit -> multires_cflux[disk]*factor;
+  rpm -> penalty = fit -> multires_penalty*factor;
+  fit -> multireslevel = level;
+
+  /* The number of pointsources changes in every subring */
+  interpover(rpm, rpm -> radsep, 1, NULL, fit -> index);
+
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Chisquare of the current parameters at the current level */
+static double multires_chisquare(hdrinf *hdr, ringparms *rpm, fitparms *fit, long loop)
+{
+  int i;
+  double chimult = 1.0;
+  varlel *varele;
+
+  /* Same penalising strategy as in the search */
+  varele = fit -> varylist;
+  while(varele) {
+    for (i = 0; i < varele -> nelem; ++i) {
+      if (maths_checkinbetw(varele -> parmax, varele -> parmin, rpm -> par[varele -> elements[i]])) {
+	chimult = chimult*OUTRANGEFAC;
+	break;
+      }
+    }
+    varele = varele -> next;
+  }
+
+  galmod(hdr, rpm, 1, NULL, fit -> index, rpm -> fluxpoints, fit -> npoints);
+  hdr -> chi2 = getchisquare_c(rpm -> par[((NPARAMS + (rpm -> ndisks - 1)*NDPARAMS))*rpm -> nur]);
+  hdr -> chi2 = reg_do(fit -> reg_contv, loop, hdr -> chi2);
+  hdr -> chi2 = chimult*(hdr -> chi2+((double) rpm -> outpoints)*rpm -> penalty);
+
+  return hdr -> chi2;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* Calculates and puts the results of the fitting procedure */
@@ -17532,7 +20874,7 @@ static int makecoolpoints(Cube *cube, hdrinf *hdr, ringparms *rpm, fitparms *fit
 	  /* Calculate the coordinates of the point source before rotation */
 	  pp[0] = cosaz*r;
 	  pp[1] = sinaz*r;
-	  pp[2] = zprof(rpm -> ltype[disk],  rpm -> sd[disk][i].permrandstr, &(rpm -> sd[disk][i].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+i];
+	  pp[2] = zsampler_draw(rpm -> zsam+disk, rpm -> sd[disk][i].permrandstr, &(rpm -> sd[disk][i].y2))*rpm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*rpm -> nr+i];
 	  
 	  (*(rpm -> inf_wm1v[disk] -> prs))((void *) rpm, pp+2, i, sinaz, cosaz, disk);
 	  (*(rpm -> inf_wm2v[disk] -> prs))((void *) rpm, pp+2, i, sinaz, cosaz, disk);
@@ -18039,6 +21381,7 @@ static int tirout(startinf *startinfv, loginf *log, ringparms *rpm, fitparms *fi
       tirout_a(startinfv -> arel, stream, "ACTION=");
       tirout_a(startinfv -> arel, stream, "PROMPT=");
       tirout_a(startinfv -> arel, stream, "NCORES=");
+      tirout_a(startinfv -> arel, stream, "NUMA=");
       fprintf(stream, "\n");
       tirout_a(startinfv -> arel, stream, "INSET=");
       /* tirout_a(startinfv -> arel, stream, "BOX="); */
@@ -18139,15 +21482,12 @@ static int tirout(startinf *startinfv, loginf *log, ringparms *rpm, fitparms *fi
 	  ftstab_putcoltitl(key, j+1);
 	  fprintf(stream, "%8s= ", key);
 	  	  
+	  /* Once for all radii */
+	  /* maths_interp_init(rpm -> interparray[j-NSSDPARAMS], rpm -> smothcar[j-NSSDPARAMS], rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, rpm -> nur); */
+	  maths_interp_init(rpm -> interparray[j-NSSDPARAMS], rpm -> smothcar[j-NSSDPARAMS], reparray+PRADI*rpm -> nur, reparray + rpm -> nur*j, rpm -> nur);
+
 	    for (m = 0; m < nrings; ++m) {
 	      
-	      /* Not sure if this is required, but do it anyway */
-	      gsl_interp_accel_reset(rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
-	      
-	      /* Very sure that this is a requirement; a test has shown */
-	      /* gsl_interp_init(rpm -> gsl_interparray[j-NSSDPARAMS],rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, rpm -> nur); */
-	      gsl_interp_init(rpm -> gsl_interparray[j-NSSDPARAMS],reparray+PRADI*rpm -> nur, reparray + rpm -> nur*j, rpm -> nur);
-	      
 	      /* Search the first radius that is greater than the current, don't care about efficiency */
 	      /* for (k = 1; k < rpm -> nur; ++k) { */
 	      /* 	if (radii[m] < reparray[PRADI*rpm -> nur+k]) */
@@ -18159,7 +21499,7 @@ static int tirout(startinf *startinfv, loginf *log, ringparms *rpm, fitparms *fi
 	      if ( radii[m] < reparray[PRADI*rpm -> nur+rpm -> nur-1]) {
 		/* dpdr = (reparray[j*rpm -> nur+k]-reparray[j*rpm -> nur+k-1])/(reparray[PRADI*rpm -> nur+k]-reparray[PRADI*rpm -> nur+k-1]); */
 		/* dpdr = reparray[j*rpm -> nur+k-1]+dpdr*(radii[m]-reparray[PRADI*rpm -> nur+k-1]); */
-		dpdr = gsl_interp_eval(rpm -> gsl_interparray[j-NSSDPARAMS], rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, radii[m], rpm -> gsl_interp_accelarray[j-NSSDPARAMS]);
+		dpdr = maths_interp_eval(rpm -> interparray[j-NSSDPARAMS], rpm -> par+PRADI*rpm -> nur, rpm -> par + rpm -> nur*j, radii[m]);
 	      }
 	      else {
 		dpdr = reparray[(j+1)*rpm -> nur-1];
@@ -18203,10 +21543,24 @@ static int tirout(startinf *startinfv, loginf *log, ringparms *rpm, fitparms *fi
       tirout_a(startinfv -> arel, stream, "RADSEP=");
       /*       tirout_a(startinfv -> arel, stream, "MEMMODE="); */
       tirout_a(startinfv -> arel, stream, "INIMODE=");
+      tirout_a(startinfv -> arel, stream, "WISDOMFILE=");
+      tirout_a(startinfv -> arel, stream, "AUTOCROP=");
       tirout_a(startinfv -> arel, stream, "ISEED=");
+      tirout_a(startinfv -> arel, stream, "CLOUDBLOCK=");
+      tirout_a(startinfv -> arel, stream, "RNG=");
+      tirout_a(startinfv -> arel, stream, "ZSAMPLER=");
+      tirout_a(startinfv -> arel, stream, "SAMPLER=");
+      tirout_a(startinfv -> arel, stream, "PREFIX=");
+      tirout_a(startinfv -> arel, stream, "SCHEDULE=");
       fprintf(stream, "\n");
       tirout_a(startinfv -> arel, stream, "FITMODE=");
       tirout_a(startinfv -> arel, stream, "LOOPS=");
+      tirout_a(startinfv -> arel, stream, "NOISEUPD=");
+      tirout_a(startinfv -> arel, stream, "MULTIRES=");
+      tirout_a(startinfv -> arel, stream, "DEPOSIT=");
+      tirout_a(startinfv -> arel, stream, "STREAM=");
+      tirout_a(startinfv -> arel, stream, "DELTAMOD=");
+      tirout_a(startinfv -> arel, stream, "BGCACHE=");
       tirout_a(startinfv -> arel, stream, "MAXITER=");
       tirout_a(startinfv -> arel, stream, "CALLITE=");
       tirout_a(startinfv -> arel, stream, "SIZE=");
@@ -18224,6 +21578,7 @@ static int tirout(startinf *startinfv, loginf *log, ringparms *rpm, fitparms *fi
       if (fit -> psfi != PSW_PSFI_DEF) tirout_a(startinfv -> arel, stream, "PSFI=");
       if (fit -> psid != PSW_PSID_DEF) tirout_a(startinfv -> arel, stream, "PSID=");
       if (fit -> psdd != PSW_PSDD_DEF) tirout_a(startinfv -> arel, stream, "PSDD=");
+      if (fit -> psba != PSW_PSBA_DEF) tirout_a(startinfv -> arel, stream, "PSBA=");
 	
       fprintf(stream, "\n");
       /*       tirout_a(startinfv -> arel, stream, "ANSTART="); */
@@ -23031,7 +26386,7 @@ static void smi_getaz_harm(void *rpm, float *az, float *sinaz, float *cosaz, int
       /* This is to keep the pointsource lists similar */
       maths_rndmf(prm -> sd[disk][srnr].permrandstr);
 /*       zprof(prm -> ltype[0],  prm -> sd[disk][srnr].permrandstr)*prm -> modpar[(PRPARAMS+disk*NDPARAMS+PZ0)*prm -> nr+srnr]; */
-      zprof(prm -> ltype[disk],  prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
+      zsampler_draw(prm -> zsam+disk, prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
       (*(prm -> inf_sdisv[disk] -> pr_empty))(rpm, srnr, disk);
     }
   }
@@ -23373,6 +26728,9 @@ static inf_azi *create_inf_azi(void)
   if (!(create_inf_azi = (inf_azi *) malloc(sizeof(inf_azi))))
     return create_inf_azi;
 
+  create_inf_azi -> kernel = &srshape_gen;
+  create_inf_azi -> block = 0;
+
   return create_inf_azi;
 }
 
@@ -23451,6 +26809,73 @@ static int chkb_azi(ringparms *rpm, fitparms *fit)
 
 
 
+/* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+/* Selects the srshape pipeline for each disk */
+static void chkb_srshape(ringparms *rpm)
+{
+  int disk, flat, vrad, zterms;
+  
+  for (disk = 0; disk < rpm -> ndisks; ++disk) {
+    
+    if (!(rpm -> inf_aziv[disk]))
+      continue;
+    
+    /* Harmonics, warps, and shifts go through the generic pipeline */
+    flat = 
+      rpm -> inf_ro1v[disk] -> prs == &pr_roi_pas && rpm -> inf_ro1v[disk] -> prc == &pr_roi_pas &&
+      rpm -> inf_ro2v[disk] -> prs == &pr_roi_pas && rpm -> inf_ro2v[disk] -> prc == &pr_roi_pas &&
+      rpm -> inf_ro3v[disk] -> prs == &pr_roi_pas && rpm -> inf_ro3v[disk] -> prc == &pr_roi_pas &&
+      rpm -> inf_ro4v[disk] -> prs == &pr_roi_pas && rpm -> inf_ro4v[disk] -> prc == &pr_roi_pas &&
+      rpm -> inf_ra1v[disk] -> prs == &pr_rai_pas && rpm -> inf_ra1v[disk] -> prc == &pr_rai_pas &&
+      rpm -> inf_ra2v[disk] -> prs == &pr_rai_pas && rpm -> inf_ra2v[disk] -> prc == &pr_rai_pas &&
+      rpm -> inf_ra3v[disk] -> prs == &pr_rai_pas && rpm -> inf_ra3v[disk] -> prc == &pr_rai_pas &&
+      rpm -> inf_ra4v[disk] -> prs == &pr_rai_pas && rpm -> inf_ra4v[disk] -> prc == &pr_rai_pas &&
+      rpm -> inf_vm1v[disk] -> prs == &pr_vmi_pas && rpm -> inf_vm1v[disk] -> prc == &pr_vmi_pas &&
+      rpm -> inf_vm2v[disk] -> prs == &pr_vmi_pas && rpm -> inf_vm2v[disk] -> prc == &pr_vmi_pas &&
+      rpm -> inf_vm3v[disk] -> prs == &pr_vmi_pas && rpm -> inf_vm3v[disk] -> prc == &pr_vmi_pas &&
+      rpm -> inf_vm4v[disk] -> prs == &pr_vmi_pas && rpm -> inf_vm4v[disk] -> prc == &pr_vmi_pas &&
+      rpm -> inf_vm0v[disk] -> pr == &pr_vmi_pas &&
+      rpm -> inf_wm1v[disk] -> prs == &pr_wmi_pas && rpm -> inf_wm1v[disk] -> prc == &pr_wmi_pas &&
+      rpm -> inf_wm2v[disk] -> prs == &pr_wmi_pas && rpm -> inf_wm2v[disk] -> prc == &pr_wmi_pas &&
+      rpm -> inf_wm3v[disk] -> prs == &pr_wmi_pas && rpm -> inf_wm3v[disk] -> prc == &pr_wmi_pas &&
+      rpm -> inf_wm4v[disk] -> prs == &pr_wmi_pas && rpm -> inf_wm4v[disk] -> prc == &pr_wmi_pas &&
+      rpm -> inf_wm0v[disk] -> pr == &pr_wmi_pas &&
+      rpm -> inf_lc0v[disk] -> pr == &pr_lc0_pas &&
+      rpm -> inf_ls0v[disk] -> pr == &pr_ls0_pas;
+    
+    rpm -> inf_aziv[disk] -> block = 0;
+
+    if (!(flat)) {
+      rpm -> inf_aziv[disk] -> kernel = &srshape_gen;
+      continue;
+    }
+    
+    /* Only pr_vrad_act is inlined, the terms depending on the height come as a block */
+    vrad = rpm -> inf_vradv[disk] -> pr != &pr_vrad_pas;
+    zterms = 
+      rpm -> inf_dvrov[disk] -> pr != &pr_dvro_pas ||
+      rpm -> inf_dvrav[disk] -> pr != &pr_dvra_pas ||
+      rpm -> inf_vverv[disk] -> pr != &pr_vver_pas ||
+      rpm -> inf_vverv[disk] -> pr_rota != &pr_vver_rota_pas ||
+      rpm -> inf_dvvev[disk] -> pr != &pr_dvve_pas;
+    
+    if ((vrad))
+      rpm -> inf_aziv[disk] -> kernel = (zterms) ? &srshape_flat_11 : &srshape_flat_10;
+    else
+      rpm -> inf_aziv[disk] -> kernel = (zterms) ? &srshape_flat_01 : &srshape_flat_00;
+
+    /* The cases srconst_block can do */
+    rpm -> inf_aziv[disk] -> block = !(zterms) && rpm -> inf_aziv[disk] -> srshape == &srshape_azi_pas && rpm -> inf_smiv[disk] -> getaz == &smi_getaz_cons && rpm -> inf_sdisv[disk] -> repeater == &sdis_repeater_pas;
+  }
+  
+  return;
+}
+
+/* ------------------------------------------------------------ */
+
+
+
 /* ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 /* calculates Gaussian surface brightness dispersion in rad and adds it to the subring */
@@ -23569,14 +26994,14 @@ static int srshape_azi_act(void *rpm, float *pp, float sinaz, float cosaz, int s
 
   if ((outofrange)) {
     maths_rndmf(prm -> sd[disk][srnr].permrandstr);
-    zprof(prm -> ltype[disk],  prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
+    zsampler_draw(prm -> zsam+disk, prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
 
     /* This shift by 5000000 pixels should do, one could do more elegant, but I'm tired */
      pp[1] = 5000000.;
      return 1;
   }
   else {
-    srshape(prm, pp, sinaz, cosaz, srnr, disk);
+    (*(prm -> inf_aziv[disk] -> kernel))(rpm, pp, sinaz, cosaz, srnr, disk);
   }
   
   return 0;
@@ -23594,7 +27019,7 @@ static int srshape_azi_pas(void *rpm, float *pp, float sinaz, float cosaz, int s
 
   prm = (ringparms *) rpm;
 
-  srshape(prm, pp, sinaz, cosaz, srnr, disk);
+  (*(prm -> inf_aziv[disk] -> kernel))(rpm, pp, sinaz, cosaz, srnr, disk);
 
   return 0;
 }
@@ -23614,7 +27039,7 @@ static int srshape_azi_actcool(void *rpm, float *pp, float sinaz, float cosaz, i
 
   if ((outofrange)) {
     maths_rndmf(prm -> sd[disk][srnr].permrandstr);
-    zprof(prm -> ltype[disk],  prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
+    zsampler_draw(prm -> zsam+disk, prm -> sd[disk][srnr].permrandstr, &(prm -> sd[disk][srnr].y2));
 
     /* This shift by 5000000 pixels should do, one could do more elegant, but I'm tired */
      pp[1] = 5000000.;
@@ -23766,13 +27191,23 @@ static void corrp_azi_pas(void *rpm, int srnr, int *outofrange, int signum)
 static void rndmf_init_sdis_act(void *rpm, int srnr, int disk)
 {
   ringparms *prm;
+  unsigned int key[2];
 
   prm = (ringparms *) rpm;
   prm -> sd[disk][srnr].siseed[0] = prm -> iseed2+1+disk;
   prm -> sd[disk][srnr].siseed[1] = srnr;
 
-  /* Reset things */
-  maths_rndmf_init(prm -> sd[disk][srnr].siseed, prm -> sd[disk][srnr].srandstr);
+  /* Reset things, the counter-based streams are keyed apart from the ones of srrandom_init */
+  if ((prm -> rng) || (prm -> sampler)) {
+    key[0] = (unsigned int) prm -> iseed2;
+    key[1] = (unsigned int) ((prm -> ndisks+disk)*prm -> nr+srnr);
+    if ((prm -> sampler))
+      maths_rndmf_initq(key, prm -> sd[disk][srnr].srandstr);
+    else
+      maths_rndmf_initc(key, prm -> sd[disk][srnr].srandstr);
+  }
+  else
+    maths_rndmf_init(prm -> sd[disk][srnr].siseed, prm -> sd[disk][srnr].srandstr);
   zprof(6, prm -> sd[disk][srnr].srandstr, &(prm -> sd[disk][srnr].y2));
 
   return;
@@ -28159,7 +31594,7 @@ static void fill_pbcfac_pas(hdrinf *hdr, struct srd **sd, int disk, int srnr, lo
 /* Function to fold in the primary beam factor list when constructing the cube */
 static void corr_pbcfac_act(struct srd **sd, int disk, int srnr, long pnr)
 {
-  *(sd[disk][srnr].pl[pnr]) += sd[disk][srnr].pf*sd[disk][srnr].pbfac[pnr];
+  sd[disk][srnr].plbase[sd[disk][srnr].pl[pnr]] += sd[disk][srnr].pf*sd[disk][srnr].pbfac[pnr];
 
   return;
 }
@@ -28174,7 +31609,7 @@ static void corr_pbcfac_act(struct srd **sd, int disk, int srnr, long pnr)
 static void corr_pbcfac_pas(struct srd **sd, int disk, int srnr, long pnr)
 {
 
-  *(sd[disk][srnr].pl[pnr]) += sd[disk][srnr].pf;
+  sd[disk][srnr].plbase[sd[disk][srnr].pl[pnr]] += sd[disk][srnr].pf;
 
   return;
 }